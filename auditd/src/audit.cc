@@ -25,7 +25,6 @@
 #include <iomanip>
 #include <iostream>
 #include <map>
-#include <queue>
 #include <sstream>
 #include <string>
 
@@ -36,6 +35,10 @@
 #include "auditd_audit_events.h"
 #include "eventdescriptor.h"
 
+// How long a reconfigure request waits for room in a full event queue
+// before it fails
+static const std::chrono::seconds max_reconfigure_wait(5);
+
 std::string Audit::hostname;
 void (*Audit::notify_io_complete)(gsl::not_null<const void*> cookie,
                                   ENGINE_ERROR_CODE status);
@@ -425,36 +428,106 @@ bool Audit::add_to_filleventqueue(const uint32_t event_id,
     //       in the correct fields.. if not we should add an
     //       event to the audit trail saying it is one in an illegal
     //       format (or missing fields)
-    bool res;
-    Event* new_event = new Event(event_id, payload, length);
-    cb_mutex_enter(&producer_consumer_lock);
-    if (filleventqueue->size() < max_audit_queue) {
-        filleventqueue->push(new_event);
-        cb_cond_broadcast(&events_arrived);
-        res = true;
-    } else {
+    std::unique_ptr<Event> new_event(new Event(event_id, payload, length));
+    if (!eventqueue.push(new_event)) {
         LOG_WARNING("Audit: Dropping audit event {}: {}",
                     new_event->id,
                     new_event->payload);
         dropped_events++;
-        delete new_event;
-        res = false;
+        return false;
     }
-    cb_mutex_exit(&producer_consumer_lock);
-    return res;
+
+    notify_consumer();
+    return true;
 }
 
 
 bool Audit::add_reconfigure_event(const char* configfile, const void *cookie) {
-    ConfigureEvent* new_event = new ConfigureEvent(configfile, cookie);
+    std::unique_ptr<Event> new_event(new ConfigureEvent(configfile, cookie));
+    if (eventqueue.push(new_event)) {
+        notify_consumer();
+        return true;
+    }
+
+    // Rather than dropping the request straight away when the queue is
+    // full, wait for the consumer thread to make room for it (it signals
+    // space_available). Fail the request if it doesn't in time (or if there
+    // is no consumer to wait for).
+    const auto deadline = std::chrono::steady_clock::now() +
+                          max_reconfigure_wait;
+    bool queued;
     cb_mutex_enter(&producer_consumer_lock);
-    filleventqueue->push(new_event);
-    cb_cond_broadcast(&events_arrived);
+    producers_waiting++;
+    // Pairs with the fence in notify_producers(); either we see the room
+    // the consumer made, or it sees that we are waiting and wakes us up.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (!(queued = eventqueue.push(new_event))) {
+        const auto now = std::chrono::steady_clock::now();
+        if (!consumer_thread_running || terminate_audit_daemon ||
+            now >= deadline) {
+            break;
+        }
+        // Make sure that the consumer is draining the queue
+        cb_cond_broadcast(&events_arrived);
+        const auto remaining =
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                        deadline - now);
+        cb_cond_timedwait(&space_available,
+                          &producer_consumer_lock,
+                          std::max(uint32_t(remaining.count()), uint32_t(1)));
+    }
+    producers_waiting--;
     cb_mutex_exit(&producer_consumer_lock);
+
+    if (!queued) {
+        LOG_WARNING("Audit: Failed to queue the reconfigure event as "
+                    "the event queue is full");
+        return false;
+    }
+    notify_consumer();
     return true;
 }
 
 
+void Audit::notify_consumer(void) {
+    // Pairs with the fence in wait_for_events(); either the consumer sees
+    // the event we just added, or we see that it is (about to start)
+    // waiting and wake it up.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumer_waiting.load()) {
+        cb_mutex_enter(&producer_consumer_lock);
+        cb_cond_broadcast(&events_arrived);
+        cb_mutex_exit(&producer_consumer_lock);
+    }
+}
+
+
+void Audit::notify_producers(void) {
+    // Pairs with the fence in add_reconfigure_event(); either the producer
+    // sees the room we just made, or we see that it is waiting and wake it
+    // up.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (producers_waiting.load() > 0) {
+        cb_mutex_enter(&producer_consumer_lock);
+        cb_cond_broadcast(&space_available);
+        cb_mutex_exit(&producer_consumer_lock);
+    }
+}
+
+
+bool Audit::wait_for_events(uint32_t timeout_ms) {
+    cb_mutex_enter(&producer_consumer_lock);
+    consumer_waiting.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (eventqueue.empty() && !terminate_audit_daemon) {
+        cb_cond_timedwait(&events_arrived, &producer_consumer_lock, timeout_ms);
+    }
+    consumer_waiting.store(false);
+    cb_mutex_exit(&producer_consumer_lock);
+    return !eventqueue.empty();
+}
+
+
 void Audit::clear_events_map(void) {
     typedef std::map<uint32_t, EventDescriptor*>::iterator it_type;
     for(it_type iterator = events.begin(); iterator != events.end(); iterator++) {
@@ -465,15 +538,8 @@ void Audit::clear_events_map(void) {
 
 
 void Audit::clear_events_queues(void) {
-    while(!processeventqueue->empty()) {
-        Event *event = processeventqueue->front();
-        processeventqueue->pop();
-        delete event;
-    }
-    while(!filleventqueue->empty()) {
-        Event *event = filleventqueue->front();
-        filleventqueue->pop();
-        delete event;
+    while (eventqueue.pop()) {
+        // Drop the event
     }
 }
 
@@ -489,6 +555,7 @@ bool Audit::terminate_consumer_thread(void)
      */
     cb_mutex_enter(&producer_consumer_lock);
     cb_cond_broadcast(&events_arrived);
+    cb_cond_broadcast(&space_available);
     cb_mutex_exit(&producer_consumer_lock);
     if (consumer_thread_running.load()) {
         if (cb_join_thread(consumer_tid) == 0) {
@@ -20,7 +20,6 @@
 #include <inttypes.h>
 #include <map>
 #include <memory>
-#include <queue>
 #include <atomic>
 
 #include <cJSON.h>
@@ -29,6 +28,7 @@
 #include "auditd.h"
 #include "auditfile.h"
 #include "eventdescriptor.h"
+#include "eventqueue.h"
 #include "memcached/audit_interface.h"
 #include "memcached/types.h"
 
@@ -39,19 +39,26 @@ public:
     AuditConfig config;
     std::map<uint32_t,EventDescriptor*> events;
 
-    // We maintain two Event queues. At any one time one will be used to accept
-    // new events, and the other will be processed. The two queues are swapped
-    // periodically.
-    std::unique_ptr<std::queue<Event*>> processeventqueue;
-    std::unique_ptr<std::queue<Event*>> filleventqueue;
+    // The queue of events waiting to be processed by the audit daemon
+    // thread. Producers add events without taking any locks.
+    EventQueue eventqueue;
 
-    bool terminate_audit_daemon;
+    std::atomic_bool terminate_audit_daemon;
     std::string configfile;
     cb_thread_t consumer_tid;
     std::atomic_bool consumer_thread_running;
-    cb_cond_t processeventqueue_empty;
     cb_cond_t events_arrived;
+    // Only used to put the consumer thread to sleep (and wake it up again)
+    // when there are no events to process.
     cb_mutex_t producer_consumer_lock;
+    // Set by the consumer thread while it is (about to start) waiting for
+    // events_arrived, so that producers only need to signal it then.
+    std::atomic_bool consumer_waiting;
+    // Signalled by the consumer thread when it has made room in the queue
+    // and reconfigure requests are waiting for it (see producers_waiting).
+    cb_cond_t space_available;
+    // The number of reconfigure requests waiting for space_available
+    std::atomic<int> producers_waiting;
     static std::string hostname;
     static void (*notify_io_complete)(gsl::not_null<const void*> cookie,
                                       ENGINE_ERROR_CODE status);
@@ -59,21 +66,21 @@ public:
     std::atomic<uint32_t> dropped_events;
 
     Audit()
-        : processeventqueue(new std::queue<Event*>()),
-          filleventqueue(new std::queue<Event*>()),
+        : eventqueue(max_audit_queue),
           terminate_audit_daemon(false),
-          dropped_events(0),
-          max_audit_queue(50000) {
+          consumer_waiting(false),
+          producers_waiting(0),
+          dropped_events(0) {
         consumer_thread_running.store(false);
-        cb_cond_initialize(&processeventqueue_empty);
         cb_cond_initialize(&events_arrived);
+        cb_cond_initialize(&space_available);
         cb_mutex_initialize(&producer_consumer_lock);
     }
 
     ~Audit(void) {
         clean_up();
-        cb_cond_destroy(&processeventqueue_empty);
         cb_cond_destroy(&events_arrived);
+        cb_cond_destroy(&space_available);
         cb_mutex_destroy(&producer_consumer_lock);
     }
 
@@ -93,6 +100,27 @@ public:
     bool add_reconfigure_event(const char *configfile, const void *cookie);
     bool create_audit_event(uint32_t event_id, cJSON *payload);
     bool terminate_consumer_thread(void);
+
+    /**
+     * Wake up the consumer thread if it is waiting for events to arrive
+     */
+    void notify_consumer(void);
+
+    /**
+     * Wake up the reconfigure requests waiting for room in the event queue
+     * (called by the consumer thread once it has taken events off it)
+     */
+    void notify_producers(void);
+
+    /**
+     * Put the calling (consumer) thread to sleep until events arrive, the
+     * daemon is terminated or the timeout expires.
+     *
+     * @param timeout_ms the maximum number of milliseconds to wait
+     * @return true if there are events to process
+     */
+    bool wait_for_events(uint32_t timeout_ms);
+
     void clear_events_map(void);
     void clear_events_queues(void);
     bool clean_up(void);
@@ -118,7 +146,10 @@ protected:
     } event_state_listener;
 
 private:
-    size_t max_audit_queue;
+    // The number of events we may have queued before we start dropping them
+    static const size_t max_audit_queue = 50000;
+    static_assert(max_audit_queue <= EventQueue::MaxCapacity,
+                  "max_audit_queue is above the EventQueue capacity limit");
 };
 
 #endif
@@ -31,6 +31,10 @@
 #include "auditd_audit_events.h"
 #include "event.h"
 
+// The maximum number of events to write to the audit file before it is
+// flushed
+static const size_t max_events_per_flush = 1024;
+
 /**
  * The entry point for the thread used to drain the generated audit events
  *
@@ -44,36 +48,36 @@ static void consume_events(void* arg) {
     }
     Audit& audit = *reinterpret_cast<Audit*>(arg);
 
-    cb_mutex_enter(&audit.producer_consumer_lock);
     while (!audit.terminate_audit_daemon) {
-        if (audit.filleventqueue->empty()) {
-            cb_cond_timedwait(&audit.events_arrived,
-                              &audit.producer_consumer_lock,
-                              audit.auditfile.get_seconds_to_rotation() * 1000);
-            if (audit.filleventqueue->empty()) {
-                // We timed out, so just rotate the files
-                audit.auditfile.maybe_rotate_files();
-            }
+        if (audit.eventqueue.empty() &&
+            !audit.wait_for_events(
+                    audit.auditfile.get_seconds_to_rotation() * 1000)) {
+            // We timed out, so just rotate the files
+            audit.auditfile.maybe_rotate_files();
+            continue;
         }
-        /* now have producer_consumer lock!
-         * event(s) have arrived or shutdown requested
-         */
-        swap(audit.processeventqueue, audit.filleventqueue);
-        cb_mutex_exit(&audit.producer_consumer_lock);
-        // Now outside of the producer_consumer_lock
-
-        while (!audit.processeventqueue->empty()) {
-            Event* event = audit.processeventqueue->front();
+
+        // Process a batch of events before flushing the file so that
+        // the events are written out in large chunks (and we don't starve
+        // the flush if the producers keep up with us).
+        size_t count = 0;
+        std::unique_ptr<Event> event;
+        while (count < max_events_per_flush &&
+               (event = audit.eventqueue.pop())) {
             if (!event->process(audit)) {
                 audit.dropped_events++;
             }
-            audit.processeventqueue->pop();
-            delete event;
+            ++count;
+        }
+        audit.notify_producers();
+        // Unbuffered audit files are fsync'ed once per batch, so that the
+        // cost of the fsync is shared by all of the events in the batch
+        if (audit.auditfile.is_buffered()) {
+            audit.auditfile.flush();
+        } else {
+            audit.auditfile.sync();
         }
-        audit.auditfile.flush();
-        cb_mutex_enter(&audit.producer_consumer_lock);
     }
-    cb_mutex_exit(&audit.producer_consumer_lock);
 
     // close the auditfile
     audit.auditfile.close();
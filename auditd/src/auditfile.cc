@@ -24,6 +24,11 @@
 #include <memcached/isotime.h>
 #include <JSON_checker.h>
 #include <fstream>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include "auditd.h"
 #include "audit.h"
 #include "auditfile.h"
@@ -102,6 +107,10 @@ bool AuditFile::open(void) {
         log_error(AuditErrorCode::FILE_OPEN_ERROR, open_file_name.c_str());
         return false;
     }
+    // The consumer thread writes events in batches and flushes the file
+    // after each batch; use a large buffer so that a batch results in a
+    // few large writes rather than one per BUFSIZ bytes.
+    setvbuf(file, nullptr, _IOFBF, 256 * 1024);
     current_size = 0;
     open_time = auditd_time();
     return true;
@@ -311,6 +320,30 @@ bool AuditFile::flush(void) {
     return true;
 }
 
+bool AuditFile::sync(void) {
+    if (!flush()) {
+        return false;
+    }
+    if (is_open()) {
+#ifdef WIN32
+        int ret = _commit(_fileno(file));
+#else
+        int ret;
+        while ((ret = fsync(fileno(file))) == -1 && errno == EINTR) {
+            // Retry
+        }
+#endif
+        if (ret != 0) {
+            log_error(AuditErrorCode::WRITING_TO_DISK_ERROR,
+                      strerror(errno));
+            close_and_rotate_log();
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool AuditFile::is_timestamp_format_correct(std::string& str) {
     const char *data = str.c_str();
     if (str.length() < 19) {
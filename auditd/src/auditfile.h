@@ -123,6 +123,16 @@ public:
      */
     bool flush(void);
 
+    /**
+     * Flush the buffers and fsync the file, so that all of the events
+     * written so far are persisted
+     */
+    bool sync(void);
+
+    bool is_buffered(void) const {
+        return buffered;
+    }
+
     /**
      * get the number of seconds for the next log rotation
      */
@@ -0,0 +1,117 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "eventqueue.h"
+#include "event.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+static size_t roundUpToPowerOfTwo(size_t value) {
+    size_t ret = 1;
+    while (ret < value) {
+        ret <<= 1;
+    }
+    return ret;
+}
+
+const size_t EventQueue::MaxCapacity;
+
+static size_t checkCapacity(size_t capacity) {
+    if (capacity == 0) {
+        throw std::invalid_argument("EventQueue: capacity must be non-zero");
+    }
+    if (capacity > EventQueue::MaxCapacity) {
+        throw std::invalid_argument(
+                "EventQueue: capacity " + std::to_string(capacity) +
+                " is above the maximum of " +
+                std::to_string(EventQueue::MaxCapacity));
+    }
+    return capacity;
+}
+
+EventQueue::EventQueue(size_t capacity)
+    : capacity(checkCapacity(capacity)),
+      mask(roundUpToPowerOfTwo(capacity) - 1),
+      slots(new Slot[mask + 1]),
+      enqueuePos(0),
+      dequeuePos(0) {
+    for (size_t ii = 0; ii <= mask; ++ii) {
+        slots[ii].sequence.store(ii, std::memory_order_relaxed);
+        slots[ii].event = nullptr;
+    }
+}
+
+EventQueue::~EventQueue() {
+    while (pop()) {
+        // Drop the remaining events
+    }
+}
+
+bool EventQueue::push(std::unique_ptr<Event>& event) {
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots[pos & mask];
+        const auto seq = slot->sequence.load(std::memory_order_acquire);
+        const auto diff = intptr_t(seq) - intptr_t(pos);
+        if (diff == 0) {
+            if (pos - dequeuePos.load(std::memory_order_acquire) >=
+                capacity) {
+                // The ring has spare slots, but we already hold as many
+                // events as we were asked to
+                return false;
+            }
+            // The slot is free; try to claim it
+            if (enqueuePos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The consumer hasn't drained this slot yet; we're full
+            return false;
+        } else {
+            // Another producer claimed the slot; try the next one
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->event = event.release();
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+std::unique_ptr<Event> EventQueue::pop() {
+    const auto pos = dequeuePos.load(std::memory_order_relaxed);
+    auto& slot = slots[pos & mask];
+    if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+        return {};
+    }
+
+    std::unique_ptr<Event> ret(slot.event);
+    slot.event = nullptr;
+    // Hand the slot back to the producers for the next lap of the ring
+    slot.sequence.store(pos + mask + 1, std::memory_order_release);
+    dequeuePos.store(pos + 1, std::memory_order_release);
+    return ret;
+}
+
+bool EventQueue::empty() const {
+    const auto pos = dequeuePos.load(std::memory_order_relaxed);
+    const auto& slot = slots[pos & mask];
+    return slot.sequence.load(std::memory_order_acquire) != pos + 1;
+}
@@ -0,0 +1,105 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+class Event;
+
+/**
+ * EventQueue is a bounded, lock-free multi-producer / single-consumer
+ * queue used to hand audit events from the memcached worker threads over
+ * to the audit daemon thread.
+ *
+ * All of the slots are allocated up front, and producers claim a slot by
+ * bumping the enqueue position with a CAS so that submitting an event
+ * never blocks on (or contends for) a mutex. When the queue is full the
+ * event is rejected and it is up to the caller to decide what to do with
+ * it.
+ *
+ * push() may be called from any thread; pop() and empty() must only be
+ * called by the (single) consumer thread.
+ */
+class EventQueue {
+public:
+    /// The largest number of events a queue may be created to hold
+    static const size_t MaxCapacity = 1 << 24;
+
+    /**
+     * @param capacity the number of events the queue can hold (the slots
+     *                 are rounded up to a power of two, but no more than
+     *                 capacity events are queued)
+     * @throws std::invalid_argument if capacity is 0 or above MaxCapacity
+     */
+    explicit EventQueue(size_t capacity);
+
+    ~EventQueue();
+
+    EventQueue(const EventQueue&) = delete;
+    EventQueue& operator=(const EventQueue&) = delete;
+
+    /**
+     * Try to add an event to the queue.
+     *
+     * @param event the event to add. Ownership is transferred to the queue
+     *              if the event was added, otherwise it is left untouched
+     * @return true if the event was added, false if the queue is full
+     */
+    bool push(std::unique_ptr<Event>& event);
+
+    /**
+     * Get the oldest event from the queue (consumer only)
+     *
+     * @return the event or nullptr if the queue is empty
+     */
+    std::unique_ptr<Event> pop();
+
+    /**
+     * Is the queue empty (consumer only)
+     */
+    bool empty() const;
+
+    size_t getCapacity() const {
+        return capacity;
+    }
+
+private:
+    struct Slot {
+        /**
+         * The sequence number is used to tell the producers and the consumer
+         * if the slot is ready for them. For the slot at position pos:
+         *   sequence == pos      : the slot is free and may be filled
+         *   sequence == pos + 1  : the slot contains an event for the consumer
+         */
+        std::atomic<size_t> sequence;
+        Event* event;
+    };
+
+    const size_t capacity;
+    const size_t mask;
+    std::unique_ptr<Slot[]> slots;
+
+    // Position of the next slot to fill (shared by the producers). Kept on
+    // its own cacheline to avoid false sharing with the consumer.
+    alignas(64) std::atomic<size_t> enqueuePos;
+
+    // Position of the next slot to drain (only updated by the consumer,
+    // read by the producers to keep the queue within its capacity)
+    alignas(64) std::atomic<size_t> dequeuePos;
+};
@@ -21,6 +21,8 @@
 #include <map>
 #include <atomic>
 #include <cstring>
+#include <fstream>
+#include <iterator>
 #include <time.h>
 #include <gtest/gtest.h>
 #include <platform/platform.h>
@@ -82,6 +84,33 @@ TEST_F(AuditFileTest, TestFileCreation) {
     EXPECT_EQ(1, files.size());
 }
 
+/**
+ * Test that sync() persists the events written to a buffered file
+ */
+TEST_F(AuditFileTest, TestSync) {
+    AuditFile auditfile;
+    config.set_buffered(true);
+    auditfile.reconfigure(config);
+    EXPECT_TRUE(auditfile.is_buffered());
+
+    // Nothing to sync before the file is opened
+    EXPECT_TRUE(auditfile.sync());
+
+    cJSON_AddStringToObject(event, "log_path", "fooo");
+    auditfile.ensure_open();
+    auditfile.write_event_to_disk(event);
+    EXPECT_TRUE(auditfile.sync());
+
+    auto files = findFilesWithPrefix(testdir + "/testing");
+    ASSERT_EQ(1, files.size());
+    std::ifstream file(files[0]);
+    std::string content((std::istreambuf_iterator<char>(file)),
+                        std::istreambuf_iterator<char>());
+    EXPECT_NE(std::string::npos, content.find("fooo"));
+
+    auditfile.close();
+}
+
 /**
  * Test that we can create a file, and as time flies by we rotate
  * to use the next file
@@ -0,0 +1,142 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "event.h"
+#include "eventqueue.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+static std::unique_ptr<Event> make_event(uint32_t id) {
+    const std::string payload = std::to_string(id);
+    return std::unique_ptr<Event>(
+            new Event(id, payload.data(), payload.size()));
+}
+
+TEST(EventQueueTest, Capacity) {
+    EXPECT_EQ(1, EventQueue(1).getCapacity());
+    EXPECT_EQ(50000, EventQueue(50000).getCapacity());
+    EXPECT_EQ(EventQueue::MaxCapacity,
+              EventQueue(EventQueue::MaxCapacity).getCapacity());
+    EXPECT_THROW(EventQueue(0), std::invalid_argument);
+    EXPECT_THROW(EventQueue(EventQueue::MaxCapacity + 1),
+                 std::invalid_argument);
+}
+
+TEST(EventQueueTest, CapacityIsExact) {
+    // The ring has 4 slots, but only 3 events may be queued
+    EventQueue queue(3);
+    for (uint32_t ii = 0; ii < 3; ++ii) {
+        auto event = make_event(ii);
+        ASSERT_TRUE(queue.push(event));
+    }
+    auto event = make_event(3);
+    EXPECT_FALSE(queue.push(event));
+
+    EXPECT_EQ(0, queue.pop()->id);
+    EXPECT_TRUE(queue.push(event));
+    event = make_event(4);
+    EXPECT_FALSE(queue.push(event));
+}
+
+TEST(EventQueueTest, EmptyQueue) {
+    EventQueue queue(4);
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.pop());
+}
+
+TEST(EventQueueTest, Fifo) {
+    EventQueue queue(4);
+    // Go around the ring a few times
+    for (uint32_t lap = 0; lap < 3; ++lap) {
+        for (uint32_t ii = 0; ii < 4; ++ii) {
+            auto event = make_event(lap * 4 + ii);
+            ASSERT_TRUE(queue.push(event));
+            EXPECT_FALSE(event);
+        }
+        EXPECT_FALSE(queue.empty());
+        for (uint32_t ii = 0; ii < 4; ++ii) {
+            auto event = queue.pop();
+            ASSERT_TRUE(event);
+            EXPECT_EQ(lap * 4 + ii, event->id);
+        }
+        EXPECT_TRUE(queue.empty());
+    }
+}
+
+TEST(EventQueueTest, FullQueueRejectsEvents) {
+    EventQueue queue(2);
+    auto event = make_event(0);
+    ASSERT_TRUE(queue.push(event));
+    event = make_event(1);
+    ASSERT_TRUE(queue.push(event));
+
+    // The event should be left with the caller when the queue is full
+    event = make_event(2);
+    EXPECT_FALSE(queue.push(event));
+    ASSERT_TRUE(event);
+    EXPECT_EQ(2, event->id);
+
+    // Once we've drained an event there should be room again
+    EXPECT_EQ(0, queue.pop()->id);
+    EXPECT_TRUE(queue.push(event));
+    EXPECT_EQ(1, queue.pop()->id);
+    EXPECT_EQ(2, queue.pop()->id);
+}
+
+/**
+ * Run a number of producers against a single consumer and verify that
+ * every event is received exactly once, and in order for each producer.
+ */
+TEST(EventQueueTest, MultipleProducers) {
+    const uint32_t num_producers = 4;
+    const uint32_t events_per_producer = 10000;
+    EventQueue queue(64);
+
+    std::vector<std::thread> producers;
+    for (uint32_t producer = 0; producer < num_producers; ++producer) {
+        producers.emplace_back([&queue, producer]() {
+            for (uint32_t ii = 0; ii < events_per_producer; ++ii) {
+                auto event = make_event(producer * events_per_producer + ii);
+                while (!queue.push(event)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::vector<uint32_t> next(num_producers, 0);
+    uint32_t received = 0;
+    while (received < num_producers * events_per_producer) {
+        auto event = queue.pop();
+        if (!event) {
+            std::this_thread::yield();
+            continue;
+        }
+        const auto producer = event->id / events_per_producer;
+        ASSERT_LT(producer, num_producers);
+        EXPECT_EQ(next[producer], event->id % events_per_producer);
+        ++next[producer];
+        ++received;
+    }
+
+    for (auto& thread : producers) {
+        thread.join();
+    }
+    EXPECT_TRUE(queue.empty());
+}
@@ -28,6 +28,7 @@
 #include "connection.h"
 #include "cookie.h"
 #include "function_chain.h"
+#include "inflated_document_cache.h"
 #include "mcbp_validators.h"
 #include "stats.h"
 #include "timings.h"
@@ -168,6 +169,11 @@ public:
      */
     TopKeys *topkeys;
 
+    /**
+     * Cache of recently inflated Snappy-compressed documents
+     */
+    InflatedDocumentCache inflatedDocumentCache;
+
     /**
      * The validator chains to use for this bucket when receiving MCBP commands.
      */
@@ -116,6 +116,15 @@ static std::string sockaddr_to_string(const struct sockaddr_storage* addr,
     char host[50];
     char port[50];
 
+#ifndef WIN32
+    if (addr->ss_family == AF_UNIX) {
+        // getnameinfo doesn't support unix domain sockets (used for
+        // connections created with socketpair and handed to a worker
+        // thread with dispatch_conn_new)
+        return "[unix]";
+    }
+#endif
+
     int err = getnameinfo(reinterpret_cast<const struct sockaddr*>(addr),
                           addr_len,
                           host, sizeof(host),
@@ -26,6 +26,7 @@
 #include <platform/checked_snprintf.h>
 #include <platform/string.h>
 #include <platform/timeutils.h>
+#include <tracing/slow_op_recorder.h>
 #include <utilities/logtags.h>
 #include <chrono>
 
@@ -477,6 +478,27 @@ void Cookie::maybeLogSlowCommand(
     }
 }
 
+void Cookie::beginSendSpan() {
+    const auto& header = getHeader();
+    sendOpcode = header.getOpcode();
+    sendOpaque = header.getOpaque();
+    sendSpan = tracer.begin(cb::tracing::TraceCode::SEND);
+}
+
+void Cookie::onResponseSent() {
+    if (sendSpan == cb::tracing::Tracer::invalidSpanId()) {
+        return;
+    }
+    tracer.end(sendSpan);
+    sendSpan = cb::tracing::Tracer::invalidSpanId();
+    maybeRecordSlowOp(sendOpcode, sendOpaque);
+}
+
+void Cookie::maybeRecordSlowOp(uint8_t opcode, uint32_t opaque) const {
+    cb::tracing::SlowOpRecorder::getInstance().maybeRecord(
+            tracer, opcode, getConnection().getId(), ntohl(opaque));
+}
+
 void Cookie::initialize(cb::const_byte_buffer header) {
     reset();
     setPacket(Cookie::PacketContent::Header, header);
@@ -78,6 +78,7 @@ public:
         commandContext.reset();
         dynamicBuffer.clear();
         tracer.clear();
+        sendSpan = cb::tracing::Tracer::invalidSpanId();
     }
 
     /**
@@ -444,10 +445,40 @@ public:
         return tracer;
     }
 
+    /**
+     * Called once the command is executed and its response is about to be
+     * sent. Starts the span covering the transmission of the response; the
+     * request is passed to the SlowOpRecorder in onResponseSent().
+     */
+    void beginSendSpan();
+
+    /**
+     * Called when the response has been transmitted. Ends the send span
+     * (if beginSendSpan() was called for the command) and passes the
+     * request to the SlowOpRecorder.
+     */
+    void onResponseSent();
+
+    /**
+     * Pass the span breakdown of the command to the SlowOpRecorder, which
+     * keeps it if the command took longer than its threshold.
+     */
+    void maybeRecordSlowOp(uint8_t opcode, uint32_t opaque) const;
+
 protected:
     bool enableTracing = false;
     cb::tracing::Tracer tracer;
 
+    /**
+     * The span covering the transmission of the response, and the opcode
+     * and opaque of the request it is for (the input packet is consumed
+     * once the command is executed).
+     */
+    cb::tracing::Tracer::SpanId sendSpan =
+            cb::tracing::Tracer::invalidSpanId();
+    uint8_t sendOpcode = 0;
+    uint32_t sendOpaque = 0;
+
     /**
      * The connection object this cookie is bound to
      */
@@ -0,0 +1,164 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include "inflated_document_cache.h"
+
+#include <memcached/types.h>
+
+#include <iterator>
+
+InflatedDocumentCache::InflatedDocumentCache(size_t maxSize)
+    : maxSize(maxSize) {
+}
+
+InflatedDocumentCache::Document InflatedDocumentCache::get(
+        cb::const_char_buffer key,
+        uint64_t cas,
+        cb::const_char_buffer compressed) {
+    const auto shardMaxSize = getShardMaxSize();
+    if (shardMaxSize == 0 || cas == 0 || cas == LOCKED_CAS) {
+        // Caching is disabled, or we don't know which revision of the
+        // document this is (the CAS is hidden for locked documents)
+        return inflate(compressed);
+    }
+
+    const std::string id{key.data(), key.size()};
+    auto& shard = getShard(id);
+    auto doc = shard.lookup(id, cas);
+    if (doc) {
+        return doc;
+    }
+
+    // Inflate outside of the shard lock. Two threads may end up inflating
+    // the same document at the same time, but the last one to insert
+    // simply replaces the entry.
+    doc = inflate(compressed);
+    if (doc) {
+        shard.insert(id, cas, doc, shardMaxSize);
+    }
+    return doc;
+}
+
+void InflatedDocumentCache::setMaxSize(size_t size) {
+    maxSize.store(size);
+    const auto shardMaxSize = getShardMaxSize();
+    for (auto& shard : shards) {
+        shard.trim(shardMaxSize);
+    }
+}
+
+void InflatedDocumentCache::clear() {
+    for (auto& shard : shards) {
+        shard.clear();
+    }
+}
+
+InflatedDocumentCache::Stats InflatedDocumentCache::getStats() const {
+    Stats stats;
+    for (const auto& shard : shards) {
+        shard.addStats(stats);
+    }
+    return stats;
+}
+
+InflatedDocumentCache::Document InflatedDocumentCache::inflate(
+        cb::const_char_buffer compressed) {
+    auto buffer = std::make_shared<cb::compression::Buffer>();
+    if (!cb::compression::inflate(
+                cb::compression::Algorithm::Snappy, compressed, *buffer)) {
+        return {};
+    }
+    return buffer;
+}
+
+InflatedDocumentCache::Shard& InflatedDocumentCache::getShard(
+        const std::string& key) {
+    return shards[std::hash<std::string>()(key) % NUM_SHARDS];
+}
+
+InflatedDocumentCache::Document InflatedDocumentCache::Shard::lookup(
+        const std::string& key, uint64_t cas) {
+    std::lock_guard<std::mutex> guard(mutex);
+    auto iter = index.find(key);
+    if (iter == index.end() || iter->second->cas != cas) {
+        ++misses;
+        return {};
+    }
+
+    // Move the entry to the head of the LRU list
+    lru.splice(lru.begin(), lru, iter->second);
+    ++hits;
+    return iter->second->doc;
+}
+
+void InflatedDocumentCache::Shard::insert(const std::string& key,
+                                          uint64_t cas,
+                                          Document doc,
+                                          size_t maxSize) {
+    const size_t entrySize = key.size() + doc->size() + ENTRY_OVERHEAD;
+    if (entrySize > maxSize / 4) {
+        // Don't let a single large document flush out the rest of the
+        // shard
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(mutex);
+    auto iter = index.find(key);
+    if (iter != index.end()) {
+        // Replace the (most likely older) revision of the document
+        erase(iter->second);
+    }
+
+    lru.push_front(Entry{key, cas, std::move(doc), entrySize});
+    index[key] = lru.begin();
+    size += entrySize;
+    unlocked_trim(maxSize);
+}
+
+void InflatedDocumentCache::Shard::trim(size_t maxSize) {
+    std::lock_guard<std::mutex> guard(mutex);
+    unlocked_trim(maxSize);
+}
+
+void InflatedDocumentCache::Shard::clear() {
+    std::lock_guard<std::mutex> guard(mutex);
+    index.clear();
+    lru.clear();
+    size = 0;
+}
+
+void InflatedDocumentCache::Shard::addStats(Stats& stats) const {
+    std::lock_guard<std::mutex> guard(mutex);
+    stats.hits += hits;
+    stats.misses += misses;
+    stats.evictions += evictions;
+    stats.items += lru.size();
+    stats.size += size;
+}
+
+void InflatedDocumentCache::Shard::erase(EntryList::iterator iter) {
+    size -= iter->size;
+    index.erase(iter->key);
+    lru.erase(iter);
+}
+
+void InflatedDocumentCache::Shard::unlocked_trim(size_t maxSize) {
+    while (size > maxSize && !lru.empty()) {
+        erase(std::prev(lru.end()));
+        ++evictions;
+    }
+}
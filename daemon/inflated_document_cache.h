@@ -0,0 +1,190 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <platform/compress.h>
+#include <platform/sized_buffer.h>
+#include <relaxed_atomic.h>
+
+#include <array>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * The InflatedDocumentCache keeps the inflated (Snappy-decompressed) body
+ * of recently accessed documents so that commands which need to look inside
+ * a compressed document (subdoc, or a GET from a client which hasn't
+ * enabled Snappy) don't have to decompress hot documents over and over
+ * again.
+ *
+ * Entries are identified by the document key and its CAS value. Given
+ * that every modification of a document results in a new CAS, a stale
+ * entry is never returned; it is replaced the next time the key is
+ * requested (or evicted when it becomes the least recently used entry).
+ *
+ * There is one cache per bucket, and it is shared by all of the worker
+ * threads. The keyspace is split into NUM_SHARDS shards, each with its
+ * own mutex, LRU list and 1/NUM_SHARDS of the memory budget.
+ */
+class InflatedDocumentCache {
+public:
+    /**
+     * The inflated documents handed out from the cache are reference
+     * counted so that an entry may be evicted while a command is still
+     * using it.
+     */
+    using Document = std::shared_ptr<const cb::compression::Buffer>;
+
+    /**
+     * Create a new cache
+     *
+     * @param maxSize the maximum number of bytes to keep in the cache
+     *                (0 disables caching)
+     */
+    explicit InflatedDocumentCache(size_t maxSize = 0);
+
+    /**
+     * Get the inflated version of the provided Snappy-compressed document.
+     * If the requested revision of the document is present in the cache
+     * the cached copy is returned, otherwise the document is inflated
+     * and (if it fits) inserted into the cache.
+     *
+     * @param key the key of the document
+     * @param cas the CAS value of the document
+     * @param compressed the Snappy-compressed document
+     * @return the inflated document, or nullptr if the document could not
+     *         be inflated
+     * @throws std::bad_alloc if we fail to allocate memory
+     */
+    Document get(cb::const_char_buffer key,
+                 uint64_t cas,
+                 cb::const_char_buffer compressed);
+
+    /**
+     * Set the maximum number of bytes to keep in the cache. If the new
+     * size is smaller than the current size, entries are evicted
+     * immediately.
+     */
+    void setMaxSize(size_t size);
+
+    size_t getMaxSize() const {
+        return maxSize.load();
+    }
+
+    /**
+     * Remove all entries from the cache
+     */
+    void clear();
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t items = 0;
+        uint64_t size = 0;
+    };
+
+    /**
+     * Get a snapshot of the statistics for the cache (aggregated over all
+     * of the shards).
+     */
+    Stats getStats() const;
+
+private:
+    // Number of shards the keyspace is broken into. Permits some level of
+    // concurrent access (there is one mutex per shard).
+    static const int NUM_SHARDS = 16;
+
+    // Per-entry overhead accounted for in addition to the key and the
+    // inflated value (list and map nodes, shared_ptr control block).
+    static const size_t ENTRY_OVERHEAD = 128;
+
+    static Document inflate(cb::const_char_buffer compressed);
+
+    class Shard {
+    public:
+        /**
+         * Search for the given revision of the key, and if found move it
+         * to the head of the LRU list.
+         */
+        Document lookup(const std::string& key, uint64_t cas);
+
+        /**
+         * Insert (or replace) the entry for the given key and evict the
+         * least recently used entries until the shard fits within
+         * maxSize.
+         */
+        void insert(const std::string& key,
+                    uint64_t cas,
+                    Document doc,
+                    size_t maxSize);
+
+        /**
+         * Evict the least recently used entries until the shard fits
+         * within maxSize.
+         */
+        void trim(size_t maxSize);
+
+        void clear();
+
+        void addStats(Stats& stats) const;
+
+    private:
+        struct Entry {
+            std::string key;
+            uint64_t cas;
+            Document doc;
+            size_t size;
+        };
+
+        using EntryList = std::list<Entry>;
+
+        void erase(EntryList::iterator iter);
+
+        void unlocked_trim(size_t maxSize);
+
+        mutable std::mutex mutex;
+
+        // list of entries, ordered from most-recently used (front) to least
+        // recently used (back).
+        EntryList lru;
+
+        // index from the document key to its entry in the LRU list
+        std::unordered_map<std::string, EntryList::iterator> index;
+
+        // The number of bytes accounted for by the entries in this shard
+        size_t size = 0;
+
+        Couchbase::RelaxedAtomic<uint64_t> hits;
+        Couchbase::RelaxedAtomic<uint64_t> misses;
+        Couchbase::RelaxedAtomic<uint64_t> evictions;
+    };
+
+    Shard& getShard(const std::string& key);
+
+    size_t getShardMaxSize() const {
+        return maxSize.load() / NUM_SHARDS;
+    }
+
+    std::atomic<size_t> maxSize;
+
+    std::array<Shard, NUM_SHARDS> shards;
+};
@@ -24,6 +24,7 @@
 #include "tracing.h"
 
 #include <mcbp/mcbp.h>
+#include <tracing/sampling_profiler.h>
 
 /*
  * Implement ioctl-style memcached commands (ioctl_get / ioctl_set).
@@ -92,6 +93,55 @@ static ENGINE_ERROR_CODE setJemallocProfDump(Cookie& cookie,
     return (res == 0) ? ENGINE_SUCCESS : ENGINE_EINVAL;
 }
 
+/**
+ * Callback for starting the sampling profiler. The value is the sampling
+ * interval in microseconds of CPU time (empty for the default).
+ */
+static ENGINE_ERROR_CODE setSamplingStart(Cookie& cookie,
+                                          const StrToStrMap&,
+                                          const std::string& value) {
+    auto interval = cb::tracing::SamplingProfiler::DefaultInterval;
+    if (!value.empty()) {
+        uint64_t usecs;
+        if (!safe_strtoull(value.c_str(), usecs) || usecs == 0) {
+            return ENGINE_EINVAL;
+        }
+        interval = std::chrono::microseconds(usecs);
+    }
+
+    auto& c = cookie.getConnection();
+    try {
+        cb::tracing::SamplingProfiler::getInstance().start(interval);
+    } catch (const std::exception& e) {
+        LOG_WARNING("{}: {} IOCTL_SET: sampling.start failed: {}",
+                    c.getId(),
+                    c.getDescription(),
+                    e.what());
+        return ENGINE_FAILED;
+    }
+    LOG_INFO("{}: {} IOCTL_SET: sampling.start interval:{}us",
+             c.getId(),
+             c.getDescription(),
+             interval.count());
+    return ENGINE_SUCCESS;
+}
+
+static ENGINE_ERROR_CODE setSamplingStop(Cookie& cookie,
+                                         const StrToStrMap&,
+                                         const std::string&) {
+    cb::tracing::SamplingProfiler::getInstance().stop();
+    auto& c = cookie.getConnection();
+    LOG_INFO("{}: {} IOCTL_SET: sampling.stop", c.getId(), c.getDescription());
+    return ENGINE_SUCCESS;
+}
+
+static ENGINE_ERROR_CODE setSamplingClear(Cookie& cookie,
+                                          const StrToStrMap&,
+                                          const std::string&) {
+    cb::tracing::SamplingProfiler::getInstance().clear();
+    return ENGINE_SUCCESS;
+}
+
 /**
  * Callback for setting the trace status of a specific connection
  */
@@ -121,6 +171,7 @@ static const std::unordered_map<std::string, GetCallbackFunc> ioctl_get_map{
         {"trace.status", ioctlGetTracingStatus},
         {"trace.dump.begin", ioctlGetTracingBeginDump},
         {"trace.dump.chunk", ioctlGetTracingDumpChunk},
+        {"trace.slow_ops", ioctlGetSlowOps},
         {"sla", ioctlGetMcbpSla}};
 
 ENGINE_ERROR_CODE ioctl_get_property(Cookie& cookie,
@@ -168,11 +219,16 @@ static const std::unordered_map<std::string, SetCallbackFunc> ioctl_set_map{
         {"jemalloc.prof.active", setJemallocProfActive},
         {"jemalloc.prof.dump", setJemallocProfDump},
         {"release_free_memory", setReleaseFreeMemory},
+        {"sampling.clear", setSamplingClear},
+        {"sampling.start", setSamplingStart},
+        {"sampling.stop", setSamplingStop},
         {"trace.connection", setTraceConnection},
         {"trace.config", ioctlSetTracingConfig},
         {"trace.start", ioctlSetTracingStart},
         {"trace.stop", ioctlSetTracingStop},
         {"trace.dump.clear", ioctlSetTracingClearDump},
+        {"trace.slow_ops.clear", ioctlSetSlowOpsClear},
+        {"trace.slow_ops.threshold", ioctlSetSlowOpsThreshold},
         {"sla", ioctlSetMcbpSla}};
 
 ENGINE_ERROR_CODE ioctl_set_property(Cookie& cookie,
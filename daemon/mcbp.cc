@@ -243,4 +243,14 @@ void mcbp_collect_timings(Cookie& cookie) {
     const auto elapsed_ms =
             std::chrono::duration_cast<std::chrono::milliseconds>(elapsed_ns);
     cookie.maybeLogSlowCommand(elapsed_ms);
+
+    // Keep the span breakdown of slow commands. If there's a response to
+    // send the command is recorded once it's sent (see conn_send_data) so
+    // the time spent sending it is included.
+    if (c->getState() == McbpStateMachine::State::send_data) {
+        cookie.beginSendSpan();
+    } else {
+        const auto& header = cookie.getHeader();
+        cookie.maybeRecordSlowOp(header.getOpcode(), header.getOpaque());
+    }
 }
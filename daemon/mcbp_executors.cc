@@ -698,13 +698,18 @@ static void execute_request_packet(Cookie& cookie,
     protocol_binary_response_status result;
 
     const auto opcode = request.opcode;
+    auto& tracer = cookie.getTracer();
+    const auto decodeSpan = tracer.begin(cb::tracing::TraceCode::DECODE);
     const auto res = privilegeChains.invoke(opcode, cookie);
     switch (res) {
     case cb::rbac::PrivilegeAccess::Fail:
-        LOG_WARNING("{} {}: no access to command {}",
-                    c->getId(),
-                    c->getDescription(),
-                    memcached_opcode_2_text(opcode));
+        tracer.end(decodeSpan);
+        // A misbehaving client may hit this on every request, so don't
+        // format the message on the front-end thread
+        LOG_WARNING_DEFERRED("{} {}: no access to command {}",
+                             c->getId(),
+                             c->getDescription(),
+                             memcached_opcode_2_text(opcode));
         audit_command_access_failed(cookie);
 
         if (c->remapErrorCode(ENGINE_EACCESS) == ENGINE_DISCONNECT) {
@@ -724,6 +729,7 @@ static void execute_request_packet(Cookie& cookie,
         } else {
             result = PROTOCOL_BINARY_RESPONSE_EINVAL;
         }
+        tracer.end(decodeSpan);
 
         if (result != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
             LOG_INFO(
@@ -741,6 +747,7 @@ static void execute_request_packet(Cookie& cookie,
         handlers[opcode](cookie);
         return;
     case cb::rbac::PrivilegeAccess::Stale:
+        tracer.end(decodeSpan);
         if (c->remapErrorCode(ENGINE_AUTH_STALE) == ENGINE_DISCONNECT) {
             c->setState(McbpStateMachine::State::closing);
         } else {
@@ -475,6 +475,18 @@ static void opcode_attributes_override_changed_listener(const std::string&,
     }
 }
 
+static void inflated_document_cache_size_changed_listener(const std::string&,
+                                                          Settings& s) {
+    auto size = s.getInflatedDocumentCacheSize();
+    bucketsForEach(
+            [](Bucket& bucket, void* arg) -> bool {
+                bucket.inflatedDocumentCache.setMaxSize(
+                        *static_cast<size_t*>(arg));
+                return true;
+            },
+            &size);
+}
+
 static void interfaces_changed_listener(const std::string&, Settings &s) {
     for (const auto& ifc : s.getInterfaces()) {
         auto* port = get_listening_port_instance(ifc.port);
@@ -538,6 +550,8 @@ static void settings_init(void) {
     settings.addChangeListener("interfaces", interfaces_changed_listener);
     settings.addChangeListener("saslauthd_socketpath",
                                saslauthd_socketpath_changed_listener);
+    settings.addChangeListener("inflated_document_cache_size",
+                               inflated_document_cache_size_changed_listener);
     NetworkInterface default_interface;
     settings.addInterface(default_interface);
 
@@ -770,11 +784,11 @@ static protocol_binary_response_status engine_error2mcbp(
 }
 
 // Begin -  Tracing api
-static void begin_trace(gsl::not_null<const void*> void_cookie,
-                        cb::tracing::TraceCode tracecode) {
+static cb::tracing::SpanId begin_trace(gsl::not_null<const void*> void_cookie,
+                                       cb::tracing::TraceCode tracecode) {
     auto* cookie =
             reinterpret_cast<Cookie*>(const_cast<void*>(void_cookie.get()));
-    cookie->getTracer().begin(tracecode);
+    return cookie->getTracer().begin(tracecode);
 }
 
 static void end_trace(gsl::not_null<const void*> void_cookie,
@@ -783,6 +797,13 @@ static void end_trace(gsl::not_null<const void*> void_cookie,
             reinterpret_cast<Cookie*>(const_cast<void*>(void_cookie.get()));
     cookie->getTracer().end(tracecode);
 }
+
+static void end_trace_span(gsl::not_null<const void*> void_cookie,
+                           cb::tracing::SpanId spanId) {
+    auto* cookie =
+            reinterpret_cast<Cookie*>(const_cast<void*>(void_cookie.get()));
+    cookie->getTracer().end(spanId);
+}
 // End -  Tracing api
 
 static ENGINE_ERROR_CODE pre_link_document(
@@ -1770,6 +1791,7 @@ SERVER_HANDLE_V1* get_server_api() {
 
         tracing_api.begin_trace = begin_trace;
         tracing_api.end_trace = end_trace;
+        tracing_api.end_trace_span = end_trace_span;
 
         rv.interface = 1;
         rv.core = &core_api;
@@ -1846,6 +1868,8 @@ void CreateBucketThread::create() {
         strcpy(all_buckets[ii].name, name.c_str());
         try {
             all_buckets[ii].topkeys = new TopKeys(settings.getTopkeysSize());
+            all_buckets[ii].inflatedDocumentCache.setMaxSize(
+                    settings.getInflatedDocumentCacheSize());
         } catch (const std::bad_alloc &) {
             result = ENGINE_ENOMEM;
             logger->warn("{} Create bucket [{}] failed - out of memory",
@@ -1912,6 +1936,7 @@ void CreateBucketThread::create() {
             bucket.engine = nullptr;
             delete bucket.topkeys;
             bucket.topkeys = nullptr;
+            bucket.inflatedDocumentCache.setMaxSize(0);
 
             result = ENGINE_NOT_STORED;
         }
@@ -1923,6 +1948,7 @@ void CreateBucketThread::create() {
             bucket.engine = nullptr;
             delete bucket.topkeys;
             bucket.topkeys = nullptr;
+            bucket.inflatedDocumentCache.setMaxSize(0);
         }
 
         logger->warn(
@@ -2097,6 +2123,7 @@ void DestroyBucketThread::destroy() {
         delete bucket.topkeys;
         bucket.responseCounters.fill(0);
         bucket.topkeys = nullptr;
+        bucket.inflatedDocumentCache.setMaxSize(0);
     }
     // don't need lock because all timing data uses atomics
     bucket.timings.reset();
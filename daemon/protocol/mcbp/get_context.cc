@@ -56,12 +56,15 @@ ENGINE_ERROR_CODE GetCommandContext::getItem() {
 
 ENGINE_ERROR_CODE GetCommandContext::inflateItem() {
     try {
-        if (!cb::compression::inflate(cb::compression::Algorithm::Snappy,
-                                      payload, buffer)) {
+        buffer = connection.getBucket().inflatedDocumentCache.get(
+                {static_cast<const char*>(info.key), info.nkey},
+                info.cas,
+                payload);
+        if (!buffer) {
             LOG_WARNING("{}: Failed to inflate item", connection.getId());
             return ENGINE_FAILED;
         }
-        payload = buffer;
+        payload = *buffer;
     } catch (const std::bad_alloc&) {
         return ENGINE_ENOMEM;
     }
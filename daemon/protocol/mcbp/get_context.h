@@ -18,6 +18,7 @@
 
 #include <mcbp/protocol/header.h>
 #include <platform/compress.h>
+#include "../../inflated_document_cache.h"
 #include "../../memcached.h"
 #include "steppable_command_context.h"
 
@@ -125,6 +126,6 @@ private:
     item_info info;
 
     cb::const_char_buffer payload;
-    cb::compression::Buffer buffer;
+    InflatedDocumentCache::Document buffer;
     State state;
 };
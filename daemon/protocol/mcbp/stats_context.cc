@@ -25,6 +25,8 @@
 #include <daemon/mc_time.h>
 #include <daemon/mcbp.h>
 #include <daemon/runtime.h>
+#include <daemon/tracing.h>
+#include <logger/logger.h>
 #include <mcbp/protocol/framebuilder.h>
 #include <mcbp/protocol/header.h>
 #include <memcached/audit_interface.h>
@@ -32,6 +34,7 @@
 #include <phosphor/trace_log.h>
 #include <platform/checked_snprintf.h>
 #include <platform/sized_buffer.h>
+#include <tracing/sampling_profiler.h>
 #include <utilities/protocol2text.h>
 
 #include <numeric>
@@ -249,6 +252,10 @@ static ENGINE_ERROR_CODE server_stats(ADD_STAT add_stat_callback,
         add_stat(cookie, add_stat_callback, "cmd_lock", thread_stats.cmd_lock);
         add_stat(cookie, add_stat_callback, "lock_errors",
                  thread_stats.lock_errors);
+        add_stat(cookie,
+                 add_stat_callback,
+                 "log_messages_dropped",
+                 cb::logger::getDroppedMessageCount());
 
         auto lookup_latency = timings.get_interval_lookup_latency();
         add_stat(cookie, add_stat_callback, "cmd_lookup_10s_count",
@@ -262,6 +269,31 @@ static ENGINE_ERROR_CODE server_stats(ADD_STAT add_stat_callback,
         add_stat(cookie, add_stat_callback, "cmd_mutation_10s_duration_us",
                  mutation_latency.duration_ns / 1000);
 
+        const auto inflated_doc_cache_stats = cookie.getConnection()
+                                                      .getBucket()
+                                                      .inflatedDocumentCache
+                                                      .getStats();
+        add_stat(cookie,
+                 add_stat_callback,
+                 "inflated_doc_cache_hits",
+                 inflated_doc_cache_stats.hits);
+        add_stat(cookie,
+                 add_stat_callback,
+                 "inflated_doc_cache_misses",
+                 inflated_doc_cache_stats.misses);
+        add_stat(cookie,
+                 add_stat_callback,
+                 "inflated_doc_cache_evictions",
+                 inflated_doc_cache_stats.evictions);
+        add_stat(cookie,
+                 add_stat_callback,
+                 "inflated_doc_cache_items",
+                 inflated_doc_cache_stats.items);
+        add_stat(cookie,
+                 add_stat_callback,
+                 "inflated_doc_cache_size",
+                 inflated_doc_cache_stats.size);
+
         auto& respCounters =
                 cookie.getConnection().getBucket().responseCounters;
         // Ignore success responses by starting from begin + 1
@@ -381,6 +413,10 @@ static void process_stat_settings(ADD_STAT add_stat_callback, Cookie& cookie) {
              settings.isDedupeNmvbMaps() ? "true" : "false");
     add_stat(cookie, add_stat_callback, "max_packet_size",
              std::to_string(settings.getMaxPacketSize()).c_str());
+    add_stat(cookie,
+             add_stat_callback,
+             "inflated_document_cache_size",
+             std::to_string(settings.getInflatedDocumentCacheSize()).c_str());
     add_stat(cookie, add_stat_callback, "xattr_enabled",
             settings.isXattrEnabled());
     add_stat(cookie, add_stat_callback, "privilege_debug",
@@ -799,6 +835,120 @@ static ENGINE_ERROR_CODE stat_tracing_executor(const std::string& arg,
     }
 }
 
+/**
+ * Handler for the "stats sampling [stacks [limit]]" command.
+ *
+ * Without an argument it returns the state of the sampling profiler and the
+ * number of samples per thread type and activity. With "stacks" it returns
+ * the (default 20) most frequently sampled stacks; each one as a JSON object
+ * with the thread type, activity, count and the symbolized frames.
+ */
+static ENGINE_ERROR_CODE stat_sampling_executor(const std::string& arg,
+                                                Cookie& cookie) {
+    auto& profiler = cb::tracing::SamplingProfiler::getInstance();
+    auto addStat = [&cookie](const std::string& key, const std::string& val) {
+        append_stats(key.data(),
+                     uint16_t(key.size()),
+                     val.data(),
+                     uint32_t(val.size()),
+                     &cookie);
+    };
+
+    try {
+        if (arg.empty()) {
+            const auto stats = profiler.getStats();
+            addStat("sampling:running", stats.running ? "true" : "false");
+            addStat("sampling:interval_us",
+                    std::to_string(stats.interval.count()));
+            addStat("sampling:threads", std::to_string(stats.threads));
+            addStat("sampling:samples", std::to_string(stats.samples));
+            addStat("sampling:dropped", std::to_string(stats.dropped));
+            addStat("sampling:unregistered",
+                    std::to_string(stats.unregistered));
+            addStat("sampling:overflow", std::to_string(stats.overflow));
+            for (const auto& activity : profiler.getActivitySummary()) {
+                addStat("sampling:activity:" + activity.first,
+                        std::to_string(activity.second));
+            }
+            return ENGINE_SUCCESS;
+        }
+
+        size_t limit = 20;
+        if (arg.compare(0, 6, "stacks") != 0) {
+            return ENGINE_EINVAL;
+        }
+        if (arg.size() > 6) {
+            uint32_t value;
+            if (arg[6] != ' ' || !safe_strtoul(arg.c_str() + 7, value)) {
+                return ENGINE_EINVAL;
+            }
+            limit = value;
+        }
+
+        size_t index = 0;
+        for (const auto& entry : profiler.getProfile(limit)) {
+            unique_cJSON_ptr json(cJSON_CreateObject());
+            cJSON_AddStringToObject(
+                    json.get(), "thread", entry.threadType.c_str());
+            cJSON_AddStringToObject(
+                    json.get(), "activity", entry.activity.c_str());
+            cJSON_AddInteger64ToObject(json.get(), "count", entry.count);
+            cJSON* frames = cJSON_CreateArray();
+            for (auto* frame : entry.frames) {
+                const auto symbol =
+                        cb::tracing::SamplingProfiler::symbolize(frame);
+                cJSON_AddItemToArray(frames,
+                                     cJSON_CreateString(symbol.c_str()));
+            }
+            cJSON_AddItemToObject(json.get(), "frames", frames);
+            addStat("sampling:stack:" + std::to_string(index++),
+                    to_string(json, false));
+        }
+        return ENGINE_SUCCESS;
+    } catch (const std::bad_alloc&) {
+        return ENGINE_ENOMEM;
+    }
+}
+
+/**
+ * Handler for the <code>stats slow_ops</code> command.
+ *
+ * Returns the state of the SlowOpRecorder and each of the requests it
+ * keeps (oldest first) as a JSON object with the span breakdown.
+ */
+static ENGINE_ERROR_CODE stat_slow_ops_executor(const std::string& arg,
+                                                Cookie& cookie) {
+    if (!arg.empty()) {
+        return ENGINE_EINVAL;
+    }
+
+    auto& recorder = cb::tracing::SlowOpRecorder::getInstance();
+    auto addStat = [&cookie](const std::string& key, const std::string& val) {
+        append_stats(key.data(),
+                     uint16_t(key.size()),
+                     val.data(),
+                     uint32_t(val.size()),
+                     &cookie);
+    };
+
+    try {
+        const auto stats = recorder.getStats();
+        addStat("slow_ops:threshold_us",
+                std::to_string(stats.threshold.count()));
+        addStat("slow_ops:recorded", std::to_string(stats.recorded));
+        addStat("slow_ops:dropped", std::to_string(stats.dropped));
+
+        size_t index = 0;
+        for (const auto& op : recorder.getRecords()) {
+            addStat("slow_ops:" + std::to_string(index++),
+                    to_string(slowOpToJSON(op), false));
+        }
+        return ENGINE_SUCCESS;
+    } catch (const std::bad_alloc&) {
+        return ENGINE_ENOMEM;
+    }
+}
+
 ENGINE_ERROR_CODE StatsCommandContext::step() {
     struct stat_handler {
         /**
@@ -827,6 +977,8 @@ ENGINE_ERROR_CODE StatsCommandContext::step() {
             {"topkeys_json", {false, stat_topkeys_json_executor}},
             {"subdoc_execute", {false, stat_subdoc_execute_executor}},
             {"responses", {false, stat_responses_json_executor}},
+            {"sampling", {true, stat_sampling_executor}},
+            {"slow_ops", {true, stat_slow_ops_executor}},
             {"tracing", {true, stat_tracing_executor}}};
 
     ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
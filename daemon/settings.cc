@@ -55,6 +55,7 @@ Settings::Settings()
     verbose.store(0);
     connection_idle_time.reset();
     dedupe_nmvb_maps.store(false);
+    inflated_document_cache_size.store(0);
     xattr_enabled.store(false);
     privilege_debug.store(false);
     collections_prototype.store(false);
@@ -447,6 +448,24 @@ static void handle_max_packet_size(Settings& s, cJSON* obj) {
     s.setMaxPacketSize(obj->valueint * 1024 * 1024);
 }
 
+/**
+ * Handle the "inflated_document_cache_size" tag in the settings
+ *
+ *  The value must be a non-negative numeric value (specified in MB), 0
+ *  disables the cache
+ *
+ * @param s the settings object to update
+ * @param obj the object in the configuration
+ */
+static void handle_inflated_document_cache_size(Settings& s, cJSON* obj) {
+    if (obj->type != cJSON_Number || obj->valueint < 0) {
+        throw std::invalid_argument(
+                "\"inflated_document_cache_size\" must be a non-negative "
+                "integer");
+    }
+    s.setInflatedDocumentCacheSize(size_t(obj->valueint) * 1024 * 1024);
+}
+
 /**
  * Handle the "saslauthd_socketpath" tag in the settings
  *
@@ -676,6 +695,8 @@ void Settings::reconfigure(const unique_cJSON_ptr& json) {
             {"ssl_minimum_protocol", handle_ssl_minimum_protocol},
             {"breakpad", handle_breakpad},
             {"max_packet_size", handle_max_packet_size},
+            {"inflated_document_cache_size",
+             handle_inflated_document_cache_size},
             {"saslauthd_socketpath", handle_saslauthd_socketpath},
             {"sasl_mechanisms", handle_sasl_mechanisms},
             {"ssl_sasl_mechanisms", handle_ssl_sasl_mechanisms},
@@ -914,6 +935,16 @@ void Settings::updateSettings(const Settings& other, bool apply) {
             setMaxPacketSize(other.max_packet_size);
         }
     }
+    if (other.has.inflated_document_cache_size) {
+        if (other.inflated_document_cache_size !=
+            inflated_document_cache_size) {
+            LOG_INFO("Change inflated document cache size from {} to {}",
+                     inflated_document_cache_size.load(),
+                     other.inflated_document_cache_size.load());
+            setInflatedDocumentCacheSize(
+                    other.inflated_document_cache_size.load());
+        }
+    }
     if (other.has.ssl_cipher_list) {
         if (other.ssl_cipher_list != ssl_cipher_list) {
             // this isn't safe!! an other thread could call stats settings
@@ -455,6 +455,29 @@ public:
         notify_changed("max_packet_size");
     }
 
+    /**
+     * Get the maximum number of bytes each bucket may use to cache
+     * inflated versions of Snappy-compressed documents
+     *
+     * @return the maximum size in bytes (0 means disabled)
+     */
+    size_t getInflatedDocumentCacheSize() const {
+        return inflated_document_cache_size.load();
+    }
+
+    /**
+     * Set the maximum number of bytes each bucket may use to cache
+     * inflated versions of Snappy-compressed documents
+     *
+     * @param inflated_document_cache_size the new maximum size in bytes
+     */
+    void setInflatedDocumentCacheSize(size_t inflated_document_cache_size) {
+        Settings::inflated_document_cache_size.store(
+                inflated_document_cache_size);
+        has.inflated_document_cache_size = true;
+        notify_changed("inflated_document_cache_size");
+    }
+
     /**
      * Get the configured socket path for Saslauthd
      */
@@ -816,6 +839,13 @@ protected:
      */
     uint32_t max_packet_size;
 
+    /**
+     * The number of bytes each bucket may use to cache the inflated
+     * version of Snappy-compressed documents (used by subdoc and by
+     * retrievals from clients which don't support Snappy)
+     */
+    std::atomic<size_t> inflated_document_cache_size;
+
     /**
      * The SSL cipher list to use
      */
@@ -924,6 +954,7 @@ public:
         bool root;
         bool breakpad;
         bool max_packet_size;
+        bool inflated_document_cache_size;
         bool ssl_cipher_list;
         bool ssl_minimum_protocol;
         bool client_cert_auth;
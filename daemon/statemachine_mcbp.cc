@@ -453,6 +453,8 @@ bool conn_send_data(McbpConnection& connection) {
 
     switch (connection.transmit()) {
     case McbpConnection::TransmitResult::Complete:
+        connection.getCookieObject().onResponseSent();
+
         // Release all allocated resources
         connection.releaseTempAlloc();
         connection.releaseReservedItems();
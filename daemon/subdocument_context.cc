@@ -344,10 +344,11 @@ protocol_binary_response_status SubdocCmdContext::get_document_for_searching(
     if (mcbp::datatype::is_snappy(info.datatype)) {
         // Need to expand before attempting to extract from it.
         try {
-            using namespace cb::compression;
-            if (!inflate(Algorithm::Snappy,
-                         in_doc,
-                         inflated_doc_buffer)) {
+            inflated_doc = c.getBucket().inflatedDocumentCache.get(
+                    {static_cast<const char*>(info.key), info.nkey},
+                    info.cas,
+                    in_doc);
+            if (!inflated_doc) {
                 char clean_key[KEY_MAX_LENGTH + 32];
                 if (buf_to_printable_buffer(clean_key,
                                             sizeof(clean_key),
@@ -368,7 +369,7 @@ protocol_binary_response_status SubdocCmdContext::get_document_for_searching(
         }
 
         // Update document to point to the uncompressed version in the buffer.
-        in_doc = inflated_doc_buffer;
+        in_doc = *inflated_doc;
         in_datatype &= ~PROTOCOL_BINARY_DATATYPE_SNAPPY;
     }
 
@@ -19,6 +19,7 @@
 
 #include "memcached.h"
 
+#include "inflated_document_cache.h"
 #include "subdocument_traits.h"
 #include "xattr/utils.h"
 
@@ -141,16 +142,16 @@ public:
 
     // The expanded input JSON document. This may either refer to:
     // a). The raw engine item iovec
-    // b). The 'inflated_doc_buffer' if the input document had to be
+    // b). The 'inflated_doc' if the input document had to be
     //     inflated.
     // c). {intermediate_result} member of this object.
     // Either way, it should /not/ be cb_free()d.
     // TODO: Remove (b), and just use intermediate result.
     cb::const_char_buffer in_doc{};
 
-    // Temporary buffer to hold the inflated content in case of the
-    // document in the engine being compressed
-    cb::compression::Buffer inflated_doc_buffer;
+    // The inflated content in case of the document in the engine being
+    // compressed. Shared with the bucket's InflatedDocumentCache.
+    InflatedDocumentCache::Document inflated_doc;
 
 
     // Temporary buffer used to hold the intermediate result document for
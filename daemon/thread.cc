@@ -18,6 +18,7 @@
 #include <platform/cb_malloc.h>
 #include <platform/platform.h>
 #include <platform/strerror.h>
+#include <tracing/sampling_profiler.h>
 #include <queue>
 #include <memory>
 
@@ -206,7 +207,10 @@ static void worker_libevent(void *arg) {
     cb_cond_signal(&init_cond);
     cb_mutex_exit(&init_lock);
 
+    cb::tracing::SamplingProfiler::registerThread("mc:worker_" +
+                                                  std::to_string(me->index));
     event_base_loop(me->base, 0);
+    cb::tracing::SamplingProfiler::unregisterThread();
 
     // Event loop exited; cleanup before thread exits.
     ERR_remove_state(0);
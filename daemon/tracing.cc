@@ -19,6 +19,7 @@
 #include "task.h"
 
 #include <platform/processclock.h>
+#include <utilities/protocol2text.h>
 
 #include <mutex>
 
@@ -302,3 +303,69 @@ ENGINE_ERROR_CODE ioctlSetTracingStop(Cookie& cookie,
     PHOSPHOR_INSTANCE.stop();
     return ENGINE_SUCCESS;
 }
+
+unique_cJSON_ptr slowOpToJSON(const cb::tracing::SlowOpRecorder::Record& op) {
+    unique_cJSON_ptr json(cJSON_CreateObject());
+    const auto timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+            op.timestamp.time_since_epoch());
+    cJSON_AddInteger64ToObject(json.get(), "timestamp_us", timestamp.count());
+    cJSON_AddInteger64ToObject(
+            json.get(), "duration_us", op.duration.count());
+    cJSON_AddNumberToObject(json.get(), "connection", op.connectionId);
+    cJSON_AddNumberToObject(json.get(), "opaque", op.opaque);
+    const char* opcode = memcached_opcode_2_text(op.opcode);
+    if (opcode != nullptr) {
+        cJSON_AddStringToObject(json.get(), "opcode", opcode);
+    } else {
+        cJSON_AddNumberToObject(json.get(), "opcode", op.opcode);
+    }
+    if (op.totalSpans > op.numSpans) {
+        cJSON_AddNumberToObject(
+                json.get(), "spans_omitted", op.totalSpans - op.numSpans);
+    }
+
+    cJSON* spans = cJSON_CreateArray();
+    for (size_t ii = 0; ii < op.numSpans; ++ii) {
+        const auto& span = op.spans[ii];
+        cJSON* obj = cJSON_CreateObject();
+        cJSON_AddStringToObject(obj, "name", to_string(span.code).c_str());
+        cJSON_AddInteger64ToObject(obj, "offset_us", span.offset.count());
+        cJSON_AddInteger64ToObject(obj, "duration_us", span.duration.count());
+        cJSON_AddItemToArray(spans, obj);
+    }
+    cJSON_AddItemToObject(json.get(), "spans", spans);
+    return json;
+}
+
+ENGINE_ERROR_CODE ioctlGetSlowOps(Cookie& cookie,
+                                  const StrToStrMap&,
+                                  std::string& value) {
+    unique_cJSON_ptr json(cJSON_CreateArray());
+    for (const auto& op :
+         cb::tracing::SlowOpRecorder::getInstance().getRecords()) {
+        cJSON_AddItemToArray(json.get(), slowOpToJSON(op).release());
+    }
+    value = to_string(json, false);
+    return ENGINE_SUCCESS;
+}
+
+ENGINE_ERROR_CODE ioctlSetSlowOpsThreshold(Cookie& cookie,
+                                           const StrToStrMap&,
+                                           const std::string& value) {
+    uint64_t usecs;
+    if (!safe_strtoull(value.c_str(), usecs)) {
+        cookie.setErrorContext(
+                "Threshold must be specified in microseconds");
+        return ENGINE_EINVAL;
+    }
+    cb::tracing::SlowOpRecorder::getInstance().setThreshold(
+            std::chrono::microseconds(usecs));
+    return ENGINE_SUCCESS;
+}
+
+ENGINE_ERROR_CODE ioctlSetSlowOpsClear(Cookie& cookie,
+                                       const StrToStrMap&,
+                                       const std::string& value) {
+    cb::tracing::SlowOpRecorder::getInstance().clear();
+    return ENGINE_SUCCESS;
+}
@@ -23,6 +23,7 @@
 #include <phosphor/phosphor.h>
 #include <phosphor/tools/export.h>
 #include <stddef.h>
+#include <tracing/slow_op_recorder.h>
 
 #include "memcached.h"
 #include "utilities/string_utilities.h"
@@ -147,3 +148,31 @@ ENGINE_ERROR_CODE ioctlSetTracingStart(Cookie& cookie,
 ENGINE_ERROR_CODE ioctlSetTracingStop(Cookie& cookie,
                                       const StrToStrMap& arguments,
                                       const std::string& value);
+
+/**
+ * Get the JSON representation of a request kept by the SlowOpRecorder
+ */
+unique_cJSON_ptr slowOpToJSON(const cb::tracing::SlowOpRecorder::Record& op);
+
+/**
+ * IOCTL Get callback to get the requests kept by the SlowOpRecorder
+ * @param[out] value JSON array of the requests (oldest first)
+ */
+ENGINE_ERROR_CODE ioctlGetSlowOps(Cookie& cookie,
+                                  const StrToStrMap& arguments,
+                                  std::string& value);
+
+/**
+ * IOCTL Set callback to set the threshold of the SlowOpRecorder
+ * @param value The threshold in microseconds (0 disables the recorder)
+ */
+ENGINE_ERROR_CODE ioctlSetSlowOpsThreshold(Cookie& cookie,
+                                           const StrToStrMap& arguments,
+                                           const std::string& value);
+
+/**
+ * IOCTL Set callback to discard the requests kept by the SlowOpRecorder
+ */
+ENGINE_ERROR_CODE ioctlSetSlowOpsClear(Cookie& cookie,
+                                       const StrToStrMap& arguments,
+                                       const std::string& value);
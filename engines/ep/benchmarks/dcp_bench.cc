@@ -0,0 +1,483 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Replication throughput benchmarks: a DcpProducer streams a set of active
+ * vBuckets to a DcpConsumer which applies the items to replica vBuckets of
+ * the same engine. The producer and the consumer are connected directly via
+ * their dcp_message_producers (no network or memcached front-end involved),
+ * so the results only cover the ep-engine side of DCP.
+ */
+
+#include "checkpoint.h"
+#include "dcp/flow-control-manager.h"
+#include "engine_fixture.h"
+#include "ep_bucket.h"
+
+#include <fakes/fake_executorpool.h>
+#include <mock/mock_dcp_consumer.h>
+#include <mock/mock_dcp_producer.h>
+#include <mock/mock_synchronous_ep_engine.h>
+#include <platform/dirutils.h>
+#include <programs/engine_testapp/mock_server.h>
+#include <valgrind/valgrind.h>
+
+#include <algorithm>
+#include <ctime>
+#include <random>
+#include <tuple>
+
+class DcpBench : public EngineFixture {
+public:
+    /// The dcp_flow_control_policy values
+    enum class FlowControl { None, Static, Dynamic, Aggressive };
+
+protected:
+    void SetUp(const benchmark::State& state) override {
+        // The disk backfill benchmarks must only see the items they wrote.
+        try {
+            cb::io::rmrf("benchmarks-test");
+        } catch (std::system_error& e) {
+            if (e.code() != std::error_code(ENOENT, std::system_category())) {
+                throw e;
+            }
+        }
+
+        // Large enough that neither side hits the high watermark; also the
+        // basis of the Dynamic and Aggressive flow control buffer sizes.
+        varConfig = "max_size=2147483648";
+        EngineFixture::SetUp(state);
+        instance = this;
+
+        numVBuckets = uint16_t(state.range(0));
+        for (uint16_t vb = 0; vb < numVBuckets; ++vb) {
+            engine->getKVBucket()->setVBucketState(
+                    vb, vbucket_state_active, false);
+            engine->getKVBucket()->setVBucketState(
+                    getReplica(vb), vbucket_state_replica, false);
+        }
+        setFlowControlPolicy(FlowControl(state.range(3)));
+
+        producerCookie = create_mock_cookie();
+        consumerCookie = create_mock_cookie();
+        streamsEnded = 0;
+        itemsReceived = 0;
+        bytesReceived = 0;
+        error = ENGINE_SUCCESS;
+    }
+
+    void TearDown(const benchmark::State& state) override {
+        consumer->closeAllStreams();
+        consumer->cancelTask();
+        producer->closeAllStreams();
+        producer->cancelCheckpointCreatorTask();
+        producer.reset();
+        consumer.reset();
+        destroy_mock_cookie(producerCookie);
+        destroy_mock_cookie(consumerCookie);
+        instance = nullptr;
+        EngineFixture::TearDown(state);
+    }
+
+    /// The replica vBucket which active vBucket vb is replicated to.
+    uint16_t getReplica(uint16_t vb) const {
+        return vb + numVBuckets;
+    }
+
+    /**
+     * The SynchronousEPEngine always creates a (disabled) base
+     * DcpFlowControlManager; install the one the real engine would create
+     * for the given dcp_flow_control_policy.
+     */
+    void setFlowControlPolicy(FlowControl policy) {
+        std::unique_ptr<DcpFlowControlManager> manager;
+        switch (policy) {
+        case FlowControl::None:
+            manager = std::make_unique<DcpFlowControlManager>(*engine);
+            break;
+        case FlowControl::Static:
+            manager = std::make_unique<DcpFlowControlManagerStatic>(*engine);
+            break;
+        case FlowControl::Dynamic:
+            manager = std::make_unique<DcpFlowControlManagerDynamic>(*engine);
+            break;
+        case FlowControl::Aggressive:
+            manager =
+                    std::make_unique<DcpFlowControlManagerAggressive>(*engine);
+            break;
+        }
+        engine->setDcpFlowControlManager(std::move(manager));
+    }
+
+    /**
+     * Store itemsPerVBucket items in each of the active vBuckets. The values
+     * are drawn from a small alphabet so that they compress roughly as well
+     * as typical JSON documents.
+     */
+    void populate(size_t itemsPerVBucket, size_t valueSize) {
+        std::default_random_engine gen;
+        std::uniform_int_distribution<int> dist('a', 'p');
+        std::string value(valueSize, 'x');
+        for (uint16_t vb = 0; vb < numVBuckets; ++vb) {
+            for (size_t ii = 0; ii < itemsPerVBucket; ++ii) {
+                std::generate(value.begin(), value.end(), [&dist, &gen]() {
+                    return char(dist(gen));
+                });
+                auto item = make_item(vb, "key" + std::to_string(ii), value);
+                item.setDataType(PROTOCOL_BINARY_RAW_BYTES);
+                engine->getKVBucket()->set(item, cookie);
+            }
+        }
+    }
+
+    /**
+     * Persist all of the active vBuckets and then drop their checkpoints, so
+     * that a stream from seqno 0 has to be backfilled from disk.
+     */
+    void persistAndRemoveCheckpoints() {
+        auto& ep = dynamic_cast<EPBucket&>(*engine->getKVBucket());
+        for (uint16_t vb = 0; vb < numVBuckets; ++vb) {
+            bool moreAvailable;
+            do {
+                std::tie(moreAvailable, std::ignore) = ep.flushVBucket(vb);
+            } while (moreAvailable);
+
+            auto vbucket = engine->getKVBucket()->getVBucket(vb);
+            vbucket->checkpointManager->createNewCheckpoint();
+            bool newCheckpointCreated;
+            vbucket->checkpointManager->removeClosedUnrefCheckpoints(
+                    *vbucket, newCheckpointCreated);
+        }
+    }
+
+    /**
+     * Create the producer and the consumer, add a passive stream for each
+     * replica vBucket and the matching active stream (up to the current
+     * high seqno) for each active vBucket.
+     */
+    void createStreams(bool compression) {
+        // Snappy must be negotiated for force_value_compression.
+        mock_set_datatype_support(
+                producerCookie,
+                PROTOCOL_BINARY_DATATYPE_JSON | PROTOCOL_BINARY_DATATYPE_XATTR |
+                        (compression ? PROTOCOL_BINARY_DATATYPE_SNAPPY : 0));
+
+        consumer = std::make_shared<MockDcpConsumer>(
+                *engine, consumerCookie, "bench_consumer");
+        producer = std::make_shared<MockDcpProducer>(*engine,
+                                                     producerCookie,
+                                                     "bench_producer",
+                                                     DCP_OPEN_INCLUDE_XATTRS,
+                                                     cb::const_byte_buffer(),
+                                                     false /*startTask*/);
+        producer->createCheckpointProcessorTask();
+        producer->setNoopEnabled(true);
+        if (compression) {
+            const std::string key{"force_value_compression"};
+            const std::string value{"true"};
+            producer->control(
+                    0, key.data(), key.size(), value.data(), value.size());
+        }
+
+        for (uint16_t vb = 0; vb < numVBuckets; ++vb) {
+            consumer->addStream(/*opaque*/ 0, getReplica(vb), /*flags*/ 0);
+            // The producer uses the passive stream's opaque, so the messages
+            // can be handed to the consumer as-is.
+            const auto opaque =
+                    consumer->getVbucketStream(getReplica(vb))->getOpaque();
+            const uint64_t highSeqno =
+                    engine->getKVBucket()->getVBucket(vb)->getHighSeqno();
+            uint64_t rollbackSeqno;
+            producer->streamRequest(/*flags*/ 0,
+                                    opaque,
+                                    vb,
+                                    /*start_seqno*/ 0,
+                                    /*end_seqno*/ highSeqno,
+                                    /*vbucket_uuid*/ 0,
+                                    /*snap_start_seqno*/ 0,
+                                    /*snap_end_seqno*/ 0,
+                                    &rollbackSeqno,
+                                    &DcpBench::addFailoverLog);
+            producer->notifySeqnoAvailable(vb, highSeqno);
+        }
+    }
+
+    /**
+     * Run the next backfill task which is due, if there is one. Returns true
+     * if a task was run.
+     */
+    bool runBackfillTask() {
+        auto& queue = *executorPool->getLpTaskQ()[AUXIO_TASK_IDX];
+        if (queue.getReadyQueueSize() == 0 && queue.getFutureQueueSize() == 0) {
+            return false;
+        }
+        try {
+            CheckedExecutor executor(executorPool, queue);
+            executor.runCurrentTask();
+            executor.completeCurrentTask();
+        } catch (const std::logic_error&) {
+            // Only snoozing tasks (waiting for the backfill buffer to drain)
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Drive the producer, the consumer and the producer's background tasks
+     * until every stream has ended. Returns false if replication stalled or
+     * failed.
+     */
+    bool replicate() {
+        dcp_message_producers producerMsgs{};
+        producerMsgs.marker = sendMarker;
+        producerMsgs.mutation = sendMutation;
+        producerMsgs.stream_end = sendStreamEnd;
+        producerMsgs.noop = sendNoop;
+
+        dcp_message_producers consumerMsgs{};
+        consumerMsgs.stream_req = sendStreamReq;
+        consumerMsgs.add_stream_rsp = sendAddStreamRsp;
+        consumerMsgs.control = sendControl;
+        consumerMsgs.buffer_acknowledgement = sendBufferAck;
+
+        while (streamsEnded < numVBuckets) {
+            bool progress = false;
+            while (producer->step(&producerMsgs) == ENGINE_WANT_MORE) {
+                progress = true;
+            }
+            while (consumer->step(&consumerMsgs) == ENGINE_WANT_MORE) {
+                progress = true;
+            }
+            auto& checkpointTask = producer->getCheckpointSnapshotTask();
+            if (checkpointTask.queueSize() > 0) {
+                checkpointTask.run();
+                progress = true;
+            }
+            if (runBackfillTask()) {
+                progress = true;
+            }
+            if (error != ENGINE_SUCCESS || !progress) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static ENGINE_ERROR_CODE sendMarker(gsl::not_null<const void*> cookie,
+                                        uint32_t opaque,
+                                        uint16_t vbucket,
+                                        uint64_t start_seqno,
+                                        uint64_t end_seqno,
+                                        uint32_t flags) {
+        instance->checkResult(instance->consumer->snapshotMarker(
+                opaque,
+                instance->getReplica(vbucket),
+                start_seqno,
+                end_seqno,
+                flags));
+        return ENGINE_SUCCESS;
+    }
+
+    static ENGINE_ERROR_CODE sendMutation(gsl::not_null<const void*> cookie,
+                                          uint32_t opaque,
+                                          item* itm,
+                                          uint16_t vbucket,
+                                          uint64_t by_seqno,
+                                          uint64_t rev_seqno,
+                                          uint32_t lock_time,
+                                          const void* meta,
+                                          uint16_t nmeta,
+                                          uint8_t nru,
+                                          uint8_t collection_len) {
+        auto* item = reinterpret_cast<Item*>(itm);
+        instance->checkResult(instance->consumer->mutation(
+                opaque,
+                item->getKey(),
+                {reinterpret_cast<const uint8_t*>(item->getData()),
+                 item->getNBytes()},
+                0,
+                item->getDataType(),
+                item->getCas(),
+                instance->getReplica(vbucket),
+                item->getFlags(),
+                by_seqno,
+                rev_seqno,
+                item->getExptime(),
+                lock_time,
+                {static_cast<const uint8_t*>(meta), nmeta},
+                nru));
+        instance->itemsReceived++;
+        instance->bytesReceived +=
+                item->getKey().size() + item->getNBytes() + nmeta;
+        instance->engine->itemRelease(itm);
+        return ENGINE_SUCCESS;
+    }
+
+    static ENGINE_ERROR_CODE sendStreamEnd(gsl::not_null<const void*> cookie,
+                                           uint32_t opaque,
+                                           uint16_t vbucket,
+                                           uint32_t flags) {
+        instance->checkResult(instance->consumer->streamEnd(
+                opaque, instance->getReplica(vbucket), flags));
+        instance->streamsEnded++;
+        return ENGINE_SUCCESS;
+    }
+
+    static ENGINE_ERROR_CODE sendNoop(gsl::not_null<const void*> cookie,
+                                      uint32_t opaque) {
+        return ENGINE_SUCCESS;
+    }
+
+    /// The passive streams are accepted directly by createStreams().
+    static ENGINE_ERROR_CODE sendStreamReq(gsl::not_null<const void*> cookie,
+                                           uint32_t opaque,
+                                           uint16_t vbucket,
+                                           uint32_t flags,
+                                           uint64_t start_seqno,
+                                           uint64_t end_seqno,
+                                           uint64_t vbucket_uuid,
+                                           uint64_t snap_start_seqno,
+                                           uint64_t snap_end_seqno) {
+        return ENGINE_SUCCESS;
+    }
+
+    static ENGINE_ERROR_CODE sendAddStreamRsp(
+            gsl::not_null<const void*> cookie,
+            uint32_t opaque,
+            uint32_t stream_opaque,
+            uint8_t status) {
+        return ENGINE_SUCCESS;
+    }
+
+    static ENGINE_ERROR_CODE sendControl(gsl::not_null<const void*> cookie,
+                                         uint32_t opaque,
+                                         const void* key,
+                                         uint16_t nkey,
+                                         const void* value,
+                                         uint32_t nvalue) {
+        // The producer's response (e.g. to an unsupported control) would
+        // go back to the consumer via handleResponse; not needed here.
+        instance->producer->control(opaque, key, nkey, value, nvalue);
+        return ENGINE_SUCCESS;
+    }
+
+    static ENGINE_ERROR_CODE sendBufferAck(gsl::not_null<const void*> cookie,
+                                           uint32_t opaque,
+                                           uint16_t vbucket,
+                                           uint32_t buffer_bytes) {
+        instance->checkResult(instance->producer->bufferAcknowledgement(
+                opaque, vbucket, buffer_bytes));
+        return ENGINE_SUCCESS;
+    }
+
+    static ENGINE_ERROR_CODE addFailoverLog(vbucket_failover_t* entry,
+                                            size_t nentries,
+                                            gsl::not_null<const void*> cookie) {
+        return ENGINE_SUCCESS;
+    }
+
+    void checkResult(ENGINE_ERROR_CODE status) {
+        if (status != ENGINE_SUCCESS && error == ENGINE_SUCCESS) {
+            error = status;
+        }
+    }
+
+    /// The fixture of the running benchmark, for the static DCP callbacks.
+    static DcpBench* instance;
+
+    uint16_t numVBuckets = 0;
+    const void* producerCookie = nullptr;
+    const void* consumerCookie = nullptr;
+    std::shared_ptr<MockDcpProducer> producer;
+    std::shared_ptr<MockDcpConsumer> consumer;
+
+    size_t streamsEnded = 0;
+    size_t itemsReceived = 0;
+    size_t bytesReceived = 0;
+    ENGINE_ERROR_CODE error = ENGINE_SUCCESS;
+};
+
+DcpBench* DcpBench::instance;
+
+/**
+ * Replicate all of the active vBuckets to their replicas, either from the
+ * checkpoints (memory) or via a backfill from disk.
+ *
+ * Each run replicates the data set once (the set-up is far more expensive
+ * than the replication itself); use --benchmark_repetitions for multiple
+ * samples.
+ *
+ * Arguments: number of vBuckets, value size, compression (0 = off,
+ * 1 = force_value_compression), flow control policy (FlowControl), disk
+ * backfill (0 = memory, 1 = disk).
+ */
+BENCHMARK_DEFINE_F(DcpBench, Replicate)(benchmark::State& state) {
+    const size_t valueSize = state.range(1);
+    const bool compression = state.range(2);
+    const bool backfill = state.range(4);
+    const size_t totalItems = RUNNING_ON_VALGRIND ? 100 : 100000;
+    const size_t itemsPerVBucket = totalItems / numVBuckets;
+
+    populate(itemsPerVBucket, valueSize);
+    if (backfill) {
+        persistAndRemoveCheckpoints();
+    }
+    createStreams(compression);
+
+    std::clock_t cpuTime = 0;
+    while (state.KeepRunning()) {
+        const auto start = std::clock();
+        if (!replicate()) {
+            state.SkipWithError("Replication stalled or failed");
+            return;
+        }
+        cpuTime += std::clock() - start;
+    }
+
+    state.SetItemsProcessed(itemsReceived);
+    state.SetBytesProcessed(bytesReceived);
+    state.counters["CPUNsPerItem"] =
+            (double(cpuTime) / CLOCKS_PER_SEC) * 1e9 / itemsReceived;
+}
+
+static void ReplicateArguments(benchmark::internal::Benchmark* b) {
+    const int aggressive = int(DcpBench::FlowControl::Aggressive);
+    for (int backfill : {0, 1}) {
+        // Scaling with the number of vBuckets and the item size, using the
+        // default flow control policy.
+        for (int vbuckets : {1, 16, 64}) {
+            for (int valueSize : {128, 1024, 4096}) {
+                b->Args({vbuckets, valueSize, 0, aggressive, backfill});
+            }
+        }
+        // Compression and the flow control policies, with 16 vBuckets and
+        // 1KB values.
+        for (int compression : {0, 1}) {
+            for (int policy = 0; policy <= aggressive; ++policy) {
+                if (compression == 0 && policy == aggressive) {
+                    continue; // Already covered above.
+                }
+                b->Args({16, 1024, compression, policy, backfill});
+            }
+        }
+    }
+}
+
+BENCHMARK_REGISTER_F(DcpBench, Replicate)
+        ->Apply(ReplicateArguments)
+        ->Iterations(1)
+        ->Unit(benchmark::kMillisecond);
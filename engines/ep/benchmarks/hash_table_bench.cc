@@ -0,0 +1,340 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmarks relating to the HashTable and StoredValue classes.
+ */
+
+#include "benchmark_memory_tracker.h"
+#include "hash_table.h"
+#include "item.h"
+#include "stats.h"
+#include "stored_value_factories.h"
+#include "tests/module_tests/test_helpers.h"
+
+#include <benchmark/benchmark.h>
+#include <programs/engine_testapp/mock_server.h>
+#include <valgrind/valgrind.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+/**
+ * Fixture which owns a HashTable and the keys of the items stored in it.
+ *
+ * For multi-threaded benchmarks the HashTable is shared by all of the
+ * threads; it is created and populated by thread 0 (the other threads
+ * wait in the first call to KeepRunning() until it is done).
+ */
+class HashTableBench : public benchmark::Fixture {
+public:
+    void SetUp(const benchmark::State& state) override {
+        if (state.thread_index == 0) {
+            memoryTracker = BenchmarkMemoryTracker::getInstance(
+                    *get_mock_server_api()->alloc_hooks);
+            memoryTracker->reset();
+        }
+    }
+
+    void TearDown(const benchmark::State& state) override {
+        if (state.thread_index == 0) {
+            ht.reset();
+            keys.clear();
+            keys.shrink_to_fit();
+            memoryTracker->destroyInstance();
+        }
+    }
+
+protected:
+    enum class Factory { StoredValue, OrderedStoredValue };
+
+    void createHashTable(Factory factory, size_t initialSize, size_t locks) {
+        std::unique_ptr<AbstractStoredValueFactory> svFactory;
+        if (factory == Factory::OrderedStoredValue) {
+            svFactory = std::make_unique<OrderedStoredValueFactory>(stats);
+        } else {
+            svFactory = std::make_unique<StoredValueFactory>(stats);
+        }
+        ht = std::make_unique<HashTable>(stats,
+                                         std::move(svFactory),
+                                         initialSize,
+                                         locks,
+                                         HashTable::EvictionPolicy::lru2Bit);
+    }
+
+    /**
+     * Create the key for the given id. The keys are shaped like typical
+     * application keys (a type prefix followed by a zero padded id, ~20
+     * bytes).
+     */
+    static StoredDocKey makeKey(size_t id) {
+        char key[32];
+        snprintf(key, sizeof(key), "user::%012zu", id);
+        return makeStoredDocKey(key);
+    }
+
+    void createKeys(size_t count) {
+        keys.clear();
+        keys.reserve(count);
+        for (size_t ii = 0; ii < count; ++ii) {
+            keys.emplace_back(makeKey(ii));
+        }
+    }
+
+    /// Store all of the keys in the HashTable, with values of the given size
+    void populate(size_t valueSize) {
+        const std::string value(valueSize, 'x');
+        for (const auto& key : keys) {
+            Item item(key, 0, 0, value.data(), value.size());
+            ht->set(item);
+        }
+    }
+
+    /// Record the bucket depth statistics of the HashTable as counters
+    void addDepthCounters(benchmark::State& state, const std::string& suffix) {
+        HashTableDepthStatVisitor depthVisitor;
+        ht->visitDepth(depthVisitor);
+        state.counters["MaxDepth" + suffix] = depthVisitor.max;
+        state.counters["AvgDepth" + suffix] =
+                double(ht->getNumItems()) / ht->getSize();
+    }
+
+    /**
+     * Number of items to use for the multi-threaded benchmarks; large enough
+     * to exceed the CPU caches, but small enough to be quick to populate.
+     */
+    static size_t getSharedTableItems() {
+        return RUNNING_ON_VALGRIND ? 100 : 1000000;
+    }
+
+    EPStats stats;
+    std::unique_ptr<HashTable> ht;
+    std::vector<StoredDocKey> keys;
+    BenchmarkMemoryTracker* memoryTracker = nullptr;
+};
+
+/**
+ * Insert N items into an (appropriately sized) empty HashTable, and report
+ * the memory used per item.
+ *
+ * Arguments: number of items, StoredValueFactory type (0 = StoredValue,
+ * 1 = OrderedStoredValue), value size.
+ */
+BENCHMARK_DEFINE_F(HashTableBench, Insert)(benchmark::State& state) {
+    const size_t itemCount = state.range(0);
+    const auto factory = Factory(state.range(1));
+    const size_t valueSize = state.range(2);
+    state.SetLabel(factory == Factory::StoredValue ? "StoredValue"
+                                                   : "OrderedStoredValue");
+    createKeys(itemCount);
+
+    size_t bytesPerItem = 0;
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        ht.reset();
+        createHashTable(factory, itemCount, 47);
+        const size_t baseBytes = memoryTracker->getCurrentAlloc();
+        state.ResumeTiming();
+
+        populate(valueSize);
+
+        state.PauseTiming();
+        bytesPerItem =
+                (memoryTracker->getCurrentAlloc() - baseBytes) / itemCount;
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(state.iterations() * itemCount);
+    // Bytes allocated per item stored (StoredValue + key + value Blob)
+    state.counters["BytesPerItem"] = bytesPerItem;
+    // Per-item overhead over the value itself
+    state.counters["OverheadPerItem"] = bytesPerItem - valueSize;
+    addDepthCounters(state, "");
+}
+
+/**
+ * Look up random (existing) keys in a shared HashTable from multiple
+ * threads.
+ *
+ * Arguments: number of locks in the HashTable.
+ */
+BENCHMARK_DEFINE_F(HashTableBench, Find)(benchmark::State& state) {
+    const size_t itemCount = getSharedTableItems();
+    if (state.thread_index == 0) {
+        createKeys(itemCount);
+        createHashTable(Factory::StoredValue, itemCount, state.range(0));
+        populate(256);
+    }
+
+    std::default_random_engine gen(state.thread_index);
+    std::uniform_int_distribution<size_t> dist(0, itemCount - 1);
+    while (state.KeepRunning()) {
+        auto* v = ht->find(
+                keys[dist(gen)], TrackReference::Yes, WantsDeleted::No);
+        benchmark::DoNotOptimize(v);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/**
+ * Update random (existing) keys in a shared HashTable from multiple
+ * threads.
+ *
+ * Arguments: number of locks in the HashTable.
+ */
+BENCHMARK_DEFINE_F(HashTableBench, Update)(benchmark::State& state) {
+    const size_t itemCount = getSharedTableItems();
+    if (state.thread_index == 0) {
+        createKeys(itemCount);
+        createHashTable(Factory::StoredValue, itemCount, state.range(0));
+        populate(256);
+    }
+
+    // Create the items up front (for a random subset of the keys) so we
+    // only measure the HashTable. Note that only thread 0 may touch the
+    // shared members before the first call to KeepRunning().
+    std::default_random_engine gen(state.thread_index);
+    std::uniform_int_distribution<size_t> dist(0, itemCount - 1);
+    const std::string value(256, 'y');
+    std::vector<Item> items;
+    for (int ii = 0; ii < 1024; ++ii) {
+        items.emplace_back(
+                makeKey(dist(gen)), 0, 0, value.data(), value.size());
+    }
+
+    size_t next = 0;
+    while (state.KeepRunning()) {
+        ht->set(items[next++ % items.size()]);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/**
+ * Delete all of the items from a populated HashTable with unlocked_del.
+ *
+ * Arguments: number of items.
+ */
+BENCHMARK_DEFINE_F(HashTableBench, Delete)(benchmark::State& state) {
+    const size_t itemCount = state.range(0);
+    createKeys(itemCount);
+
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        ht.reset();
+        createHashTable(Factory::StoredValue, itemCount, 47);
+        populate(256);
+        state.ResumeTiming();
+
+        for (const auto& key : keys) {
+            auto hbl = ht->getLockedBucket(key);
+            ht->unlocked_del(hbl, key);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * itemCount);
+}
+
+/**
+ * Resize a HashTable which has been populated far beyond its initial size,
+ * and report the bucket depths before and after the resize.
+ *
+ * Arguments: number of items.
+ */
+BENCHMARK_DEFINE_F(HashTableBench, Resize)(benchmark::State& state) {
+    const size_t itemCount = state.range(0);
+    createKeys(itemCount);
+
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        ht.reset();
+        // Start with an average chain length of 16
+        createHashTable(Factory::StoredValue, itemCount / 16, 47);
+        populate(256);
+        addDepthCounters(state, "Before");
+        state.ResumeTiming();
+
+        ht->resize();
+    }
+    state.SetItemsProcessed(state.iterations() * itemCount);
+    addDepthCounters(state, "After");
+}
+
+/**
+ * The item counts for the benchmarks which populate a HashTable of their
+ * own. The larger counts need many GB of memory and take minutes per run,
+ * so they are only used if EP_BENCH_LARGE_HASHTABLES is set.
+ */
+static std::vector<int> getItemCounts() {
+    if (RUNNING_ON_VALGRIND) {
+        return {100};
+    }
+    if (getenv("EP_BENCH_LARGE_HASHTABLES") != nullptr) {
+        return {1000000, 10000000, 100000000};
+    }
+    return {100000, 1000000};
+}
+
+static void InsertArguments(benchmark::internal::Benchmark* b) {
+    for (int items : getItemCounts()) {
+        for (int factory : {0, 1}) {
+            for (int valueSize : {32, 256, 4096}) {
+                if (size_t(items) * valueSize > 16ull * 1024 * 1024 * 1024) {
+                    // Don't need more than 16GB of values for a baseline
+                    continue;
+                }
+                b->Args({items, factory, valueSize});
+            }
+        }
+    }
+}
+
+/// Arguments for the benchmarks which populate the HashTable with 256 byte
+/// values
+static void ItemCountArguments(benchmark::internal::Benchmark* b) {
+    for (int items : getItemCounts()) {
+        if (size_t(items) * 256 > 16ull * 1024 * 1024 * 1024) {
+            continue;
+        }
+        b->Args({items});
+    }
+}
+
+BENCHMARK_REGISTER_F(HashTableBench, Insert)
+        ->Apply(InsertArguments)
+        ->Unit(benchmark::kMillisecond);
+
+// ht_locks values: a single lock, the default (47) and a large prime
+BENCHMARK_REGISTER_F(HashTableBench, Find)
+        ->ThreadRange(1, 16)
+        ->Args({1})
+        ->Args({47})
+        ->Args({1021});
+
+BENCHMARK_REGISTER_F(HashTableBench, Update)
+        ->ThreadRange(1, 16)
+        ->Args({1})
+        ->Args({47})
+        ->Args({1021});
+
+BENCHMARK_REGISTER_F(HashTableBench, Delete)
+        ->Apply(ItemCountArguments)
+        ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_REGISTER_F(HashTableBench, Resize)
+        ->Apply(ItemCountArguments)
+        ->Unit(benchmark::kMillisecond);
@@ -17,7 +17,9 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 
 #include <phosphor/phosphor.h>
 #include <platform/make_unique.h>
@@ -78,7 +80,11 @@ public:
                     "INFO: Skipping expired/deleted item: %" PRIu64,
                     v.getBySeqno());
             } else {
-                accessed.push_back(StoredDocKey(v.getKey()));
+                // The counter is 8 bits wide (stored in a uint16_t)
+                const auto freq = std::min(
+                        v.getFreqCounterValue(),
+                        uint16_t(std::numeric_limits<uint8_t>::max()));
+                accessed.emplace_back(StoredDocKey(v.getKey()), uint8_t(freq));
                 return ++items_scanned < items_to_scan;
             }
         }
@@ -87,8 +93,15 @@ public:
 
     void update() {
         if (log != nullptr) {
-            for (auto it = accessed.begin(); it != accessed.end(); ++it) {
-                log->newItem(currentBucket->getId(), *it);
+            // Log the hottest items first so that warmup finds them early
+            // in the file.
+            std::stable_sort(accessed.begin(),
+                             accessed.end(),
+                             [](const AccessedItem& a, const AccessedItem& b) {
+                                 return a.second > b.second;
+                             });
+            for (const auto& item : accessed) {
+                log->newItem(currentBucket->getId(), item.first, item.second);
             }
         }
         accessed.clear();
@@ -202,7 +215,9 @@ private:
     std::string name;
     uint16_t shardID;
 
-    std::vector<StoredDocKey> accessed;
+    // The key and frequency counter value of the items to log
+    using AccessedItem = std::pair<StoredDocKey, uint8_t>;
+    std::vector<AccessedItem> accessed;
 
     std::unique_ptr<MutationLog> log;
     std::atomic<bool> &stateFinalizer;
@@ -0,0 +1,475 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+
+#include "couch-kvstore/couch-fs-async.h"
+
+#include <fcntl.h>
+#include <platform/make_unique.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+
+#ifdef EP_USE_LIBURING
+#include <liburing.h>
+#include <unistd.h>
+#endif
+
+const size_t AsyncReadOps::MaxPrefetches;
+const size_t AsyncReadOps::MaxPrefetchSize;
+const size_t AsyncReadOps::SubmitBatch;
+
+#ifdef POSIX_FADV_WILLNEED
+const couchstore_file_advice_t AsyncReadOps::WillNeed =
+        couchstore_file_advice_t(POSIX_FADV_WILLNEED);
+#else
+const couchstore_file_advice_t AsyncReadOps::WillNeed =
+        couchstore_file_advice_t(3);
+#endif
+
+/// Prefetched ranges are aligned to this, so block sized reads hit them
+static const cs_off_t prefetchAlignment = 4096;
+
+struct AsyncReadOps::Ring {
+#ifdef EP_USE_LIBURING
+    ~Ring() {
+        if (initialised) {
+            io_uring_queue_exit(&ring);
+        }
+    }
+
+    io_uring ring;
+    bool initialised = false;
+#endif
+    /// Queued reads which haven't been submitted yet, in queue order
+    std::deque<Prefetch*> unsubmitted;
+    /// Number of submitted reads which haven't been reaped yet
+    size_t inflight = 0;
+    /// False once submitting to or waiting on the ring failed
+    bool usable = true;
+};
+
+bool AsyncReadOps::isAvailable() {
+#ifdef EP_USE_LIBURING
+    // The kernel may not support io_uring (or a seccomp policy may deny
+    // it), so check once by trying to set up a ring.
+    static const bool available = []() {
+        io_uring ring;
+        if (io_uring_queue_init(1, &ring, 0) != 0) {
+            return false;
+        }
+        io_uring_queue_exit(&ring);
+        return true;
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+AsyncReadOps::AsyncFile::AsyncFile(couch_file_handle orig_handle)
+    : orig_handle(orig_handle) {
+}
+
+AsyncReadOps::AsyncFile::~AsyncFile() {
+#ifdef EP_USE_LIBURING
+    if (fd != -1) {
+        ::close(fd);
+    }
+#endif
+}
+
+#ifdef EP_USE_LIBURING
+std::shared_ptr<AsyncReadOps::Ring> AsyncReadOps::getThreadRing() {
+    thread_local std::shared_ptr<Ring> threadRing;
+    if (threadRing && !threadRing->usable && threadRing.use_count() == 1) {
+        // No file uses the failed ring any more; start over with a new one
+        threadRing.reset();
+    }
+    if (!threadRing) {
+        auto ring = std::make_shared<Ring>();
+        if (io_uring_queue_init(MaxPrefetches, &ring->ring, 0) != 0) {
+            return {};
+        }
+        ring->initialised = true;
+        threadRing = std::move(ring);
+    }
+    return threadRing;
+}
+
+bool AsyncReadOps::prefetch(AsyncFile& file, cs_off_t offset, size_t length) {
+    if (!file.usable || !isAvailable()) {
+        return false;
+    }
+    if (!file.ring) {
+        file.ring = getThreadRing();
+        if (file.ring) {
+            file.fd = ::open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (!file.ring || file.fd == -1) {
+            file.ring.reset();
+            file.usable = false;
+            return false;
+        }
+    }
+    auto& ring = *file.ring;
+    if (!ring.usable) {
+        return false;
+    }
+
+    const cs_off_t start = offset - (offset % prefetchAlignment);
+    cs_off_t end = offset + length;
+    end += (prefetchAlignment - (end % prefetchAlignment)) % prefetchAlignment;
+    for (const auto& prefetch : file.prefetches) {
+        if (start >= prefetch->offset &&
+            end <= prefetch->offset + cs_off_t(prefetch->length)) {
+            return true;
+        }
+    }
+
+    if (file.prefetches.size() >= MaxPrefetches) {
+        // Make space by dropping the oldest completed prefetch
+        auto it = std::find_if(file.prefetches.begin(),
+                               file.prefetches.end(),
+                               [](const std::unique_ptr<Prefetch>& p) {
+                                   return p->done;
+                               });
+        if (it == file.prefetches.end()) {
+            return false;
+        }
+        file.prefetches.erase(it);
+    }
+
+    // The ring is shared by the files of the thread; never have more reads
+    // outstanding than the completion queue can hold
+    if (ring.unsubmitted.size() + ring.inflight >= MaxPrefetches) {
+        return false;
+    }
+    auto* sqe = io_uring_get_sqe(&ring.ring);
+    if (sqe == nullptr) {
+        return false;
+    }
+    auto prefetch = std::make_unique<Prefetch>();
+    prefetch->file = &file;
+    prefetch->offset = start;
+    prefetch->length = end - start;
+    prefetch->buffer.reset(new uint8_t[prefetch->length]);
+    io_uring_prep_read(sqe,
+                       file.fd,
+                       prefetch->buffer.get(),
+                       prefetch->length,
+                       prefetch->offset);
+    io_uring_sqe_set_data(sqe, prefetch.get());
+    ring.unsubmitted.push_back(prefetch.get());
+    ++file.pending;
+    file.prefetches.push_back(std::move(prefetch));
+    if (ring.unsubmitted.size() >= SubmitBatch) {
+        submit(ring);
+    }
+    return true;
+}
+
+void AsyncReadOps::submit(Ring& ring) {
+    if (ring.unsubmitted.empty()) {
+        return;
+    }
+    int submitted = ring.usable ? io_uring_submit(&ring.ring) : -1;
+    if (submitted < int(ring.unsubmitted.size())) {
+        // The reads which weren't submitted will never complete (and can't
+        // be cancelled, as they're still in the submission queue); fail
+        // them and stop using the ring so they're never submitted later on.
+        ring.usable = false;
+        submitted = std::max(submitted, 0);
+    }
+
+    // Reads are submitted in the order they were queued
+    for (auto* prefetch : ring.unsubmitted) {
+        if (submitted > 0) {
+            prefetch->submitted = true;
+            --submitted;
+            ++ring.inflight;
+        } else {
+            prefetch->done = true;
+            prefetch->result = -EIO;
+            --prefetch->file->pending;
+        }
+    }
+    ring.unsubmitted.clear();
+}
+
+void AsyncReadOps::reap(Ring& ring) {
+    io_uring_cqe* cqes[MaxPrefetches];
+    const auto count =
+            io_uring_peek_batch_cqe(&ring.ring, cqes, MaxPrefetches);
+    for (unsigned ii = 0; ii < count; ++ii) {
+        auto* prefetch =
+                static_cast<Prefetch*>(io_uring_cqe_get_data(cqes[ii]));
+        prefetch->result = cqes[ii]->res;
+        prefetch->done = true;
+        --prefetch->file->pending;
+        --ring.inflight;
+    }
+    io_uring_cq_advance(&ring.ring, count);
+}
+
+void AsyncReadOps::wait(AsyncFile& file, Prefetch& prefetch) {
+    auto& ring = *file.ring;
+    if (!prefetch.submitted) {
+        submit(ring);
+    }
+    // Once the ring has failed its completions are never reaped (their
+    // prefetches may be gone); drain() deals with the buffer
+    while (!prefetch.done && ring.usable) {
+        io_uring_cqe* cqe;
+        const int rv = io_uring_wait_cqe(&ring.ring, &cqe);
+        if (rv == 0) {
+            reap(ring);
+        } else if (rv != -EINTR) {
+            ring.usable = false;
+        }
+    }
+}
+
+void AsyncReadOps::drain(AsyncFile& file) {
+    if (file.ring) {
+        auto& ring = *file.ring;
+        // Queued reads would otherwise be submitted with the next batch
+        submit(ring);
+        while (file.pending > 0 && ring.usable) {
+            io_uring_cqe* cqe;
+            const int rv = io_uring_wait_cqe(&ring.ring, &cqe);
+            if (rv == 0) {
+                reap(ring);
+            } else if (rv != -EINTR) {
+                ring.usable = false;
+            }
+        }
+        if (file.pending > 0) {
+            // The kernel may still write to the buffers of the reads which
+            // didn't complete, so leak them rather than free them.
+            for (auto& prefetch : file.prefetches) {
+                if (!prefetch->done) {
+                    prefetch->buffer.release();
+                }
+            }
+        }
+    }
+    file.prefetches.clear();
+    file.pending = 0;
+}
+
+#else
+bool AsyncReadOps::prefetch(AsyncFile&, cs_off_t, size_t) {
+    return false;
+}
+
+void AsyncReadOps::submit(Ring&) {
+}
+
+void AsyncReadOps::reap(Ring&) {
+}
+
+void AsyncReadOps::wait(AsyncFile&, Prefetch&) {
+}
+
+void AsyncReadOps::drain(AsyncFile& file) {
+    file.prefetches.clear();
+}
+#endif
+
+couch_file_handle AsyncReadOps::constructor(couchstore_error_info_t* errinfo) {
+    auto* file = new AsyncFile(wrapped_ops.constructor(errinfo));
+    return reinterpret_cast<couch_file_handle>(file);
+}
+
+couchstore_error_t AsyncReadOps::open(couchstore_error_info_t* errinfo,
+                                      couch_file_handle* handle,
+                                      const char* path,
+                                      int oflag) {
+    auto* file = reinterpret_cast<AsyncFile*>(*handle);
+    file->path = path;
+    return wrapped_ops.open(errinfo, &file->orig_handle, path, oflag);
+}
+
+couchstore_error_t AsyncReadOps::close(couchstore_error_info_t* errinfo,
+                                       couch_file_handle handle) {
+    auto* file = reinterpret_cast<AsyncFile*>(handle);
+    drain(*file);
+    return wrapped_ops.close(errinfo, file->orig_handle);
+}
+
+couchstore_error_t AsyncReadOps::set_periodic_sync(couch_file_handle handle,
+                                                   uint64_t period_bytes) {
+    auto* file = reinterpret_cast<AsyncFile*>(handle);
+    return wrapped_ops.set_periodic_sync(file->orig_handle, period_bytes);
+}
+
+ssize_t AsyncReadOps::pread(couchstore_error_info_t* errinfo,
+                            couch_file_handle handle,
+                            void* buf,
+                            size_t nbytes,
+                            cs_off_t offset) {
+    auto* file = reinterpret_cast<AsyncFile*>(handle);
+    const cs_off_t end = offset + nbytes;
+    for (auto& prefetch : file->prefetches) {
+        if (offset < prefetch->offset ||
+            end > prefetch->offset + cs_off_t(prefetch->length)) {
+            continue;
+        }
+        wait(*file, *prefetch);
+        // A short (or failed) read is left to the wrapped ops to report
+        if (prefetch->done && prefetch->result >= end - prefetch->offset) {
+            std::memcpy(buf,
+                        prefetch->buffer.get() + (offset - prefetch->offset),
+                        nbytes);
+            return nbytes;
+        }
+        break;
+    }
+    return wrapped_ops.pread(errinfo, file->orig_handle, buf, nbytes, offset);
+}
+
+ssize_t AsyncReadOps::pwrite(couchstore_error_info_t* errinfo,
+                             couch_file_handle handle,
+                             const void* buf,
+                             size_t nbytes,
+                             cs_off_t offset) {
+    auto* file = reinterpret_cast<AsyncFile*>(handle);
+    return wrapped_ops.pwrite(errinfo, file->orig_handle, buf, nbytes, offset);
+}
+
+cs_off_t AsyncReadOps::goto_eof(couchstore_error_info_t* errinfo,
+                                couch_file_handle handle) {
+    auto* file = reinterpret_cast<AsyncFile*>(handle);
+    return wrapped_ops.goto_eof(errinfo, file->orig_handle);
+}
+
+couchstore_error_t AsyncReadOps::sync(couchstore_error_info_t* errinfo,
+                                      couch_file_handle handle) {
+    auto* file = reinterpret_cast<AsyncFile*>(handle);
+    return wrapped_ops.sync(errinfo, file->orig_handle);
+}
+
+couchstore_error_t AsyncReadOps::advise(couchstore_error_info_t* errinfo,
+                                        couch_file_handle handle,
+                                        cs_off_t offset,
+                                        cs_off_t len,
+                                        couchstore_file_advice_t advice) {
+    auto* file = reinterpret_cast<AsyncFile*>(handle);
+    if (advice == WillNeed && len > 0 && size_t(len) <= MaxPrefetchSize &&
+        prefetch(*file, offset, len)) {
+        return COUCHSTORE_SUCCESS;
+    }
+    return wrapped_ops.advise(errinfo, file->orig_handle, offset, len, advice);
+}
+
+FileOpsInterface::FHStats* AsyncReadOps::get_stats(couch_file_handle handle) {
+    auto* file = reinterpret_cast<AsyncFile*>(handle);
+    return wrapped_ops.get_stats(file->orig_handle);
+}
+
+void AsyncReadOps::destructor(couch_file_handle handle) {
+    auto* file = reinterpret_cast<AsyncFile*>(handle);
+    drain(*file);
+    wrapped_ops.destructor(file->orig_handle);
+    delete file;
+}
+
+void ReadHintOps::willNeedChunk(uint64_t position, size_t size) {
+    if (handle == nullptr || size == 0) {
+        return;
+    }
+    // On disk a chunk has an 8 byte header (length and CRC), and a one byte
+    // marker is inserted at the start of every 4KB block it spans.
+    const size_t raw = size + 8;
+    const size_t length = raw + raw / 4095 + 1;
+    couchstore_error_info_t errinfo;
+    wrapped_ops.advise(
+            &errinfo, handle, position, length, AsyncReadOps::WillNeed);
+}
+
+couch_file_handle ReadHintOps::constructor(couchstore_error_info_t* errinfo) {
+    handle = wrapped_ops.constructor(errinfo);
+    return handle;
+}
+
+couchstore_error_t ReadHintOps::open(couchstore_error_info_t* errinfo,
+                                     couch_file_handle* h,
+                                     const char* path,
+                                     int oflag) {
+    auto result = wrapped_ops.open(errinfo, h, path, oflag);
+    handle = *h;
+    return result;
+}
+
+couchstore_error_t ReadHintOps::close(couchstore_error_info_t* errinfo,
+                                      couch_file_handle h) {
+    return wrapped_ops.close(errinfo, h);
+}
+
+couchstore_error_t ReadHintOps::set_periodic_sync(couch_file_handle h,
+                                                  uint64_t period_bytes) {
+    return wrapped_ops.set_periodic_sync(h, period_bytes);
+}
+
+ssize_t ReadHintOps::pread(couchstore_error_info_t* errinfo,
+                           couch_file_handle h,
+                           void* buf,
+                           size_t nbytes,
+                           cs_off_t offset) {
+    return wrapped_ops.pread(errinfo, h, buf, nbytes, offset);
+}
+
+ssize_t ReadHintOps::pwrite(couchstore_error_info_t* errinfo,
+                            couch_file_handle h,
+                            const void* buf,
+                            size_t nbytes,
+                            cs_off_t offset) {
+    return wrapped_ops.pwrite(errinfo, h, buf, nbytes, offset);
+}
+
+cs_off_t ReadHintOps::goto_eof(couchstore_error_info_t* errinfo,
+                               couch_file_handle h) {
+    return wrapped_ops.goto_eof(errinfo, h);
+}
+
+couchstore_error_t ReadHintOps::sync(couchstore_error_info_t* errinfo,
+                                     couch_file_handle h) {
+    return wrapped_ops.sync(errinfo, h);
+}
+
+couchstore_error_t ReadHintOps::advise(couchstore_error_info_t* errinfo,
+                                       couch_file_handle h,
+                                       cs_off_t offset,
+                                       cs_off_t len,
+                                       couchstore_file_advice_t advice) {
+    return wrapped_ops.advise(errinfo, h, offset, len, advice);
+}
+
+FileOpsInterface::FHStats* ReadHintOps::get_stats(couch_file_handle h) {
+    return wrapped_ops.get_stats(h);
+}
+
+void ReadHintOps::destructor(couch_file_handle h) {
+    if (h == handle) {
+        handle = nullptr;
+    }
+    wrapped_ops.destructor(h);
+}
@@ -0,0 +1,212 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <libcouchstore/couch_db.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * FileOpsInterface implementation which turns WILLNEED advice (see
+ * AsyncReadOps::WillNeed) into asynchronous reads.
+ *
+ * couchstore only issues blocking reads, so a thread looking up many
+ * documents waits for one disk read at a time. If the caller knows which
+ * ranges it's about to read (e.g. the bodies of the documents found by
+ * couchstore_docinfos_by_id) it can advise WILLNEED for each of them first;
+ * each hint queues a read on the calling thread's io_uring, and the queued
+ * reads are submitted in batches. Setting up a ring is relatively costly
+ * and a Db is typically opened for a single operation (e.g. a bgfetch
+ * batch), so each thread keeps one ring for all of the files it reads; a
+ * file's prefetches and reads must be done by one thread at a time. A later pread() which falls within a
+ * prefetched range waits for (and reaps, together with any others which
+ * completed) that read instead of going to disk.
+ *
+ * Everything else (and every read when io_uring isn't available, either at
+ * build time or in the running kernel) is passed to the wrapped ops; so is
+ * the WILLNEED advice itself in that case, which for the default ops is a
+ * posix_fadvise() starting kernel readahead of the range.
+ */
+class AsyncReadOps : public FileOpsInterface {
+public:
+    /// Maximum number of prefetched ranges held per file
+    static const size_t MaxPrefetches = 64;
+
+    /// Ranges larger than this aren't prefetched by this layer
+    static const size_t MaxPrefetchSize = 1024 * 1024;
+
+    /// Queued reads are submitted once this many are pending
+    static const size_t SubmitBatch = 16;
+
+    /**
+     * couchstore only names the advice it uses itself (EVICT); the default
+     * ops pass the value to posix_fadvise(), so this is POSIX_FADV_WILLNEED.
+     */
+    static const couchstore_file_advice_t WillNeed;
+
+    explicit AsyncReadOps(FileOpsInterface& ops) : wrapped_ops(ops) {
+    }
+
+    /// @return true if prefetches are done with io_uring
+    static bool isAvailable();
+
+    couch_file_handle constructor(couchstore_error_info_t* errinfo) override;
+    couchstore_error_t open(couchstore_error_info_t* errinfo,
+                            couch_file_handle* handle,
+                            const char* path,
+                            int oflag) override;
+    couchstore_error_t close(couchstore_error_info_t* errinfo,
+                             couch_file_handle handle) override;
+    couchstore_error_t set_periodic_sync(couch_file_handle handle,
+                                         uint64_t period_bytes) override;
+    ssize_t pread(couchstore_error_info_t* errinfo,
+                  couch_file_handle handle,
+                  void* buf,
+                  size_t nbytes,
+                  cs_off_t offset) override;
+    ssize_t pwrite(couchstore_error_info_t* errinfo,
+                   couch_file_handle handle,
+                   const void* buf,
+                   size_t nbytes,
+                   cs_off_t offset) override;
+    cs_off_t goto_eof(couchstore_error_info_t* errinfo,
+                      couch_file_handle handle) override;
+    couchstore_error_t sync(couchstore_error_info_t* errinfo,
+                            couch_file_handle handle) override;
+    couchstore_error_t advise(couchstore_error_info_t* errinfo,
+                              couch_file_handle handle,
+                              cs_off_t offset,
+                              cs_off_t len,
+                              couchstore_file_advice_t advice) override;
+    FHStats* get_stats(couch_file_handle handle) override;
+    void destructor(couch_file_handle handle) override;
+
+protected:
+    struct AsyncFile;
+
+    struct Prefetch {
+        /// The file the read is for
+        AsyncFile* file = nullptr;
+        cs_off_t offset;
+        size_t length;
+        std::unique_ptr<uint8_t[]> buffer;
+        bool submitted = false;
+        bool done = false;
+        /// Bytes read, or -errno; only valid once done
+        ssize_t result = 0;
+    };
+
+    struct Ring;
+
+    struct AsyncFile {
+        explicit AsyncFile(couch_file_handle orig_handle);
+        ~AsyncFile();
+
+        couch_file_handle orig_handle;
+        std::string path;
+        /// Read-only descriptor used for the async reads (opened lazily)
+        int fd = -1;
+        /// The ring of the thread which first prefetched from the file
+        std::shared_ptr<Ring> ring;
+        /// False once setting up the descriptor or ring failed
+        bool usable = true;
+        std::vector<std::unique_ptr<Prefetch>> prefetches;
+        /// Number of prefetches which haven't completed yet
+        size_t pending = 0;
+    };
+
+    /**
+     * Get the calling thread's ring, setting it up if this is the first
+     * prefetch of the thread (or the previous ring failed).
+     * @return the ring, or nullptr if it couldn't be set up
+     */
+    static std::shared_ptr<Ring> getThreadRing();
+
+    /// Queue a read of the given range; returns false if it wasn't queued
+    bool prefetch(AsyncFile& file, cs_off_t offset, size_t length);
+
+    /// Submit the queued reads (of all of the files using the ring)
+    void submit(Ring& ring);
+
+    /// Record the completed reads
+    void reap(Ring& ring);
+
+    /// Wait for the given prefetch to complete
+    void wait(AsyncFile& file, Prefetch& prefetch);
+
+    /// Wait for all prefetches of the file (so the buffers can be freed)
+    void drain(AsyncFile& file);
+
+    FileOpsInterface& wrapped_ops;
+};
+
+/**
+ * Pass-through FileOpsInterface used to open a single Db, which remembers
+ * the file handle couchstore created so the caller can send read hints
+ * for that file down the ops stack.
+ */
+class ReadHintOps : public FileOpsInterface {
+public:
+    explicit ReadHintOps(FileOpsInterface& ops) : wrapped_ops(ops) {
+    }
+
+    /**
+     * Hint that the couchstore chunk (e.g. a document body) at the given
+     * position of size bytes is about to be read.
+     */
+    void willNeedChunk(uint64_t position, size_t size);
+
+    couch_file_handle constructor(couchstore_error_info_t* errinfo) override;
+    couchstore_error_t open(couchstore_error_info_t* errinfo,
+                            couch_file_handle* handle,
+                            const char* path,
+                            int oflag) override;
+    couchstore_error_t close(couchstore_error_info_t* errinfo,
+                             couch_file_handle handle) override;
+    couchstore_error_t set_periodic_sync(couch_file_handle handle,
+                                         uint64_t period_bytes) override;
+    ssize_t pread(couchstore_error_info_t* errinfo,
+                  couch_file_handle handle,
+                  void* buf,
+                  size_t nbytes,
+                  cs_off_t offset) override;
+    ssize_t pwrite(couchstore_error_info_t* errinfo,
+                   couch_file_handle handle,
+                   const void* buf,
+                   size_t nbytes,
+                   cs_off_t offset) override;
+    cs_off_t goto_eof(couchstore_error_info_t* errinfo,
+                      couch_file_handle handle) override;
+    couchstore_error_t sync(couchstore_error_info_t* errinfo,
+                            couch_file_handle handle) override;
+    couchstore_error_t advise(couchstore_error_info_t* errinfo,
+                              couch_file_handle handle,
+                              cs_off_t offset,
+                              cs_off_t len,
+                              couchstore_file_advice_t advice) override;
+    FHStats* get_stats(couch_file_handle handle) override;
+    void destructor(couch_file_handle handle) override;
+
+protected:
+    FileOpsInterface& wrapped_ops;
+    couch_file_handle handle = nullptr;
+};
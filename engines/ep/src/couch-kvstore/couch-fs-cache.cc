@@ -0,0 +1,316 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+
+#include "couch-kvstore/couch-fs-cache.h"
+#include "kvstore.h"
+
+#include <platform/make_unique.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <map>
+
+const size_t BlockCache::BlockSize;
+const size_t BlockCacheOps::MaxCachedRead;
+const size_t BlockCacheOps::MaxReadBlocks;
+
+std::shared_ptr<BlockCache> BlockCache::get(const std::string& dbname,
+                                            size_t capacity) {
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<BlockCache>> caches;
+
+    std::lock_guard<std::mutex> lh(mutex);
+    auto cache = caches[dbname].lock();
+    if (!cache) {
+        cache = std::make_shared<BlockCache>(capacity);
+        caches[dbname] = cache;
+    }
+    return cache;
+}
+
+size_t BlockCache::KeyHash::operator()(const Key& key) const {
+    std::hash<uint64_t> hash;
+    return hash(key.block) ^ (hash(key.inode) << 1) ^ (hash(key.device) << 2);
+}
+
+BlockCache::BlockCache(size_t capacity, size_t numShards)
+    : capacity(capacity),
+      shardBlocks(std::max(size_t(1), capacity / BlockSize / numShards)) {
+    for (size_t ii = 0; ii < numShards; ++ii) {
+        shards.emplace_back(std::make_unique<Shard>());
+    }
+}
+
+BlockCache::Shard& BlockCache::getShard(const Key& key) {
+    // Consecutive blocks of a file go to different shards
+    return *shards[KeyHash()(key) % shards.size()];
+}
+
+bool BlockCache::lookup(const Key& key, uint8_t* buf) {
+    auto& shard = getShard(key);
+    std::lock_guard<std::mutex> lh(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    std::copy(it->second->data.begin(), it->second->data.end(), buf);
+    return true;
+}
+
+void BlockCache::insert(const Key& key, const uint8_t* data) {
+    auto& shard = getShard(key);
+    std::lock_guard<std::mutex> lh(shard.mutex);
+    if (shard.index.count(key) != 0) {
+        // Another reader got there first
+        return;
+    }
+
+    auto ghost = shard.ghostIndex.find(key);
+    if (ghost == shard.ghostIndex.end()) {
+        // First miss; only remember the key
+        shard.ghosts.push_front(key);
+        shard.ghostIndex.emplace(key, shard.ghosts.begin());
+        if (shard.ghosts.size() > shardBlocks) {
+            shard.ghostIndex.erase(shard.ghosts.back());
+            shard.ghosts.pop_back();
+        }
+        return;
+    }
+    shard.ghosts.erase(ghost->second);
+    shard.ghostIndex.erase(ghost);
+
+    if (shard.lru.size() >= shardBlocks) {
+        // Re-use the least recently used entry
+        shard.index.erase(shard.lru.back().key);
+        shard.lru.splice(
+                shard.lru.begin(), shard.lru, std::prev(shard.lru.end()));
+        ++evictions;
+    } else {
+        shard.lru.emplace_front();
+        ++items;
+    }
+    auto& entry = shard.lru.front();
+    entry.key = key;
+    std::copy(data, data + BlockSize, entry.data.begin());
+    shard.index.emplace(key, shard.lru.begin());
+}
+
+void BlockCache::invalidate(uint64_t device,
+                            uint64_t inode,
+                            uint64_t firstBlock,
+                            uint64_t lastBlock) {
+    for (auto block = firstBlock; block <= lastBlock; ++block) {
+        const Key key{device, inode, block};
+        auto& shard = getShard(key);
+        std::lock_guard<std::mutex> lh(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+            --items;
+        }
+        auto ghost = shard.ghostIndex.find(key);
+        if (ghost != shard.ghostIndex.end()) {
+            shard.ghosts.erase(ghost->second);
+            shard.ghostIndex.erase(ghost);
+        }
+    }
+}
+
+BlockCache::Stats BlockCache::getStats() const {
+    Stats stats;
+    stats.items = items;
+    stats.size = stats.items * BlockSize;
+    stats.evictions = evictions;
+    return stats;
+}
+
+couch_file_handle BlockCacheOps::constructor(couchstore_error_info_t* errinfo) {
+    auto* file = new CacheFile(wrapped_ops.constructor(errinfo));
+    return reinterpret_cast<couch_file_handle>(file);
+}
+
+couchstore_error_t BlockCacheOps::open(couchstore_error_info_t* errinfo,
+                                       couch_file_handle* handle,
+                                       const char* path,
+                                       int oflag) {
+    auto* file = reinterpret_cast<CacheFile*>(*handle);
+    auto result = wrapped_ops.open(errinfo, &file->orig_handle, path, oflag);
+    file->cacheable = false;
+#ifndef WIN32
+    // Windows has no inode numbers to tell two files of the same name apart
+    // (e.g. after a vBucket reset), so the cache is bypassed there.
+    struct stat st;
+    if (result == COUCHSTORE_SUCCESS && stat(path, &st) == 0) {
+        file->cacheable = true;
+        file->device = st.st_dev;
+        file->inode = st.st_ino;
+    }
+#endif
+    return result;
+}
+
+couchstore_error_t BlockCacheOps::close(couchstore_error_info_t* errinfo,
+                                        couch_file_handle handle) {
+    auto* file = reinterpret_cast<CacheFile*>(handle);
+    return wrapped_ops.close(errinfo, file->orig_handle);
+}
+
+couchstore_error_t BlockCacheOps::set_periodic_sync(couch_file_handle handle,
+                                                    uint64_t period_bytes) {
+    auto* file = reinterpret_cast<CacheFile*>(handle);
+    return wrapped_ops.set_periodic_sync(file->orig_handle, period_bytes);
+}
+
+ssize_t BlockCacheOps::pread(couchstore_error_info_t* errinfo,
+                             couch_file_handle handle,
+                             void* buf,
+                             size_t nbytes,
+                             cs_off_t offset) {
+    auto* file = reinterpret_cast<CacheFile*>(handle);
+    if (!file->cacheable || nbytes == 0 || nbytes > MaxCachedRead) {
+        return wrapped_ops.pread(
+                errinfo, file->orig_handle, buf, nbytes, offset);
+    }
+
+    const uint64_t firstBlock = offset / BlockCache::BlockSize;
+    const size_t numBlocks =
+            (offset + nbytes - 1) / BlockCache::BlockSize - firstBlock + 1;
+    auto key = [file, firstBlock](size_t index) {
+        return BlockCache::Key{file->device, file->inode, firstBlock + index};
+    };
+
+    // Copy the cached blocks into place...
+    std::array<uint8_t, MaxReadBlocks * BlockCache::BlockSize> blocks;
+    std::array<bool, MaxReadBlocks> cached;
+    for (size_t ii = 0; ii < numBlocks; ++ii) {
+        cached[ii] = cache->lookup(key(ii),
+                                   blocks.data() + ii * BlockCache::BlockSize);
+        if (cached[ii]) {
+            ++stats.blockCacheHits;
+        } else {
+            ++stats.blockCacheMisses;
+        }
+    }
+
+    // ... then read each run of missing blocks with a single read.
+    size_t available = numBlocks * BlockCache::BlockSize;
+    for (size_t ii = 0; ii < numBlocks;) {
+        if (cached[ii]) {
+            ++ii;
+            continue;
+        }
+        size_t end = ii + 1;
+        while (end < numBlocks && !cached[end]) {
+            ++end;
+        }
+
+        const size_t length = (end - ii) * BlockCache::BlockSize;
+        uint8_t* dest = blocks.data() + ii * BlockCache::BlockSize;
+        const ssize_t result = wrapped_ops.pread(
+                errinfo,
+                file->orig_handle,
+                dest,
+                length,
+                (firstBlock + ii) * BlockCache::BlockSize);
+        if (result < 0) {
+            return result;
+        }
+
+        // The last block of a file is still being appended to, so only
+        // full blocks may be cached.
+        if (populate) {
+            for (size_t block = ii;
+                 (block - ii + 1) * BlockCache::BlockSize <= size_t(result);
+                 ++block) {
+                cache->insert(key(block),
+                              blocks.data() + block * BlockCache::BlockSize);
+            }
+        }
+
+        if (size_t(result) < length) {
+            // End of file
+            available = ii * BlockCache::BlockSize + result;
+            break;
+        }
+        ii = end;
+    }
+
+    const size_t start = offset - firstBlock * BlockCache::BlockSize;
+    if (available <= start) {
+        return 0;
+    }
+    const size_t copied = std::min(nbytes, available - start);
+    std::memcpy(buf, blocks.data() + start, copied);
+    return copied;
+}
+
+ssize_t BlockCacheOps::pwrite(couchstore_error_info_t* errinfo,
+                              couch_file_handle handle,
+                              const void* buf,
+                              size_t nbytes,
+                              cs_off_t offset) {
+    auto* file = reinterpret_cast<CacheFile*>(handle);
+    if (file->cacheable && nbytes > 0) {
+        // Couchstore only appends, so this only finds anything when a file
+        // re-uses the inode of a deleted one.
+        cache->invalidate(file->device,
+                          file->inode,
+                          offset / BlockCache::BlockSize,
+                          (offset + nbytes - 1) / BlockCache::BlockSize);
+    }
+    return wrapped_ops.pwrite(errinfo, file->orig_handle, buf, nbytes, offset);
+}
+
+cs_off_t BlockCacheOps::goto_eof(couchstore_error_info_t* errinfo,
+                                 couch_file_handle handle) {
+    auto* file = reinterpret_cast<CacheFile*>(handle);
+    return wrapped_ops.goto_eof(errinfo, file->orig_handle);
+}
+
+couchstore_error_t BlockCacheOps::sync(couchstore_error_info_t* errinfo,
+                                       couch_file_handle handle) {
+    auto* file = reinterpret_cast<CacheFile*>(handle);
+    return wrapped_ops.sync(errinfo, file->orig_handle);
+}
+
+couchstore_error_t BlockCacheOps::advise(couchstore_error_info_t* errinfo,
+                                         couch_file_handle handle,
+                                         cs_off_t offset,
+                                         cs_off_t len,
+                                         couchstore_file_advice_t advice) {
+    auto* file = reinterpret_cast<CacheFile*>(handle);
+    return wrapped_ops.advise(errinfo, file->orig_handle, offset, len, advice);
+}
+
+FileOpsInterface::FHStats* BlockCacheOps::get_stats(couch_file_handle handle) {
+    auto* file = reinterpret_cast<CacheFile*>(handle);
+    return wrapped_ops.get_stats(file->orig_handle);
+}
+
+void BlockCacheOps::destructor(couch_file_handle handle) {
+    auto* file = reinterpret_cast<CacheFile*>(handle);
+    wrapped_ops.destructor(file->orig_handle);
+    delete file;
+}
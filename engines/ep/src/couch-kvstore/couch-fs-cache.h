@@ -0,0 +1,226 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <libcouchstore/couch_db.h>
+
+#include <array>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct FileStats;
+
+/**
+ * A bounded cache of fixed size blocks of couchstore files, shared by all
+ * of the files of a bucket (see BlockCache::get).
+ *
+ * Couchstore files are append-only, so a block which has been read in full
+ * never changes; blocks are identified by the device and inode of the file
+ * (so a file which is replaced by compaction or a vBucket reset doesn't
+ * share blocks with its predecessor) and the block number. Writes through
+ * BlockCacheOps invalidate the blocks they overlap, which covers the rare
+ * case of an inode being re-used.
+ *
+ * The cache is sharded (one mutex and LRU list per shard). To keep it for
+ * the blocks which are read repeatedly (the B-tree nodes on the path to a
+ * document) rather than the document bodies which are typically read once,
+ * a block is only admitted on the second miss within a recently-missed
+ * window of the same size as the cache.
+ */
+class BlockCache {
+public:
+    static const size_t BlockSize = 4096;
+
+    struct Key {
+        bool operator==(const Key& other) const {
+            return device == other.device && inode == other.inode &&
+                   block == other.block;
+        }
+
+        uint64_t device;
+        uint64_t inode;
+        uint64_t block;
+    };
+
+    struct Stats {
+        /// Bytes of block data held by the cache
+        size_t size;
+        /// Number of blocks in the cache
+        size_t items;
+        /// Number of blocks evicted to make space for new ones
+        size_t evictions;
+    };
+
+    /**
+     * Get the cache for the given bucket (identified by its data
+     * directory), creating it with the given capacity if no store of the
+     * bucket currently uses one.
+     */
+    static std::shared_ptr<BlockCache> get(const std::string& dbname,
+                                           size_t capacity);
+
+    /**
+     * @param capacity the maximum number of bytes of block data
+     * @param numShards number of independently locked shards
+     */
+    explicit BlockCache(size_t capacity, size_t numShards = 16);
+
+    /**
+     * Copy the block into buf (which must have space for BlockSize bytes)
+     * if it is present.
+     *
+     * @return true on a hit
+     */
+    bool lookup(const Key& key, uint8_t* buf);
+
+    /**
+     * Offer a block which was read from disk (following a lookup miss). It
+     * is admitted if it missed recently before.
+     */
+    void insert(const Key& key, const uint8_t* data);
+
+    /// Remove the given blocks of a file
+    void invalidate(uint64_t device,
+                    uint64_t inode,
+                    uint64_t firstBlock,
+                    uint64_t lastBlock);
+
+    Stats getStats() const;
+
+    size_t getCapacity() const {
+        return capacity;
+    }
+
+protected:
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry {
+        Key key;
+        std::array<uint8_t, BlockSize> data;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        /// Most recently used at the front
+        std::list<Entry> lru;
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+        /// Keys which missed recently (but aren't cached), newest first
+        std::list<Key> ghosts;
+        std::unordered_map<Key, std::list<Key>::iterator, KeyHash> ghostIndex;
+    };
+
+    Shard& getShard(const Key& key);
+
+    const size_t capacity;
+    /// Maximum number of blocks (and ghost keys) per shard
+    const size_t shardBlocks;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<size_t> items{0};
+    std::atomic<size_t> evictions{0};
+};
+
+/**
+ * FileOpsInterface implementation which serves reads of (up to) a few
+ * blocks from a BlockCache, and reads the whole blocks which miss from the
+ * wrapped ops (with one read per run of consecutive missing blocks).
+ * Larger reads (document bodies, compaction) bypass the cache.
+ */
+class BlockCacheOps : public FileOpsInterface {
+public:
+    /// Reads larger than this bypass the cache
+    static const size_t MaxCachedRead = 4 * BlockCache::BlockSize;
+
+    /**
+     * @param cache the cache to use
+     * @param stats where the hits and misses are counted
+     * @param ops the ops to wrap
+     * @param populate whether blocks read on a miss should be offered to
+     *        the cache (false for compaction, which reads each block once)
+     */
+    BlockCacheOps(std::shared_ptr<BlockCache> cache,
+                  FileStats& stats,
+                  FileOpsInterface& ops,
+                  bool populate = true)
+        : cache(std::move(cache)),
+          stats(stats),
+          wrapped_ops(ops),
+          populate(populate) {
+    }
+
+    couch_file_handle constructor(couchstore_error_info_t* errinfo) override;
+    couchstore_error_t open(couchstore_error_info_t* errinfo,
+                            couch_file_handle* handle,
+                            const char* path,
+                            int oflag) override;
+    couchstore_error_t close(couchstore_error_info_t* errinfo,
+                             couch_file_handle handle) override;
+    couchstore_error_t set_periodic_sync(couch_file_handle handle,
+                                         uint64_t period_bytes) override;
+    ssize_t pread(couchstore_error_info_t* errinfo,
+                  couch_file_handle handle,
+                  void* buf,
+                  size_t nbytes,
+                  cs_off_t offset) override;
+    ssize_t pwrite(couchstore_error_info_t* errinfo,
+                   couch_file_handle handle,
+                   const void* buf,
+                   size_t nbytes,
+                   cs_off_t offset) override;
+    cs_off_t goto_eof(couchstore_error_info_t* errinfo,
+                      couch_file_handle handle) override;
+    couchstore_error_t sync(couchstore_error_info_t* errinfo,
+                            couch_file_handle handle) override;
+    couchstore_error_t advise(couchstore_error_info_t* errinfo,
+                              couch_file_handle handle,
+                              cs_off_t offset,
+                              cs_off_t len,
+                              couchstore_file_advice_t advice) override;
+    FHStats* get_stats(couch_file_handle handle) override;
+    void destructor(couch_file_handle handle) override;
+
+protected:
+    struct CacheFile {
+        explicit CacheFile(couch_file_handle orig_handle)
+            : orig_handle(orig_handle) {
+        }
+
+        couch_file_handle orig_handle;
+        /// False if the file couldn't be identified (the cache is bypassed)
+        bool cacheable = false;
+        uint64_t device = 0;
+        uint64_t inode = 0;
+    };
+
+    /// The most blocks a cached read can span (if it isn't aligned)
+    static const size_t MaxReadBlocks =
+            MaxCachedRead / BlockCache::BlockSize + 1;
+
+    std::shared_ptr<BlockCache> cache;
+    FileStats& stats;
+    FileOpsInterface& wrapped_ops;
+    const bool populate;
+};
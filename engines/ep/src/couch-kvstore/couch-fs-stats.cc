@@ -22,6 +22,7 @@
 #include "kvstore.h"
 
 #include <platform/histogram.h>
+#include <platform/processclock.h>
 
 std::unique_ptr<FileOpsInterface> getCouchstoreStatsOps(
     FileStats& stats, FileOpsInterface& base_ops) {
@@ -61,7 +62,13 @@ couchstore_error_t StatsOps::open(couchstore_error_info_t* errinfo,
     StatFile* sf = reinterpret_cast<StatFile*>(*h);
     sf->read_count_since_open = 0;
     sf->write_count_since_open = 0;
-    return sf->orig_ops->open(errinfo, &sf->orig_handle, path, flags);
+    const auto start = ProcessClock::now();
+    couchstore_error_t result =
+            sf->orig_ops->open(errinfo, &sf->orig_handle, path, flags);
+    addClassTime(&IOClassTimings::openTimeHisto,
+                 std::chrono::duration_cast<std::chrono::microseconds>(
+                         ProcessClock::now() - start));
+    return result;
 }
 
 couchstore_error_t StatsOps::close(couchstore_error_info_t* errinfo,
@@ -97,9 +104,13 @@ ssize_t StatsOps::pread(couchstore_error_info_t* errinfo,
         stats.readSeekHisto.add(std::abs(off - sf->last_offs));
     }
     sf->last_offs = off;
-    BlockTimer bt(&stats.readTimeHisto);
+    const auto start = ProcessClock::now();
     ssize_t result = sf->orig_ops->pread(errinfo, sf->orig_handle, buf,
                                          sz, off);
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            ProcessClock::now() - start);
+    stats.readTimeHisto.add(elapsed);
+    addClassTime(&IOClassTimings::readTimeHisto, elapsed);
     if (result > 0) {
         stats.totalBytesRead += result;
         ++sf->read_count_since_open;
@@ -114,9 +125,13 @@ ssize_t StatsOps::pwrite(couchstore_error_info_t*errinfo,
                          cs_off_t off) {
     StatFile* sf = reinterpret_cast<StatFile*>(h);
     stats.writeSizeHisto.add(sz);
-    BlockTimer bt(&stats.writeTimeHisto);
+    const auto start = ProcessClock::now();
     ssize_t result = sf->orig_ops->pwrite(errinfo, sf->orig_handle, buf,
                                           sz, off);
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            ProcessClock::now() - start);
+    stats.writeTimeHisto.add(elapsed);
+    addClassTime(&IOClassTimings::writeTimeHisto, elapsed);
     if (result > 0) {
         stats.totalBytesWritten += result;
         ++sf->write_count_since_open;
@@ -133,8 +148,13 @@ cs_off_t StatsOps::goto_eof(couchstore_error_info_t* errinfo,
 couchstore_error_t StatsOps::sync(couchstore_error_info_t* errinfo,
                                   couch_file_handle h) {
     StatFile* sf = reinterpret_cast<StatFile*>(h);
-    BlockTimer bt(&stats.syncTimeHisto);
-    return sf->orig_ops->sync(errinfo, sf->orig_handle);
+    const auto start = ProcessClock::now();
+    couchstore_error_t result = sf->orig_ops->sync(errinfo, sf->orig_handle);
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            ProcessClock::now() - start);
+    stats.syncTimeHisto.add(elapsed);
+    addClassTime(&IOClassTimings::syncTimeHisto, elapsed);
+    return result;
 }
 
 couchstore_error_t StatsOps::advise(couchstore_error_info_t* errinfo,
@@ -152,6 +172,15 @@ FileOpsInterface::FHStats* StatsOps::get_stats(couch_file_handle h) {
     return sf;
 }
 
+void StatsOps::addClassTime(MicrosecondHistogram IOClassTimings::*histo,
+                            std::chrono::microseconds elapsed) {
+    if (stats.classTimings) {
+        auto& timings =
+                (*stats.classTimings)[size_t(IOClassScope::current())];
+        (timings.*histo).add(elapsed);
+    }
+}
+
 void StatsOps::destructor(couch_file_handle h) {
     StatFile* sf = reinterpret_cast<StatFile*>(h);
     sf->orig_ops->destructor(sf->orig_handle);
@@ -20,12 +20,14 @@
 #include "config.h"
 
 #include <atomic>
+#include <chrono>
 #include <memory>
 
 #include <libcouchstore/couch_db.h>
 #include <platform/histogram.h>
 
 struct FileStats;
+struct IOClassTimings;
 
 /**
  * Returns an instance of StatsOps from a FileStats reference and
@@ -70,6 +72,11 @@ public:
     void destructor(couch_file_handle handle) override;
 
 protected:
+    /// Add the duration of an operation to the given histogram of the
+    /// current IOClass
+    void addClassTime(MicrosecondHistogram IOClassTimings::*histo,
+                      std::chrono::microseconds elapsed);
+
     FileStats& stats;
     FileOpsInterface& wrapped_ops;
 
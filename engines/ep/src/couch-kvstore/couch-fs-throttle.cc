@@ -0,0 +1,233 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+
+#include "couch-kvstore/couch-fs-throttle.h"
+#include "kvstore.h"
+
+#include <algorithm>
+#include <map>
+#include <thread>
+
+const std::chrono::milliseconds CompactionRateLimiter::AdjustInterval{100};
+const size_t CompactionRateLimiter::MinRateDivisor;
+const std::chrono::milliseconds CompactionRateLimiter::BurstInterval{100};
+
+static std::mutex registryMutex;
+static std::map<std::string, std::weak_ptr<CompactionRateLimiter>> registry;
+
+std::shared_ptr<CompactionRateLimiter> CompactionRateLimiter::get(
+        const std::string& dbname) {
+    std::lock_guard<std::mutex> lh(registryMutex);
+    auto limiter = registry[dbname].lock();
+    if (!limiter) {
+        limiter = std::make_shared<CompactionRateLimiter>();
+        registry[dbname] = limiter;
+    }
+    return limiter;
+}
+
+std::shared_ptr<CompactionRateLimiter> CompactionRateLimiter::getGlobal() {
+    static auto global = std::make_shared<CompactionRateLimiter>();
+    return global;
+}
+
+void CompactionRateLimiter::configure(
+        CompactionRateLimiter& limiter,
+        size_t bytesPerSec,
+        size_t globalBytesPerSec,
+        std::chrono::microseconds latencyThreshold) {
+    limiter.setRate(bytesPerSec);
+    limiter.setLatencyThreshold(latencyThreshold);
+
+    std::lock_guard<std::mutex> lh(registryMutex);
+    {
+        std::lock_guard<std::mutex> lh2(limiter.mutex);
+        limiter.globalRate = globalBytesPerSec;
+        limiter.globalLatencyThreshold = latencyThreshold;
+    }
+
+    // Recompute the global limit from the buckets which are still around
+    size_t globalRate = 0;
+    std::chrono::microseconds globalThreshold{0};
+    for (auto it = registry.begin(); it != registry.end();) {
+        auto bucket = it->second.lock();
+        if (!bucket) {
+            it = registry.erase(it);
+            continue;
+        }
+        std::lock_guard<std::mutex> lh2(bucket->mutex);
+        if (bucket->globalRate != 0 &&
+            (globalRate == 0 || bucket->globalRate < globalRate)) {
+            globalRate = bucket->globalRate;
+            globalThreshold = bucket->globalLatencyThreshold;
+        }
+        ++it;
+    }
+    auto global = getGlobal();
+    global->setRate(globalRate);
+    global->setLatencyThreshold(globalThreshold);
+}
+
+void CompactionRateLimiter::setRate(size_t bytesPerSec) {
+    std::lock_guard<std::mutex> lh(mutex);
+    if (bytesPerSec != rate) {
+        rate = bytesPerSec;
+        currentRate = double(bytesPerSec);
+        tokens = std::min(tokens, 0.0);
+    }
+}
+
+size_t CompactionRateLimiter::getRate() const {
+    std::lock_guard<std::mutex> lh(mutex);
+    return rate;
+}
+
+size_t CompactionRateLimiter::getCurrentRate() const {
+    std::lock_guard<std::mutex> lh(mutex);
+    return size_t(currentRate);
+}
+
+void CompactionRateLimiter::setLatencyThreshold(
+        std::chrono::microseconds threshold) {
+    std::lock_guard<std::mutex> lh(mutex);
+    latencyThreshold = threshold;
+}
+
+void CompactionRateLimiter::refill(ProcessClock::time_point now) {
+    if (now > lastRefill) {
+        const std::chrono::duration<double> elapsed = now - lastRefill;
+        const std::chrono::duration<double> burst = BurstInterval;
+        tokens = std::min(tokens + elapsed.count() * currentRate,
+                          burst.count() * currentRate);
+    }
+    lastRefill = now;
+}
+
+std::chrono::microseconds CompactionRateLimiter::reserve(
+        size_t bytes, ProcessClock::time_point now) {
+    std::lock_guard<std::mutex> lh(mutex);
+    if (rate == 0) {
+        return std::chrono::microseconds(0);
+    }
+    refill(now);
+    if (currentRate < rate && now - lastAdjust >= AdjustInterval) {
+        // Front-end latency has been fine since the last adjustment
+        const auto intervals = (now - lastAdjust) / AdjustInterval;
+        currentRate = std::min(double(rate),
+                               currentRate + intervals * rate / MinRateDivisor);
+        lastAdjust = now;
+    }
+    // Always take the bytes (going into debt if needed), so that callers
+    // are served in order and large requests aren't starved.
+    tokens -= bytes;
+    if (tokens >= 0) {
+        return std::chrono::microseconds(0);
+    }
+    return std::chrono::microseconds(
+            uint64_t(-tokens * 1000000 / currentRate));
+}
+
+void CompactionRateLimiter::reportLatency(std::chrono::microseconds latency,
+                                          ProcessClock::time_point now) {
+    std::lock_guard<std::mutex> lh(mutex);
+    if (rate == 0 || latencyThreshold.count() == 0 ||
+        latency <= latencyThreshold || now - lastAdjust < AdjustInterval) {
+        return;
+    }
+    refill(now);
+    currentRate = std::max(double(rate) / MinRateDivisor, currentRate / 2);
+    lastAdjust = now;
+}
+
+void ThrottledOps::throttle(size_t nbytes) {
+    std::chrono::microseconds wait(0);
+    const auto now = ProcessClock::now();
+    for (auto& limiter : limiters) {
+        wait = std::max(wait, limiter->reserve(nbytes, now));
+    }
+    if (wait.count() > 0) {
+        std::this_thread::sleep_for(wait);
+        stats.throttleWaitTime += wait.count();
+    }
+}
+
+couch_file_handle ThrottledOps::constructor(couchstore_error_info_t* errinfo) {
+    return wrapped_ops.constructor(errinfo);
+}
+
+couchstore_error_t ThrottledOps::open(couchstore_error_info_t* errinfo,
+                                      couch_file_handle* handle,
+                                      const char* path,
+                                      int oflag) {
+    return wrapped_ops.open(errinfo, handle, path, oflag);
+}
+
+couchstore_error_t ThrottledOps::close(couchstore_error_info_t* errinfo,
+                                       couch_file_handle handle) {
+    return wrapped_ops.close(errinfo, handle);
+}
+
+couchstore_error_t ThrottledOps::set_periodic_sync(couch_file_handle handle,
+                                                   uint64_t period_bytes) {
+    return wrapped_ops.set_periodic_sync(handle, period_bytes);
+}
+
+ssize_t ThrottledOps::pread(couchstore_error_info_t* errinfo,
+                            couch_file_handle handle,
+                            void* buf,
+                            size_t nbytes,
+                            cs_off_t offset) {
+    throttle(nbytes);
+    return wrapped_ops.pread(errinfo, handle, buf, nbytes, offset);
+}
+
+ssize_t ThrottledOps::pwrite(couchstore_error_info_t* errinfo,
+                             couch_file_handle handle,
+                             const void* buf,
+                             size_t nbytes,
+                             cs_off_t offset) {
+    throttle(nbytes);
+    return wrapped_ops.pwrite(errinfo, handle, buf, nbytes, offset);
+}
+
+cs_off_t ThrottledOps::goto_eof(couchstore_error_info_t* errinfo,
+                                couch_file_handle handle) {
+    return wrapped_ops.goto_eof(errinfo, handle);
+}
+
+couchstore_error_t ThrottledOps::sync(couchstore_error_info_t* errinfo,
+                                      couch_file_handle handle) {
+    return wrapped_ops.sync(errinfo, handle);
+}
+
+couchstore_error_t ThrottledOps::advise(couchstore_error_info_t* errinfo,
+                                        couch_file_handle handle,
+                                        cs_off_t offset,
+                                        cs_off_t len,
+                                        couchstore_file_advice_t advice) {
+    return wrapped_ops.advise(errinfo, handle, offset, len, advice);
+}
+
+FileOpsInterface::FHStats* ThrottledOps::get_stats(couch_file_handle handle) {
+    return wrapped_ops.get_stats(handle);
+}
+
+void ThrottledOps::destructor(couch_file_handle handle) {
+    wrapped_ops.destructor(handle);
+}
@@ -0,0 +1,174 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <libcouchstore/couch_db.h>
+#include <platform/processclock.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct FileStats;
+
+/**
+ * Token bucket limiting the rate of compaction I/O (bytes read plus bytes
+ * written), shared by all of the compactions it applies to: one per bucket
+ * (see CompactionRateLimiter::get) and one for the whole process (see
+ * CompactionRateLimiter::getGlobal).
+ *
+ * The limit adapts to the latency of front-end disk operations (BgFetches
+ * and flusher commits) reported by reportLatency(): each report above the
+ * latency threshold halves the current rate (at most once per
+ * AdjustInterval, and not below rate / MinRateDivisor), and every quiet
+ * AdjustInterval adds back rate / MinRateDivisor until the configured rate
+ * is reached again.
+ */
+class CompactionRateLimiter {
+public:
+    /// Minimum time between two adjustments of the current rate
+    static const std::chrono::milliseconds AdjustInterval;
+
+    /// The current rate is kept at or above rate / MinRateDivisor
+    static const size_t MinRateDivisor = 10;
+
+    /// Up to this much of the current rate can be used in a burst
+    static const std::chrono::milliseconds BurstInterval;
+
+    /**
+     * Get the limiter of the given bucket (identified by its data
+     * directory), creating it if no store of the bucket currently uses one.
+     */
+    static std::shared_ptr<CompactionRateLimiter> get(
+            const std::string& dbname);
+
+    /// Get the limiter shared by all buckets
+    static std::shared_ptr<CompactionRateLimiter> getGlobal();
+
+    /**
+     * Set the limit of the given bucket's limiter, and its contribution
+     * to the global one (0 for none); the global limit is the lowest of
+     * the non-zero contributions of all the buckets.
+     */
+    static void configure(CompactionRateLimiter& limiter,
+                          size_t bytesPerSec,
+                          size_t globalBytesPerSec,
+                          std::chrono::microseconds latencyThreshold);
+
+    /// Set the limit in bytes per second (0 for no limit)
+    void setRate(size_t bytesPerSec);
+
+    size_t getRate() const;
+
+    /// @return the limit after adapting to the front-end latency
+    size_t getCurrentRate() const;
+
+    /// Set the front-end latency above which the rate is reduced (0 for
+    /// no adaptation)
+    void setLatencyThreshold(std::chrono::microseconds threshold);
+
+    /**
+     * Take the given number of bytes from the bucket.
+     *
+     * @return how long the caller has to wait before doing the I/O
+     */
+    std::chrono::microseconds reserve(
+            size_t bytes, ProcessClock::time_point now = ProcessClock::now());
+
+    /// Report the latency of a front-end disk operation
+    void reportLatency(std::chrono::microseconds latency,
+                       ProcessClock::time_point now = ProcessClock::now());
+
+protected:
+    /// Add the tokens accumulated (at the current rate) since the last refill
+    void refill(ProcessClock::time_point now);
+
+    mutable std::mutex mutex;
+    size_t rate = 0;
+    double currentRate = 0;
+    std::chrono::microseconds latencyThreshold{0};
+    /// Bytes which can be used without waiting (negative when in debt)
+    double tokens = 0;
+    ProcessClock::time_point lastRefill;
+    ProcessClock::time_point lastAdjust;
+
+    /// This bucket's contribution to the global limit (see configure)
+    size_t globalRate = 0;
+    std::chrono::microseconds globalLatencyThreshold{0};
+};
+
+/**
+ * FileOpsInterface implementation used for compaction, which waits for the
+ * given rate limiters before each read and write of the wrapped ops.
+ */
+class ThrottledOps : public FileOpsInterface {
+public:
+    /**
+     * @param limiters the limiters each read and write has to pass
+     * @param stats where the time spent waiting is counted
+     * @param ops the ops to wrap
+     */
+    ThrottledOps(std::vector<std::shared_ptr<CompactionRateLimiter>> limiters,
+                 FileStats& stats,
+                 FileOpsInterface& ops)
+        : limiters(std::move(limiters)), stats(stats), wrapped_ops(ops) {
+    }
+
+    couch_file_handle constructor(couchstore_error_info_t* errinfo) override;
+    couchstore_error_t open(couchstore_error_info_t* errinfo,
+                            couch_file_handle* handle,
+                            const char* path,
+                            int oflag) override;
+    couchstore_error_t close(couchstore_error_info_t* errinfo,
+                             couch_file_handle handle) override;
+    couchstore_error_t set_periodic_sync(couch_file_handle handle,
+                                         uint64_t period_bytes) override;
+    ssize_t pread(couchstore_error_info_t* errinfo,
+                  couch_file_handle handle,
+                  void* buf,
+                  size_t nbytes,
+                  cs_off_t offset) override;
+    ssize_t pwrite(couchstore_error_info_t* errinfo,
+                   couch_file_handle handle,
+                   const void* buf,
+                   size_t nbytes,
+                   cs_off_t offset) override;
+    cs_off_t goto_eof(couchstore_error_info_t* errinfo,
+                      couch_file_handle handle) override;
+    couchstore_error_t sync(couchstore_error_info_t* errinfo,
+                            couch_file_handle handle) override;
+    couchstore_error_t advise(couchstore_error_info_t* errinfo,
+                              couch_file_handle handle,
+                              cs_off_t offset,
+                              cs_off_t len,
+                              couchstore_file_advice_t advice) override;
+    FHStats* get_stats(couch_file_handle handle) override;
+    void destructor(couch_file_handle handle) override;
+
+protected:
+    /// Wait until all of the limiters allow nbytes of I/O
+    void throttle(size_t nbytes);
+
+    std::vector<std::shared_ptr<CompactionRateLimiter>> limiters;
+    FileStats& stats;
+    FileOpsInterface& wrapped_ops;
+};
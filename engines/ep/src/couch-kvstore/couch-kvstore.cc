@@ -43,6 +43,7 @@
 #include <cJSON.h>
 #include <platform/dirutils.h>
 
+#include "collections/collections_types.h"
 #include "common.h"
 #include "couch-kvstore/couch-kvstore.h"
 #include "ep_types.h"
@@ -171,12 +172,43 @@ static DocKey makeDocKey(const sized_buf buf, bool restoreNamespace) {
 }
 
 struct GetMultiCbCtx {
-    GetMultiCbCtx(CouchKVStore &c, uint16_t v, vb_bgfetch_queue_t &f) :
-        cks(c), vbId(v), fetches(f) {}
+    /// A document whose body is read after all of the lookups
+    struct DeferredFetch {
+        DeferredFetch(const DocInfo& info, vb_bgfetch_item_ctx_t& itm)
+            : buffer(new char[sizeof(DocInfo) + info.id.size +
+                              info.rev_meta.size]),
+              bgItemCtx(itm) {
+            // Deep-copy the DocInfo; couchstore frees it after the callback
+            auto* copy = getDocInfo();
+            *copy = info;
+            copy->id.buf = buffer.get() + sizeof(DocInfo);
+            std::memcpy(copy->id.buf, info.id.buf, info.id.size);
+            copy->rev_meta.buf = copy->id.buf + info.id.size;
+            std::memcpy(copy->rev_meta.buf, info.rev_meta.buf,
+                        info.rev_meta.size);
+        }
+
+        DocInfo* getDocInfo() {
+            return reinterpret_cast<DocInfo*>(buffer.get());
+        }
+
+        std::unique_ptr<char[]> buffer;
+        vb_bgfetch_item_ctx_t& bgItemCtx;
+    };
+
+    GetMultiCbCtx(CouchKVStore& c,
+                  uint16_t v,
+                  vb_bgfetch_queue_t& f,
+                  ReadHintOps* h)
+        : cks(c), vbId(v), fetches(f), hints(h) {
+    }
 
     CouchKVStore &cks;
     uint16_t vbId;
     vb_bgfetch_queue_t &fetches;
+    /// If non-null, the body reads are hinted and deferred
+    ReadHintOps* hints;
+    std::vector<DeferredFetch> deferred;
 };
 
 struct StatResponseCtx {
@@ -198,6 +230,11 @@ struct AllKeysCtx {
     uint32_t count;
 };
 
+struct SystemItemCountCtx {
+    sized_buf prefix;
+    size_t count;
+};
+
 couchstore_content_meta_flags CouchRequest::getContentMeta(const Item& it) {
     couchstore_content_meta_flags rval;
 
@@ -222,6 +259,7 @@ CouchRequest::CouchRequest(const Item& it,
                            bool persistDocNamespace)
     : IORequest(it.getVBucketId(), cb, del, it.getKey()),
       value(it.getValue()),
+      knownDiskState(it.getKnownDiskState()),
       fileRevNum(rev) {
     // Collections: TODO: Temporary switch to ensure upgrades don't break.
     if (persistDocNamespace) {
@@ -280,9 +318,36 @@ CouchKVStore::CouchKVStore(KVStoreConfig& config,
       logger(config.getLogger()),
       base_ops(ops) {
     createDataDir(dbname);
-    statCollectingFileOps = getCouchstoreStatsOps(st.fsStats, base_ops);
+    if (config.isAsyncReads() && AsyncReadOps::isAvailable()) {
+        // Only reads which have been hinted are affected, so compaction
+        // doesn't need it.
+        asyncReadOps = std::make_unique<AsyncReadOps>(base_ops);
+    }
+    statCollectingFileOps = getCouchstoreStatsOps(
+            st.fsStats, asyncReadOps ? *asyncReadOps : base_ops);
     statCollectingFileOpsCompaction = getCouchstoreStatsOps(
         st.fsStatsCompaction, base_ops);
+    compactionLimiter = CompactionRateLimiter::get(dbname);
+    throttledCompactionOps = std::make_unique<ThrottledOps>(
+            std::vector<std::shared_ptr<CompactionRateLimiter>>{
+                    compactionLimiter, CompactionRateLimiter::getGlobal()},
+            st.fsStatsCompaction,
+            *statCollectingFileOpsCompaction);
+
+    if (config.getBlockCacheSize() > 0) {
+        // The cache sits above the stats ops so that only the reads which
+        // miss it are counted as disk I/O. Compaction reads every block of
+        // the file once, so it doesn't populate the cache; its writes still
+        // need to invalidate any stale blocks.
+        blockCache = BlockCache::get(dbname, config.getBlockCacheSize());
+        blockCacheFileOps = std::make_unique<BlockCacheOps>(
+                blockCache, st.fsStats, *statCollectingFileOps);
+        blockCacheFileOpsCompaction = std::make_unique<BlockCacheOps>(
+                blockCache,
+                st.fsStatsCompaction,
+                *throttledCompactionOps,
+                false /*populate*/);
+    }
 
     // init db file map with default revision number, 1
     numDbFiles = configuration.getMaxVBuckets();
@@ -421,6 +486,7 @@ void CouchKVStore::set(const Item& itm,
 GetValue CouchKVStore::get(const StoredDocKey& key,
                            uint16_t vb,
                            bool fetchDelete) {
+    IOClassScope ioClass(IOClass::BgFetch);
     DbHolder db(*this);
     couchstore_error_t errCode = openDB(vb, db, COUCHSTORE_OPEN_FLAG_RDONLY);
     if (errCode != COUCHSTORE_SUCCESS) {
@@ -505,10 +571,19 @@ void CouchKVStore::getMulti(uint16_t vb, vb_bgfetch_queue_t &itms) {
     if (itms.empty()) {
         return;
     }
+    IOClassScope ioClass(IOClass::BgFetch);
     int numItems = itms.size();
 
+    // With async reads the Db is opened through ReadHintOps, so the reads
+    // of the document bodies can be issued while the keys are looked up.
+    std::unique_ptr<ReadHintOps> hintOps;
+    if (configuration.isAsyncReads()) {
+        hintOps = std::make_unique<ReadHintOps>(getFileOps());
+    }
+
     DbHolder db(*this);
-    couchstore_error_t errCode = openDB(vb, db, COUCHSTORE_OPEN_FLAG_RDONLY);
+    couchstore_error_t errCode = openDB(
+            vb, db, COUCHSTORE_OPEN_FLAG_RDONLY, hintOps.get());
     if (errCode != COUCHSTORE_SUCCESS) {
         logger.log(EXTENSION_LOG_WARNING,
                    "CouchKVStore::getMulti: openDB error:%s, "
@@ -537,10 +612,13 @@ void CouchKVStore::getMulti(uint16_t vb, vb_bgfetch_queue_t &itms) {
         ++idx;
     }
 
-    GetMultiCbCtx ctx(*this, vb, itms);
+    GetMultiCbCtx ctx(*this, vb, itms, hintOps.get());
 
     errCode = couchstore_docinfos_by_id(
             db, ids.data(), itms.size(), 0, getMultiCbC, &ctx);
+    for (auto& fetch : ctx.deferred) {
+        fetchMultiDoc(db, fetch.getDocInfo(), vb, fetch.bgItemCtx);
+    }
     if (errCode != COUCHSTORE_SUCCESS) {
         st.numGetFailure += numItems;
         logger.log(EXTENSION_LOG_WARNING,
@@ -884,6 +962,7 @@ static int time_purge_hook(Db* d, DocInfo* info, sized_buf item, void* ctx_p) {
 }
 
 bool CouchKVStore::compactDB(compaction_ctx *hook_ctx) {
+    IOClassScope ioClass(IOClass::Compaction);
     auto result = compactDBInternal(hook_ctx, edit_docinfo_hook);
     if (!result) {
         ++st.numCompactionFailure;
@@ -904,7 +983,7 @@ bool CouchKVStore::compactDBInternal(compaction_ctx* hook_ctx,
     }
     couchstore_compact_hook       hook = time_purge_hook;
     couchstore_docinfo_hook dhook = docinfo_hook;
-    FileOpsInterface         *def_iops = statCollectingFileOpsCompaction.get();
+    FileOpsInterface         *def_iops = throttledCompactionOps.get();
     DbHolder compactdb(*this);
     DbHolder targetDb(*this);
     couchstore_error_t         errCode = COUCHSTORE_SUCCESS;
@@ -916,6 +995,17 @@ bool CouchKVStore::compactDBInternal(compaction_ctx* hook_ctx,
     uint16_t                      vbid = hook_ctx->db_file_id;
     hook_ctx->config = &configuration;
 
+    if (blockCacheFileOpsCompaction) {
+        def_iops = blockCacheFileOpsCompaction.get();
+    }
+
+    // Pick up any changes to the rate limits
+    CompactionRateLimiter::configure(
+            *compactionLimiter,
+            configuration.getCompactionMaxBytesPerSec(),
+            configuration.getCompactionGlobalMaxBytesPerSec(),
+            configuration.getCompactionThrottleLatencyThreshold());
+
     TRACE_EVENT1("CouchKVStore", "compactDB", "vbid", vbid);
 
     // Open the source VBucket database file ...
@@ -1122,6 +1212,7 @@ bool CouchKVStore::snapshotVBucket(uint16_t vbucketId,
         return false;
     }
 
+    IOClassScope ioClass(IOClass::Flush);
     auto start = ProcessClock::now();
 
     if (updateCachedVBState(vbucketId, vbstate) &&
@@ -1162,6 +1253,7 @@ bool CouchKVStore::commit(const Item* collectionsManifest) {
         throw std::logic_error("CouchKVStore::commit: Not valid on a read-only "
                         "object.");
     }
+    IOClassScope ioClass(IOClass::Flush);
 
     if (intransaction) {
         if (commit2couchstore(collectionsManifest)) {
@@ -1194,11 +1286,33 @@ bool CouchKVStore::getStat(const char* name, size_t& value)  {
     } else if (strcmp("io_compaction_write_bytes", name) == 0) {
         value = st.fsStatsCompaction.totalBytesWritten;
         return true;
+    } else if (strcmp("io_compaction_throttle_time", name) == 0) {
+        value = st.fsStatsCompaction.throttleWaitTime;
+        return true;
     } else if (strcmp("io_bg_fetch_read_count", name) == 0) {
         value = st.getMultiFsReadCount;
         return true;
     }
 
+    if (blockCache) {
+        if (strcmp("block_cache_hits", name) == 0) {
+            value = st.fsStats.blockCacheHits;
+            return true;
+        } else if (strcmp("block_cache_misses", name) == 0) {
+            value = st.fsStats.blockCacheMisses;
+            return true;
+        } else if (!isReadOnly()) {
+            // The cache is shared, so only reported once (by the RW store)
+            if (strcmp("block_cache_size", name) == 0) {
+                value = blockCache->getStats().size;
+                return true;
+            } else if (strcmp("block_cache_evictions", name) == 0) {
+                value = blockCache->getStats().evictions;
+                return true;
+            }
+        }
+    }
+
     return false;
 }
 
@@ -1234,6 +1348,7 @@ ScanContext* CouchKVStore::initScanContext(
         uint64_t startSeqno,
         DocumentFilter options,
         ValueFilter valOptions) {
+    IOClassScope ioClass(IOClass::Backfill);
     DbHolder db(*this);
     couchstore_error_t errorCode =
             openDB(vbid, db, COUCHSTORE_OPEN_FLAG_RDONLY);
@@ -1313,9 +1428,54 @@ static couchstore_docinfos_options getDocFilter(const DocumentFilter& filter) {
 }
 
 scan_error_t CouchKVStore::scan(ScanContext* ctx) {
+    return changesSince(ctx, recordDbDumpC, ctx);
+}
+
+/// The state of a CouchKVStore::scanKeys()
+struct KeyScanCtx {
+    /// @return false if the batch callback asked for the scan to stop
+    bool flush() {
+        if (batch.empty()) {
+            return true;
+        }
+        cb.callback(batch);
+        batch.clear();
+        return cb.getStatus() != ENGINE_ENOMEM;
+    }
+
+    ScanContext& sctx;
+    StatusCallback<KeyScanBatch>& cb;
+    const size_t batchSize;
+    KeyScanBatch batch;
+};
+
+extern "C" {
+    static int recordKeyDumpC(Db* db, DocInfo* docinfo, void* ctx) {
+        return CouchKVStore::recordKeyDump(db, docinfo, ctx);
+    }
+}
+
+scan_error_t CouchKVStore::scanKeys(ScanContext* ctx,
+                                    StatusCallback<KeyScanBatch>& cb,
+                                    size_t batchSize) {
+    if (!ctx) {
+        return scan_failed;
+    }
+    KeyScanCtx keyCtx{*ctx, cb, batchSize, {}};
+    auto rv = changesSince(ctx, recordKeyDumpC, &keyCtx);
+    if (!keyCtx.flush() && rv == scan_success) {
+        rv = scan_again;
+    }
+    return rv;
+}
+
+scan_error_t CouchKVStore::changesSince(ScanContext* ctx,
+                                        int (*callback)(Db*, DocInfo*, void*),
+                                        void* callbackCtx) {
     if (!ctx) {
         return scan_failed;
     }
+    IOClassScope ioClass(IOClass::Backfill);
 
     if (ctx->lastReadSeqno == ctx->maxSeqno) {
         return scan_success;
@@ -1348,8 +1508,8 @@ scan_error_t CouchKVStore::scan(ScanContext* ctx) {
     errorCode = couchstore_changes_since(db,
                                          start,
                                          getDocFilter(ctx->docFilter),
-                                         recordDbDumpC,
-                                         static_cast<void*>(ctx));
+                                         callback,
+                                         callbackCtx);
 
     TRACE_EVENT_END1(
             "CouchKVStore", "scan", "lastReadSeqno", ctx->lastReadSeqno);
@@ -1492,7 +1652,7 @@ couchstore_error_t CouchKVStore::openSpecificDB(uint16_t vbucketId,
     db.setFileRev(fileRev); // save the rev so the caller can log it
 
     if(ops == nullptr) {
-        ops = statCollectingFileOps.get();
+        ops = &getFileOps();
     }
 
     couchstore_error_t errorCode = COUCHSTORE_SUCCESS;
@@ -1831,6 +1991,49 @@ int CouchKVStore::recordDbDump(Db *db, DocInfo *docinfo, void *ctx) {
     return COUCHSTORE_SUCCESS;
 }
 
+int CouchKVStore::recordKeyDump(Db* db, DocInfo* docinfo, void* ctx) {
+    auto& keyCtx = *static_cast<KeyScanCtx*>(ctx);
+    auto& sctx = keyCtx.sctx;
+    const uint64_t byseqno = docinfo->db_seq;
+
+    if (docinfo->id.size > UINT16_MAX) {
+        throw std::invalid_argument(
+                "CouchKVStore::recordKeyDump: docinfo->id.size (which is " +
+                std::to_string(docinfo->id.size) + ") is greater than " +
+                std::to_string(UINT16_MAX));
+    }
+
+    // Collections: TODO: Permanently restore to stored namespace
+    DocKey docKey = makeDocKey(docinfo->id,
+                               sctx.config.shouldPersistDocNamespace());
+    CacheLookup lookup(docKey, byseqno, sctx.vbid);
+    sctx.lookup->callback(lookup);
+    if (sctx.lookup->getStatus() == ENGINE_KEY_EEXISTS) {
+        sctx.lastReadSeqno = byseqno;
+        return COUCHSTORE_SUCCESS;
+    } else if (sctx.lookup->getStatus() == ENGINE_ENOMEM) {
+        return COUCHSTORE_ERROR_CANCEL;
+    }
+
+    // Pass on a full batch before adding to it, so that a callback which
+    // stops the scan leaves this document unread.
+    if (keyCtx.batch.size() >= keyCtx.batchSize && !keyCtx.flush()) {
+        return COUCHSTORE_ERROR_CANCEL;
+    }
+
+    const MetaData metadata(docinfo->rev_meta);
+    auto& record = keyCtx.batch.add(docKey, byseqno);
+    record.cas = metadata.getCas();
+    record.revSeqno = docinfo->rev_seq;
+    record.flags = metadata.getFlags();
+    record.exptime = metadata.getExptime();
+    record.datatype = metadata.getDataType();
+    record.deleted = docinfo->deleted;
+
+    sctx.lastReadSeqno = byseqno;
+    return COUCHSTORE_SUCCESS;
+}
+
 bool CouchKVStore::commit2couchstore(const Item* collectionsManifest) {
     bool success = true;
 
@@ -1881,6 +2084,15 @@ bool CouchKVStore::commit2couchstore(const Item* collectionsManifest) {
 
     // The docinfo callback needs to know if the DocNamespace feature is on
     kvstats_ctx kvctx(configuration.shouldPersistDocNamespace());
+    // Keys whose state on disk is already known don't need to be read first
+    for (size_t i = 0; i < pendingCommitCnt; ++i) {
+        const auto state = pendingReqsQ[i]->getKnownDiskState();
+        if (state != KnownDiskState::Unknown) {
+            kvctx.keyStats[makeDocKey(docinfos[i]->id,
+                                      kvctx.persistDocNamespace)] =
+                    (state == KnownDiskState::Alive);
+        }
+    }
     // flush all
     couchstore_error_t errCode =
             saveDocs(vbucket2flush, docs, docinfos, kvctx, collectionsManifest);
@@ -1953,20 +2165,26 @@ couchstore_error_t CouchKVStore::saveDocs(uint16_t vbid,
 
         // Only do a couchstore_save_documents if there are docs
         if (docs.size() > 0) {
-            std::vector<sized_buf> ids(docs.size());
+            std::vector<sized_buf> ids;
+            ids.reserve(docs.size());
             for (size_t idx = 0; idx < docs.size(); idx++) {
-                ids[idx] = docinfos[idx]->id;
                 maxDBSeqno = std::max(maxDBSeqno, docinfos[idx]->db_seq);
                 DocKey key = makeDocKey(
-                        ids[idx], configuration.shouldPersistDocNamespace());
-                kvctx.keyStats[key] = false;
+                        docinfos[idx]->id,
+                        configuration.shouldPersistDocNamespace());
+                // Only look up the keys the caller doesn't already know about
+                if (kvctx.keyStats.emplace(key, false).second) {
+                    ids.push_back(docinfos[idx]->id);
+                }
+            }
+            if (!ids.empty()) {
+                couchstore_docinfos_by_id(db,
+                                          ids.data(),
+                                          (unsigned)ids.size(),
+                                          0,
+                                          readDocInfos,
+                                          &kvctx);
             }
-            couchstore_docinfos_by_id(db,
-                                      ids.data(),
-                                      (unsigned)ids.size(),
-                                      0,
-                                      readDocInfos,
-                                      &kvctx);
 
             auto cs_begin = ProcessClock::now();
             uint64_t flags = COMPRESS_DOC_BODIES | COUCHSTORE_SEQUENCE_AS_IS;
@@ -2005,9 +2223,11 @@ couchstore_error_t CouchKVStore::saveDocs(uint16_t vbid,
 
         auto cs_begin = ProcessClock::now();
         errCode = couchstore_commit(db);
-        st.commitHisto.add(
+        const auto commitTime =
                 std::chrono::duration_cast<std::chrono::microseconds>(
-                        ProcessClock::now() - cs_begin));
+                        ProcessClock::now() - cs_begin);
+        st.commitHisto.add(commitTime);
+        reportFrontEndLatency(commitTime);
         if (errCode) {
             logger.log(
                     EXTENSION_LOG_WARNING,
@@ -2341,7 +2561,6 @@ int CouchKVStore::getMultiCb(Db *db, DocInfo *docinfo, void *ctx) {
     // Collections: TODO: Permanently restore to stored namespace
     DocKey key = makeDocKey(docinfo->id,
                             cbCtx->cks.getConfig().shouldPersistDocNamespace());
-    KVStoreStats& st = cbCtx->cks.getKVStoreStat();
 
     vb_bgfetch_queue_t::iterator qitr = cbCtx->fetches.find(key);
     if (qitr == cbCtx->fetches.end()) {
@@ -2356,15 +2575,35 @@ int CouchKVStore::getMultiCb(Db *db, DocInfo *docinfo, void *ctx) {
     }
 
     vb_bgfetch_item_ctx_t& bg_itm_ctx = (*qitr).second;
+    // Start reading the body now, but only wait for it once all of the
+    // keys have been looked up.
+    if (cbCtx->hints != nullptr && bg_itm_ctx.isMetaOnly == GetMetaOnly::No &&
+        docinfo->physical_size > 0) {
+        cbCtx->hints->willNeedChunk(docinfo->bp, docinfo->physical_size);
+        cbCtx->deferred.emplace_back(*docinfo, bg_itm_ctx);
+        return 0;
+    }
+
+    cbCtx->cks.fetchMultiDoc(db, docinfo, cbCtx->vbId, bg_itm_ctx);
+    return 0;
+}
+
+void CouchKVStore::fetchMultiDoc(Db* db,
+                                 DocInfo* docinfo,
+                                 uint16_t vbId,
+                                 vb_bgfetch_item_ctx_t& bg_itm_ctx) {
     GetMetaOnly meta_only = bg_itm_ctx.isMetaOnly;
 
-    couchstore_error_t errCode = cbCtx->cks.fetchDoc(
-            db, docinfo, bg_itm_ctx.value, cbCtx->vbId, meta_only);
+    const auto start = ProcessClock::now();
+    couchstore_error_t errCode =
+            fetchDoc(db, docinfo, bg_itm_ctx.value, vbId, meta_only);
+    reportFrontEndLatency(std::chrono::duration_cast<std::chrono::microseconds>(
+            ProcessClock::now() - start));
     if (errCode != COUCHSTORE_SUCCESS && (meta_only == GetMetaOnly::No)) {
         st.numGetFailure++;
     }
 
-    bg_itm_ctx.value.setStatus(cbCtx->cks.couchErr2EngineErr(errCode));
+    bg_itm_ctx.value.setStatus(couchErr2EngineErr(errCode));
 
     bool return_val_ownership_transferred = false;
     for (auto& fetch : bg_itm_ctx.bgfetched_list) {
@@ -2381,17 +2620,27 @@ int CouchKVStore::getMultiCb(Db *db, DocInfo *docinfo, void *ctx) {
         }
     }
     if (!return_val_ownership_transferred) {
-        cbCtx->cks.logger.log(EXTENSION_LOG_WARNING,
-                              "CouchKVStore::getMultiCb called with zero"
-                              "items in bgfetched_list, vb:%" PRIu16
-                              ", seqno:%" PRIu64,
-                              cbCtx->vbId, docinfo->rev_seq);
+        logger.log(EXTENSION_LOG_WARNING,
+                   "CouchKVStore::fetchMultiDoc called with zero"
+                   "items in bgfetched_list, vb:%" PRIu16 ", seqno:%" PRIu64,
+                   vbId,
+                   docinfo->rev_seq);
     }
+}
 
-    return 0;
+void CouchKVStore::reportFrontEndLatency(std::chrono::microseconds latency) {
+    compactionLimiter->reportLatency(latency);
+    CompactionRateLimiter::getGlobal()->reportLatency(latency);
 }
 
 
+FileOpsInterface& CouchKVStore::getFileOps() {
+    if (blockCacheFileOps) {
+        return *blockCacheFileOps;
+    }
+    return *statCollectingFileOps;
+}
+
 void CouchKVStore::closeDatabaseHandle(Db *db) {
     couchstore_error_t ret = couchstore_close_file(db);
     if (ret != COUCHSTORE_SUCCESS) {
@@ -2722,6 +2971,58 @@ CouchKVStore::getAllKeys(uint16_t vbid,
     return ENGINE_FAILED;
 }
 
+static int countSystemItems(Db* db, DocInfo* docinfo, void* ctx) {
+    auto& countCtx = *static_cast<SystemItemCountCtx*>(ctx);
+    if (docinfo->id.size < countCtx.prefix.size ||
+        memcmp(docinfo->id.buf, countCtx.prefix.buf, countCtx.prefix.size) !=
+                0) {
+        // Past the last System document
+        return COUCHSTORE_ERROR_CANCEL;
+    }
+    ++countCtx.count;
+    return COUCHSTORE_SUCCESS;
+}
+
+size_t CouchKVStore::getSystemItemCount(uint16_t vbid) {
+    DbHolder db(*this);
+    couchstore_error_t errCode = openDB(vbid, db, COUCHSTORE_OPEN_FLAG_RDONLY);
+    if (errCode != COUCHSTORE_SUCCESS) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "CouchKVStore::getSystemItemCount: openDB error:%s, "
+                   "vb:%" PRIu16 ", rev:%" PRIu64,
+                   couchstore_strerror(errCode),
+                   vbid,
+                   db.getFileRev());
+        return 0;
+    }
+
+    // All of the System documents start with the system event prefix, so
+    // they are adjacent in the by-id index.
+    const StoredDocKey prefix(Collections::SystemEventPrefix,
+                              DocNamespace::System);
+    SystemItemCountCtx ctx;
+    if (configuration.shouldPersistDocNamespace()) {
+        ctx.prefix = {const_cast<char*>(reinterpret_cast<const char*>(
+                              prefix.getDocNameSpacedData())),
+                      prefix.getDocNameSpacedSize()};
+    } else {
+        ctx.prefix = {const_cast<char*>(prefix.c_str()), prefix.size()};
+    }
+    ctx.count = 0;
+    errCode = couchstore_all_docs(
+            db, &ctx.prefix, COUCHSTORE_NO_DELETES, countSystemItems, &ctx);
+    if (errCode != COUCHSTORE_SUCCESS && errCode != COUCHSTORE_ERROR_CANCEL) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "CouchKVStore::getSystemItemCount: couchstore_all_docs "
+                   "error:%s [%s] vb:%" PRIu16 ", rev:%" PRIu64,
+                   couchstore_strerror(errCode),
+                   cb_strerror().c_str(),
+                   vbid,
+                   db.getFileRev());
+    }
+    return ctx.count;
+}
+
 void CouchKVStore::unlinkCouchFile(uint16_t vbucket,
                                    uint64_t fRev) {
 
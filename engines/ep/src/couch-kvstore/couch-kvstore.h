@@ -22,7 +22,10 @@
 
 #include "atomicqueue.h"
 #include "configuration.h"
+#include "couch-kvstore/couch-fs-async.h"
+#include "couch-kvstore/couch-fs-cache.h"
 #include "couch-kvstore/couch-fs-stats.h"
+#include "couch-kvstore/couch-fs-throttle.h"
 #include "couch-kvstore/couch-kvstore-metadata.h"
 #include "item.h"
 #include "kvstore.h"
@@ -137,10 +140,19 @@ public:
         return key;
     }
 
+    /**
+     * Get what was known about the key's document on disk when the item
+     * was queued (see Item::getKnownDiskState)
+     */
+    KnownDiskState getKnownDiskState() const {
+        return knownDiskState;
+    }
+
 protected:
     static couchstore_content_meta_flags getContentMeta(const Item& it);
 
     value_t value;
+    KnownDiskState knownDiskState;
 
     MetaData meta;
     uint64_t fileRevNum;
@@ -389,6 +401,8 @@ public:
      */
     size_t getItemCount(uint16_t vbid) override;
 
+    size_t getSystemItemCount(uint16_t vbid) override;
+
     /**
      * Do a rollback to the specified seqNo on the particular vbucket
      *
@@ -408,8 +422,25 @@ public:
     bool getStat(const char* name, size_t& value) override;
 
     static int recordDbDump(Db *db, DocInfo *docinfo, void *ctx);
+    static int recordKeyDump(Db* db, DocInfo* docinfo, void* ctx);
     static int recordDbStat(Db *db, DocInfo *docinfo, void *ctx);
     static int getMultiCb(Db *db, DocInfo *docinfo, void *ctx);
+
+    /**
+     * Fetch the document for one of the keys of a getMulti, and complete
+     * the bgfetches for it.
+     */
+    void fetchMultiDoc(Db* db,
+                       DocInfo* docinfo,
+                       uint16_t vbId,
+                       vb_bgfetch_item_ctx_t& bg_itm_ctx);
+
+    /**
+     * Feed the latency of a front-end disk operation (bgfetch or commit)
+     * to the compaction rate limiters, so they back off when it's high.
+     */
+    void reportFrontEndLatency(std::chrono::microseconds latency);
+
     ENGINE_ERROR_CODE readVBState(Db *db, uint16_t vbId);
 
     couchstore_error_t fetchDoc(Db* db,
@@ -419,6 +450,14 @@ public:
                                 GetMetaOnly metaOnly);
     ENGINE_ERROR_CODE couchErr2EngineErr(couchstore_error_t errCode);
 
+    /**
+     * Run the given scan, passing the documents from its last read seqno
+     * onwards to the given couchstore_changes_since callback.
+     */
+    scan_error_t changesSince(ScanContext* ctx,
+                              int (*callback)(Db*, DocInfo*, void*),
+                              void* callbackCtx);
+
     uint64_t getLastPersistedSeqno(uint16_t vbid);
 
     /**
@@ -438,6 +477,14 @@ public:
 
     scan_error_t scan(ScanContext* sctx) override;
 
+    /**
+     * Read the keys and metadata straight from the by-seqno index into the
+     * batch, without creating an Item (or reading the document bodies).
+     */
+    scan_error_t scanKeys(ScanContext* sctx,
+                          StatusCallback<KeyScanBatch>& cb,
+                          size_t batchSize = DefaultKeyScanBatchSize) override;
+
     void destroyScanContext(ScanContext* ctx) override;
 
     std::string getCollectionsManifest(uint16_t vbid) override;
@@ -546,6 +593,9 @@ protected:
                                       couchstore_open_flags options,
                                       FileOpsInterface* ops = nullptr);
 
+    /// The ops used for everything except compaction
+    FileOpsInterface& getFileOps();
+
     /**
      * save the Documents held in docs to the file associated with vbid/rev
      *
@@ -653,6 +703,13 @@ protected:
     bool intransaction;
     std::unique_ptr<TransactionContext> transactionCtx;
 
+    /**
+     * FileOpsInterface implementation which services hinted reads with
+     * io_uring, wrapping base_ops. Null unless couchstore_async_reads is
+     * enabled and io_uring is available.
+     */
+    std::unique_ptr<FileOpsInterface> asyncReadOps;
+
     /**
      * FileOpsInterface implementation for couchstore which tracks
      * all bytes read/written by couchstore *except* compaction.
@@ -669,6 +726,25 @@ protected:
      */
     std::unique_ptr<FileOpsInterface> statCollectingFileOpsCompaction;
 
+    /**
+     * Compaction rate limiter shared by all of the CouchKVStores of the
+     * bucket, and the FileOpsInterface implementation which throttles the
+     * compaction I/O with it (and the global limiter), wrapping
+     * statCollectingFileOpsCompaction.
+     */
+    std::shared_ptr<CompactionRateLimiter> compactionLimiter;
+    std::unique_ptr<FileOpsInterface> throttledCompactionOps;
+
+    /**
+     * Block cache shared by all of the CouchKVStores of the bucket, and the
+     * FileOpsInterface implementations which read through it (wrapping
+     * statCollectingFileOps and throttledCompactionOps). Null
+     * unless couchstore_block_cache_size is non-zero.
+     */
+    std::shared_ptr<BlockCache> blockCache;
+    std::unique_ptr<FileOpsInterface> blockCacheFileOps;
+    std::unique_ptr<FileOpsInterface> blockCacheFileOpsCompaction;
+
     /* deleted docs in each file, indexed by vBucket. RelaxedAtomic
        to allow stats access witout lock */
     std::vector<Couchbase::RelaxedAtomic<size_t>> cachedDeleteCount;
@@ -0,0 +1,161 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "dcp/compressed_value_cache.h"
+
+#include "item.h"
+#include "statwriter.h"
+
+#include <iterator>
+
+DcpCompressedValueCache::DcpCompressedValueCache(size_t maxSize)
+    : maxSize(maxSize) {
+}
+
+bool DcpCompressedValueCache::compressValue(uint16_t vbid, Item& item) {
+    const auto shardMaxSize = getShardMaxSize();
+    if (shardMaxSize == 0 || !item.getValue()) {
+        return item.compressValue();
+    }
+
+    const Key key{vbid,
+                  item.getBySeqno(),
+                  item.getCas(),
+                  item.getDataType(),
+                  item.getNBytes()};
+    auto& shard = shards[vbid % NUM_SHARDS];
+
+    value_t value;
+    protocol_binary_datatype_t datatype;
+    if (shard.lookup(key, value, datatype)) {
+        item.setValue(value);
+        item.setDataType(datatype);
+        return true;
+    }
+
+    if (!item.compressValue()) {
+        return false;
+    }
+
+    // Note that compressValue() leaves the value untouched if it didn't
+    // compress well; cache that outcome as well so the next stream doesn't
+    // retry the compression.
+    shard.insert(key, item.getValue(), item.getDataType(), shardMaxSize);
+    return true;
+}
+
+void DcpCompressedValueCache::setMaxSize(size_t size) {
+    maxSize.store(size);
+    const auto shardMaxSize = getShardMaxSize();
+    for (auto& shard : shards) {
+        shard.trim(shardMaxSize);
+    }
+}
+
+void DcpCompressedValueCache::addStats(ADD_STAT add_stat,
+                                       const void* c) const {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t items = 0;
+    size_t size = 0;
+    for (const auto& shard : shards) {
+        hits += shard.hits;
+        misses += shard.misses;
+        evictions += shard.evictions;
+        items += shard.getNumItems();
+        size += shard.getSize();
+    }
+
+    add_casted_stat("ep_dcp_compressed_value_cache_hits", hits, add_stat, c);
+    add_casted_stat(
+            "ep_dcp_compressed_value_cache_misses", misses, add_stat, c);
+    add_casted_stat(
+            "ep_dcp_compressed_value_cache_evictions", evictions, add_stat, c);
+    add_casted_stat("ep_dcp_compressed_value_cache_items", items, add_stat, c);
+    add_casted_stat("ep_dcp_compressed_value_cache_mem_used", size, add_stat, c);
+}
+
+bool DcpCompressedValueCache::Shard::lookup(
+        const Key& key,
+        value_t& value,
+        protocol_binary_datatype_t& datatype) {
+    std::lock_guard<std::mutex> lh(mutex);
+    auto iter = index.find(key);
+    if (iter == index.end()) {
+        ++misses;
+        return false;
+    }
+
+    lru.splice(lru.begin(), lru, iter->second);
+    value = iter->second->value;
+    datatype = iter->second->datatype;
+    ++hits;
+    return true;
+}
+
+void DcpCompressedValueCache::Shard::insert(
+        const Key& key,
+        const value_t& value,
+        protocol_binary_datatype_t datatype,
+        size_t maxSize) {
+    const size_t entrySize = value->getSize() + ENTRY_OVERHEAD;
+    if (entrySize > maxSize / 4) {
+        // Don't let a single large value flush out the rest of the shard
+        return;
+    }
+
+    std::lock_guard<std::mutex> lh(mutex);
+    auto iter = index.find(key);
+    if (iter != index.end()) {
+        // Another stream compressed the same value concurrently
+        erase(iter->second);
+    }
+
+    lru.push_front(Entry{key, value, datatype, entrySize});
+    index[key] = lru.begin();
+    size += entrySize;
+    unlocked_trim(maxSize);
+}
+
+void DcpCompressedValueCache::Shard::trim(size_t maxSize) {
+    std::lock_guard<std::mutex> lh(mutex);
+    unlocked_trim(maxSize);
+}
+
+size_t DcpCompressedValueCache::Shard::getNumItems() const {
+    std::lock_guard<std::mutex> lh(mutex);
+    return lru.size();
+}
+
+size_t DcpCompressedValueCache::Shard::getSize() const {
+    std::lock_guard<std::mutex> lh(mutex);
+    return size;
+}
+
+void DcpCompressedValueCache::Shard::erase(EntryList::iterator iter) {
+    size -= iter->size;
+    index.erase(iter->key);
+    lru.erase(iter);
+}
+
+void DcpCompressedValueCache::Shard::unlocked_trim(size_t maxSize) {
+    while (size > maxSize && !lru.empty()) {
+        erase(std::prev(lru.end()));
+        ++evictions;
+    }
+}
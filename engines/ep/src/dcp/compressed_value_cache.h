@@ -0,0 +1,171 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include "blob.h"
+
+#include <memcached/engine_common.h>
+#include <memcached/protocol_binary.h>
+#include <relaxed_atomic.h>
+
+#include <array>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+class Item;
+
+/**
+ * DcpCompressedValueCache holds the Snappy-compressed value of recently
+ * streamed mutations, so that a given revision of a document is compressed
+ * at most once even if it is sent to several DCP consumers (replicas,
+ * XDCR, indexer, ...) which all requested value compression.
+ *
+ * There is one cache per bucket (owned by the DcpConnMap). Entries are
+ * identified by vBucket, seqno and CAS of the mutation, together with the
+ * datatype and size of the value to compress (so that a value with its
+ * xattrs pruned is not confused with the full value). The keyspace is split
+ * into NUM_SHARDS shards by vBucket, each with its own mutex, LRU list and
+ * 1/NUM_SHARDS of the memory budget.
+ *
+ * This class is thread safe.
+ */
+class DcpCompressedValueCache {
+public:
+    /**
+     * @param maxSize the maximum number of bytes of compressed values to
+     *                keep (0 disables caching)
+     */
+    explicit DcpCompressedValueCache(size_t maxSize);
+
+    /**
+     * Snappy compress the value of the given item (which is about to be sent
+     * on a DCP stream for the given vBucket) and update its datatype. If the
+     * same revision has already been compressed for another stream the
+     * cached value is used instead of compressing it again.
+     *
+     * @param vbid the vBucket the item belongs to
+     * @param item the item to compress
+     * @return false if the value could not be compressed (as
+     *         Item::compressValue())
+     */
+    bool compressValue(uint16_t vbid, Item& item);
+
+    /**
+     * Set the maximum number of bytes of compressed values to keep. Entries
+     * are evicted immediately if the cache is larger than the new size.
+     */
+    void setMaxSize(size_t size);
+
+    size_t getMaxSize() const {
+        return maxSize.load();
+    }
+
+    void addStats(ADD_STAT add_stat, const void* c) const;
+
+private:
+    static const int NUM_SHARDS = 16;
+
+    // Per-entry overhead accounted for in addition to the compressed Blob
+    // (list and map nodes).
+    static const size_t ENTRY_OVERHEAD = 96;
+
+    struct Key {
+        bool operator==(const Key& other) const {
+            return vbid == other.vbid && bySeqno == other.bySeqno &&
+                   cas == other.cas && datatype == other.datatype &&
+                   nbytes == other.nbytes;
+        }
+
+        uint16_t vbid;
+        int64_t bySeqno;
+        uint64_t cas;
+        protocol_binary_datatype_t datatype;
+        uint32_t nbytes;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return std::hash<int64_t>()(key.bySeqno) ^
+                   (std::hash<uint64_t>()(key.cas) << 1) ^ key.vbid;
+        }
+    };
+
+    struct Entry {
+        Key key;
+        value_t value;
+        protocol_binary_datatype_t datatype;
+        size_t size;
+    };
+
+    class Shard {
+    public:
+        /**
+         * Search for the given key, and if found move it to the head of the
+         * LRU list.
+         *
+         * @return true (and the value and datatype) if found
+         */
+        bool lookup(const Key& key,
+                    value_t& value,
+                    protocol_binary_datatype_t& datatype);
+
+        void insert(const Key& key,
+                    const value_t& value,
+                    protocol_binary_datatype_t datatype,
+                    size_t maxSize);
+
+        void trim(size_t maxSize);
+
+        size_t getNumItems() const;
+
+        size_t getSize() const;
+
+        Couchbase::RelaxedAtomic<uint64_t> hits;
+        Couchbase::RelaxedAtomic<uint64_t> misses;
+        Couchbase::RelaxedAtomic<uint64_t> evictions;
+
+    private:
+        using EntryList = std::list<Entry>;
+
+        void erase(EntryList::iterator iter);
+
+        void unlocked_trim(size_t maxSize);
+
+        mutable std::mutex mutex;
+
+        // Entries ordered from most-recently used (front) to least recently
+        // used (back).
+        EntryList lru;
+
+        std::unordered_map<Key, EntryList::iterator, KeyHash> index;
+
+        size_t size = 0;
+    };
+
+    size_t getShardMaxSize() const {
+        return maxSize.load() / NUM_SHARDS;
+    }
+
+    std::atomic<size_t> maxSize;
+
+    std::array<Shard, NUM_SHARDS> shards;
+};
@@ -40,7 +40,9 @@ private:
 
 DcpConnMap::DcpConnMap(EventuallyPersistentEngine &e)
     : ConnMap(e),
-      aggrDcpConsumerBufferSize(0) {
+      aggrDcpConsumerBufferSize(0),
+      compressedValueCache(
+              e.getConfiguration().getDcpCompressedValueCacheSize()) {
     backfills.numActiveSnoozing = 0;
     updateMaxActiveSnoozingBackfills(engine.getEpStats().getMaxDataSize());
     minCompressionRatioForProducer.store(
@@ -53,6 +55,9 @@ DcpConnMap::DcpConnMap(EventuallyPersistentEngine &e)
     engine.getConfiguration().addValueChangedListener(
             "dcp_consumer_process_buffered_messages_batch_size",
             std::make_unique<DcpConfigChangeListener>(*this));
+    engine.getConfiguration().addValueChangedListener(
+            "dcp_compressed_value_cache_size",
+            std::make_unique<DcpConfigChangeListener>(*this));
 }
 
 DcpConnMap::~DcpConnMap() {
@@ -447,6 +452,7 @@ void DcpConnMap::addStats(ADD_STAT add_stat, const void *c) {
     LockHolder lh(connsLock);
     add_casted_stat("ep_dcp_dead_conn_count", deadConnections.size(), add_stat,
                     c);
+    compressedValueCache.addStats(add_stat, c);
 }
 
 void DcpConnMap::updateMinCompressionRatioForProducers(float value) {
@@ -466,6 +472,8 @@ void DcpConnMap::DcpConfigChangeListener::sizeValueChanged(const std::string &ke
         myConnMap.consumerYieldConfigChanged(value);
     } else if (key == "dcp_consumer_process_buffered_messages_batch_size") {
         myConnMap.consumerBatchSizeConfigChanged(value);
+    } else if (key == "dcp_compressed_value_cache_size") {
+        myConnMap.compressedValueCache.setMaxSize(value);
     }
 }
 
@@ -21,6 +21,7 @@
 
 #include "collections/filter.h"
 #include "connmap.h"
+#include "dcp/compressed_value_cache.h"
 
 #include <memcached/engine.h>
 #include <platform/sized_buffer.h>
@@ -135,6 +136,13 @@ public:
 
     float getMinCompressionRatio();
 
+    /* The cache of compressed values shared by all of the producers, so
+     * that a mutation is compressed at most once regardless of the number
+     * of streams it is sent on */
+    DcpCompressedValueCache& getCompressedValueCache() {
+        return compressedValueCache;
+    }
+
     std::shared_ptr<ConnHandler> findByName(const std::string& name);
 
     bool isConnections() {
@@ -202,5 +210,7 @@ protected:
     /* Total memory used by all DCP consumer buffers */
     std::atomic<size_t> aggrDcpConsumerBufferSize;
 
+    DcpCompressedValueCache compressedValueCache;
+
     class DcpConfigChangeListener;
 };
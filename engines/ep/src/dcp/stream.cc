@@ -1166,7 +1166,9 @@ std::unique_ptr<DcpResponse> ActiveStream::makeResponseFromItem(
             if (isSnappyEnabled()) {
                 if (isForceValueCompressionEnabled()) {
                     if (!mcbp::datatype::is_snappy(finalItem->getDataType())) {
-                        if (!finalItem->compressValue()) {
+                        auto& cache = engine->getDcpConnMap()
+                                              .getCompressedValueCache();
+                        if (!cache.compressValue(vb_, *finalItem)) {
                             LOG(EXTENSION_LOG_WARNING,
                                 "Failed to snappy compress an uncompressed value");
                         }
@@ -24,10 +24,16 @@
 #include "ep_vb.h"
 #include "failover-table.h"
 #include "flusher.h"
+#include "hash_table_snapshot.h"
 #include "persistence_callback.h"
 #include "replicationthrottle.h"
 #include "tasks.h"
 
+#include <platform/timeutils.h>
+
+#include <algorithm>
+#include <climits>
+
 /**
  * Callback class used by EpStore, for adding relevant keys
  * to bloomfilter during compaction.
@@ -222,9 +228,68 @@ void EPBucket::deinitialize() {
     stopFlusher();
     stopBgFetcher();
 
+    if (!stats.forceShutdown && !isWarmingUp() &&
+        engine.getConfiguration().isWarmupHashtableSnapshot()) {
+        saveHashTableSnapshots();
+    }
+
     KVBucket::deinitialize();
 }
 
+void EPBucket::saveHashTableSnapshots() {
+    const auto start = ProcessClock::now();
+    const auto& dbname = engine.getConfiguration().getDbname();
+    size_t numSnapshots = 0;
+    size_t totalItems = 0;
+
+    for (auto vbid : vbMap.getBuckets()) {
+        VBucketPtr vb = getVBucket(vbid);
+        if (!vb || vb->getState() == vbucket_state_dead) {
+            continue;
+        }
+
+        size_t numItems;
+        if (!HashTableSnapshot::save(*vb, dbname, numItems)) {
+            LOG(EXTENSION_LOG_WARNING,
+                "EPBucket::saveHashTableSnapshots: Failed to write "
+                "snapshot for vb:%" PRIu16,
+                vbid);
+            continue;
+        }
+
+        // With value eviction every item must be present in the hash
+        // table, otherwise the snapshot would cause the missing items to
+        // "disappear" after warmup. The System namespace documents on disk
+        // are never in the hash table.
+        if (eviction_policy == VALUE_ONLY) {
+            auto* kvstore = getRWUnderlying(vbid);
+            const auto diskItems = kvstore->getItemCount(vbid) -
+                                   kvstore->getSystemItemCount(vbid);
+            if (numItems != diskItems) {
+                LOG(EXTENSION_LOG_WARNING,
+                    "EPBucket::saveHashTableSnapshots: vb:%" PRIu16
+                    " has %" PRIu64 " items in memory but %" PRIu64
+                    " items on disk; discarding snapshot",
+                    vbid,
+                    uint64_t(numItems),
+                    uint64_t(diskItems));
+                HashTableSnapshot::remove(dbname, vbid);
+                continue;
+            }
+        }
+
+        ++numSnapshots;
+        totalItems += numItems;
+    }
+
+    LOG(EXTENSION_LOG_NOTICE,
+        "Wrote hash table snapshots of %" PRIu64 " vBuckets (%" PRIu64
+        " items) in %s",
+        uint64_t(numSnapshots),
+        uint64_t(totalItems),
+        cb::time2text(ProcessClock::now() - start).c_str());
+}
+
 void EPBucket::reset() {
     KVBucket::reset();
 
@@ -588,19 +653,27 @@ ENGINE_ERROR_CODE EPBucket::scheduleCompaction(uint16_t vbid,
     /* Update the compaction ctx with the previous purge seqno */
     c.max_purged_seq[vbid] = vb->getPurgeSeqno();
 
+    uint64_t priority = 0;
+    try {
+        priority = getCompactionPriority(
+                getRWUnderlying(vbid)->getDbFileInfo(c.db_file_id));
+    } catch (std::runtime_error& e) {
+        LOG(EXTENSION_LOG_WARNING,
+            "EPBucket::scheduleCompaction: Failed to get the file info of "
+            "db %d: %s",
+            c.db_file_id,
+            e.what());
+    }
+
     LockHolder lh(compactionLock);
     ExTask task = std::make_shared<CompactTask>(*this, c, cookie);
-    compactionTasks.push_back(std::make_pair(c.db_file_id, task));
-    if (compactionTasks.size() > 1) {
-        if ((stats.diskQueueSize > compactionWriteQueueCap &&
-             compactionTasks.size() > (vbMap.getNumShards() / 2)) ||
-            engine.getWorkLoadPolicy().getWorkLoadPattern() == READ_HEAVY) {
-            // Snooze a new compaction task.
-            // We will wake it up when one of the existing compaction tasks is
-            // done.
-            task->snooze(60);
-        }
+    if (getRunningCompactions() >= getMaxConcurrentCompactions()) {
+        // Snooze a new compaction task until one of the running compaction
+        // tasks is done and wakes it up (in order of priority). At least one
+        // compaction is running while any is waiting, so it will be woken.
+        task->snooze(INT_MAX);
     }
+    compactionTasks.push_back({c.db_file_id, task, priority});
 
     ExecutorPool::get()->schedule(task);
 
@@ -732,7 +805,9 @@ void EPBucket::compactInternal(compaction_ctx* ctx) {
         ctx->stats.post.purgeSeqno);
 }
 
-bool EPBucket::doCompact(compaction_ctx* ctx, const void* cookie) {
+bool EPBucket::doCompact(compaction_ctx* ctx,
+                         size_t taskId,
+                         const void* cookie) {
     ENGINE_ERROR_CODE err = ENGINE_SUCCESS;
     StorageProperties storeProp = getStorageProperties();
     bool concWriteCompact = storeProp.hasConcWriteCompact();
@@ -766,7 +841,7 @@ bool EPBucket::doCompact(compaction_ctx* ctx, const void* cookie) {
         compactInternal(ctx);
     }
 
-    updateCompactionTasks(ctx->db_file_id);
+    updateCompactionTasks(taskId);
 
     if (cookie) {
         engine.notifyIOComplete(cookie, err);
@@ -775,26 +850,56 @@ bool EPBucket::doCompact(compaction_ctx* ctx, const void* cookie) {
     return false;
 }
 
-void EPBucket::updateCompactionTasks(DBFileId db_file_id) {
+void EPBucket::updateCompactionTasks(size_t taskId) {
     LockHolder lh(compactionLock);
-    bool erased = false, woke = false;
-    std::list<CompTaskEntry>::iterator it = compactionTasks.begin();
-    while (it != compactionTasks.end()) {
-        if ((*it).first == db_file_id) {
-            it = compactionTasks.erase(it);
-            erased = true;
-        } else {
-            ExTask& task = (*it).second;
-            if (task->getState() == TASK_SNOOZED) {
-                ExecutorPool::get()->wake(task->getId());
-                woke = true;
+    compactionTasks.remove_if([taskId](const CompTaskEntry& entry) {
+        return entry.task->getId() == taskId;
+    });
+
+    const auto maxRunning = getMaxConcurrentCompactions();
+    for (auto running = getRunningCompactions(); running < maxRunning;
+         ++running) {
+        auto next = compactionTasks.end();
+        for (auto it = compactionTasks.begin(); it != compactionTasks.end();
+             ++it) {
+            if (it->task->getState() == TASK_SNOOZED &&
+                (next == compactionTasks.end() ||
+                 it->priority > next->priority)) {
+                next = it;
             }
-            ++it;
         }
-        if (erased && woke) {
+        if (next == compactionTasks.end()) {
             break;
         }
+        ExecutorPool::get()->wake(next->task->getId());
+    }
+}
+
+size_t EPBucket::getMaxConcurrentCompactions() const {
+    if (stats.diskQueueSize > compactionWriteQueueCap ||
+        engine.getWorkLoadPolicy().getWorkLoadPattern() == READ_HEAVY) {
+        return 1;
+    }
+    return std::max(size_t(1),
+                    size_t(vbMap.getNumShards() * compactionMaxConcurrentRatio));
+}
+
+size_t EPBucket::getRunningCompactions() const {
+    return std::count_if(compactionTasks.begin(),
+                         compactionTasks.end(),
+                         [](const CompTaskEntry& entry) {
+                             return entry.task->getState() != TASK_SNOOZED;
+                         });
+}
+
+uint64_t EPBucket::getCompactionPriority(const DBFileInfo& info) {
+    if (info.fileSize == 0 || info.spaceUsed >= info.fileSize) {
+        return 0;
     }
+    // stale * (stale / fileSize), computed in floating point as stale^2 can
+    // overflow.
+    const double stale = double(info.fileSize - info.spaceUsed);
+    return uint64_t(stale * (stale / info.fileSize));
 }
 
 std::pair<uint64_t, bool> EPBucket::getLastPersistedCheckpointId(uint16_t vb) {
@@ -77,6 +77,13 @@ public:
     /// Stops the background fetcher for each shard.
     void stopBgFetcher();
 
+    /**
+     * Write a HashTableSnapshot of each of the vBuckets, to be used by the
+     * next warmup. Only called on graceful shutdown, after the flusher has
+     * persisted all outstanding items.
+     */
+    void saveHashTableSnapshots();
+
     ENGINE_ERROR_CODE scheduleCompaction(uint16_t vbid,
                                          compaction_ctx c,
                                          const void* ck) override;
@@ -85,12 +92,21 @@ public:
      * Compaction of a database file
      *
      * @param ctx Context for compaction hooks
+     * @param taskId the id of the CompactTask running the compaction
      * @param ck cookie used to notify connection of operation completion
      *
      * return true if the compaction needs to be rescheduled and false
      *             otherwise
      */
-    bool doCompact(compaction_ctx* ctx, const void* cookie);
+    bool doCompact(compaction_ctx* ctx, size_t taskId, const void* cookie);
+
+    /**
+     * The priority with which compaction of a database file is started
+     * when it has to wait for others: the space it would reclaim, weighted
+     * by the fraction of the file reclaimed, so that files which free the
+     * most space for the least rewriting (write amplification) go first.
+     */
+    static uint64_t getCompactionPriority(const DBFileInfo& info);
 
     std::pair<uint64_t, bool> getLastPersistedCheckpointId(
             uint16_t vb) override;
@@ -158,11 +174,29 @@ protected:
     void compactInternal(compaction_ctx* ctx);
 
     /**
-     * Remove completed compaction tasks or wake snoozed tasks
+     * Remove the completed compaction task, and wake the snoozed tasks with
+     * the highest priority while fewer than getMaxConcurrentCompactions()
+     * are running.
      *
-     * @param db_file_id vbucket id for couchstore
+     * @param taskId the id of the completed task (there may be more than
+     *        one task for the same database file)
+     */
+    void updateCompactionTasks(size_t taskId);
+
+    /**
+     * @return how many compaction tasks may run at the same time: one while
+     *         the disk write queue is above compactionWriteQueueCap (so
+     *         that compaction doesn't compete with the flushers) or the
+     *         workload is read heavy, otherwise the configured ratio of the
+     *         number of shards.
+     */
+    size_t getMaxConcurrentCompactions() const;
+
+    /**
+     * @return the number of scheduled compaction tasks which aren't waiting
+     *         for others to finish. compactionLock must be held.
      */
-    void updateCompactionTasks(DBFileId db_file_id);
+    size_t getRunningCompactions() const;
 
     /**
      * Max number of backill items in a single flusher batch before we split
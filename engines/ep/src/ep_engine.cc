@@ -555,6 +555,18 @@ protocol_binary_response_status EventuallyPersistentEngine::setFlushParam(
             runDefragmenterTask();
         } else if (strcmp(keyz, "compaction_write_queue_cap") == 0) {
             getConfiguration().setCompactionWriteQueueCap(std::stoull(valz));
+        } else if (strcmp(keyz, "compaction_max_concurrent_ratio") == 0) {
+            getConfiguration().setCompactionMaxConcurrentRatio(
+                    std::stof(valz));
+        } else if (strcmp(keyz, "compaction_max_bytes_per_sec") == 0) {
+            getConfiguration().setCompactionMaxBytesPerSec(std::stoull(valz));
+        } else if (strcmp(keyz, "compaction_global_max_bytes_per_sec") == 0) {
+            getConfiguration().setCompactionGlobalMaxBytesPerSec(
+                    std::stoull(valz));
+        } else if (strcmp(keyz, "compaction_throttle_latency_threshold") ==
+                   0) {
+            getConfiguration().setCompactionThrottleLatencyThreshold(
+                    std::stoull(valz));
         } else if (strcmp(keyz, "dcp_min_compression_ratio") == 0) {
             getConfiguration().setDcpMinCompressionRatio(std::stof(valz));
         } else if (strcmp(keyz, "dcp_noop_mandatory_for_v5_features") == 0) {
@@ -638,6 +650,10 @@ protocol_binary_response_status EventuallyPersistentEngine::setDcpParam(
             validate(v, size_t(1), std::numeric_limits<size_t>::max());
             getConfiguration().setDcpConsumerProcessBufferedMessagesBatchSize(
                     v);
+        } else if (strcmp(keyz, "dcp_compressed_value_cache_size") == 0) {
+            checkNumeric(valz);
+            getConfiguration().setDcpCompressedValueCacheSize(
+                    std::stoull(valz));
         } else {
             msg = "Unknown config param";
             rv = PROTOCOL_BINARY_RESPONSE_KEY_ENOENT;
@@ -2843,6 +2859,11 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
                                  KVBucketIface::KVSOption::BOTH)) {
         add_casted_stat("ep_io_compaction_write_bytes",  value, add_stat, cookie);
     }
+    if (kvBucket->getKVStoreStat("io_compaction_throttle_time", value,
+                                 KVBucketIface::KVSOption::BOTH)) {
+        add_casted_stat("ep_io_compaction_throttle_time", value, add_stat,
+                        cookie);
+    }
 
     if (kvBucket->getKVStoreStat("io_bg_fetch_read_count",
                                  value,
@@ -5019,7 +5040,7 @@ EventuallyPersistentEngine::handleTrafficControlCmd(const void *cookie,
 
     switch (request->request.opcode) {
     case PROTOCOL_BINARY_CMD_ENABLE_TRAFFIC:
-        if (kvBucket->isWarmingUp()) {
+        if (kvBucket->isWarmupBlockingTraffic()) {
             // engine is still warming up, do not turn on data traffic yet
             status = PROTOCOL_BINARY_RESPONSE_ETMPFAIL;
             setErrorContext(cookie, "Persistent engine is still warming up!");
@@ -5068,7 +5089,7 @@ EventuallyPersistentEngine::handleTrafficControlCmd(const void *cookie,
 }
 
 bool EventuallyPersistentEngine::isDegradedMode() const {
-    return kvBucket->isWarmingUp() || !trafficEnabled.load();
+    return kvBucket->isWarmupBlockingTraffic() || !trafficEnabled.load();
 }
 
 ENGINE_ERROR_CODE
@@ -483,7 +483,14 @@ EPVBucket::updateStoredValue(const HashTable::HashBucketLock& hbl,
         status = ht.unlocked_updateStoredValue(hbl.getHTLock(), v, itm);
     }
 
-    return std::make_tuple(&v, status, queueDirty(v, queueItmCtx));
+    VBQueueItemCtx ctx(queueItmCtx);
+    if (!v.isDeleted() && !v.isNewCacheItem()) {
+        // The key is already counted as alive on disk, so the flusher needn't
+        // look it up. (It would be wrong for an item resurrected from a
+        // deleted one, but those are flagged as new cache items.)
+        ctx.knownDiskState = KnownDiskState::Alive;
+    }
+    return std::make_tuple(&v, status, queueDirty(v, ctx));
 }
 
 std::pair<StoredValue*, VBNotifyCtx> EPVBucket::addNewStoredValue(
@@ -498,7 +505,15 @@ std::pair<StoredValue*, VBNotifyCtx> EPVBucket::addNewStoredValue(
         updateRevSeqNoOfNewStoredValue(*v);
     }
 
-    return {v, queueDirty(*v, queueItmCtx)};
+    VBQueueItemCtx ctx(queueItmCtx);
+    if (!itm.isDeleted() &&
+        (eviction == VALUE_ONLY || !maybeKeyExistsInFilter(itm.getKey()))) {
+        // With value eviction every key alive on disk is resident, and with
+        // full eviction the evicted ones are in the bloom filter; either way
+        // this key has no alive document on disk.
+        ctx.knownDiskState = KnownDiskState::Absent;
+    }
+    return {v, queueDirty(*v, ctx)};
 }
 
 std::tuple<StoredValue*, VBNotifyCtx> EPVBucket::softDeleteStoredValue(
@@ -521,12 +536,19 @@ void EPVBucket::bgFetch(const DocKey& key,
                         EventuallyPersistentEngine& engine,
                         const int bgFetchDelay,
                         const bool isMeta) {
+    auto waitSpan = cb::tracing::Tracer::invalidSpanId();
+    if (cookie) {
+        // Ended when the fetch completes (see KVBucket::completeBGFetch and
+        // KVBucket::completeBGFetchMulti)
+        waitSpan = engine.getServerApi()->tracing->begin_trace(
+                cookie, cb::tracing::TraceCode::BGFETCH_WAIT);
+    }
     if (multiBGFetchEnabled) {
         // schedule to the current batch of background fetch of the given
         // vbucket
         size_t bgfetch_size = queueBGFetchItem(
                 key,
-                std::make_unique<VBucketBGFetchItem>(cookie, isMeta),
+                std::make_unique<VBucketBGFetchItem>(cookie, isMeta, waitSpan),
                 getShard()->getBgFetcher());
         if (getShard()) {
             getShard()->getBgFetcher()->notifyBGEvent();
@@ -540,8 +562,14 @@ void EPVBucket::bgFetch(const DocKey& key,
                 std::max(stats.maxRemainingBgJobs.load(),
                          stats.numRemainingBgJobs.load()));
         ExecutorPool* iom = ExecutorPool::get();
-        ExTask task = std::make_shared<SingleBGFetcherTask>(
-                &engine, key, getId(), cookie, isMeta, bgFetchDelay, false);
+        ExTask task = std::make_shared<SingleBGFetcherTask>(&engine,
+                                                            key,
+                                                            getId(),
+                                                            cookie,
+                                                            isMeta,
+                                                            bgFetchDelay,
+                                                            false,
+                                                            waitSpan);
         iom->schedule(task);
         LOG(EXTENSION_LOG_DEBUG,
             "Queued a background fetch, now at %" PRIu64,
@@ -623,12 +651,15 @@ void EPVBucket::scheduleDeferredDeletion(EventuallyPersistentEngine& engine) {
     ExecutorPool::get()->schedule(task);
 }
 
-MutationStatus EPVBucket::insertFromWarmup(Item& itm,
-                                         bool eject,
-                                         bool keyMetaDataOnly) {
+MutationStatus EPVBucket::insertFromWarmup(
+        Item& itm,
+        bool eject,
+        bool keyMetaDataOnly,
+        const std::function<bool()>& existingOnly) {
     if (!hasMemoryForStoredValue(stats, itm, false)) {
         return MutationStatus::NoMem;
     }
 
-    return ht.insertFromWarmup(itm, eject, keyMetaDataOnly, eviction);
+    return ht.insertFromWarmup(
+            itm, eject, keyMetaDataOnly, eviction, existingOnly);
 }
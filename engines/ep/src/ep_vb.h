@@ -154,12 +154,15 @@ public:
      * @param eject true if we should eject the value immediately
      * @param keyMetaDataOnly is this just the key and meta-data or a complete
      *                        item
+     * @param existingOnly should only an item already in the HashTable be
+     *                     updated? (called under the hash bucket lock)
      *
      * @return the result of the operation
      */
     MutationStatus insertFromWarmup(Item& itm,
                                     bool eject,
-                                    bool keyMetaDataOnly);
+                                    bool keyMetaDataOnly,
+                                    const std::function<bool()>& existingOnly);
 
 protected:
     /**
@@ -27,6 +27,7 @@
 #include "taskqueue.h"
 
 #include <platform/timeutils.h>
+#include <tracing/sampling_profiler.h>
 
 extern "C" {
     static void launch_executor_thread(void *arg) {
@@ -71,6 +72,7 @@ void ExecutorThread::stop(bool wait) {
 
 void ExecutorThread::run() {
     LOG(EXTENSION_LOG_DEBUG, "Thread %s running..", getName().c_str());
+    cb::tracing::SamplingProfiler::registerThread(getName());
 
     for (uint8_t tick = 1;; tick++) {
         resetCurrentTask();
@@ -144,7 +146,9 @@ void ExecutorThread::run() {
 
             // Now Run the Task ....
             currentTask->setState(TASK_RUNNING, TASK_SNOOZED);
+            cb::tracing::SamplingProfiler::setActivity(curTaskDescr);
             bool again = currentTask->run();
+            cb::tracing::SamplingProfiler::setActivity({});
 
             // Task done, log it ...
             const ProcessClock::duration runtime(ProcessClock::now() -
@@ -212,6 +216,7 @@ void ExecutorThread::run() {
     }
     // Thread is about to terminate - disassociate it from any engine.
     ObjectRegistry::onSwitchThread(nullptr);
+    cb::tracing::SamplingProfiler::unregisterThread();
 
     state = EXECUTOR_DEAD;
 }
@@ -523,7 +523,8 @@ MutationStatus HashTable::insertFromWarmup(
         Item& itm,
         bool eject,
         bool keyMetaDataOnly,
-        item_eviction_policy_t evictionPolicy) {
+        item_eviction_policy_t evictionPolicy,
+        const std::function<bool()>& existingOnly) {
     auto hbl = getLockedBucket(itm.getKey());
     auto* v = unlocked_find(itm.getKey(),
                             hbl.getBucketNum(),
@@ -531,6 +532,11 @@ MutationStatus HashTable::insertFromWarmup(
                             TrackReference::No);
 
     if (v == NULL) {
+        if (existingOnly()) {
+            // The item has been removed since warmup started (for example
+            // deleted by a client once traffic was enabled).
+            return MutationStatus::InvalidCas;
+        }
         v = unlocked_addNewStoredValue(hbl, itm);
 
         // TODO: Would be faster if we just skipped creating the value in the
@@ -775,11 +775,15 @@ public:
      * @param keyMetaDataOnly Is the item being inserted metadata-only?
      * @param evictionPolicy What eviction policy should be used if eject is
      * true?
+     * @param existingOnly If the item isn't in the HashTable, should it be
+     * left out rather than inserted (MutationStatus::InvalidCas is
+     * returned)? Called with the hash bucket lock held.
      */
     MutationStatus insertFromWarmup(Item& itm,
                                     bool eject,
                                     bool keyMetaDataOnly,
-                                    item_eviction_policy_t evictionPolicy);
+                                    item_eviction_policy_t evictionPolicy,
+                                    const std::function<bool()>& existingOnly);
 
     /**
      * Dump a representation of the HashTable to stderr.
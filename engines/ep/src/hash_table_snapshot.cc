@@ -0,0 +1,496 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "hash_table_snapshot.h"
+
+#include "hash_table.h"
+#include "item.h"
+#include "logger.h"
+#include "stored-value.h"
+#include "vbucket.h"
+
+#include <platform/crc32c.h>
+#include <platform/dirutils.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const uint32_t SNAPSHOT_MAGIC = 0x48545331; // "HTS1"
+const uint32_t SNAPSHOT_VERSION = 1;
+
+// magic, version, vbid, high seqno, checksum
+const size_t HEADER_SIZE = 4 + 4 + 2 + 8 + 4;
+
+// payload length, number of items, checksum
+const size_t BLOCK_HEADER_SIZE = 4 + 4 + 4;
+
+// flags, datatype, nru, namespace, key length, value length, item flags,
+// expiry time, cas, by seqno, rev seqno
+const size_t RECORD_HEADER_SIZE = 1 + 1 + 1 + 1 + 2 + 4 + 4 + 4 + 8 + 8 + 8;
+
+// Blocks are flushed to the file once they exceed this size
+const size_t BLOCK_SIZE = 1024 * 1024;
+
+// Upper limit of the size of a block read back from a snapshot. A block
+// may exceed BLOCK_SIZE by the size of its last item.
+const size_t MAX_BLOCK_SIZE = BLOCK_SIZE + 64 * 1024 * 1024;
+
+// Size of the stdio buffer used for the snapshot files
+const size_t FILE_BUFFER_SIZE = 4 * 1024 * 1024;
+
+const uint8_t RECORD_RESIDENT = 0x01;
+
+struct FileCloser {
+    void operator()(FILE* fp) {
+        if (fp != nullptr) {
+            fclose(fp);
+        }
+    }
+};
+
+using unique_file_ptr = std::unique_ptr<FILE, FileCloser>;
+
+/**
+ * Flush the (already fflush'ed) content of the file to disk
+ */
+bool syncFile(FILE* fp) {
+#ifdef WIN32
+    return FlushFileBuffers(HANDLE(_get_osfhandle(_fileno(fp)))) != 0;
+#else
+    int ret;
+    while ((ret = fsync(fileno(fp))) == -1 && (errno == EINTR)) {
+        /* Retry */
+    }
+    return ret == 0;
+#endif
+}
+
+/**
+ * Flush the entries of the directory to disk, making a rename into it
+ * durable. Windows has no equivalent (nor needs one).
+ */
+bool syncDirectory(const std::string& dirname) {
+#ifdef WIN32
+    return true;
+#else
+    const int fd = open(dirname.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    int ret;
+    while ((ret = fsync(fd)) == -1 && (errno == EINTR)) {
+        /* Retry */
+    }
+    close(fd);
+    return ret == 0;
+#endif
+}
+
+/**
+ * All of the fields in the snapshot files are stored in network byte order
+ */
+class Encoder {
+public:
+    explicit Encoder(std::vector<uint8_t>& buffer) : buffer(buffer) {
+    }
+
+    void put8(uint8_t value) {
+        buffer.push_back(value);
+    }
+
+    void put16(uint16_t value) {
+        put8(uint8_t(value >> 8));
+        put8(uint8_t(value));
+    }
+
+    void put32(uint32_t value) {
+        put16(uint16_t(value >> 16));
+        put16(uint16_t(value));
+    }
+
+    void put64(uint64_t value) {
+        put32(uint32_t(value >> 32));
+        put32(uint32_t(value));
+    }
+
+    void put(const void* data, size_t size) {
+        auto* ptr = static_cast<const uint8_t*>(data);
+        buffer.insert(buffer.end(), ptr, ptr + size);
+    }
+
+private:
+    std::vector<uint8_t>& buffer;
+};
+
+class Decoder {
+public:
+    Decoder(const uint8_t* data, size_t size) : ptr(data), end(data + size) {
+    }
+
+    size_t remaining() const {
+        return end - ptr;
+    }
+
+    uint8_t get8() {
+        return *ptr++;
+    }
+
+    uint16_t get16() {
+        uint16_t value = get8();
+        return (value << 8) | get8();
+    }
+
+    uint32_t get32() {
+        uint32_t value = get16();
+        return (value << 16) | get16();
+    }
+
+    uint64_t get64() {
+        uint64_t value = get32();
+        return (value << 32) | get32();
+    }
+
+    const uint8_t* get(size_t size) {
+        auto* ret = ptr;
+        ptr += size;
+        return ret;
+    }
+
+private:
+    const uint8_t* ptr;
+    const uint8_t* end;
+};
+
+/**
+ * Visitor appending the items of a HashTable to the snapshot file, one
+ * block at a time.
+ */
+class SnapshotWriter : public HashTableVisitor {
+public:
+    explicit SnapshotWriter(FILE* fp) : fp(fp) {
+        block.reserve(BLOCK_SIZE + BLOCK_HEADER_SIZE);
+    }
+
+    bool visit(const HashTable::HashBucketLock& lh, StoredValue& v) override {
+        if (v.isTempItem() || v.isDeleted() ||
+            v.getKey().getDocNamespace() == DocNamespace::System) {
+            return true;
+        }
+
+        if (v.isDirty()) {
+            // The item isn't persisted; the snapshot wouldn't match the
+            // high seqno on disk.
+            failed = true;
+            return false;
+        }
+
+        const auto& key = v.getKey();
+        const bool resident = v.isResident() && v.getValue();
+        const uint32_t valueSize =
+                resident ? uint32_t(v.getValue()->valueSize()) : 0;
+
+        if (block.empty()) {
+            block.resize(BLOCK_HEADER_SIZE);
+        }
+
+        Encoder encoder(block);
+        encoder.put8(resident ? RECORD_RESIDENT : 0);
+        encoder.put8(v.getDatatype());
+        encoder.put8(v.getNRUValue());
+        encoder.put8(uint8_t(key.getDocNamespace()));
+        encoder.put16(uint16_t(key.size()));
+        encoder.put32(valueSize);
+        encoder.put32(v.getFlags());
+        encoder.put32(uint32_t(v.getExptime()));
+        encoder.put64(v.getCas());
+        encoder.put64(uint64_t(v.getBySeqno()));
+        encoder.put64(v.getRevSeqno());
+        encoder.put(key.data(), key.size());
+        if (resident) {
+            encoder.put(v.getValue()->getData(), valueSize);
+        }
+        ++blockItems;
+        ++numItems;
+
+        if (block.size() >= BLOCK_SIZE) {
+            return flushBlock();
+        }
+        return true;
+    }
+
+    /**
+     * Write the current block (if any) and the terminating block
+     */
+    bool finish() {
+        if (failed || !flushBlock()) {
+            return false;
+        }
+        block.resize(BLOCK_HEADER_SIZE);
+        blockItems = uint32_t(numItems);
+        return flushBlock();
+    }
+
+    size_t getNumItems() const {
+        return numItems;
+    }
+
+private:
+    bool flushBlock() {
+        if (block.empty()) {
+            return true;
+        }
+
+        const size_t payloadSize = block.size() - BLOCK_HEADER_SIZE;
+        const uint32_t crc =
+                crc32c(block.data() + BLOCK_HEADER_SIZE, payloadSize, 0);
+        std::vector<uint8_t> header;
+        Encoder encoder(header);
+        encoder.put32(uint32_t(payloadSize));
+        encoder.put32(blockItems);
+        encoder.put32(crc);
+        std::copy(header.begin(), header.end(), block.begin());
+
+        if (fwrite(block.data(), block.size(), 1, fp) != 1) {
+            failed = true;
+            return false;
+        }
+        block.clear();
+        blockItems = 0;
+        return true;
+    }
+
+    FILE* fp;
+    std::vector<uint8_t> block;
+    uint32_t blockItems = 0;
+    size_t numItems = 0;
+    bool failed = false;
+};
+
+bool readBlock(FILE* fp,
+               std::vector<uint8_t>& payload,
+               uint32_t& numItems) {
+    uint8_t header[BLOCK_HEADER_SIZE];
+    if (fread(header, sizeof(header), 1, fp) != 1) {
+        return false;
+    }
+    Decoder decoder(header, sizeof(header));
+    const uint32_t payloadSize = decoder.get32();
+    numItems = decoder.get32();
+    const uint32_t crc = decoder.get32();
+    if (payloadSize > MAX_BLOCK_SIZE) {
+        return false;
+    }
+
+    payload.resize(payloadSize);
+    if (payloadSize > 0 && fread(payload.data(), payloadSize, 1, fp) != 1) {
+        return false;
+    }
+    return crc32c(payload.data(), payload.size(), 0) == crc;
+}
+
+} // anonymous namespace
+
+bool HashTableSnapshot::save(VBucket& vb,
+                             const std::string& dbname,
+                             size_t& numItems) {
+    numItems = 0;
+    const auto highSeqno = vb.getHighSeqno();
+    if (uint64_t(highSeqno) != vb.getPersistenceSeqno()) {
+        return false;
+    }
+
+    const auto fname = getFileName(dbname, vb.getId());
+    const auto tmpname = fname + ".tmp";
+    unique_file_ptr fp(fopen(tmpname.c_str(), "wb"));
+    if (!fp) {
+        LOG(EXTENSION_LOG_WARNING,
+            "HashTableSnapshot::save: Failed to create %s: %s",
+            tmpname.c_str(),
+            cb_strerror().c_str());
+        return false;
+    }
+    setvbuf(fp.get(), nullptr, _IOFBF, FILE_BUFFER_SIZE);
+
+    std::vector<uint8_t> header;
+    Encoder encoder(header);
+    encoder.put32(SNAPSHOT_MAGIC);
+    encoder.put32(SNAPSHOT_VERSION);
+    encoder.put16(vb.getId());
+    encoder.put64(uint64_t(highSeqno));
+    encoder.put32(crc32c(header.data(), header.size(), 0));
+
+    SnapshotWriter writer(fp.get());
+    bool success = fwrite(header.data(), header.size(), 1, fp.get()) == 1;
+    if (success) {
+        vb.ht.visit(writer);
+        success = writer.finish();
+    }
+    // The snapshot must be complete on disk before it appears under its
+    // final name, otherwise a crash could leave a truncated snapshot behind.
+    success = fflush(fp.get()) == 0 && success && syncFile(fp.get());
+    fp.reset();
+
+    if (!success || rename(tmpname.c_str(), fname.c_str()) != 0) {
+        ::remove(tmpname.c_str());
+        return false;
+    }
+    if (!syncDirectory(dbname)) {
+        LOG(EXTENSION_LOG_WARNING,
+            "HashTableSnapshot::save: Failed to sync %s: %s",
+            dbname.c_str(),
+            cb_strerror().c_str());
+        ::remove(fname.c_str());
+        return false;
+    }
+    numItems = writer.getNumItems();
+    return true;
+}
+
+HashTableSnapshot::LoadStatus HashTableSnapshot::load(
+        const std::string& dbname,
+        uint16_t vbid,
+        int64_t highSeqno,
+        StatusCallback<GetValue>& cb,
+        size_t& numItems) {
+    numItems = 0;
+    const auto fname = getFileName(dbname, vbid);
+    unique_file_ptr fp(fopen(fname.c_str(), "rb"));
+    if (!fp) {
+        return LoadStatus::NotFound;
+    }
+    setvbuf(fp.get(), nullptr, _IOFBF, FILE_BUFFER_SIZE);
+
+    uint8_t header[HEADER_SIZE];
+    if (fread(header, sizeof(header), 1, fp.get()) != 1) {
+        return LoadStatus::Corrupt;
+    }
+    Decoder decoder(header, sizeof(header));
+    const auto magic = decoder.get32();
+    const auto version = decoder.get32();
+    const auto snapshotVbid = decoder.get16();
+    const auto snapshotSeqno = decoder.get64();
+    const auto crc = decoder.get32();
+    if (magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION ||
+        crc32c(header, HEADER_SIZE - 4, 0) != crc) {
+        return LoadStatus::Corrupt;
+    }
+    if (snapshotVbid != vbid || snapshotSeqno != uint64_t(highSeqno)) {
+        return LoadStatus::Stale;
+    }
+
+    std::vector<uint8_t> payload;
+    payload.reserve(BLOCK_SIZE * 2);
+    uint32_t blockItems;
+    while (readBlock(fp.get(), payload, blockItems)) {
+        if (payload.empty()) {
+            // The terminating block holds the total number of items
+            return blockItems == numItems ? LoadStatus::Success
+                                          : LoadStatus::Corrupt;
+        }
+
+        Decoder records(payload.data(), payload.size());
+        for (uint32_t ii = 0; ii < blockItems; ++ii) {
+            if (records.remaining() < RECORD_HEADER_SIZE) {
+                return LoadStatus::Corrupt;
+            }
+            const auto recordFlags = records.get8();
+            const auto datatype = records.get8();
+            const auto nru = records.get8();
+            const auto ns = DocNamespace(records.get8());
+            const auto keylen = records.get16();
+            const auto valuelen = records.get32();
+            const auto flags = records.get32();
+            const auto exptime = records.get32();
+            const auto cas = records.get64();
+            const auto bySeqno = records.get64();
+            const auto revSeqno = records.get64();
+            if (records.remaining() < size_t(keylen) + valuelen) {
+                return LoadStatus::Corrupt;
+            }
+            const auto* key = records.get(keylen);
+            const auto* value = records.get(valuelen);
+            const bool resident = (recordFlags & RECORD_RESIDENT) != 0;
+
+            auto item = std::make_unique<Item>(DocKey(key, keylen, ns),
+                                               flags,
+                                               exptime,
+                                               value,
+                                               valuelen,
+                                               datatype,
+                                               cas,
+                                               int64_t(bySeqno),
+                                               vbid,
+                                               revSeqno,
+                                               nru);
+            GetValue gv(std::move(item), ENGINE_SUCCESS, -1, !resident);
+            cb.callback(gv);
+            ++numItems;
+            if (cb.getStatus() != ENGINE_SUCCESS) {
+                return LoadStatus::Stopped;
+            }
+        }
+        if (records.remaining() != 0) {
+            return LoadStatus::Corrupt;
+        }
+    }
+
+    return LoadStatus::Corrupt;
+}
+
+void HashTableSnapshot::remove(const std::string& dbname, uint16_t vbid) {
+    const auto fname = getFileName(dbname, vbid);
+    ::remove(fname.c_str());
+}
+
+void HashTableSnapshot::removeAll(const std::string& dbname) {
+    const auto prefix = dbname + "/ht_snapshot.";
+    for (const auto& file : cb::io::findFilesWithPrefix(prefix)) {
+        ::remove(file.c_str());
+    }
+}
+
+std::string HashTableSnapshot::getFileName(const std::string& dbname,
+                                           uint16_t vbid) {
+    return dbname + "/ht_snapshot." + std::to_string(vbid);
+}
+
+const char* HashTableSnapshot::toString(LoadStatus status) {
+    switch (status) {
+    case LoadStatus::Success:
+        return "success";
+    case LoadStatus::NotFound:
+        return "not found";
+    case LoadStatus::Stale:
+        return "stale";
+    case LoadStatus::Corrupt:
+        return "corrupt";
+    case LoadStatus::Stopped:
+        return "stopped";
+    }
+    return "invalid";
+}
@@ -0,0 +1,112 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include "callbacks.h"
+
+#include <cstdint>
+#include <string>
+
+class VBucket;
+
+/**
+ * A HashTableSnapshot is an image of the (clean) StoredValues of a vBucket's
+ * HashTable, written on graceful shutdown so that the next warmup can
+ * restore the HashTable with a single sequential read instead of walking
+ * the by-id B-tree of the vBucket file.
+ *
+ * Each vBucket has its own snapshot file in the database directory. The
+ * file starts with a header recording the vBucket and the high seqno which
+ * was persisted when the snapshot was written, followed by a number of
+ * checksummed blocks of items, and a terminating (empty) block holding the
+ * total number of items. Values are only present for resident items; for
+ * the other items only the metadata is recorded (so that in value eviction
+ * the keys of evicted items don't need to be loaded from disk).
+ *
+ * A snapshot may only be used if the high seqno recorded in it matches the
+ * persisted vbucket_state; the snapshot files are removed during warmup
+ * once they have been consumed (or found to be stale), so that they never
+ * outlive the data they were taken from.
+ */
+class HashTableSnapshot {
+public:
+    enum class LoadStatus {
+        /// All of the items in the snapshot were loaded
+        Success,
+        /// There is no snapshot for the vBucket
+        NotFound,
+        /// The snapshot is for a different high seqno (or vBucket)
+        Stale,
+        /// The snapshot is truncated or failed checksum validation. The
+        /// items in the blocks preceding the corrupt block may have been
+        /// loaded.
+        Corrupt,
+        /// The callback requested us to stop loading
+        Stopped
+    };
+
+    /**
+     * Write a snapshot of the given vBucket's HashTable. The snapshot is
+     * written to a temporary file which is synced to disk and renamed
+     * into place once complete.
+     *
+     * The snapshot is not written (and false is returned) if the vBucket
+     * has any items which are not persisted.
+     *
+     * @param vb the vBucket to snapshot
+     * @param dbname the database directory
+     * @param[out] numItems the number of items written (System namespace
+     *             documents are never part of the snapshot)
+     * @return true if the snapshot was written
+     */
+    static bool save(VBucket& vb, const std::string& dbname, size_t& numItems);
+
+    /**
+     * Load the snapshot of the given vBucket by passing each of the items
+     * in it to the callback (in the same way as a KVStore scan would).
+     * Items without a value are passed as partial (key and metadata only).
+     *
+     * @param dbname the database directory
+     * @param vbid the vBucket to load the snapshot for
+     * @param highSeqno the persisted high seqno of the vBucket
+     * @param cb callback to receive the items; loading stops if the
+     *           callback sets a status other than ENGINE_SUCCESS
+     * @param[out] numItems the number of items passed to the callback
+     */
+    static LoadStatus load(const std::string& dbname,
+                           uint16_t vbid,
+                           int64_t highSeqno,
+                           StatusCallback<GetValue>& cb,
+                           size_t& numItems);
+
+    /**
+     * Remove the snapshot of the given vBucket (if any)
+     */
+    static void remove(const std::string& dbname, uint16_t vbid);
+
+    /**
+     * Remove all of the snapshots in the database directory
+     */
+    static void removeAll(const std::string& dbname);
+
+    static std::string getFileName(const std::string& dbname, uint16_t vbid);
+
+    static const char* toString(LoadStatus status);
+};
@@ -50,6 +50,7 @@ Item::Item(const DocKey& k,
       op(k.getDocNamespace() == DocNamespace::System ? queue_op::system_event
                                                      : queue_op::mutation),
       nru(nru_value),
+      knownDiskState(uint8_t(KnownDiskState::Unknown)),
       datatype(dtype) {
     if (bySeqno == 0) {
         throw std::invalid_argument("Item(): bySeqno must be non-zero");
@@ -78,6 +79,7 @@ Item::Item(const DocKey& k,
       op(k.getDocNamespace() == DocNamespace::System ? queue_op::system_event
                                                      : queue_op::mutation),
       nru(nru_value),
+      knownDiskState(uint8_t(KnownDiskState::Unknown)),
       datatype(dtype) {
     if (bySeqno == 0) {
         throw std::invalid_argument("Item(): bySeqno must be non-zero");
@@ -100,7 +102,8 @@ Item::Item(const DocKey& k,
       vbucketId(vb),
       deleted(false),
       op(o),
-      nru(nru_value) {
+      nru(nru_value),
+      knownDiskState(uint8_t(KnownDiskState::Unknown)) {
     if (bySeqno < 0) {
         throw std::invalid_argument("Item(): bySeqno must be non-negative");
     }
@@ -118,6 +121,7 @@ Item::Item(const Item& other)
       deleted(other.deleted),
       op(other.op),
       nru(other.nru),
+      knownDiskState(other.knownDiskState),
       datatype(other.datatype) {
     ObjectRegistry::onCreateItem(this);
 }
@@ -99,6 +99,20 @@ const uint8_t MIN_NRU_VALUE = 0;
 
 const uint64_t DEFAULT_REV_SEQ_NUM = 1;
 
+/**
+ * What was known, when an item was queued for persistence, about the
+ * document stored on disk for its key. Lets the KVStore skip looking the
+ * key up to tell an insert from an update.
+ */
+enum class KnownDiskState : uint8_t {
+    /// Nothing is known; the KVStore has to look the key up
+    Unknown,
+    /// There is no alive document for the key on disk
+    Absent,
+    /// There is an alive document for the key on disk
+    Alive
+};
+
 /**
  * The ItemMetaData structure is used to pass meta data information of
  * an Item.
@@ -395,6 +409,14 @@ public:
         return nru;
     }
 
+    KnownDiskState getKnownDiskState() const {
+        return static_cast<KnownDiskState>(knownDiskState);
+    }
+
+    void setKnownDiskState(KnownDiskState state) {
+        knownDiskState = static_cast<uint8_t>(state);
+    }
+
     static uint64_t nextCas(void) {
         return ProcessClock::now().time_since_epoch().count() + (++casCounter);
     }
@@ -455,6 +477,7 @@ private:
     bool deleted;
     queue_op op;
     uint8_t nru  : 2;
+    uint8_t knownDiskState : 2;
 
     // Keep a cached version of the datatype. It allows for using
     // "partial" items created from from the hashtable. Every time the
@@ -190,6 +190,8 @@ public:
     virtual void floatValueChanged(const std::string &key, float value) {
         if (key.compare("bfilter_residency_threshold") == 0) {
             store.setBfiltersResidencyThreshold(value);
+        } else if (key.compare("compaction_max_concurrent_ratio") == 0) {
+            store.setCompactionMaxConcurrentRatio(value);
         } else if (key.compare("dcp_min_compression_ratio") == 0) {
             store.getEPEngine().updateDcpMinCompressionRatio(value);
         }
@@ -367,6 +369,11 @@ KVBucket::KVBucket(EventuallyPersistentEngine& theEngine)
             "compaction_write_queue_cap",
             std::make_unique<EPStoreValueChangeListener>(*this));
 
+    compactionMaxConcurrentRatio = config.getCompactionMaxConcurrentRatio();
+    config.addValueChangedListener(
+            "compaction_max_concurrent_ratio",
+            std::make_unique<EPStoreValueChangeListener>(*this));
+
     config.addValueChangedListener(
             "dcp_min_compression_ratio",
             std::make_unique<EPStoreValueChangeListener>(*this));
@@ -1229,11 +1236,25 @@ void KVBucket::appendAggregatedVBucketStats(VBucketCountVisitor& active,
 #undef DO_STAT
 }
 
+/**
+ * End the span covering the time the given cookie waited for its background
+ * fetch (started in EPVBucket::bgFetch). The span is ended by its id, as the
+ * cookie may be waiting for more than one fetch.
+ */
+static void endBGFetchWait(EventuallyPersistentEngine& engine,
+                           const void* cookie,
+                           cb::tracing::SpanId waitSpan) {
+    if (cookie) {
+        engine.getServerApi()->tracing->end_trace_span(cookie, waitSpan);
+    }
+}
+
 void KVBucket::completeBGFetch(const DocKey& key,
                                uint16_t vbucket,
                                const void* cookie,
                                ProcessClock::time_point init,
-                               bool isMeta) {
+                               bool isMeta,
+                               cb::tracing::SpanId waitSpan) {
     TRACE_SCOPE(engine.serverApi, cookie, cb::tracing::TraceCode::BGFETCH);
     ProcessClock::time_point startTime(ProcessClock::now());
     // Go find the data
@@ -1245,9 +1266,10 @@ void KVBucket::completeBGFetch(const DocKey& key,
 
         VBucketPtr vb = getVBucket(vbucket);
         if (vb) {
-            VBucketBGFetchItem item{&gcb, cookie, init, isMeta};
+            VBucketBGFetchItem item{&gcb, cookie, init, isMeta, waitSpan};
             ENGINE_ERROR_CODE status =
                     vb->completeBGFetchForSingleItem(key, item, startTime);
+            endBGFetchWait(engine, item.cookie, item.waitSpan);
             engine.notifyIOComplete(item.cookie, status);
         } else {
             LOG(EXTENSION_LOG_INFO,
@@ -1257,6 +1279,7 @@ void KVBucket::completeBGFetch(const DocKey& key,
                 vbucket,
                 int(key.size()),
                 key.data());
+            endBGFetchWait(engine, cookie, waitSpan);
             engine.notifyIOComplete(cookie, ENGINE_NOT_MY_VBUCKET);
         }
     }
@@ -1274,6 +1297,8 @@ void KVBucket::completeBGFetchMulti(uint16_t vbId,
             auto* fetched_item = item.second;
             ENGINE_ERROR_CODE status = vb->completeBGFetchForSingleItem(
                     key, *fetched_item, startTime);
+            endBGFetchWait(
+                    engine, fetched_item->cookie, fetched_item->waitSpan);
             engine.notifyIOComplete(fetched_item->cookie, status);
         }
         LOG(EXTENSION_LOG_DEBUG,
@@ -1287,6 +1312,8 @@ void KVBucket::completeBGFetchMulti(uint16_t vbId,
                     .count());
     } else {
         for (const auto& item : fetchedItems) {
+            endBGFetchWait(
+                    engine, item.second->cookie, item.second->waitSpan);
             engine.notifyIOComplete(item.second->cookie,
                                     ENGINE_NOT_MY_VBUCKET);
         }
@@ -1840,29 +1867,39 @@ bool KVBucket::maybeEnableTraffic()
             static_cast<double>(stats.getEstimatedTotalMemoryUsed());
     double maxSize = static_cast<double>(stats.getMaxDataSize());
 
+    // We're called for every batch warmup loads; only log the reason for
+    // enabling traffic the first time we decide to do so.
+    const bool log = !enableTrafficLogged.load();
+    bool enable = true;
+
     if (memoryUsed  >= stats.mem_low_wat) {
-        LOG(EXTENSION_LOG_NOTICE,
-            "Total memory use reached to the low water mark, stop warmup"
-            ": memoryUsed (%f) >= low water mark (%" PRIu64 ")",
-            memoryUsed, uint64_t(stats.mem_low_wat.load()));
-        return true;
+        if (log) {
+            LOG(EXTENSION_LOG_NOTICE,
+                "Total memory use reached to the low water mark, stop warmup"
+                ": memoryUsed (%f) >= low water mark (%" PRIu64 ")",
+                memoryUsed, uint64_t(stats.mem_low_wat.load()));
+        }
     } else if (memoryUsed > (maxSize * stats.warmupMemUsedCap)) {
-        LOG(EXTENSION_LOG_NOTICE,
+        if (log) {
+            LOG(EXTENSION_LOG_NOTICE,
                 "Enough MB of data loaded to enable traffic"
                 ": memoryUsed (%f) > (maxSize(%f) * warmupMemUsedCap(%f))",
-                 memoryUsed, maxSize, stats.warmupMemUsedCap.load());
-        return true;
+                memoryUsed, maxSize, stats.warmupMemUsedCap.load());
+        }
     } else if (eviction_policy == VALUE_ONLY &&
                stats.warmedUpValues >=
                                (stats.warmedUpKeys * stats.warmupNumReadCap)) {
         // Let ep-engine think we're done with the warmup phase
         // (we should refactor this into "enableTraffic")
-        LOG(EXTENSION_LOG_NOTICE,
-            "Enough number of items loaded to enable traffic (value eviction)"
-            ": warmedUpValues(%" PRIu64 ") >= (warmedUpKeys(%" PRIu64 ") * "
-            "warmupNumReadCap(%f))",  uint64_t(stats.warmedUpValues.load()),
-            uint64_t(stats.warmedUpKeys.load()), stats.warmupNumReadCap.load());
-        return true;
+        if (log) {
+            LOG(EXTENSION_LOG_NOTICE,
+                "Enough number of items loaded to enable traffic (value "
+                "eviction): warmedUpValues(%" PRIu64 ") >= (warmedUpKeys(%"
+                PRIu64 ") * warmupNumReadCap(%f))",
+                uint64_t(stats.warmedUpValues.load()),
+                uint64_t(stats.warmedUpKeys.load()),
+                stats.warmupNumReadCap.load());
+        }
     } else if (eviction_policy == FULL_EVICTION &&
                stats.warmedUpValues >=
                             (warmupTask->getEstimatedItemCount() *
@@ -1870,21 +1907,31 @@ bool KVBucket::maybeEnableTraffic()
         // In case of FULL EVICTION, warmed up keys always matches the number
         // of warmed up values, therefore for honoring the min_item threshold
         // in this scenario, we can consider warmup's estimated item count.
-        LOG(EXTENSION_LOG_NOTICE,
-            "Enough number of items loaded to enable traffic (full eviction)"
-            ": warmedUpValues(%" PRIu64 ") >= (warmup est items(%" PRIu64 ") * "
-            "warmupNumReadCap(%f))",  uint64_t(stats.warmedUpValues.load()),
-            uint64_t(warmupTask->getEstimatedItemCount()),
-            stats.warmupNumReadCap.load());
-        return true;
+        if (log) {
+            LOG(EXTENSION_LOG_NOTICE,
+                "Enough number of items loaded to enable traffic (full "
+                "eviction): warmedUpValues(%" PRIu64 ") >= (warmup est "
+                "items(%" PRIu64 ") * warmupNumReadCap(%f))",
+                uint64_t(stats.warmedUpValues.load()),
+                uint64_t(warmupTask->getEstimatedItemCount()),
+                stats.warmupNumReadCap.load());
+        }
+    } else {
+        enable = false;
     }
-    return false;
+
+    enableTrafficLogged = enable;
+    return enable;
 }
 
 bool KVBucket::isWarmingUp() {
     return warmupTask && !warmupTask->isComplete();
 }
 
+bool KVBucket::isWarmupBlockingTraffic() {
+    return isWarmingUp() && !warmupTask->isEarlyTrafficEnabled();
+}
+
 bool KVBucket::shouldSetVBStateBlock(const void* cookie) {
     if (warmupTask) {
         return warmupTask->shouldSetVBStateBlock(cookie);
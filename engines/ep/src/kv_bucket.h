@@ -87,7 +87,16 @@ private:
 const uint16_t EP_PRIMARY_SHARD = 0;
 class KVShard;
 
-typedef std::pair<uint16_t, ExTask> CompTaskEntry;
+/**
+ * A compaction task scheduled by the bucket, with the priority it is started
+ * with when it has to wait for other compactions to finish.
+ */
+struct CompTaskEntry {
+    uint16_t db_file_id;
+    ExTask task;
+    /// Higher runs first, see EPBucket::getCompactionPriority
+    uint64_t priority;
+};
 
 
 /**
@@ -321,7 +330,8 @@ public:
                          uint16_t vbucket,
                          const void* cookie,
                          ProcessClock::time_point init,
-                         bool isMeta);
+                         bool isMeta,
+                         cb::tracing::SpanId waitSpan);
     /**
      * Complete a batch of background fetch of a non resident value or metadata.
      *
@@ -656,6 +666,13 @@ public:
 
     bool isWarmingUp();
 
+    /**
+     * Is data traffic blocked by warmup? This is the case until warmup
+     * completes, unless warmup has enabled traffic early (see
+     * Warmup::enableEarlyTraffic).
+     */
+    bool isWarmupBlockingTraffic();
+
     /**
      * Method checks with Warmup if a setVBState should block.
      * On returning true, Warmup will have saved the cookie ready for
@@ -751,6 +768,10 @@ public:
         compactionWriteQueueCap = to;
     }
 
+    void setCompactionMaxConcurrentRatio(float to) {
+        compactionMaxConcurrentRatio = to;
+    }
+
     void setCompactionExpMemThreshold(size_t to) {
         compactionExpMemThreshold = static_cast<double>(to) / 100.0;
     }
@@ -928,6 +949,7 @@ protected:
     // frequency counts do not become saturated.
     ExTask itemFreqDecayerTask;
     size_t                          compactionWriteQueueCap;
+    float                           compactionMaxConcurrentRatio;
     float                           compactionExpMemThreshold;
 
     /* Vector of mutexes for each vbucket
@@ -935,6 +957,11 @@ protected:
     std::vector<std::mutex>       vb_mutexes;
     std::deque<MutationLog>       accessLog;
 
+    /// Has maybeEnableTraffic() logged its (current) decision to enable
+    /// traffic? It's called for every batch warmup loads, so only log
+    /// when the decision changes.
+    std::atomic<bool> enableTrafficLogged{false};
+
     std::atomic<bool> diskDeleteAll;
     struct DeleteAllTaskCtx {
         DeleteAllTaskCtx() : delay(true), cookie(NULL) {
@@ -387,12 +387,14 @@ public:
      * @param init the timestamp of when the request came in
      * @param isMeta whether the fetch is for a non-resident value or metadata of
      *               a (possibly) deleted item
+     * @param waitSpan the cookie's BGFETCH_WAIT span
      */
     virtual void completeBGFetch(const DocKey& key,
                                  uint16_t vbucket,
                                  const void* cookie,
                                  ProcessClock::time_point init,
-                                 bool isMeta) = 0;
+                                 bool isMeta,
+                                 cb::tracing::SpanId waitSpan) = 0;
     /**
      * Complete a batch of background fetch of a non resident value or metadata.
      *
@@ -629,6 +631,8 @@ public:
 
     virtual bool isWarmingUp() = 0;
 
+    virtual bool isWarmupBlockingTraffic() = 0;
+
     virtual bool maybeEnableTraffic(void) = 0;
 
     /**
@@ -691,6 +695,8 @@ public:
 
     virtual void setCompactionWriteQueueCap(size_t to) = 0;
 
+    virtual void setCompactionMaxConcurrentRatio(float to) = 0;
+
     virtual void setCompactionExpMemThreshold(size_t to) = 0;
 
     virtual bool compactionCanExpireItems() = 0;
@@ -37,6 +37,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+const size_t KVStore::DefaultKeyScanBatchSize = 1024;
+
 ScanContext::ScanContext(std::shared_ptr<StatusCallback<GetValue>> cb,
                          std::shared_ptr<StatusCallback<CacheLookup>> cl,
                          uint16_t vb,
@@ -61,6 +63,134 @@ ScanContext::ScanContext(std::shared_ptr<StatusCallback<GetValue>> cb,
       config(_config) {
 }
 
+KeyScanBatch::Record& KeyScanBatch::add(const DocKey& key, int64_t bySeqno) {
+    records.emplace_back();
+    auto& record = records.back();
+    record.bySeqno = bySeqno;
+    record.docNamespace = key.getDocNamespace();
+    record.keyLen = uint16_t(key.size());
+    record.keyOffset = keys.size();
+    keys.insert(keys.end(), key.data(), key.data() + key.size());
+    return record;
+}
+
+/**
+ * Collects the Items read by KVStore::scan() into KeyScanBatches, for the
+ * KVStores which don't implement scanKeys() themselves.
+ */
+class KeyScanBatcher : public StatusCallback<GetValue> {
+public:
+    KeyScanBatcher(StatusCallback<KeyScanBatch>& cb, size_t batchSize)
+        : cb(cb), batchSize(batchSize) {
+    }
+
+    void callback(GetValue& val) override {
+        // Pass on a full batch before adding to it, so that a callback which
+        // stops the scan leaves this item unread.
+        if (batch.size() >= batchSize && !flush()) {
+            setStatus(ENGINE_ENOMEM);
+            return;
+        }
+        const Item& item = *val.item;
+        auto& record = batch.add(item.getKey(), item.getBySeqno());
+        record.cas = item.getCas();
+        record.revSeqno = item.getRevSeqno();
+        record.flags = item.getFlags();
+        record.exptime = uint32_t(item.getExptime());
+        record.datatype = item.getDataType();
+        record.deleted = item.isDeleted();
+        setStatus(ENGINE_SUCCESS);
+    }
+
+    /// @return false if the batch callback asked for the scan to stop
+    bool flush() {
+        if (batch.empty()) {
+            return true;
+        }
+        cb.callback(batch);
+        batch.clear();
+        return cb.getStatus() != ENGINE_ENOMEM;
+    }
+
+private:
+    StatusCallback<KeyScanBatch>& cb;
+    const size_t batchSize;
+    KeyScanBatch batch;
+};
+
+scan_error_t KVStore::scanKeys(ScanContext* sctx,
+                               StatusCallback<KeyScanBatch>& cb,
+                               size_t batchSize) {
+    if (!sctx) {
+        return scan_failed;
+    }
+
+    // Run the scan with a copy of the context which passes the items to the
+    // batcher.
+    auto batcher = std::make_shared<KeyScanBatcher>(cb, batchSize);
+    ScanContext ctx(batcher,
+                    sctx->lookup,
+                    sctx->vbid,
+                    sctx->scanId,
+                    sctx->startSeqno,
+                    sctx->maxSeqno,
+                    sctx->docFilter,
+                    sctx->valFilter,
+                    sctx->documentCount,
+                    sctx->config);
+    ctx.lastReadSeqno = sctx->lastReadSeqno;
+    ctx.logger = sctx->logger;
+
+    auto rv = scan(&ctx);
+    sctx->lastReadSeqno = ctx.lastReadSeqno;
+    if (!batcher->flush() && rv == scan_success) {
+        rv = scan_again;
+    }
+    return rv;
+}
+
+std::string to_string(IOClass ioClass) {
+    switch (ioClass) {
+    case IOClass::Other:
+        return "other";
+    case IOClass::BgFetch:
+        return "bgfetch";
+    case IOClass::Flush:
+        return "flush";
+    case IOClass::Backfill:
+        return "backfill";
+    case IOClass::Compaction:
+        return "compaction";
+    case IOClass::Warmup:
+        return "warmup";
+    }
+    throw std::invalid_argument("to_string(IOClass): unknown value " +
+                                std::to_string(int(ioClass)));
+}
+
+static thread_local IOClass currentIOClass = IOClass::Other;
+
+IOClassScope::IOClassScope(IOClass ioClass) : previous(currentIOClass) {
+    if (previous == IOClass::Other) {
+        currentIOClass = ioClass;
+    }
+}
+
+IOClassScope::~IOClassScope() {
+    currentIOClass = previous;
+}
+
+IOClass IOClassScope::current() {
+    return currentIOClass;
+}
+
+void IOClassTimings::reset() {
+    openTimeHisto.reset();
+    readTimeHisto.reset();
+    writeTimeHisto.reset();
+    syncTimeHisto.reset();
+}
+
 void FileStats::reset() {
     readTimeHisto.reset();
     readSeekHisto.reset();
@@ -72,6 +202,9 @@ void FileStats::reset() {
     writeCountHisto.reset();
     totalBytesRead = 0;
     totalBytesWritten = 0;
+    blockCacheHits = 0;
+    blockCacheMisses = 0;
+    throttleWaitTime = 0;
 }
 
 KVStoreRWRO KVStoreFactory::create(KVStoreConfig& config) {
@@ -287,9 +420,25 @@ void KVStore::addStats(ADD_STAT add_stat, const void *c) {
             st.fsStatsCompaction.totalBytesRead, add_stat, c);
     addStat(prefix, "io_compaction_write_bytes",
             st.fsStatsCompaction.totalBytesWritten, add_stat, c);
+    addStat(prefix, "io_compaction_throttle_time",
+            st.fsStatsCompaction.throttleWaitTime, add_stat, c);
 
-    // Specific to RocksDB. Per-shard stats.
+    // Specific to Couchstore (if the block cache is enabled)
     size_t value = 0;
+    if (getStat("block_cache_hits", value)) {
+        addStat(prefix, "block_cache_hits", value, add_stat, c);
+    }
+    if (getStat("block_cache_misses", value)) {
+        addStat(prefix, "block_cache_misses", value, add_stat, c);
+    }
+    if (getStat("block_cache_size", value)) {
+        addStat(prefix, "block_cache_size", value, add_stat, c);
+    }
+    if (getStat("block_cache_evictions", value)) {
+        addStat(prefix, "block_cache_evictions", value, add_stat, c);
+    }
+
+    // Specific to RocksDB. Per-shard stats.
     // Memory Usage
     if (getStat("kMemTableTotal", value)) {
         addStat(prefix, "rocksdb_kMemTableTotal", value, add_stat, c);
@@ -303,6 +452,10 @@ void KVStore::addStats(ADD_STAT add_stat, const void *c) {
     if (getStat("kCacheTotal", value)) {
         addStat(prefix, "rocksdb_kCacheTotal", value, add_stat, c);
     }
+    // Snapshots
+    if (getStat("kNumSnapshots", value)) {
+        addStat(prefix, "rocksdb_kNumSnapshots", value, add_stat, c);
+    }
     // MemTable Size per-CF
     if (getStat("default_kSizeAllMemTables", value)) {
         addStat(prefix,
@@ -424,6 +577,26 @@ void KVStore::addTimingStats(ADD_STAT add_stat, const void *c) {
     addStat(prefix, "fsReadSeek",  st.fsStats.readSeekHisto,  add_stat, c);
     addStat(prefix, "fsReadCount", st.fsStats.readCountHisto, add_stat, c);
     addStat(prefix, "fsWriteCount", st.fsStats.writeCountHisto, add_stat, c);
+
+    // file ops latency by IOClass (only the ones which saw any)
+    for (size_t ii = 0; ii < NumIOClasses; ++ii) {
+        auto& timings = st.ioClassTimings[ii];
+        const auto suffix = "_" + to_string(IOClass(ii));
+        const std::pair<const char*, MicrosecondHistogram&> histos[] = {
+                {"fsOpenTime", timings.openTimeHisto},
+                {"fsReadTime", timings.readTimeHisto},
+                {"fsWriteTime", timings.writeTimeHisto},
+                {"fsSyncTime", timings.syncTimeHisto}};
+        for (const auto& histo : histos) {
+            if (histo.second.total() > 0) {
+                addStat(prefix,
+                        (histo.first + suffix).c_str(),
+                        histo.second,
+                        add_stat,
+                        c);
+            }
+        }
+    }
 }
 
 void KVStore::optimizeWrites(std::vector<queued_item>& items) {
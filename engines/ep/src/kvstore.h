@@ -28,6 +28,7 @@
 #include <platform/processclock.h>
 
 #include <relaxed_atomic.h>
+#include <array>
 #include <atomic>
 #include <cstring>
 #include <deque>
@@ -237,6 +238,113 @@ public:
     const KVStoreConfig& config;
 };
 
+/**
+ * The keys and metadata of a batch of documents read by KVStore::scanKeys().
+ * The keys are copied into a single buffer, and both it and the records keep
+ * their capacity when the batch is cleared, so that a scan doesn't allocate
+ * for each document.
+ */
+class KeyScanBatch {
+public:
+    struct Record {
+        int64_t bySeqno = 0;
+        uint64_t cas = 0;
+        uint64_t revSeqno = 0;
+        uint32_t flags = 0;
+        uint32_t exptime = 0;
+        protocol_binary_datatype_t datatype = PROTOCOL_BINARY_RAW_BYTES;
+        bool deleted = false;
+
+    private:
+        friend class KeyScanBatch;
+        DocNamespace docNamespace = DocNamespace::DefaultCollection;
+        uint16_t keyLen = 0;
+        size_t keyOffset = 0;
+    };
+
+    /**
+     * Add a document to the batch, copying its key.
+     *
+     * @return the document's record, for the caller to fill in the metadata
+     */
+    Record& add(const DocKey& key, int64_t bySeqno);
+
+    /// @return the key of one of the batch's records
+    DocKey getKey(const Record& record) const {
+        return DocKey(keys.data() + record.keyOffset,
+                      record.keyLen,
+                      record.docNamespace);
+    }
+
+    const std::vector<Record>& getRecords() const {
+        return records;
+    }
+
+    size_t size() const {
+        return records.size();
+    }
+
+    bool empty() const {
+        return records.empty();
+    }
+
+    void clear() {
+        records.clear();
+        keys.clear();
+    }
+
+private:
+    std::vector<Record> records;
+    std::vector<uint8_t> keys;
+};
+
+/**
+ * The kind of work a KVStore does file I/O for, so that the I/O latency can
+ * be broken down by it (see IOClassScope).
+ */
+enum class IOClass : uint8_t {
+    Other,
+    BgFetch,
+    Flush,
+    Backfill,
+    Compaction,
+    Warmup
+};
+
+const size_t NumIOClasses = size_t(IOClass::Warmup) + 1;
+
+std::string to_string(IOClass ioClass);
+
+/**
+ * Sets the IOClass of the file I/O done by the current thread for as long as
+ * it is in scope - unless an enclosing scope has already set one, so that for
+ * example the scans done by warmup count as warmup rather than backfill.
+ */
+class IOClassScope {
+public:
+    explicit IOClassScope(IOClass ioClass);
+
+    ~IOClassScope();
+
+    /// @return the IOClass of the current thread's file I/O
+    static IOClass current();
+
+private:
+    IOClass previous;
+};
+
+/// Latency of the file operations done for one IOClass
+struct IOClassTimings {
+    MicrosecondHistogram openTimeHisto;
+    MicrosecondHistogram readTimeHisto;
+    MicrosecondHistogram writeTimeHisto;
+    MicrosecondHistogram syncTimeHisto;
+
+    void reset();
+};
+
+using IOClassTimingsArray = std::array<IOClassTimings, NumIOClasses>;
+
 struct FileStats {
     // Read time length
     MicrosecondHistogram readTimeHisto;
@@ -261,6 +369,15 @@ struct FileStats {
     std::atomic<size_t> totalBytesRead{0};
     // Total bytes written to disk.
     std::atomic<size_t> totalBytesWritten{0};
+    // Blocks read from the couchstore block cache.
+    std::atomic<size_t> blockCacheHits{0};
+    // Blocks which had to be read from disk by the couchstore block cache.
+    std::atomic<size_t> blockCacheMisses{0};
+    // Time (in microseconds) I/O waited for the compaction rate limit.
+    std::atomic<size_t> throttleWaitTime{0};
+    // Latency by IOClass; shared by the FileStats of one KVStore (may be
+    // null).
+    IOClassTimingsArray* classTimings = nullptr;
 
     void reset();
 };
@@ -294,9 +411,14 @@ public:
       getMultiFsReadCount(0),
       getMultiFsReadHisto(ExponentialGenerator<uint32_t>(6, 1.2), 50),
       getMultiFsReadPerDocHisto(ExponentialGenerator<uint32_t>(6, 1.2),50) {
+        fsStats.classTimings = &ioClassTimings;
+        fsStatsCompaction.classTimings = &ioClassTimings;
     }
 
-    KVStoreStats(const KVStoreStats &copyFrom) {}
+    KVStoreStats(const KVStoreStats &copyFrom) {
+        fsStats.classTimings = &ioClassTimings;
+        fsStatsCompaction.classTimings = &ioClassTimings;
+    }
 
     void reset() {
         docsCommitted = 0;
@@ -324,6 +446,9 @@ public:
         getMultiFsReadHisto.reset();
         getMultiFsReadPerDocHisto.reset();
         fsStats.reset();
+        for (auto& timings : ioClassTimings) {
+            timings.reset();
+        }
     }
 
     // the number of docs committed
@@ -393,6 +518,9 @@ public:
 
     // Underlying stats for OS file operations during compaction
     FileStats fsStatsCompaction;
+
+    // Latency of the OS file operations (of both of the above), by IOClass
+    IOClassTimingsArray ioClassTimings;
 };
 
 /**
@@ -706,6 +834,15 @@ public:
      */
     virtual size_t getItemCount(uint16_t vbid) = 0;
 
+    /**
+     * This method will return the number of (non-deleted) System namespace
+     * documents in the vbucket, i.e. the collections system events. These
+     * are included in getItemCount() but are never in the HashTable.
+     *
+     * vbid - vbucket id
+     */
+    virtual size_t getSystemItemCount(uint16_t vbid) = 0;
+
     /**
      * Rollback the specified vBucket to the state it had at rollbackseqno.
      *
@@ -777,6 +914,26 @@ public:
 
     virtual scan_error_t scan(ScanContext* sctx) = 0;
 
+    /// The default maximum number of records of the batches of scanKeys()
+    static const size_t DefaultKeyScanBatchSize;
+
+    /**
+     * Read the keys and metadata of the documents of a scan (normally
+     * created with ValueFilter::KEYS_ONLY), and pass them to the given
+     * callback in batches of up to batchSize records rather than creating an
+     * Item for each. The scan context's CacheLookup callback is still called
+     * for every key, but its GetValue callback isn't used.
+     *
+     * As with scan(), ENGINE_ENOMEM from either callback stops the scan with
+     * scan_again; the records passed to the batch callback count as read.
+     *
+     * The default implementation batches the Items created by scan().
+     */
+    virtual scan_error_t scanKeys(
+            ScanContext* sctx,
+            StatusCallback<KeyScanBatch>& cb,
+            size_t batchSize = DefaultKeyScanBatchSize);
+
     virtual void destroyScanContext(ScanContext* ctx) = 0;
 
     /**
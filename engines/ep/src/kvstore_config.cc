@@ -28,6 +28,13 @@ public:
     void sizeValueChanged(const std::string& key, size_t value) override {
         if (key == "fsync_after_every_n_bytes_written") {
             config.setPeriodicSyncBytes(value);
+        } else if (key == "compaction_max_bytes_per_sec") {
+            config.setCompactionMaxBytesPerSec(value);
+        } else if (key == "compaction_global_max_bytes_per_sec") {
+            config.setCompactionGlobalMaxBytesPerSec(value);
+        } else if (key == "compaction_throttle_latency_threshold") {
+            config.setCompactionThrottleLatencyThreshold(
+                    std::chrono::microseconds(value));
         }
     }
 
@@ -43,9 +50,25 @@ KVStoreConfig::KVStoreConfig(Configuration& config, uint16_t shardid)
                     shardid,
                     config.isCollectionsPrototypeEnabled()) {
     setPeriodicSyncBytes(config.getFsyncAfterEveryNBytesWritten());
+    setBlockCacheSize(config.getCouchstoreBlockCacheSize());
+    setAsyncReads(config.isCouchstoreAsyncReads());
+    setCompactionMaxBytesPerSec(config.getCompactionMaxBytesPerSec());
+    setCompactionGlobalMaxBytesPerSec(
+            config.getCompactionGlobalMaxBytesPerSec());
+    setCompactionThrottleLatencyThreshold(std::chrono::microseconds(
+            config.getCompactionThrottleLatencyThreshold()));
     config.addValueChangedListener(
             "fsync_after_every_n_bytes_written",
             std::make_unique<ConfigChangeListener>(*this));
+    config.addValueChangedListener(
+            "compaction_max_bytes_per_sec",
+            std::make_unique<ConfigChangeListener>(*this));
+    config.addValueChangedListener(
+            "compaction_global_max_bytes_per_sec",
+            std::make_unique<ConfigChangeListener>(*this));
+    config.addValueChangedListener(
+            "compaction_throttle_latency_threshold",
+            std::make_unique<ConfigChangeListener>(*this));
 }
 
 KVStoreConfig::KVStoreConfig(uint16_t _maxVBuckets,
@@ -61,7 +84,12 @@ KVStoreConfig::KVStoreConfig(uint16_t _maxVBuckets,
       shardId(_shardId),
       logger(&global_logger),
       buffered(true),
-      persistDocNamespace(_persistDocNamespace) {
+      persistDocNamespace(_persistDocNamespace),
+      blockCacheSize(0),
+      asyncReads(false),
+      compactionMaxBytesPerSec(0),
+      compactionGlobalMaxBytesPerSec(0),
+      compactionThrottleLatencyThreshold(0) {
 }
 
 KVStoreConfig::~KVStoreConfig() = default;
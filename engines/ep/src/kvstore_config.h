@@ -22,6 +22,7 @@
 #include "configuration.h"
 #include "logger.h"
 
+#include <chrono>
 #include <string>
 
 class Logger;
@@ -110,6 +111,47 @@ public:
         periodicSyncBytes = bytes;
     }
 
+    size_t getBlockCacheSize() const {
+        return blockCacheSize;
+    }
+
+    void setBlockCacheSize(size_t bytes) {
+        blockCacheSize = bytes;
+    }
+
+    bool isAsyncReads() const {
+        return asyncReads;
+    }
+
+    void setAsyncReads(bool value) {
+        asyncReads = value;
+    }
+
+    size_t getCompactionMaxBytesPerSec() const {
+        return compactionMaxBytesPerSec;
+    }
+
+    void setCompactionMaxBytesPerSec(size_t value) {
+        compactionMaxBytesPerSec = value;
+    }
+
+    size_t getCompactionGlobalMaxBytesPerSec() const {
+        return compactionGlobalMaxBytesPerSec;
+    }
+
+    void setCompactionGlobalMaxBytesPerSec(size_t value) {
+        compactionGlobalMaxBytesPerSec = value;
+    }
+
+    std::chrono::microseconds getCompactionThrottleLatencyThreshold() const {
+        return compactionThrottleLatencyThreshold;
+    }
+
+    void setCompactionThrottleLatencyThreshold(
+            std::chrono::microseconds value) {
+        compactionThrottleLatencyThreshold = value;
+    }
+
 private:
     class ConfigChangeListener;
 
@@ -127,4 +169,25 @@ private:
      * N bytes written.
      */
     uint64_t periodicSyncBytes;
+
+    /**
+     * Size in bytes of the block cache shared by all of the CouchKVStores of
+     * the bucket. Disabled if zero.
+     */
+    size_t blockCacheSize;
+
+    /**
+     * If true, the document bodies of a getMulti are read asynchronously
+     * (with io_uring if available). Only recognised by CouchKVStore.
+     */
+    bool asyncReads;
+
+    /**
+     * Limits (in bytes per second, 0 for none) of the compaction I/O of
+     * the bucket, and of all buckets; and the front-end latency above which
+     * they are temporarily reduced. Only recognised by CouchKVStore.
+     */
+    size_t compactionMaxBytesPerSec;
+    size_t compactionGlobalMaxBytesPerSec;
+    std::chrono::microseconds compactionThrottleLatencyThreshold;
 };
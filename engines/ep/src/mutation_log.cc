@@ -18,7 +18,9 @@
 #include "config.h"
 
 #include <algorithm>
+#include <array>
 #include <fcntl.h>
+#include <limits>
 #include <platform/strerror.h>
 #include <string>
 #include <sys/stat.h>
@@ -295,10 +297,10 @@ void MutationLog::disable() {
     }
 }
 
-void MutationLog::newItem(uint16_t vbucket, const DocKey& key) {
+void MutationLog::newItem(uint16_t vbucket, const DocKey& key, uint8_t freq) {
     if (isEnabled()) {
         MutationLogEntry* mle = MutationLogEntry::newEntry(
-                entryBuffer.get(), MutationLogType::New, vbucket, key);
+                entryBuffer.get(), MutationLogType::New, vbucket, key, freq);
         writeEntry(mle);
     }
 }
@@ -399,10 +401,11 @@ void MutationLog::readInitialBlock() {
 
     headerBlock.set(buf);
 
-    // Check the version is one we can handle, V1 and V2.
+    // Check the version is one we can handle, V1, V2 and V3.
     switch (headerBlock.version()) {
     case MutationLogVersion::V1:
     case MutationLogVersion::V2:
+    case MutationLogVersion::V3:
         break;
     default: {
         std::stringstream ss;
@@ -778,6 +781,11 @@ void MutationLog::iterator::prepItem() {
                 MutationLogEntryV2::newEntry(p, bufferBytesRemaining())->len();
         break;
     }
+    case MutationLogVersion::V3: {
+        copyLen =
+                MutationLogEntryV3::newEntry(p, bufferBytesRemaining())->len();
+        break;
+    }
     }
 
     std::copy_n(p, copyLen, entryBuf.begin());
@@ -793,6 +801,10 @@ size_t MutationLog::iterator::getCurrentEntryLen() const {
         return MutationLogEntryV2::newEntry(entryBuf.begin(), entryBuf.size())
                 ->len();
     }
+    case MutationLogVersion::V3: {
+        return MutationLogEntryV3::newEntry(entryBuf.begin(), entryBuf.size())
+                ->len();
+    }
     }
     throw std::logic_error(
             "MutationLog::iterator::getCurrentEntryLen unknown version " +
@@ -832,22 +844,20 @@ MutationLog::MutationLogEntryHolder MutationLog::iterator::upgradeEntry()
     // The addition of more source versions would mean adding more const
     // pointers here.
     const MutationLogEntryV1* mleV1 = nullptr;
+    const MutationLogEntryV2* mleV2 = nullptr;
     std::unique_ptr<uint8_t[]> allocated;
 
-    // With only two versions this code is a little unnecessary but will
-    // cause the addition of V3 to fail compile. The aim is that the addition of
-    // V3 should now be obvious. I.e. we can step V1->V2->V3 or V2->V3
+    // The aim is that the addition of V4 should now be obvious. I.e. we can
+    // step V1->V2->V3->V4, V2->V3->V4 or V3->V4
     switch (log->headerBlock.version()) {
     case MutationLogVersion::V1: {
         mleV1 = MutationLogEntryV1::newEntry(entryBuf.begin(), entryBuf.size());
         break;
     }
-    /* If V3 exists then add a case for V2, for example:
     case MutationLogVersion::V2: {
         mleV2 = MutationLogEntryV2::newEntry(entryBuf.begin(), entryBuf.size());
         break;
     }
-    */
     case MutationLogVersion::Current: {
         throw std::invalid_argument(
                 "MutationLog::iterator::upgradeEntry cannot"
@@ -870,25 +880,24 @@ MutationLog::MutationLogEntryHolder MutationLog::iterator::upgradeEntry()
         allocated = std::make_unique<uint8_t[]>(
                 MutationLogEntryV2::len(mleV1->getKeylen()));
 
-        // Now in-place construct into the buffer
-        (void) new (allocated.get()) MutationLogEntryV2(*mleV1);
-        // If adding more cases, we should assign the above "new" pointer to a
-        // mleV2 and allow the next case to read it.
+        // Now in-place construct into the buffer and assign to mleV2
+        mleV2 = new (allocated.get()) MutationLogEntryV2(*mleV1);
 
         // fall through
     }
-    /* If V3 exists then add a case (which is hit by V2 falling through)
     case MutationLogVersion::V3: {
         // Upgrade V2 to V3
         // Alloc a buffer using the length read from V2 as input to V3::len
-        allocated = std::make_unique<uint8_t[]>(
-                MutationLogEntryV3::len(mleV2->getKeylen()));
+        auto allocatedV3 = std::make_unique<uint8_t[]>(
+                MutationLogEntryV3::len(mleV2->key().size()));
 
-        // Now in-place construct into the new buffer and assign to mleV3
-        mleV3 = new (allocated.get()) MutationLogEntryV3(*mleV3);
-        // fall through
+        // Now in-place construct into the new buffer. The V2 buffer (if
+        // we allocated one) is released once the V3 entry is built.
+        (void)new (allocatedV3.get()) MutationLogEntryV3(*mleV2);
+        allocated = std::move(allocatedV3);
+        // If adding more cases, we should assign the above "new" pointer to a
+        // mleV3 and allow the next case to read it.
     }
-    */
     }
 
     // transfer ownership to the MutationLogEntryHolder and mark that it's
@@ -1030,6 +1039,46 @@ MutationLog::iterator MutationLogHarvester::loadBatch(
     return it;
 }
 
+void MutationLogHarvester::loadByFrequency() {
+    for (const auto& le : mlog) {
+        ++itemsSeen[int(le->type())];
+
+        // As in loadBatch() only the New entries are of interest for the
+        // access log
+        if (le->type() == MutationLogType::New &&
+            vbid_set.find(le->vbucket()) != vbid_set.end()) {
+            byFrequency[le->freq()].emplace_back(le->vbucket(), le->key());
+        }
+    }
+    nextFreq = byFrequency.size();
+}
+
+bool MutationLogHarvester::loadNextBatch(size_t limit) {
+    if (limit == 0) {
+        limit = std::numeric_limits<size_t>::max();
+    }
+
+    // Move past the frequencies we've loaded all of the keys for, and
+    // release their memory
+    auto skipLoaded = [this]() {
+        while (nextFreq > 0 && byFrequency[nextFreq - 1].empty()) {
+            std::vector<std::pair<uint16_t, StoredDocKey>>().swap(
+                    byFrequency[nextFreq - 1]);
+            --nextFreq;
+        }
+    };
+
+    committed.clear();
+    size_t count = 0;
+    for (skipLoaded(); nextFreq > 0 && count < limit; skipLoaded()) {
+        auto& keys = byFrequency[nextFreq - 1];
+        committed[keys.back().first].emplace(std::move(keys.back().second));
+        keys.pop_back();
+        count++;
+    }
+    return nextFreq > 0;
+}
+
 void MutationLogHarvester::apply(void *arg, mlCallback mlc) {
     for (const uint16_t vb : vbid_set) {
         for (const auto& key : committed[vb]) {
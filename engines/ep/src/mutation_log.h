@@ -44,6 +44,7 @@
 
 #include <array>
 #include <cstring>
+#include <limits>
 #include <memory>
 #include <set>
 #include <string>
@@ -73,7 +74,7 @@ const int MUTATION_LOG_COMPACTOR_FREQ(3600);
 const size_t MIN_LOG_HEADER_SIZE(4096);
 const size_t HEADER_RESERVED(4);
 
-enum class MutationLogVersion { V1 = 1, V2 = 2, Current = V2 };
+enum class MutationLogVersion { V1 = 1, V2 = 2, V3 = 3, Current = V3 };
 
 const size_t LOG_ENTRY_BUF_SIZE(512);
 
@@ -210,7 +211,15 @@ public:
 
     ~MutationLog();
 
-    void newItem(uint16_t vbucket, const DocKey& key);
+    /**
+     * Log a (resident) item.
+     *
+     * @param vbucket the vBucket of the item
+     * @param key the key of the item
+     * @param freq the frequency counter value of the item, used to load the
+     *        hottest items first during warmup
+     */
+    void newItem(uint16_t vbucket, const DocKey& key, uint8_t freq = 0);
 
     void commit1();
 
@@ -512,7 +521,7 @@ class EventuallyPersistentEngine;
 class MutationLogHarvester {
 public:
     MutationLogHarvester(MutationLog &ml, EventuallyPersistentEngine *e = NULL) :
-        mlog(ml), engine(e)
+        mlog(ml), engine(e), nextFreq(byFrequency.size())
     {
         memset(itemsSeen, 0, sizeof(itemsSeen));
     }
@@ -545,6 +554,23 @@ public:
     MutationLog::iterator loadBatch(const MutationLog::iterator& start,
                                         size_t limit);
 
+    /**
+     * Read the entire log in one pass, grouping the New entries (for the
+     * vBuckets set) by their frequency counter value. The keys are then
+     * handed out hottest first by loadNextBatch().
+     */
+    void loadByFrequency();
+
+    /**
+     * Move the next (up to) limit of the keys read by loadByFrequency()
+     * into `committed` (which is cleared first), hottest first.
+     *
+     * @param limit Limit of how many keys should be loaded. Zero means no
+     *              limit.
+     * @return true if there are more keys left to load
+     */
+    bool loadNextBatch(size_t limit);
+
     /**
      * Apply the processed log entries through the given function.
      */
@@ -572,4 +598,11 @@ private:
     std::unordered_map<uint16_t, std::set<StoredDocKey>> committed;
     std::unordered_map<uint16_t, std::set<StoredDocKey>> loading;
     size_t itemsSeen[int(MutationLogType::NumberOfTypes)];
+
+    /// The keys read by loadByFrequency(), indexed by frequency counter
+    std::array<std::vector<std::pair<uint16_t, StoredDocKey>>,
+               std::numeric_limits<uint8_t>::max() + 1>
+            byFrequency;
+    /// One past the frequency loadNextBatch() takes keys from next
+    size_t nextFreq;
 };
@@ -59,6 +59,14 @@ public:
      */
     void preLink(uint64_t cas, uint64_t seqno);
 
+    EventuallyPersistentEngine& getEngine() const {
+        return engine;
+    }
+
+    const void* getCookie() const {
+        return cookie;
+    }
+
     PreLinkDocumentContext(const PreLinkDocumentContext&) = delete;
 
 protected:
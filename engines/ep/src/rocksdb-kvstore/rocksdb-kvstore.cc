@@ -20,6 +20,7 @@
 #include "rocksdb-kvstore.h"
 #include "rocksdb-kvstore_config.h"
 
+#include "collections/vbucket_manifest.h"
 #include "ep_time.h"
 
 #include "kvstore_priv.h"
@@ -27,6 +28,7 @@
 #include <platform/sysinfo.h>
 #include <rocksdb/convenience.h>
 #include <rocksdb/filter_policy.h>
+#include <rocksdb/write_buffer_manager.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -34,6 +36,7 @@
 #include <gsl/gsl>
 #include <limits>
 #include <thread>
+#include <unordered_set>
 
 #include "vbucket.h"
 
@@ -163,11 +166,13 @@ public:
     VBHandle(rocksdb::DB& rdb,
              rocksdb::ColumnFamilyHandle* defaultCFH,
              rocksdb::ColumnFamilyHandle* seqnoCFH,
-             uint16_t vbid)
+             uint16_t vbid,
+             uint64_t revision)
         : rdb(rdb),
           defaultCFH(ColumnFamilyPtr(defaultCFH, rdb)),
           seqnoCFH(ColumnFamilyPtr(seqnoCFH, rdb)),
-          vbid(vbid) {
+          vbid(vbid),
+          revision(revision) {
     }
 
     void dropColumnFamilies() {
@@ -195,11 +200,42 @@ public:
     const ColumnFamilyPtr defaultCFH;
     const ColumnFamilyPtr seqnoCFH;
     const uint16_t vbid;
+    const uint64_t revision;
 };
 
+static const std::string defaultCFPrefix = "default_";
+static const std::string seqnoCFPrefix = "local+seqno_";
+
+// The CFs of a VBucket are named '<prefix><vbid>', followed by '.<revision>'
+// for revisions other than 0 (the CFs created before revisions were used).
+static std::string getCFName(const std::string& prefix,
+                             uint16_t vbid,
+                             uint64_t revision) {
+    auto name = prefix + std::to_string(vbid);
+    if (revision != 0) {
+        name += "." + std::to_string(revision);
+    }
+    return name;
+}
+
+// Parse the name of a 'default_' CF. Returns false for any other CF.
+static bool parseDefaultCFName(const std::string& name,
+                               uint16_t& vbid,
+                               uint64_t& revision) {
+    if (name.compare(0, defaultCFPrefix.size(), defaultCFPrefix) != 0) {
+        return false;
+    }
+    const auto dot = name.find('.', defaultCFPrefix.size());
+    vbid = std::stoi(name.substr(defaultCFPrefix.size(),
+                                 dot - defaultCFPrefix.size()));
+    revision = dot == std::string::npos ? 0 : std::stoull(name.substr(dot + 1));
+    return true;
+}
+
 RocksDBKVStore::RocksDBKVStore(RocksDBKVStoreConfig& configuration)
     : KVStore(configuration),
       vbHandles(configuration.getMaxVBuckets()),
+      vbRevisions(configuration.getMaxVBuckets()),
       in_transaction(false),
       scanCounter(0),
       logger(configuration.getLogger()) {
@@ -218,7 +254,7 @@ RocksDBKVStore::RocksDBKVStore(RocksDBKVStoreConfig& configuration)
     }
 
     // Set number of background threads - note these are per-environment, so
-    // are shared across all DB instances (vBuckets) and all Buckets.
+    // are shared across all DB instances (shards) and all Buckets.
     auto lowPri = configuration.getLowPriBackgroundThreads();
     if (lowPri == 0) {
         lowPri = cb::get_available_cpu_count();
@@ -269,6 +305,17 @@ RocksDBKVStore::RocksDBKVStore(RocksDBKVStoreConfig& configuration)
                 false /*strict_capacity_limit*/,
                 configuration.getBlockCacheHighPriPoolRatio());
     }
+
+    // With a shared Memtables Quota, the WriteBufferManager keeps the total
+    // size of the Memtables of all the CFs under the quota, flushing Memtables
+    // whichever VBucket they belong to when it is exceeded.
+    if (configuration.isMemtablesShared() &&
+        configuration.getMemtablesRatio() > 0.0) {
+        dbOptions.write_buffer_manager =
+                std::make_shared<rocksdb::WriteBufferManager>(
+                        getMemtablesQuota());
+    }
+
     // Configure all the Column Families
     const auto& cfOptions = configuration.getCFOptions();
     const auto& bbtOptions = configuration.getBBTOptions();
@@ -303,6 +350,7 @@ RocksDBKVStore::~RocksDBKVStore() {
     //     "Before delete DB, you have to close All column families by calling
     //      DestroyColumnFamilyHandle() with all the handles."
     vbHandles.clear();
+    deletingVBHandles.clear();
     in_transaction = false;
 }
 
@@ -334,29 +382,32 @@ void RocksDBKVStore::openDB() {
     // MaxShards=4:
     //     cfDescriptors[0] = default_0
     //     cfDescriptors[1] = seqno_0
-    //     cfDescriptors[2] = default_4
-    //     cfDescriptors[3] = seqno_4
+    //     cfDescriptors[2] = default_4.2
+    //     cfDescriptors[3] = seqno_4.2
     //     ..
     // That helps us in populating 'vbHandles' later, because after
     // 'rocksdb::DB::Open' handles[i] will be the handle that we will use
-    // to operate on the ColumnFamily at cfDescriptors[i].
+    // to operate on the ColumnFamily at cfDescriptors[i]. The VBucket and
+    // revision of each pair of CFs are in 'cfRevisions'.
     std::vector<rocksdb::ColumnFamilyDescriptor> cfDescriptors;
-    for (uint16_t vbid = 0; vbid < configuration.getMaxVBuckets(); vbid++) {
-        if ((vbid % configuration.getMaxShards()) ==
-            configuration.getShardId()) {
-            std::string defaultCF = "default_" + std::to_string(vbid);
-            std::string seqnoCF = "local+seqno_" + std::to_string(vbid);
-            if (std::find(cfs.begin(), cfs.end(), defaultCF) != cfs.end()) {
-                if (std::find(cfs.begin(), cfs.end(), seqnoCF) == cfs.end()) {
-                    throw std::logic_error("RocksDBKVStore::openDB: DB '" +
-                                           dbname +
-                                           "' is in inconsistent state: CF " +
-                                           seqnoCF + " not found.");
-                }
-                cfDescriptors.emplace_back(defaultCF, defaultCFOptions);
-                cfDescriptors.emplace_back(seqnoCF, seqnoCFOptions);
-            }
+    std::vector<std::pair<uint16_t, uint64_t>> cfRevisions;
+    for (const auto& defaultCF : cfs) {
+        uint16_t vbid;
+        uint64_t revision;
+        if (!parseDefaultCFName(defaultCF, vbid, revision) ||
+            (vbid % configuration.getMaxShards()) !=
+                    configuration.getShardId()) {
+            continue;
+        }
+        const auto seqnoCF = getCFName(seqnoCFPrefix, vbid, revision);
+        if (std::find(cfs.begin(), cfs.end(), seqnoCF) == cfs.end()) {
+            throw std::logic_error("RocksDBKVStore::openDB: DB '" + dbname +
+                                   "' is in inconsistent state: CF " +
+                                   seqnoCF + " not found.");
         }
+        cfDescriptors.emplace_back(defaultCF, defaultCFOptions);
+        cfDescriptors.emplace_back(seqnoCF, seqnoCFOptions);
+        cfRevisions.emplace_back(vbid, revision);
     }
 
     // TODO: The RocksDB built-in 'default' CF always exists, need to check if
@@ -373,18 +424,23 @@ void RocksDBKVStore::openDB() {
     }
     rdb.reset(db);
 
-    // The way we populated 'cfDescriptors' guarantees that: if 'cfDescriptors'
-    // contains more than only the RocksDB 'default' CF (i.e.,
-    // '(cfDescriptors.size() - 1) > 0') then 'cfDescriptors[i]' and
-    // 'cfDescriptors[i+1]' are respectively the 'default_' and 'seqno'_ CFs
-    // for a certain VBucket.
-    for (uint16_t i = 0; i < (cfDescriptors.size() - 1); i += 2) {
-        // Note: any further sanity-check is redundant as we will have always
-        // 'cf = "default_<vbid>"'.
-        const auto& cf = cfDescriptors[i].name;
-        uint16_t vbid = std::stoi(cf.substr(8));
-        vbHandles[vbid] = std::make_shared<VBHandle>(
-                *rdb, handles[i], handles[i + 1], vbid);
+    // The way we populated 'cfDescriptors' guarantees that
+    // 'cfDescriptors[2 * i]' and 'cfDescriptors[2 * i + 1]' are respectively
+    // the 'default_' and 'seqno_' CFs for 'cfRevisions[i]'.
+    for (size_t i = 0; i < cfRevisions.size(); i++) {
+        const auto vbid = cfRevisions[i].first;
+        const auto revision = cfRevisions[i].second;
+        auto vbh = std::make_shared<VBHandle>(
+                *rdb, handles[2 * i], handles[2 * i + 1], vbid, revision);
+        if (!vbHandles[vbid] || vbHandles[vbid]->revision < revision) {
+            std::swap(vbHandles[vbid], vbh);
+        }
+        if (vbh) {
+            // An older revision, left by a deferred deletion which did not
+            // complete before shutdown.
+            vbh->dropColumnFamilies();
+        }
+        vbRevisions[vbid] = std::max(vbRevisions[vbid], revision);
     }
 
     // We need to release the ColumnFamilyHandle for the built-in 'default' CF
@@ -401,9 +457,11 @@ std::shared_ptr<VBHandle> RocksDBKVStore::getVBHandle(uint16_t vbid) {
     // If the VBHandle for vbid does not exist it means that we need to create
     // the VBucket, i.e. we need to create the set of CFs on DB for vbid
     std::vector<rocksdb::ColumnFamilyDescriptor> cfDescriptors;
-    auto vbid_ = std::to_string(vbid);
-    cfDescriptors.emplace_back("default_" + vbid_, defaultCFOptions);
-    cfDescriptors.emplace_back("local+seqno_" + vbid_, seqnoCFOptions);
+    const auto revision = vbRevisions[vbid];
+    cfDescriptors.emplace_back(getCFName(defaultCFPrefix, vbid, revision),
+                               defaultCFOptions);
+    cfDescriptors.emplace_back(getCFName(seqnoCFPrefix, vbid, revision),
+                               seqnoCFOptions);
 
     std::vector<rocksdb::ColumnFamilyHandle*> handles;
     auto status = rdb->CreateColumnFamilies(cfDescriptors, &handles);
@@ -423,8 +481,8 @@ std::shared_ptr<VBHandle> RocksDBKVStore::getVBHandle(uint16_t vbid) {
                 std::to_string(vbid) + ": " + status.getState());
     }
 
-    vbHandles[vbid] =
-            std::make_shared<VBHandle>(*rdb, handles[0], handles[1], vbid);
+    vbHandles[vbid] = std::make_shared<VBHandle>(
+            *rdb, handles[0], handles[1], vbid, revision);
 
     // The number of VBuckets has increased, we need to re-balance the
     // Memtables Quota among the CFs of existing VBuckets.
@@ -454,7 +512,7 @@ bool RocksDBKVStore::commit(const Item* collectionsManifest) {
         return true;
     }
 
-    if (pendingReqs.size() == 0) {
+    if (pendingReqs.size() == 0 && !collectionsManifest) {
         in_transaction = false;
         return true;
     }
@@ -468,7 +526,8 @@ bool RocksDBKVStore::commit(const Item* collectionsManifest) {
     }
 
     bool success = true;
-    auto vbid = commitBatch[0]->getVBucketId();
+    auto vbid = commitBatch.empty() ? collectionsManifest->getVBucketId()
+                                    : commitBatch[0]->getVBucketId();
 
     // Flush all documents to disk
     auto status = saveDocs(vbid, collectionsManifest, commitBatch);
@@ -595,10 +654,14 @@ GetValue RocksDBKVStore::getWithHeader(void* dbHandle,
                                        bool fetchDelete) {
     std::string value;
     const auto vbh = getVBHandle(vb);
+    // 'dbHandle' is the rollback Snapshot to read from (see 'rollback'), or
+    // nullptr to read the current state.
+    rocksdb::ReadOptions readOptions;
+    readOptions.snapshot = static_cast<const rocksdb::Snapshot*>(dbHandle);
     // TODO RDB: use a PinnableSlice to avoid some memcpy
     rocksdb::Slice keySlice = getKeySlice(key);
-    rocksdb::Status s = rdb->Get(
-            rocksdb::ReadOptions(), vbh->defaultCFH.get(), keySlice, &value);
+    rocksdb::Status s =
+            rdb->Get(readOptions, vbh->defaultCFH.get(), keySlice, &value);
     if (!s.ok()) {
         return GetValue{NULL, ENGINE_KEY_ENOENT};
     }
@@ -653,10 +716,25 @@ void RocksDBKVStore::delVBucket(uint16_t vbid, uint64_t vb_version) {
     std::lock_guard<std::mutex> lg1(writeMutex);
     std::lock_guard<std::mutex> lg2(vbhMutex);
 
-    if (!vbHandles[vbid]) {
+    // If 'prepareToDelete' detached the CFs of this revision then drop them,
+    // as the VBucket may have been re-created since. Else drop the current
+    // CFs of the VBucket.
+    std::shared_ptr<VBHandle> sharedPtr;
+    auto deleting = deletingVBHandles.find({vbid, vb_version});
+    if (deleting != deletingVBHandles.end()) {
+        std::swap(deleting->second, sharedPtr);
+        deletingVBHandles.erase(deleting);
+    } else {
+        std::swap(vbHandles[vbid], sharedPtr);
+        forgetRollbackSnapshots(vbid);
+    }
+
+    if (!sharedPtr) {
         logger.log(EXTENSION_LOG_WARNING,
-                   "RocksDBKVStore::delVBucket: VBucket not found, vb:%" PRIu16,
-                   vbid);
+                   "RocksDBKVStore::delVBucket: VBucket not found, vb:%" PRIu16
+                   ", rev:%" PRIu64,
+                   vbid,
+                   vb_version);
         return;
     }
 
@@ -670,21 +748,40 @@ void RocksDBKVStore::delVBucket(uint16_t vbid, uint64_t vb_version) {
     // So, the thread executing 'delVBucket' spins until it is the exclusive
     // owner of the shared_ptr (i.e., other concurrent threads like 'commit'
     // have completed and do not own any copy of the shared_ptr).
-    {
-        std::shared_ptr<VBHandle> sharedPtr;
-        std::swap(vbHandles[vbid], sharedPtr);
-        while (!sharedPtr.unique()) {
-            std::this_thread::sleep_for(std::chrono::microseconds(100));
-        }
-        // Drop all the CF for vbid.
-        sharedPtr->dropColumnFamilies();
+    while (!sharedPtr.unique()) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
     }
+    // Drop all the CF for vbid.
+    sharedPtr->dropColumnFamilies();
+    sharedPtr.reset();
 
     // The number of VBuckets has decreased, we need to re-balance the
     // Memtables Quota among the CFs of existing VBuckets.
     applyMemtablesQuota(lg2);
 }
 
+void RocksDBKVStore::incrementRevision(uint16_t vbid) {
+    std::lock_guard<std::mutex> lg(vbhMutex);
+    vbRevisions[vbid]++;
+}
+
+uint64_t RocksDBKVStore::prepareToDelete(uint16_t vbid) {
+    std::lock_guard<std::mutex> lg(vbhMutex);
+    auto& vbh = vbHandles[vbid];
+    const auto revision = vbh ? vbh->revision : vbRevisions[vbid];
+    auto& deleting = deletingVBHandles[{vbid, revision}];
+    if (vbh) {
+        deleting = std::move(vbh);
+    }
+    // Any CFs created from now on (e.g., by a 'get' before the VBucket is
+    // re-created) must not clash with the ones being deleted.
+    vbRevisions[vbid] = std::max(vbRevisions[vbid], revision + 1);
+
+    forgetRollbackSnapshots(vbid);
+
+    return revision;
+}
+
 bool RocksDBKVStore::snapshotVBucket(uint16_t vbucketId,
                                      const vbucket_state& vbstate,
                                      VBStatePersist options) {
@@ -759,6 +856,17 @@ bool RocksDBKVStore::getStat(const char* name_, size_t& value) {
         return getStatFromMemUsage(rocksdb::MemoryUtil::kCacheTotal, value);
     }
 
+    // Snapshots (for rollback and for scans)
+    else if (name == "kNumSnapshots") {
+        uint64_t numSnapshots = 0;
+        if (!rdb->GetIntProperty(rocksdb::DB::Properties::kNumSnapshots,
+                                 &numSnapshots)) {
+            return false;
+        }
+        value = numSnapshots;
+        return true;
+    }
+
     // MemTable Size per Column Famiy
     else if (name == "default_kSizeAllMemTables") {
         return getStatFromProperties(ColumnFamily::Default,
@@ -867,11 +975,24 @@ rocksdb::StatsLevel RocksDBKVStore::getStatsLevel(
     }
 }
 
-rocksdb::Slice RocksDBKVStore::getKeySlice(const DocKey& key) {
+rocksdb::Slice RocksDBKVStore::getKeySlice(const StoredDocKey& key) {
+    if (configuration.shouldPersistDocNamespace()) {
+        return rocksdb::Slice(
+                reinterpret_cast<const char*>(key.getDocNameSpacedData()),
+                key.getDocNameSpacedSize());
+    }
     return rocksdb::Slice(reinterpret_cast<const char*>(key.data()),
                           key.size());
 }
 
+DocKey RocksDBKVStore::makeDocKey(const rocksdb::Slice& keySlice) {
+    const auto* data = reinterpret_cast<const uint8_t*>(keySlice.data());
+    if (configuration.shouldPersistDocNamespace()) {
+        return DocKey(data + 1, keySlice.size() - 1, DocNamespace(data[0]));
+    }
+    return DocKey(data, keySlice.size(), DocNamespace::DefaultCollection);
+}
+
 rocksdb::Slice RocksDBKVStore::getSeqnoSlice(const int64_t* seqno) {
     return rocksdb::Slice(reinterpret_cast<const char*>(seqno), sizeof(*seqno));
 }
@@ -1174,7 +1295,7 @@ rocksdb::Status RocksDBKVStore::saveDocs(
         const Item* collectionsManifest,
         const std::vector<std::unique_ptr<RocksRequest>>& commitBatch) {
     auto reqsSize = commitBatch.size();
-    if (reqsSize == 0) {
+    if (reqsSize == 0 && !collectionsManifest) {
         st.docsCommitted = 0;
         return rocksdb::Status::OK();
     }
@@ -1185,6 +1306,8 @@ rocksdb::Status RocksDBKVStore::saveDocs(
                                std::to_string(vbid) + "] is NULL");
     }
 
+    std::lock_guard<std::mutex> lg(eraseMutex);
+
     rocksdb::Status status;
     int64_t maxDBSeqno = 0;
     rocksdb::WriteBatch batch;
@@ -1213,9 +1336,7 @@ rocksdb::Status RocksDBKVStore::saveDocs(
         // updates for at least 2 CFs (key & seqno) which will be written into
         // separate memtables, so we don't exactly know the size contribution
         // to each memtable in the batch.
-        const auto batchLimit = defaultCFOptions.write_buffer_size +
-                                seqnoCFOptions.write_buffer_size;
-        if (batch.GetDataSize() > batchLimit) {
+        if (batch.GetDataSize() > writeBatchLimit) {
             status = writeAndTimeBatch(batch);
             if (!status.ok()) {
                 logger.log(EXTENSION_LOG_WARNING,
@@ -1238,6 +1359,22 @@ rocksdb::Status RocksDBKVStore::saveDocs(
         return status;
     }
 
+    if (collectionsManifest) {
+        auto key = getCollectionsManifestKey();
+        status = batch.Put(vbh->seqnoCFH.get(),
+                           getSeqnoSlice(&key),
+                           Collections::VB::Manifest::serialToJson(
+                                   *collectionsManifest));
+        if (!status.ok()) {
+            logger.log(EXTENSION_LOG_WARNING,
+                       "RocksDBKVStore::saveDocs: saving the collections "
+                       "manifest error:%d, vb:%" PRIu16,
+                       status.code(),
+                       vbid);
+            return status;
+        }
+    }
+
     status = writeAndTimeBatch(batch);
     if (!status.ok()) {
         logger.log(EXTENSION_LOG_WARNING,
@@ -1253,7 +1390,7 @@ rocksdb::Status RocksDBKVStore::saveDocs(
 
     // Check and update last seqno
     auto lastSeqno = readHighSeqnoFromDisk(*vbh);
-    if (maxDBSeqno != lastSeqno) {
+    if (reqsSize > 0 && maxDBSeqno != lastSeqno) {
         logger.log(EXTENSION_LOG_WARNING,
                    "RocksDBKVStore::saveDocs: Seqno in db header (%" PRIu64
                    ") is not matched with what was persisted (%" PRIu64
@@ -1264,6 +1401,8 @@ rocksdb::Status RocksDBKVStore::saveDocs(
     }
     vbstate->highSeqno = lastSeqno;
 
+    maybeTakeRollbackSnapshot(reqsSize);
+
     return rocksdb::Status::OK();
 }
 
@@ -1311,9 +1450,12 @@ rocksdb::Status RocksDBKVStore::addRequestToWriteBatch(
     return rocksdb::Status::OK();
 }
 
-int64_t RocksDBKVStore::readHighSeqnoFromDisk(const VBHandle& vbh) {
+int64_t RocksDBKVStore::readHighSeqnoFromDisk(
+        const VBHandle& vbh, const rocksdb::Snapshot* snapshot) {
+    rocksdb::ReadOptions readOpts;
+    readOpts.snapshot = snapshot;
     std::unique_ptr<rocksdb::Iterator> it(
-            rdb->NewIterator(rocksdb::ReadOptions(), vbh.seqnoCFH.get()));
+            rdb->NewIterator(readOpts, vbh.seqnoCFH.get()));
 
     // Seek to the highest seqno=>key mapping stored for the vbid
     auto maxSeqno = std::numeric_limits<int64_t>::max();
@@ -1335,6 +1477,416 @@ int64_t RocksDBKVStore::getVbstateKey() {
     return -9999;
 }
 
+int64_t RocksDBKVStore::getCollectionsManifestKey() {
+    // Stored next to the VBState, see 'getVbstateKey'
+    return -9998;
+}
+
+std::string RocksDBKVStore::getCollectionsManifest(uint16_t vbid) {
+    const auto vbh = getVBHandle(vbid);
+    auto key = getCollectionsManifestKey();
+    std::string manifest;
+    auto status = rdb->Get(rocksdb::ReadOptions(),
+                           vbh->seqnoCFH.get(),
+                           getSeqnoSlice(&key),
+                           &manifest);
+    if (!status.ok()) {
+        if (status.IsNotFound()) {
+            logger.log(EXTENSION_LOG_NOTICE,
+                       "RocksDBKVStore::getCollectionsManifest: manifest not "
+                       "found, vb:%" PRIu16,
+                       vbid);
+        } else {
+            logger.log(EXTENSION_LOG_WARNING,
+                       "RocksDBKVStore::getCollectionsManifest: error:%s, "
+                       "vb:%" PRIu16,
+                       status.getState(),
+                       vbid);
+        }
+        return {};
+    }
+    return manifest;
+}
+
+void RocksDBKVStore::maybeTakeRollbackSnapshot(size_t persisted) {
+    auto& configuration =
+            dynamic_cast<RocksDBKVStoreConfig&>(this->configuration);
+    const auto interval = configuration.getRollbackSnapshotInterval();
+    const auto count = configuration.getRollbackSnapshotCount();
+    if (interval == 0 || count == 0) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lg(rollbackSnapshotsMutex);
+        seqnosSinceRollbackSnapshot += persisted;
+        if (seqnosSinceRollbackSnapshot < interval) {
+            return;
+        }
+        seqnosSinceRollbackSnapshot = 0;
+    }
+
+    std::vector<std::shared_ptr<VBHandle>> handles;
+    {
+        std::lock_guard<std::mutex> lg(vbhMutex);
+        for (const auto& vbh : vbHandles) {
+            if (vbh) {
+                handles.push_back(vbh);
+            }
+        }
+    }
+
+    // Note: a Snapshot prevents RocksDB from discarding (on Compaction) any
+    // item version visible in it, so the retention must stay bounded. One
+    // Snapshot covers all the VBuckets, with the high seqno of each of them
+    // in it.
+    RollbackSnapshot rbs;
+    rbs.snapshot = std::shared_ptr<const rocksdb::Snapshot>(
+            rdb->GetSnapshot(), SnapshotDeleter(*rdb));
+    for (const auto& vbh : handles) {
+        rbs.vbuckets[vbh->vbid] = {
+                vbh->revision,
+                readHighSeqnoFromDisk(*vbh, rbs.snapshot.get())};
+    }
+    // Do not hold the VBHandles, 'delVBucket' waits for them to be released
+    handles.clear();
+
+    std::lock_guard<std::mutex> lg(rollbackSnapshotsMutex);
+    rollbackSnapshots.push_back(std::move(rbs));
+    while (rollbackSnapshots.size() > count) {
+        rollbackSnapshots.pop_front();
+    }
+}
+
+void RocksDBKVStore::forgetRollbackSnapshots(uint16_t vbid) {
+    std::lock_guard<std::mutex> lg(rollbackSnapshotsMutex);
+    for (auto& rbs : rollbackSnapshots) {
+        rbs.vbuckets.erase(vbid);
+    }
+    rollbackSnapshots.erase(
+            std::remove_if(rollbackSnapshots.begin(),
+                           rollbackSnapshots.end(),
+                           [](const RollbackSnapshot& rbs) {
+                               return rbs.vbuckets.empty();
+                           }),
+            rollbackSnapshots.end());
+}
+
+RollbackResult RocksDBKVStore::rollback(uint16_t vbid,
+                                        uint64_t rollbackSeqno,
+                                        std::shared_ptr<RollbackCB> cb) {
+    const auto vbh = getVBHandle(vbid);
+    const int64_t latestSeqno = readHighSeqnoFromDisk(*vbh);
+    if (latestSeqno <= int64_t(rollbackSeqno)) {
+        // Nothing has been persisted after the rollback point
+        vbucket_state* vb_state = getVBucketState(vbid);
+        return RollbackResult(true,
+                              vb_state->highSeqno,
+                              vb_state->lastSnapStart,
+                              vb_state->lastSnapEnd);
+    }
+
+    // Take the most recent Snapshot at or before the rollback point, taken
+    // for the current revision of the VBucket. The Snapshots with a higher
+    // seqno for the VBucket hold a history which is discarded by the
+    // rollback, so they cannot be used for it any more.
+    std::shared_ptr<const rocksdb::Snapshot> snapshot;
+    int64_t snapSeqno = 0;
+    {
+        std::lock_guard<std::mutex> lg(rollbackSnapshotsMutex);
+        for (auto it = rollbackSnapshots.rbegin();
+             it != rollbackSnapshots.rend();
+             ++it) {
+            const auto vb = it->vbuckets.find(vbid);
+            if (vb != it->vbuckets.end() &&
+                vb->second.revision == vbh->revision &&
+                vb->second.highSeqno <= int64_t(rollbackSeqno)) {
+                snapSeqno = vb->second.highSeqno;
+                snapshot = it->snapshot;
+                break;
+            }
+        }
+        for (auto& rbs : rollbackSnapshots) {
+            const auto vb = rbs.vbuckets.find(vbid);
+            if (vb != rbs.vbuckets.end() &&
+                (vb->second.revision != vbh->revision ||
+                 vb->second.highSeqno > snapSeqno)) {
+                rbs.vbuckets.erase(vb);
+            }
+        }
+    }
+    if (!snapshot) {
+        logger.log(EXTENSION_LOG_NOTICE,
+                   "RocksDBKVStore::rollback: No Snapshot at or before "
+                   "seqno:%" PRIu64 ", vb:%" PRIu16,
+                   rollbackSeqno,
+                   vbid);
+        return RollbackResult(false, 0, 0, 0);
+    }
+
+    // As for Couchstore, if we would discard more than half of the seqnos
+    // then prefer to discard everything (than have to patch up a large amount
+    // of in-memory data).
+    if ((latestSeqno / 2) <= (latestSeqno - snapSeqno)) {
+        return RollbackResult(false, 0, 0, 0);
+    }
+
+    // Iterate across the keys which have been updated since the Snapshot,
+    // invoking the callback on each. The callback looks the key up in the
+    // Snapshot (see 'getWithHeader') and corrects the in-memory view.
+    cb->setDbHeader(const_cast<rocksdb::Snapshot*>(snapshot.get()));
+    auto cl = std::make_shared<NoLookupCallback>();
+    ScanContext* ctx = initScanContext(cb,
+                                       cl,
+                                       vbid,
+                                       snapSeqno + 1,
+                                       DocumentFilter::ALL_ITEMS,
+                                       ValueFilter::KEYS_ONLY);
+    scan_error_t error = scan(ctx);
+    destroyScanContext(ctx);
+
+    if (error != scan_success) {
+        return RollbackResult(false, 0, 0, 0);
+    }
+
+    auto status = restoreSnapshot(*vbh, snapshot.get(), snapSeqno);
+    if (!status.ok()) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "RocksDBKVStore::rollback: restoreSnapshot error:%s, "
+                   "vb:%" PRIu16,
+                   status.getState(),
+                   vbid);
+        return RollbackResult(false, 0, 0, 0);
+    }
+
+    readVBState(*vbh);
+
+    vbucket_state* vb_state = getVBucketState(vbid);
+    return RollbackResult(true,
+                          vb_state->highSeqno,
+                          vb_state->lastSnapStart,
+                          vb_state->lastSnapEnd);
+}
+
+rocksdb::Status RocksDBKVStore::restoreSnapshot(
+        const VBHandle& vbh,
+        const rocksdb::Snapshot* snapshot,
+        int64_t snapSeqno) {
+    rocksdb::WriteBatch batch;
+
+    // Remove the seqno=>key mappings persisted after the Snapshot, and
+    // collect the keys they refer to.
+    std::unordered_set<std::string> keys;
+    std::unique_ptr<rocksdb::Iterator> it(
+            rdb->NewIterator(rocksdb::ReadOptions(), vbh.seqnoCFH.get()));
+    auto startSeqno = snapSeqno + 1;
+    for (it->Seek(getSeqnoSlice(&startSeqno)); it->Valid(); it->Next()) {
+        auto status = batch.Delete(vbh.seqnoCFH.get(), it->key());
+        if (!status.ok()) {
+            return status;
+        }
+        keys.insert(it->value().ToString());
+    }
+    if (!it->status().ok()) {
+        return it->status();
+    }
+
+    // Put back the version of those keys visible in the Snapshot, or remove
+    // them if they did not exist yet.
+    rocksdb::ReadOptions snapshotOpts;
+    snapshotOpts.snapshot = snapshot;
+    for (const auto& key : keys) {
+        std::string value;
+        auto status =
+                rdb->Get(snapshotOpts, vbh.defaultCFH.get(), key, &value);
+        if (status.ok()) {
+            status = batch.Put(vbh.defaultCFH.get(), key, value);
+        } else if (status.IsNotFound()) {
+            status = batch.Delete(vbh.defaultCFH.get(), key);
+        }
+        if (!status.ok()) {
+            return status;
+        }
+    }
+
+    // Finally, restore the vbstate and the collections manifest persisted
+    // with the Snapshot
+    for (auto key : {getVbstateKey(), getCollectionsManifestKey()}) {
+        rocksdb::Slice keySlice = getSeqnoSlice(&key);
+        std::string value;
+        auto status =
+                rdb->Get(snapshotOpts, vbh.seqnoCFH.get(), keySlice, &value);
+        if (status.ok()) {
+            status = batch.Put(vbh.seqnoCFH.get(), keySlice, value);
+        } else if (status.IsNotFound()) {
+            status = batch.Delete(vbh.seqnoCFH.get(), keySlice);
+        }
+        if (!status.ok()) {
+            return status;
+        }
+    }
+
+    return rdb->Write(writeOptions, &batch);
+}
+
+bool RocksDBKVStore::compactDB(compaction_ctx* ctx) {
+    if (!ctx->collectionsEraser) {
+        return true;
+    }
+
+    const uint16_t vbid = ctx->db_file_id;
+    const auto vbh = getVBHandle(vbid);
+
+    // Nothing can be written to the VBucket between taking the Snapshot and
+    // reading its high seqno.
+    SnapshotPtr snapshot(nullptr, *rdb);
+    int64_t snapSeqno;
+    {
+        std::lock_guard<std::mutex> lg(eraseMutex);
+        snapshot.reset(rdb->GetSnapshot());
+        snapSeqno = readHighSeqnoFromDisk(*vbh);
+    }
+
+    // Find the runs of consecutive keys to erase (the first and last key of
+    // each run). As the keys of a collection are contiguous, a dropped
+    // collection is usually a single run.
+    std::vector<std::pair<std::string, std::string>> ranges;
+    bool inRange = false;
+    rocksdb::ReadOptions snapshotOpts;
+    snapshotOpts.snapshot = snapshot.get();
+    std::unique_ptr<rocksdb::Iterator> it(
+            rdb->NewIterator(snapshotOpts, vbh->defaultCFH.get()));
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        rockskv::MetaData meta;
+        std::memcpy(&meta, it->value().data(), sizeof(meta));
+        if (ctx->collectionsEraser(makeDocKey(it->key()), meta.bySeqno)) {
+            ctx->stats.collectionsItemsPurged++;
+            if (!inRange) {
+                ranges.emplace_back(it->key().ToString(), std::string());
+                inRange = true;
+            }
+            ranges.back().second = it->key().ToString();
+        } else {
+            inRange = false;
+        }
+    }
+    if (!it->status().ok()) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "RocksDBKVStore::compactDB: iterator error:%s, vb:%" PRIu16,
+                   it->status().getState(),
+                   vbid);
+        return false;
+    }
+    if (ranges.empty()) {
+        return true;
+    }
+
+    rocksdb::WriteBatch batch;
+    std::lock_guard<std::mutex> lg(eraseMutex);
+    if (readHighSeqnoFromDisk(*vbh) == snapSeqno) {
+        // Nothing has been written since the Snapshot, so each run is exactly
+        // the keys in [first, last]. DeleteRange excludes the end key, which
+        // is the successor of 'last'.
+        for (const auto& range : ranges) {
+            auto status = batch.DeleteRange(
+                    vbh->defaultCFH.get(), range.first, range.second + '\0');
+            if (!status.ok()) {
+                return false;
+            }
+        }
+    } else {
+        // Keys may have been written into the runs since the Snapshot (e.g.,
+        // if a collection has been re-created), delete only the ones which
+        // have not changed.
+        std::unique_ptr<rocksdb::Iterator> current(rdb->NewIterator(
+                rocksdb::ReadOptions(), vbh->defaultCFH.get()));
+        for (const auto& range : ranges) {
+            for (current->Seek(range.first);
+                 current->Valid() && current->key().compare(range.second) <= 0;
+                 current->Next()) {
+                rockskv::MetaData meta;
+                std::memcpy(&meta, current->value().data(), sizeof(meta));
+                if (meta.bySeqno <= snapSeqno) {
+                    auto status =
+                            batch.Delete(vbh->defaultCFH.get(), current->key());
+                    if (!status.ok()) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    auto status = rdb->Write(writeOptions, &batch);
+    if (!status.ok()) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "RocksDBKVStore::compactDB: Write error:%s, vb:%" PRIu16,
+                   status.getState(),
+                   vbid);
+        return false;
+    }
+    return true;
+}
+
+ENGINE_ERROR_CODE RocksDBKVStore::getAllKeys(
+        uint16_t vbid,
+        const DocKey start_key,
+        uint32_t count,
+        std::shared_ptr<Callback<const DocKey&>> cb) {
+    const auto vbh = getVBHandle(vbid);
+    const StoredDocKey startKey(start_key);
+    std::unique_ptr<rocksdb::Iterator> it(
+            rdb->NewIterator(rocksdb::ReadOptions(), vbh->defaultCFH.get()));
+    for (it->Seek(getKeySlice(startKey)); it->Valid() && count > 0;
+         it->Next()) {
+        rockskv::MetaData meta;
+        std::memcpy(&meta, it->value().data(), sizeof(meta));
+        if (meta.deleted) {
+            continue;
+        }
+        const DocKey key = makeDocKey(it->key());
+        cb->callback(key);
+        count--;
+    }
+    if (!it->status().ok()) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "RocksDBKVStore::getAllKeys: iterator error:%s, vb:%" PRIu16,
+                   it->status().getState(),
+                   vbid);
+        return ENGINE_FAILED;
+    }
+    return ENGINE_SUCCESS;
+}
+
+size_t RocksDBKVStore::getSystemItemCount(uint16_t vbid) {
+    // All of the System documents start with the system event prefix, so
+    // they are adjacent in the default CF.
+    const StoredDocKey prefix(Collections::SystemEventPrefix,
+                              DocNamespace::System);
+    const auto prefixSlice = getKeySlice(prefix);
+    const auto vbh = getVBHandle(vbid);
+    std::unique_ptr<rocksdb::Iterator> it(
+            rdb->NewIterator(rocksdb::ReadOptions(), vbh->defaultCFH.get()));
+    size_t count = 0;
+    for (it->Seek(prefixSlice);
+         it->Valid() && it->key().starts_with(prefixSlice);
+         it->Next()) {
+        rockskv::MetaData meta;
+        std::memcpy(&meta, it->value().data(), sizeof(meta));
+        if (!meta.deleted) {
+            ++count;
+        }
+    }
+    if (!it->status().ok()) {
+        logger.log(EXTENSION_LOG_WARNING,
+                   "RocksDBKVStore::getSystemItemCount: iterator error:%s, "
+                   "vb:%" PRIu16,
+                   it->status().getState(),
+                   vbid);
+    }
+    return count;
+}
+
 ScanContext* RocksDBKVStore::initScanContext(
         std::shared_ptr<StatusCallback<GetValue>> cb,
         std::shared_ptr<StatusCallback<CacheLookup>> cl,
@@ -1426,10 +1978,7 @@ scan_error_t RocksDBKVStore::scan(ScanContext* ctx) {
 
         rocksdb::Slice valSlice(valueStr);
 
-        // TODO RDB: Deal with collections
-        DocKey key(reinterpret_cast<const uint8_t*>(keySlice.data()),
-                   keySlice.size(),
-                   DocNamespace::DefaultCollection);
+        DocKey key = makeDocKey(keySlice);
 
         std::unique_ptr<Item> itm =
                 makeItem(ctx->vbid, key, valSlice, isMetaOnly);
@@ -1585,9 +2134,7 @@ void RocksDBKVStore::applyMemtablesQuota(
     // write_buffer_size for both the 'default' and the 'seqno' CFs is left
     // to the baseline value.
     if (configuration.getMemtablesRatio() > 0.0 && vbuckets > 0) {
-        const auto memtablesQuota = configuration.getBucketQuota() /
-                                    configuration.getMaxShards() *
-                                    configuration.getMemtablesRatio();
+        const auto memtablesQuota = getMemtablesQuota();
         // TODO: for now I am hard-coding the percentage of Memtables Quota
         // that we allocate for the 'deafult' (90%) and 'seqno' (10%) CFs. The
         // plan is to expose this percentage as a configuration parameter in a
@@ -1596,13 +2143,18 @@ void RocksDBKVStore::applyMemtablesQuota(
         const auto seqnoCFMemtablesQuota =
                 memtablesQuota - defaultCFMemtablesQuota;
 
+        // If the quota is shared then the WriteBufferManager enforces the
+        // total, so that the Memtables of a busy VBucket can use the quota
+        // left by the idle ones. Else each VBucket gets an even slice.
+        const auto slices = configuration.isMemtablesShared() ? 1 : vbuckets;
+
         // Set the the write_buffer_size for the 'default' CF
         defaultCFOptions.write_buffer_size =
-                defaultCFMemtablesQuota / vbuckets /
+                defaultCFMemtablesQuota / slices /
                 defaultCFOptions.max_write_buffer_number;
         // Set the write_buffer_size for the 'seqno' CF
         seqnoCFOptions.write_buffer_size =
-                seqnoCFMemtablesQuota / vbuckets /
+                seqnoCFMemtablesQuota / slices /
                 seqnoCFOptions.max_write_buffer_number;
 
         // Apply the new write_buffer_size
@@ -1656,6 +2208,24 @@ void RocksDBKVStore::applyMemtablesQuota(
         seqnoCFOptions.OptimizeUniversalStyleCompaction(
                 seqnoCFOptions.write_buffer_size);
     }
+
+    // A WriteBatch is split when it exceeds the Memtables of a VBucket. With
+    // a shared quota the write_buffer_size covers the whole quota, so the
+    // limit is a per-VBucket slice of it.
+    auto batchLimit = defaultCFOptions.write_buffer_size +
+                      seqnoCFOptions.write_buffer_size;
+    if (configuration.isMemtablesShared() &&
+        configuration.getMemtablesRatio() > 0.0 && vbuckets > 0) {
+        batchLimit /= vbuckets;
+    }
+    writeBatchLimit = batchLimit;
+}
+
+size_t RocksDBKVStore::getMemtablesQuota() const {
+    auto& configuration =
+            dynamic_cast<RocksDBKVStoreConfig&>(this->configuration);
+    return configuration.getBucketQuota() / configuration.getMaxShards() *
+           configuration.getMemtablesRatio();
 }
 
 size_t RocksDBKVStore::getVBucketsCount(
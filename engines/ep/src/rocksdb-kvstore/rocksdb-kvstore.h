@@ -24,7 +24,10 @@
 #pragma once
 
 #include <platform/dirutils.h>
+#include <atomic>
+#include <deque>
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 #include <kvstore.h>
@@ -214,16 +217,19 @@ public:
         return 1024;
     }
 
-    bool compactDB(compaction_ctx*) override {
-        // Explicit compaction is not needed.
-        // Compaction is continuously occurring in separate threads
-        // under RocksDB's control
-        return true;
-    }
+    /**
+     * Compaction is continuously occurring in separate threads under RocksDB's
+     * control, so an explicit compaction only erases the items of the dropped
+     * collections (see 'compaction_ctx::collectionsEraser'). The keys of a
+     * collection are contiguous in the 'default' CF, so they are removed with
+     * range deletes.
+     */
+    bool compactDB(compaction_ctx* ctx) override;
 
-    uint16_t getDBFileId(const protocol_binary_request_compact_db&) override {
-        // Not needed if there is no explicit compaction
-        return 0;
+    uint16_t getDBFileId(
+            const protocol_binary_request_compact_db& req) override {
+        // Explicit compaction is per-VBucket (see 'compactDB')
+        return ntohs(req.message.header.request.vbucket);
     }
 
     vbucket_state* getVBucketState(uint16_t vbucketId) override {
@@ -252,15 +258,17 @@ public:
         return 0;
     }
 
+    size_t getSystemItemCount(uint16_t vbid) override;
+
+    /**
+     * Rollback the given VBucket to the most recent rollback Snapshot (see
+     * 'rocksdb_rollback_snapshot_interval') whose high seqno is not greater
+     * than 'rollbackSeqno'. If there is no such Snapshot, or if it would
+     * discard more than half of the VBucket, a full rollback is requested.
+     */
     RollbackResult rollback(uint16_t vbid,
                             uint64_t rollbackSeqno,
-                            std::shared_ptr<RollbackCB> cb) override {
-        // TODO vmx 2016-10-29: implement
-        // NOTE vmx 2016-10-29: For LevelDB/RocksDB it will probably
-        // always be a full rollback as it doesn't support Couchstore
-        // like rollback semantics
-        return RollbackResult(false, 0, 0, 0);
-    }
+                            std::shared_ptr<RollbackCB> cb) override;
 
     void pendingTasks() override {
         // NOTE vmx 2016-10-29: Intentionally left empty;
@@ -270,10 +278,7 @@ public:
             uint16_t vbid,
             const DocKey start_key,
             uint32_t count,
-            std::shared_ptr<Callback<const DocKey&>> cb) override {
-        // TODO vmx 2016-10-29: implement
-        return ENGINE_SUCCESS;
-    }
+            std::shared_ptr<Callback<const DocKey&>> cb) override;
 
     ScanContext* initScanContext(
             std::shared_ptr<StatusCallback<GetValue>> cb,
@@ -287,18 +292,39 @@ public:
 
     void destroyScanContext(ScanContext* ctx) override;
 
-    std::string getCollectionsManifest(uint16_t vbid) override {
-        // TODO DJR 2017-05-19 implement this.
-        return "";
+    std::string getCollectionsManifest(uint16_t vbid) override;
+
+    /**
+     * The CFs of a VBucket are created with the current revision in their
+     * name, so that a VBucket can be re-created while the CFs of its previous
+     * revision are waiting to be dropped.
+     */
+    void incrementRevision(uint16_t vbid) override;
+
+    /**
+     * Detach the CFs of the given VBucket, which are dropped by a later call
+     * to 'delVBucket' with the returned revision.
+     */
+    uint64_t prepareToDelete(uint16_t vbid) override;
+
+    // Return the options the DB was opened with.
+    const rocksdb::DBOptions& getDBOptions() const {
+        return dbOptions;
     }
 
-    void incrementRevision(uint16_t vbid) override {
-        // TODO DJR 2017-05-19 implement this.
+    // Return the current options of the 'default' CFs.
+    const rocksdb::ColumnFamilyOptions& getDefaultCFOptions() const {
+        return defaultCFOptions;
     }
 
-    uint64_t prepareToDelete(uint16_t vbid) override {
-        // TODO DJR 2017-05-19 implement this.
-        return 0;
+    // Return the current options of the 'seqno' CFs.
+    const rocksdb::ColumnFamilyOptions& getSeqnoCFOptions() const {
+        return seqnoCFOptions;
+    }
+
+    // Return the size above which 'saveDocs' splits a WriteBatch.
+    size_t getWriteBatchLimit() const {
+        return writeBatchLimit;
     }
 
 protected:
@@ -323,15 +349,29 @@ private:
     //          first time (in a call to 'getVBHandle()')
     //     2) In 'openDB()', all the ColumnFamilyHandles for all the existing
     //         Vbuckets are loaded.
-    // An entry is removed only in 'delVBucket(vbid)'.
+    // An entry is removed in 'prepareToDelete(vbid)' or in 'delVBucket(vbid)'.
     std::vector<std::shared_ptr<VBHandle>> vbHandles;
 
+    // The revision to use for the next CFs created for each VBucket (see
+    // 'incrementRevision'). Guarded by 'vbhMutex'.
+    std::vector<uint64_t> vbRevisions;
+
+    // The VBHandles detached by 'prepareToDelete', by VBucket and revision,
+    // waiting for 'delVBucket'. An entry can be null if the VBucket had no
+    // CFs. Guarded by 'vbhMutex'.
+    std::map<std::pair<uint16_t, uint64_t>, std::shared_ptr<VBHandle>>
+            deletingVBHandles;
+
     SeqnoComparator seqnoComparator;
 
     rocksdb::DBOptions dbOptions;
     rocksdb::ColumnFamilyOptions defaultCFOptions;
     rocksdb::ColumnFamilyOptions seqnoCFOptions;
 
+    // 'saveDocs' splits a WriteBatch which exceeds this size, so that it
+    // does not bloat the Memtables of a VBucket (see 'applyMemtablesQuota').
+    std::atomic<size_t> writeBatchLimit{0};
+
     // Per-shard Block Cache
     std::shared_ptr<rocksdb::Cache> blockCache;
 
@@ -387,7 +427,11 @@ private:
      */
     static rocksdb::StatsLevel getStatsLevel(const std::string& stats_level);
 
-    rocksdb::Slice getKeySlice(const DocKey& key);
+    // The keys in the 'default' CF are prefixed with their DocNamespace when
+    // 'shouldPersistDocNamespace()' (as in Couchstore), so that all the keys
+    // of a collection are contiguous.
+    rocksdb::Slice getKeySlice(const StoredDocKey& key);
+    DocKey makeDocKey(const rocksdb::Slice& keySlice);
     rocksdb::Slice getSeqnoSlice(const int64_t* seqno);
     int64_t getNumericSeqno(const rocksdb::Slice& seqnoSlice);
 
@@ -422,10 +466,32 @@ private:
             rocksdb::Status status,
             const std::vector<std::unique_ptr<RocksRequest>>& commitBatch);
 
-    int64_t readHighSeqnoFromDisk(const VBHandle& db);
+    // Return the high seqno of the given VBucket on disk, or in 'snapshot' if
+    // one is given.
+    int64_t readHighSeqnoFromDisk(const VBHandle& db,
+                                  const rocksdb::Snapshot* snapshot = nullptr);
 
     int64_t getVbstateKey();
 
+    int64_t getCollectionsManifestKey();
+
+    // Retain a Snapshot of the DB for rollback if at least
+    // 'rocksdb_rollback_snapshot_interval' seqnos have been persisted (across
+    // all the VBuckets) since the last one, releasing the oldest if we are
+    // over the retention limit. 'persisted' is the number of seqnos just
+    // persisted.
+    void maybeTakeRollbackSnapshot(size_t persisted);
+
+    // Stop using the rollback Snapshots for the given VBucket (e.g., as it is
+    // being deleted), releasing the ones no VBucket can use any more.
+    void forgetRollbackSnapshots(uint16_t vbid);
+
+    // Restore on disk the state of the given VBucket in 'snapshot' (taken at
+    // 'snapSeqno'), discarding everything persisted after it.
+    rocksdb::Status restoreSnapshot(const VBHandle& vbh,
+                                    const rocksdb::Snapshot* snapshot,
+                                    int64_t snapSeqno);
+
     // Helper function to retrieve stats from the RocksDB MemoryUtil API.
     bool getStatFromMemUsage(const rocksdb::MemoryUtil::UsageType type,
                              size_t& value);
@@ -447,6 +513,9 @@ private:
     // consistent.
     void applyMemtablesQuota(const std::lock_guard<std::mutex>&);
 
+    // Returns the Memtables Quota of this shard, in bytes.
+    size_t getMemtablesQuota() const;
+
     // Returns the current number of VBuckets managed by the underlying
     // RocksDB instance. It must be called under lock on 'vbhMutex', so that
     // the number of VBuckets seen is consistent.
@@ -463,6 +532,10 @@ private:
     // commit, potentially losing data.
     std::mutex writeMutex;
 
+    // Serialises 'saveDocs' with the parts of 'compactDB' which need to know
+    // that nothing is written to the VBucket meanwhile.
+    std::mutex eraseMutex;
+
     // This variable is used to verify that the KVStore API is used correctly
     // when RocksDB is used as store. "Correctly" means that the caller must
     // use the API in the following way:
@@ -488,5 +561,25 @@ private:
     std::map<size_t, SnapshotPtr> scanSnapshots;
     std::mutex scanSnapshotsMutex;
 
+    // A Snapshot of the DB retained for rolling back the VBuckets of this
+    // shard, with the revision and high seqno of each VBucket it can be used
+    // for.
+    struct RollbackSnapshot {
+        struct VBucketInfo {
+            uint64_t revision;
+            int64_t highSeqno;
+        };
+        std::shared_ptr<const rocksdb::Snapshot> snapshot;
+        std::unordered_map<uint16_t, VBucketInfo> vbuckets;
+    };
+
+    // The rollback Snapshots, oldest first. They are shared by all the
+    // VBuckets, so an idle VBucket does not keep an old Snapshot alive. They
+    // are only held in memory, so they do not survive a restart.
+    std::deque<RollbackSnapshot> rollbackSnapshots;
+    // Seqnos persisted since the last rollback Snapshot was taken
+    size_t seqnosSinceRollbackSnapshot = 0;
+    std::mutex rollbackSnapshotsMutex;
+
     Logger& logger;
 };
@@ -39,12 +39,15 @@ RocksDBKVStoreConfig::RocksDBKVStoreConfig(Configuration& config,
     blockCacheRatio = config.getRocksdbBlockCacheRatio();
     blockCacheHighPriPoolRatio = config.getRocksdbBlockCacheHighPriPoolRatio();
     memtablesRatio = config.getRocksdbMemtablesRatio();
+    memtablesShared = config.isRocksdbMemtablesShared();
     defaultCfOptimizeCompaction =
             config.getRocksdbDefaultCfOptimizeCompaction();
     seqnoCfOptimizeCompaction = config.getRocksdbSeqnoCfOptimizeCompaction();
     writeRateLimit = config.getRocksdbWriteRateLimit();
     ucMaxSizeAmplificationPercent =
             config.getRocksdbUcMaxSizeAmplificationPercent();
+    rollbackSnapshotInterval = config.getRocksdbRollbackSnapshotInterval();
+    rollbackSnapshotCount = config.getRocksdbRollbackSnapshotCount();
 }
 
 std::shared_ptr<rocksdb::RateLimiter>
@@ -82,6 +82,11 @@ public:
         return memtablesRatio;
     }
 
+    // Return true if the Memtables quota is shared by all the VBuckets
+    bool isMemtablesShared() {
+        return memtablesShared;
+    }
+
     // Return the Compaction Optimization type for the 'default' CF
     std::string getDefaultCfOptimizeCompaction() {
         return defaultCfOptimizeCompaction;
@@ -102,6 +107,16 @@ public:
         return ucMaxSizeAmplificationPercent;
     }
 
+    // Return the number of seqnos persisted between two rollback Snapshots
+    size_t getRollbackSnapshotInterval() const {
+        return rollbackSnapshotInterval;
+    }
+
+    // Return the maximum number of rollback Snapshots retained per shard
+    size_t getRollbackSnapshotCount() const {
+        return rollbackSnapshotCount;
+    }
+
     // Creates a RateLimiter object, which is shared across all the RocksDB
     // instances in the environment to control the IO rate of Flush and
     // Compaction tasks.
@@ -143,6 +158,11 @@ private:
     // 0.0, then we set each Memtable size to a baseline value.
     float memtablesRatio = 0.0;
 
+    // If true, the Memtables of all the CFs share the Memtables quota (which
+    // is enforced by a RocksDB WriteBufferManager), rather than each CF
+    // getting an even slice of it.
+    bool memtablesShared = false;
+
     // Flag to enable Compaction Optimization for the 'default' CF
     std::string defaultCfOptimizeCompaction = "";
 
@@ -165,4 +185,12 @@ private:
     // Essentially we can use this parameter to relax/narrow the size
     // amplification constraint under Universal Compaction.
     size_t ucMaxSizeAmplificationPercent = 200;
+
+    // A Snapshot of the shard is retained (for rollback) every time this many
+    // seqnos have been persisted since the previous one. 0 disables them.
+    size_t rollbackSnapshotInterval = 0;
+
+    // Maximum number of rollback Snapshots retained per shard (the oldest is
+    // released first). 0 disables them.
+    size_t rollbackSnapshotCount = 0;
 };
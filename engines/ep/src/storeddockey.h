@@ -156,6 +156,7 @@ struct hash<StoredDocKey> {
 }
 
 class MutationLogEntryV2;
+class MutationLogEntryV3;
 class StoredValue;
 
 /**
@@ -237,6 +238,7 @@ protected:
      * and construct this object so are allowed access to the constructor.
      */
     friend class MutationLogEntryV2;
+    friend class MutationLogEntryV3;
     friend class StoredValue;
 
     SerialisedDocKey() : length(0), docNamespace(), bytes() {
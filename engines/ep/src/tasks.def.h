@@ -34,11 +34,17 @@ TASK(Warmup, READER_TASK_IDX, 0)
 TASK(WarmupInitialize, READER_TASK_IDX, 0)
 TASK(WarmupCreateVBuckets, READER_TASK_IDX, 0)
 TASK(WarmupEstimateDatabaseItemCount, READER_TASK_IDX, 0)
+TASK(WarmupLoadHashTableSnapshot, READER_TASK_IDX, 0)
 TASK(WarmupKeyDump, READER_TASK_IDX, 0)
 TASK(WarmupCheckforAccessLog, READER_TASK_IDX, 0)
 TASK(WarmupLoadAccessLog, READER_TASK_IDX, 0)
 TASK(WarmupLoadingKVPairs, READER_TASK_IDX, 0)
 TASK(WarmupLoadingData, READER_TASK_IDX, 0)
+// The loaders once data traffic is enabled early (warmup_early_traffic);
+// they run behind the BGFetchers fetching the values traffic needs
+TASK(WarmupLoadAccessLogEarlyTraffic, READER_TASK_IDX, 2)
+TASK(WarmupLoadingKVPairsEarlyTraffic, READER_TASK_IDX, 2)
+TASK(WarmupLoadingDataEarlyTraffic, READER_TASK_IDX, 2)
 TASK(WarmupCompletion, READER_TASK_IDX, 0)
 TASK(SingleBGFetcherTask, READER_TASK_IDX, 1)
 TASK(VKeyStatBGFetchTask, READER_TASK_IDX, 3)
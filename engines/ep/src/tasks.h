@@ -22,6 +22,7 @@
 #include "globaltask.h"
 
 #include <platform/processclock.h>
+#include <tracing/tracer.h>
 
 #include <array>
 #include <string>
@@ -208,7 +209,9 @@ public:
                         const void* c,
                         bool isMeta,
                         int sleeptime = 0,
-                        bool completeBeforeShutdown = false)
+                        bool completeBeforeShutdown = false,
+                        cb::tracing::SpanId waitSpan =
+                                cb::tracing::Tracer::invalidSpanId())
         : GlobalTask(e,
                      TaskId::SingleBGFetcherTask,
                      sleeptime,
@@ -218,6 +221,7 @@ public:
           cookie(c),
           metaFetch(isMeta),
           init(ProcessClock::now()),
+          waitSpan(waitSpan),
           description("Fetching item from disk: key{" +
                       std::string(key.c_str()) + "}, vb:" +
                       std::to_string(vbucket)) {
@@ -245,6 +249,7 @@ private:
     const void*                cookie;
     bool                       metaFetch;
     ProcessClock::time_point   init;
+    const cb::tracing::SpanId waitSpan;
     const std::string description;
 };
 
@@ -33,6 +33,7 @@
 #include "vbucket.h"
 #include "vbucketdeletiontask.h"
 
+#include <tracing/trace_helpers.h>
 #include <xattr/blob.h>
 #include <xattr/utils.h>
 
@@ -700,10 +701,12 @@ VBNotifyCtx VBucket::queueDirty(
         const GenerateBySeqno generateBySeqno,
         const GenerateCas generateCas,
         const bool isBackfillItem,
-        PreLinkDocumentContext* preLinkDocumentContext) {
+        PreLinkDocumentContext* preLinkDocumentContext,
+        KnownDiskState knownDiskState) {
     VBNotifyCtx notifyCtx;
 
     queued_item qi(v.toItem(false, getId()));
+    qi->setKnownDiskState(knownDiskState);
 
     if (!mightContainXattrs() && mcbp::datatype::is_xattr(v.getDatatype())) {
         setMightContainXattrs();
@@ -720,6 +723,15 @@ VBNotifyCtx VBucket::queueDirty(
             checkpointManager->resetSnapshotRange();
         }
     } else {
+        // Front-end mutations carry the cookie in the pre-link context; use
+        // it to trace the time spent queueing into the checkpoint.
+        SERVER_HANDLE_V1* api = nullptr;
+        const void* cookie = nullptr;
+        if (preLinkDocumentContext) {
+            api = preLinkDocumentContext->getEngine().getServerApi();
+            cookie = preLinkDocumentContext->getCookie();
+        }
+        TRACE_SCOPE(api, cookie, cb::tracing::TraceCode::CHECKPOINT_QUEUE);
         notifyCtx.notifyFlusher =
                 checkpointManager->queueDirty(*this,
                                               qi,
@@ -2574,7 +2586,8 @@ VBNotifyCtx VBucket::queueDirty(StoredValue& v,
                       queueItmCtx.genBySeqno,
                       queueItmCtx.genCas,
                       queueItmCtx.isBackfillItem,
-                      queueItmCtx.preLinkDocumentContext);
+                      queueItmCtx.preLinkDocumentContext,
+                      queueItmCtx.knownDiskState);
 }
 
 void VBucket::updateRevSeqNoOfNewStoredValue(StoredValue& v) {
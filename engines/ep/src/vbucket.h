@@ -86,6 +86,9 @@ struct VBQueueItemCtx {
     TrackCasDrift trackCasDrift;
     bool isBackfillItem;
     PreLinkDocumentContext* preLinkDocumentContext;
+    /* What is known about the key's document on disk (see
+       Item::getKnownDiskState) */
+    KnownDiskState knownDiskState = KnownDiskState::Unknown;
 };
 
 /**
@@ -1419,6 +1422,8 @@ protected:
      * @param preLinkDocumentContext context object which allows running the
      *        document pre link callback after the cas is assinged (but
      *        but document not available for anyone)
+     * @param knownDiskState what is known about the key's document on disk,
+     *        recorded in the queued item for the flusher
      *
      * @return Notification context containing info needed to notify the
      *         clients (like connections, flusher)
@@ -1428,7 +1433,8 @@ protected:
             GenerateBySeqno generateBySeqno = GenerateBySeqno::Yes,
             GenerateCas generateCas = GenerateCas::Yes,
             bool isBackfillItem = false,
-            PreLinkDocumentContext* preLinkDocumentContext = nullptr);
+            PreLinkDocumentContext* preLinkDocumentContext = nullptr,
+            KnownDiskState knownDiskState = KnownDiskState::Unknown);
 
     /**
      * Adds a temporary StoredValue in in-memory data structures like HT.
@@ -21,19 +21,30 @@
 
 #include "item.h"
 
+#include <tracing/tracer.h>
+
 class VBucketBGFetchItem {
 public:
-    VBucketBGFetchItem(const void* c, bool meta_only)
-        : cookie(c), initTime(ProcessClock::now()), metaDataOnly(meta_only) {
+    VBucketBGFetchItem(const void* c,
+                       bool meta_only,
+                       cb::tracing::SpanId wait_span =
+                               cb::tracing::Tracer::invalidSpanId())
+        : cookie(c),
+          initTime(ProcessClock::now()),
+          metaDataOnly(meta_only),
+          waitSpan(wait_span) {
     }
     VBucketBGFetchItem(GetValue* value_,
                        const void* c,
                        const ProcessClock::time_point& init_time,
-                       bool meta_only)
+                       bool meta_only,
+                       cb::tracing::SpanId wait_span =
+                               cb::tracing::Tracer::invalidSpanId())
         : value(value_),
           cookie(c),
           initTime(init_time),
-          metaDataOnly(meta_only) {
+          metaDataOnly(meta_only),
+          waitSpan(wait_span) {
     }
 
     ~VBucketBGFetchItem() {
@@ -43,6 +54,8 @@ public:
     const void* cookie;
     ProcessClock::time_point initTime;
     bool metaDataOnly;
+    /// The cookie's BGFETCH_WAIT span, ended when the fetch completes
+    cb::tracing::SpanId waitSpan;
 };
 
 struct vb_bgfetch_item_ctx_t {
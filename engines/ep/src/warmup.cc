@@ -24,6 +24,7 @@
 #include "ep_engine.h"
 #include "ep_vb.h"
 #include "failover-table.h"
+#include "hash_table_snapshot.h"
 #include "kv_bucket.h"
 #include "mutation_log.h"
 #include "statwriter.h"
@@ -32,6 +33,7 @@
 #include <platform/make_unique.h>
 #include <platform/timeutils.h>
 
+#include <algorithm>
 #include <limits>
 #include <string>
 #include <utility>
@@ -70,6 +72,7 @@ public:
 
     bool run() {
         TRACE_EVENT0("ep-engine/task", "WarmupInitialize");
+        IOClassScope ioClass(IOClass::Warmup);
         _warmup->initialize();
         _warmup->removeFromTaskSet(uid);
         return false;
@@ -101,6 +104,7 @@ public:
 
     bool run() {
         TRACE_EVENT0("ep-engine/task", "WarmupCreateVBuckets");
+        IOClassScope ioClass(IOClass::Warmup);
         _warmup->createVBuckets(_shardId);
         _warmup->removeFromTaskSet(uid);
         return false;
@@ -138,6 +142,7 @@ public:
 
     bool run() {
         TRACE_EVENT0("ep-engine/task", "WarpupEstimateDatabaseItemCount");
+        IOClassScope ioClass(IOClass::Warmup);
         _warmup->estimateDatabaseItemCount(_shardId);
         _warmup->removeFromTaskSet(uid);
         return false;
@@ -149,13 +154,64 @@ private:
     const std::string _description;
 };
 
+class WarmupLoadHashTableSnapshot : public GlobalTask {
+public:
+    WarmupLoadHashTableSnapshot(KVBucket& st,
+                                uint16_t sh,
+                                uint16_t vb,
+                                Warmup* w)
+        : GlobalTask(&st.getEPEngine(),
+                     TaskId::WarmupLoadHashTableSnapshot,
+                     0,
+                     false),
+          _shardId(sh),
+          _vbid(vb),
+          _warmup(w),
+          _description("Warmup - loading hash table snapshot: shard " +
+                       std::to_string(_shardId) + " vb:" +
+                       std::to_string(_vbid)) {
+        _warmup->addToTaskSet(uid);
+    }
+
+    cb::const_char_buffer getDescription() {
+        return _description;
+    }
+
+    std::chrono::microseconds maxExpectedDuration() {
+        // Runtime is a function of the size of the snapshot; a sequential
+        // read but can still take minutes for large vBuckets.
+        return std::chrono::hours(1);
+    }
+
+    bool run() {
+        TRACE_EVENT2("ep-engine/task",
+                     "WarmupLoadHashTableSnapshot",
+                     "shard",
+                     _shardId,
+                     "vb",
+                     _vbid);
+        IOClassScope ioClass(IOClass::Warmup);
+        _warmup->loadHashTableSnapshotforVBucket(_shardId, _vbid);
+        _warmup->removeFromTaskSet(uid);
+        return false;
+    }
+
+private:
+    uint16_t _shardId;
+    uint16_t _vbid;
+    Warmup* _warmup;
+    const std::string _description;
+};
+
 class WarmupKeyDump : public GlobalTask {
 public:
-    WarmupKeyDump(KVBucket& st, uint16_t sh, Warmup* w)
+    WarmupKeyDump(KVBucket& st, uint16_t sh, uint16_t vb, Warmup* w)
         : GlobalTask(&st.getEPEngine(), TaskId::WarmupKeyDump, 0, false),
           _shardId(sh),
+          _vbid(vb),
           _warmup(w),
-          _description("Warmup - key dump: shard " + std::to_string(_shardId)) {
+          _description("Warmup - key dump: shard " + std::to_string(_shardId) +
+                       " vb:" + std::to_string(_vbid)) {
         _warmup->addToTaskSet(uid);
     }
 
@@ -172,14 +228,21 @@ public:
     }
 
     bool run() {
-        TRACE_EVENT1("ep-engine/task", "WarmupKeyDump", "shard", _shardId);
-        _warmup->keyDumpforShard(_shardId);
+        TRACE_EVENT2("ep-engine/task",
+                     "WarmupKeyDump",
+                     "shard",
+                     _shardId,
+                     "vb",
+                     _vbid);
+        IOClassScope ioClass(IOClass::Warmup);
+        _warmup->keyDumpforVBucket(_shardId, _vbid);
         _warmup->removeFromTaskSet(uid);
         return false;
     }
 
 private:
     uint16_t _shardId;
+    uint16_t _vbid;
     Warmup* _warmup;
     const std::string _description;
 };
@@ -206,6 +269,7 @@ public:
 
     bool run() {
         TRACE_EVENT0("ep-engine/task", "WarmupCheckForAccessLog");
+        IOClassScope ioClass(IOClass::Warmup);
         _warmup->checkForAccessLog();
         _warmup->removeFromTaskSet(uid);
         return false;
@@ -218,7 +282,12 @@ private:
 class WarmupLoadAccessLog : public GlobalTask {
 public:
     WarmupLoadAccessLog(KVBucket& st, uint16_t sh, Warmup* w)
-        : GlobalTask(&st.getEPEngine(), TaskId::WarmupLoadAccessLog, 0, false),
+        : GlobalTask(&st.getEPEngine(),
+                     w->isEarlyTrafficEnabled()
+                             ? TaskId::WarmupLoadAccessLogEarlyTraffic
+                             : TaskId::WarmupLoadAccessLog,
+                     0,
+                     false),
           _shardId(sh),
           _warmup(w),
           _description("Warmup - loading access log: shard " +
@@ -240,6 +309,7 @@ public:
 
     bool run() {
         TRACE_EVENT0("ep-engine/task", "WarmupLoadAccessLog");
+        IOClassScope ioClass(IOClass::Warmup);
         _warmup->loadingAccessLog(_shardId);
         _warmup->removeFromTaskSet(uid);
         return false;
@@ -253,12 +323,19 @@ private:
 
 class WarmupLoadingKVPairs : public GlobalTask {
 public:
-    WarmupLoadingKVPairs(KVBucket& st, uint16_t sh, Warmup* w)
-        : GlobalTask(&st.getEPEngine(), TaskId::WarmupLoadingKVPairs, 0, false),
+    WarmupLoadingKVPairs(KVBucket& st, uint16_t sh, uint16_t vb, Warmup* w)
+        : GlobalTask(&st.getEPEngine(),
+                     w->isEarlyTrafficEnabled()
+                             ? TaskId::WarmupLoadingKVPairsEarlyTraffic
+                             : TaskId::WarmupLoadingKVPairs,
+                     0,
+                     false),
           _shardId(sh),
+          _vbid(vb),
           _warmup(w),
           _description("Warmup - loading KV Pairs: shard " +
-                       std::to_string(_shardId)) {
+                       std::to_string(_shardId) + " vb:" +
+                       std::to_string(_vbid)) {
         _warmup->addToTaskSet(uid);
     }
 
@@ -277,25 +354,34 @@ public:
 
     bool run() {
         TRACE_EVENT0("ep-engine/task", "WarmupLoadingKVPairs");
-        _warmup->loadKVPairsforShard(_shardId);
+        IOClassScope ioClass(IOClass::Warmup);
+        _warmup->loadKVPairsforVBucket(_shardId, _vbid);
         _warmup->removeFromTaskSet(uid);
         return false;
     }
 
 private:
     uint16_t _shardId;
+    uint16_t _vbid;
     Warmup* _warmup;
     const std::string _description;
 };
 
 class WarmupLoadingData : public GlobalTask {
 public:
-    WarmupLoadingData(KVBucket& st, uint16_t sh, Warmup* w) :
-        GlobalTask(&st.getEPEngine(), TaskId::WarmupLoadingData, 0, false),
+    WarmupLoadingData(KVBucket& st, uint16_t sh, uint16_t vb, Warmup* w) :
+        GlobalTask(&st.getEPEngine(),
+                   w->isEarlyTrafficEnabled()
+                           ? TaskId::WarmupLoadingDataEarlyTraffic
+                           : TaskId::WarmupLoadingData,
+                   0,
+                   false),
         _shardId(sh),
+        _vbid(vb),
         _warmup(w),
         _description("Warmup - loading data: shard " +
-                     std::to_string(_shardId)) {
+                     std::to_string(_shardId) + " vb:" +
+                     std::to_string(_vbid)) {
         _warmup->addToTaskSet(uid);
     }
 
@@ -314,13 +400,15 @@ public:
 
     bool run() {
         TRACE_EVENT0("ep-engine/task", "WarmupLoadingData");
-        _warmup->loadDataforShard(_shardId);
+        IOClassScope ioClass(IOClass::Warmup);
+        _warmup->loadDataforVBucket(_shardId, _vbid);
         _warmup->removeFromTaskSet(uid);
         return false;
     }
 
 private:
     uint16_t _shardId;
+    uint16_t _vbid;
     Warmup* _warmup;
     const std::string _description;
 };
@@ -456,6 +544,8 @@ const char* WarmupState::getStateDescription(State st) const {
         return "creating vbuckets";
     case State::EstimateDatabaseItemCount:
         return "estimating database item count";
+    case State::LoadingHashTableSnapshot:
+        return "loading hash table snapshot";
     case State::KeyDump:
         return "loading keys";
     case State::CheckForAccessLog:
@@ -496,6 +586,9 @@ bool WarmupState::legalTransition(State to) const {
     case State::CreateVBuckets:
         return (to == State::EstimateDatabaseItemCount);
     case State::EstimateDatabaseItemCount:
+        return (to == State::LoadingHashTableSnapshot ||
+                to == State::KeyDump || to == State::CheckForAccessLog);
+    case State::LoadingHashTableSnapshot:
         return (to == State::KeyDump || to == State::CheckForAccessLog);
     case State::KeyDump:
         return (to == State::LoadingKVPairs || to == State::CheckForAccessLog);
@@ -534,27 +627,36 @@ LoadStorageKVPairCallback::LoadStorageKVPairCallback(
 void LoadStorageKVPairCallback::callback(GetValue &val) {
     // This callback method is responsible for deleting the Item
     std::unique_ptr<Item> i(std::move(val.item));
+    load(*i, val.isPartial());
+}
 
+void LoadStorageKVPairCallback::load(Item& item, bool partial) {
     // Don't attempt to load the system event documents.
-    if (i->getKey().getDocNamespace() == DocNamespace::System) {
+    if (item.getKey().getDocNamespace() == DocNamespace::System) {
         return;
     }
 
     bool stopLoading = false;
-    if (i != NULL && !epstore.getWarmup()->isComplete()) {
-        VBucketPtr vb = vbuckets.getBucket(i->getVBucketId());
+    if (!epstore.getWarmup()->isComplete()) {
+        VBucketPtr vb = vbuckets.getBucket(item.getVBucketId());
         if (!vb) {
             setStatus(ENGINE_NOT_MY_VBUCKET);
             return;
         }
+        // Evaluated by the HashTable under the hash bucket lock, so that a
+        // client can't delete the item between the check and the insert
+        const auto* warmup = epstore.getWarmup();
+        auto existingOnly = [warmup, &vb]() {
+            return warmup->shouldOnlyLoadExistingItems(*vb);
+        };
         bool succeeded(false);
         int retry = 2;
         do {
-            if (i->getCas() == static_cast<uint64_t>(-1)) {
-                if (val.isPartial()) {
-                    i->setCas(0);
+            if (item.getCas() == static_cast<uint64_t>(-1)) {
+                if (partial) {
+                    item.setCas(0);
                 } else {
-                    i->setCas(vb->nextHLCCas());
+                    item.setCas(vb->nextHLCCas());
                 }
             }
 
@@ -564,8 +666,8 @@ void LoadStorageKVPairCallback::callback(GetValue &val) {
                 return;
             }
 
-            const auto res =
-                    epVb->insertFromWarmup(*i, shouldEject(), val.isPartial());
+            const auto res = epVb->insertFromWarmup(
+                    item, shouldEject(), partial, existingOnly);
             switch (res) {
             case MutationStatus::NoMem:
                 if (retry == 2) {
@@ -588,7 +690,7 @@ void LoadStorageKVPairCallback::callback(GetValue &val) {
             case MutationStatus::InvalidCas:
                 LOG(EXTENSION_LOG_DEBUG,
                     "Value changed in memory before restore from disk. "
-                    "Ignored disk value for: key{%s}.", i->getKey().c_str());
+                    "Ignored disk value for: key{%s}.", item.getKey().c_str());
                 ++stats.warmDups;
                 succeeded = true;
                 break;
@@ -616,6 +718,17 @@ void LoadStorageKVPairCallback::callback(GetValue &val) {
                 ++stats.warmedUpKeys;
             }
             break;
+        case WarmupState::State::LoadingHashTableSnapshot:
+            if (stats.warmOOM) {
+                epstore.getWarmup()->setOOMFailure();
+                stopLoading = true;
+            } else {
+                ++stats.warmedUpKeys;
+                if (!partial) {
+                    ++stats.warmedUpValues;
+                }
+            }
+            break;
         case WarmupState::State::LoadingData:
         case WarmupState::State::LoadingAccessLog:
             if (epstore.getItemEvictionPolicy() == FULL_EVICTION) {
@@ -651,6 +764,40 @@ void LoadStorageKVPairCallback::callback(GetValue &val) {
     }
 }
 
+LoadStorageKeyBatchCallback::LoadStorageKeyBatchCallback(
+        LoadStorageKVPairCallback& loader, uint16_t vbid)
+    : loader(loader), vbid(vbid) {
+}
+
+void LoadStorageKeyBatchCallback::callback(KeyScanBatch& batch) {
+    for (const auto& record : batch.getRecords()) {
+        const auto key = batch.getKey(record);
+        if (key.getDocNamespace() == DocNamespace::System) {
+            continue;
+        }
+
+        // Only the key and metadata are loaded, so the Item has no value
+        Item item(key,
+                  record.flags,
+                  record.exptime,
+                  value_t{},
+                  record.datatype,
+                  record.cas,
+                  record.bySeqno,
+                  vbid,
+                  record.revSeqno);
+        if (record.deleted) {
+            item.setDeleted();
+        }
+        loader.load(item, true);
+        if (loader.getStatus() == ENGINE_ENOMEM) {
+            setStatus(ENGINE_ENOMEM);
+            return;
+        }
+    }
+    setStatus(ENGINE_SUCCESS);
+}
+
 bool LoadStorageKVPairCallback::shouldEject() const {
     return stats.getEstimatedTotalMemoryUsed() >= stats.mem_low_wat;
 }
@@ -734,6 +881,7 @@ Warmup::Warmup(KVBucket& st, Configuration& config_)
       corruptAccessLog(false),
       warmupComplete(false),
       warmupOOMFailure(false),
+      earlyTrafficEnabled(false),
       estimatedWarmupCount(std::numeric_limits<size_t>::max()),
       createVBucketsComplete(false) {
 }
@@ -941,67 +1089,188 @@ void Warmup::estimateDatabaseItemCount(uint16_t shardId)
     estimateTime.fetch_add(ProcessClock::now() - st);
 
     if (++threadtask_count == store.vbMap.getNumShards()) {
-        if (store.getItemEvictionPolicy() == VALUE_ONLY) {
-            transition(WarmupState::State::KeyDump);
+        if (cleanShutdown && config.isWarmupHashtableSnapshot()) {
+            transition(WarmupState::State::LoadingHashTableSnapshot);
         } else {
-            transition(WarmupState::State::CheckForAccessLog);
+            // Any snapshot left behind is either from before an unclean
+            // shutdown, or has been disabled; don't let it linger.
+            HashTableSnapshot::removeAll(config.getDbname());
+            transitionToLoadingKeys();
+        }
+    }
+}
+
+void Warmup::transitionToLoadingKeys() {
+    if (store.getItemEvictionPolicy() == VALUE_ONLY) {
+        transition(WarmupState::State::KeyDump);
+    } else {
+        transition(WarmupState::State::CheckForAccessLog);
+    }
+}
+
+void Warmup::scheduleLoadingHashTableSnapshots() {
+    {
+        std::lock_guard<std::mutex> lh(snapshotVbsMutex);
+        snapshotVbs.clear();
+    }
+
+    scheduleVBucketScans(
+            [this](uint16_t shardId, uint16_t vbid) {
+                return std::make_shared<WarmupLoadHashTableSnapshot>(
+                        store, shardId, vbid, this);
+            },
+            [this]() { hashTableSnapshotsComplete(); });
+}
+
+void Warmup::loadHashTableSnapshotforVBucket(uint16_t shardId, uint16_t vbid) {
+    const auto& dbname = config.getDbname();
+    if (!vbScans.stopped) {
+        const auto itr = shardVbStates[shardId].find(vbid);
+        if (itr != shardVbStates[shardId].end()) {
+            // Keys must not be skipped in value eviction (just like in the
+            // key dump), so only allow traffic to be enabled early with
+            // full eviction.
+            LoadStorageKVPairCallback cb(
+                    store,
+                    store.getItemEvictionPolicy() == FULL_EVICTION,
+                    state.getState());
+            const auto start = ProcessClock::now();
+            size_t numItems;
+            const auto status = HashTableSnapshot::load(
+                    dbname, vbid, itr->second.highSeqno, cb, numItems);
+            switch (status) {
+            case HashTableSnapshot::LoadStatus::Success: {
+                LOG(EXTENSION_LOG_NOTICE,
+                    "Warmup::loadHashTableSnapshotforVBucket: vb:%" PRIu16
+                    " loaded %" PRIu64 " items in %s",
+                    vbid,
+                    uint64_t(numItems),
+                    cb::time2text(ProcessClock::now() - start).c_str());
+                std::lock_guard<std::mutex> lh(snapshotVbsMutex);
+                snapshotVbs.insert(vbid);
+                break;
+            }
+            case HashTableSnapshot::LoadStatus::NotFound:
+                break;
+            case HashTableSnapshot::LoadStatus::Stopped:
+                vbScans.stopped = true;
+                break;
+            case HashTableSnapshot::LoadStatus::Stale:
+            case HashTableSnapshot::LoadStatus::Corrupt:
+                // Any items already loaded are valid; the rest of the
+                // vBucket is loaded from disk by the following phases.
+                LOG(EXTENSION_LOG_WARNING,
+                    "Warmup::loadHashTableSnapshotforVBucket: vb:%" PRIu16
+                    " snapshot is %s (loaded %" PRIu64
+                    " items); falling back to disk",
+                    vbid,
+                    HashTableSnapshot::toString(status),
+                    uint64_t(numItems));
+                break;
+            }
+        }
+    }
+
+    // The snapshot is only valid for the warmup immediately following the
+    // shutdown which wrote it.
+    HashTableSnapshot::remove(dbname, vbid);
+    completeVBucketScan();
+}
+
+void Warmup::hashTableSnapshotsComplete() {
+    // Any snapshots of vBuckets which no longer exist
+    HashTableSnapshot::removeAll(config.getDbname());
+
+    // The vBuckets restored from their snapshot are complete; the
+    // following phases only need to look at the others.
+    {
+        std::lock_guard<std::mutex> lh(snapshotVbsMutex);
+        for (size_t shardId = 0; shardId < shardVbIds.size(); ++shardId) {
+            auto& vbids = shardVbIds[shardId];
+            vbids.erase(std::remove_if(vbids.begin(),
+                                       vbids.end(),
+                                       [this](uint16_t vbid) {
+                                           return snapshotVbs.count(vbid) != 0;
+                                       }),
+                        vbids.end());
+            for (const auto vbid : snapshotVbs) {
+                shardVbStates[shardId].erase(vbid);
+            }
         }
+        LOG(EXTENSION_LOG_NOTICE,
+            "Warmup::hashTableSnapshotsComplete: restored %" PRIu64
+            " vBuckets from hash table snapshots",
+            uint64_t(snapshotVbs.size()));
     }
+
+    transitionToLoadingKeys();
 }
 
 void Warmup::scheduleKeyDump()
 {
-    threadtask_count = 0;
-    for (size_t i = 0; i < store.vbMap.shards.size(); i++) {
-        ExTask task = std::make_shared<WarmupKeyDump>(store, i, this);
-        ExecutorPool::get()->schedule(task);
+    // The key dump tasks mark their shard as done; a shard which owns no
+    // vBuckets (or whose vBuckets were all restored from a snapshot) gets
+    // no task, so there is nothing left for it to dump.
+    for (size_t shardId = 0; shardId < shardVbIds.size(); ++shardId) {
+        if (shardVbIds[shardId].empty()) {
+            shardKeyDumpStatus[shardId] = true;
+        }
     }
 
+    scheduleVBucketScans(
+            [this](uint16_t shardId, uint16_t vbid) {
+                return std::make_shared<WarmupKeyDump>(
+                        store, shardId, vbid, this);
+            },
+            [this]() { keyDumpComplete(); });
 }
 
-void Warmup::keyDumpforShard(uint16_t shardId)
+void Warmup::keyDumpforVBucket(uint16_t shardId, uint16_t vbid)
 {
-    KVStore* kvstore = store.getROUnderlyingByShard(shardId);
-    auto cb = std::make_shared<LoadStorageKVPairCallback>(
-            store, false, state.getState());
-    auto cl =
-            std::make_shared<Collections::VB::LogicallyDeletedCallback>(store);
+    if (!vbScans.stopped) {
+        KVStore* kvstore = store.getROUnderlyingByShard(shardId);
+        auto cb = std::make_shared<LoadStorageKVPairCallback>(
+                store, false, state.getState());
+        auto cl = std::make_shared<Collections::VB::LogicallyDeletedCallback>(
+                store);
 
-    for (const auto vbid : shardVbIds[shardId]) {
         ScanContext* ctx = kvstore->initScanContext(cb, cl, vbid, 0,
                                                     DocumentFilter::NO_DELETES,
                                                     ValueFilter::KEYS_ONLY);
         if (ctx) {
-            auto errorCode = kvstore->scan(ctx);
+            LoadStorageKeyBatchCallback batchCb(*cb, vbid);
+            auto errorCode = kvstore->scanKeys(ctx, batchCb);
             kvstore->destroyScanContext(ctx);
             if (errorCode == scan_again) { // ENGINE_ENOMEM
                 // skip loading remaining VBuckets as memory limit was reached
-                break;
+                vbScans.stopped = true;
             }
         }
     }
 
     shardKeyDumpStatus[shardId] = true;
+    completeVBucketScan();
+}
 
-    if (++threadtask_count == store.vbMap.getNumShards()) {
-        bool success = false;
-        for (size_t i = 0; i < store.vbMap.getNumShards(); i++) {
-            if (shardKeyDumpStatus[i]) {
-                success = true;
-            } else {
-                success = false;
-                break;
-            }
-        }
-
-        if (success) {
-            transition(WarmupState::State::CheckForAccessLog);
+void Warmup::keyDumpComplete()
+{
+    bool success = false;
+    for (size_t i = 0; i < store.vbMap.getNumShards(); i++) {
+        if (shardKeyDumpStatus[i]) {
+            success = true;
         } else {
-            LOG(EXTENSION_LOG_WARNING,
-                "Failed to dump keys, falling back to full dump");
-            transition(WarmupState::State::LoadingKVPairs);
+            success = false;
+            break;
         }
     }
+
+    if (success) {
+        transition(WarmupState::State::CheckForAccessLog);
+    } else {
+        LOG(EXTENSION_LOG_WARNING,
+            "Failed to dump keys, falling back to full dump");
+        transition(WarmupState::State::LoadingKVPairs);
+    }
 }
 
 void Warmup::scheduleCheckForAccessLog()
@@ -1019,6 +1288,10 @@ void Warmup::checkForAccessLog()
     LOG(EXTENSION_LOG_NOTICE, "metadata loaded in %s",
         cb::time2text(std::chrono::nanoseconds(metadata.load())).c_str());
 
+    if (config.isWarmupEarlyTraffic()) {
+        enableEarlyTraffic();
+    }
+
     if (store.maybeEnableTraffic()) {
         transition(WarmupState::State::Done);
     }
@@ -1045,6 +1318,31 @@ void Warmup::checkForAccessLog()
 
 }
 
+void Warmup::enableEarlyTraffic() {
+    for (const auto vbid : store.vbMap.getBuckets()) {
+        VBucketPtr vb = store.vbMap.getBucket(vbid);
+        if (vb) {
+            earlyTrafficSeqnos[vbid] = vb->getHighSeqno();
+        }
+    }
+    earlyTrafficEnabled.store(true);
+    LOG(EXTENSION_LOG_NOTICE,
+        "Warmup: enabling data traffic before the values are loaded; "
+        "values not yet loaded will be fetched from disk on demand");
+}
+
+bool Warmup::shouldOnlyLoadExistingItems(const VBucket& vb) const {
+    if (!earlyTrafficEnabled.load()) {
+        return false;
+    }
+    if (store.getItemEvictionPolicy() == VALUE_ONLY) {
+        return true;
+    }
+    const auto itr = earlyTrafficSeqnos.find(vb.getId());
+    return itr == earlyTrafficSeqnos.end() ||
+           vb.getHighSeqno() != itr->second;
+}
+
 void Warmup::scheduleLoadingAccessLog()
 {
     threadtask_count = 0;
@@ -1124,19 +1422,26 @@ size_t Warmup::doWarmup(MutationLog& lf,
         harvester.setVBucket(it->first);
     }
 
-    // To constrain the number of elements from the access log we have to keep
-    // alive (there may be millions of items per-vBucket), process it
-    // a batch at a time.
+    // The keys are applied to the store a batch at a time, checking
+    // between batches whether we've loaded enough to enable traffic.
     std::chrono::nanoseconds log_load_duration{};
     std::chrono::nanoseconds log_apply_duration{};
     WarmupCookie cookie(&store, cb);
 
-    auto alog_iter = lf.begin();
+    // The access log records the frequency counter of each item. Read it
+    // once, grouping the keys by frequency, and load them hottest first so
+    // that if we reach the memory (or item) threshold for enabling traffic
+    // before the whole log is loaded, it's the coldest items which are
+    // left on disk. Logs written before the frequency was recorded have
+    // the same frequency for every key.
+    auto start = ProcessClock::now();
+    harvester.loadByFrequency();
+    log_load_duration += (ProcessClock::now() - start);
+
+    bool more;
     do {
-        // Load a chunk of the access log file
-        auto start = ProcessClock::now();
-        alog_iter = harvester.loadBatch(alog_iter, config.getWarmupBatchSize());
-        log_load_duration += (ProcessClock::now() - start);
+        // Take the next (hottest) chunk of the access log...
+        more = harvester.loadNextBatch(config.getWarmupBatchSize());
 
         // .. then apply it to the store.
         auto apply_start = ProcessClock::now();
@@ -1146,7 +1451,7 @@ size_t Warmup::doWarmup(MutationLog& lf,
             harvester.apply(&cookie, &warmupCallback);
         }
         log_apply_duration += (ProcessClock::now() - apply_start);
-    } while (alog_iter != lf.end());
+    } while (more && !store.maybeEnableTraffic());
 
     size_t total = harvester.total();
     setEstimatedWarmupCount(total);
@@ -1169,12 +1474,12 @@ void Warmup::scheduleLoadingKVPairs()
     // keys have been warmed up at this point.
     setEstimatedWarmupCount(estimatedItemCount);
 
-    threadtask_count = 0;
-    for (size_t i = 0; i < store.vbMap.shards.size(); i++) {
-        ExTask task = std::make_shared<WarmupLoadingKVPairs>(store, i, this);
-        ExecutorPool::get()->schedule(task);
-    }
-
+    scheduleVBucketScans(
+            [this](uint16_t shardId, uint16_t vbid) {
+                return std::make_shared<WarmupLoadingKVPairs>(
+                        store, shardId, vbid, this);
+            },
+            [this]() { transition(WarmupState::State::Done); });
 }
 
 ValueFilter getValueFilterForCompressionMode(
@@ -1187,40 +1492,37 @@ ValueFilter getValueFilterForCompressionMode(
     return ValueFilter::VALUES_DECOMPRESSED;
 }
 
-void Warmup::loadKVPairsforShard(uint16_t shardId)
+void Warmup::loadKVPairsforVBucket(uint16_t shardId, uint16_t vbid)
 {
-    bool maybe_enable_traffic = false;
-    scan_error_t errorCode = scan_success;
-
-    if (store.getItemEvictionPolicy() == FULL_EVICTION) {
-        maybe_enable_traffic = true;
-    }
+    if (!vbScans.stopped) {
+        bool maybe_enable_traffic = false;
+        if (store.getItemEvictionPolicy() == FULL_EVICTION) {
+            maybe_enable_traffic = true;
+        }
 
-    KVStore* kvstore = store.getROUnderlyingByShard(shardId);
-    auto cb = std::make_shared<LoadStorageKVPairCallback>(
-            store, maybe_enable_traffic, state.getState());
-    auto cl =
-            std::make_shared<LoadValueCallback>(store.vbMap, state.getState());
+        KVStore* kvstore = store.getROUnderlyingByShard(shardId);
+        auto cb = std::make_shared<LoadStorageKVPairCallback>(
+                store, maybe_enable_traffic, state.getState());
+        auto cl = std::make_shared<LoadValueCallback>(store.vbMap,
+                                                      state.getState());
 
-    ValueFilter valFilter = getValueFilterForCompressionMode(
-                                    store.getEPEngine().getCompressionMode());
+        ValueFilter valFilter = getValueFilterForCompressionMode(
+                store.getEPEngine().getCompressionMode());
 
-    for (const auto vbid : shardVbIds[shardId]) {
         ScanContext* ctx = kvstore->initScanContext(cb, cl, vbid, 0,
                                                     DocumentFilter::NO_DELETES,
                                                     valFilter);
         if (ctx) {
-            errorCode = kvstore->scan(ctx);
+            scan_error_t errorCode = kvstore->scan(ctx);
             kvstore->destroyScanContext(ctx);
             if (errorCode == scan_again) { // ENGINE_ENOMEM
                 // skip loading remaining VBuckets as memory limit was reached
-                break;
+                vbScans.stopped = true;
             }
         }
     }
-    if (++threadtask_count == store.vbMap.getNumShards()) {
-        transition(WarmupState::State::Done);
-    }
+
+    completeVBucketScan();
 }
 
 void Warmup::scheduleLoadingData()
@@ -1228,42 +1530,83 @@ void Warmup::scheduleLoadingData()
     size_t estimatedCount = store.getEPEngine().getEpStats().warmedUpKeys;
     setEstimatedWarmupCount(estimatedCount);
 
-    threadtask_count = 0;
-    for (size_t i = 0; i < store.vbMap.shards.size(); i++) {
-        ExTask task = std::make_shared<WarmupLoadingData>(store, i, this);
-        ExecutorPool::get()->schedule(task);
-    }
+    scheduleVBucketScans(
+            [this](uint16_t shardId, uint16_t vbid) {
+                return std::make_shared<WarmupLoadingData>(
+                        store, shardId, vbid, this);
+            },
+            [this]() { transition(WarmupState::State::Done); });
 }
 
-void Warmup::loadDataforShard(uint16_t shardId)
+void Warmup::loadDataforVBucket(uint16_t shardId, uint16_t vbid)
 {
-    scan_error_t errorCode = scan_success;
-
-    KVStore* kvstore = store.getROUnderlyingByShard(shardId);
-    auto cb = std::make_shared<LoadStorageKVPairCallback>(
-            store, true, state.getState());
-    auto cl =
-            std::make_shared<LoadValueCallback>(store.vbMap, state.getState());
+    if (!vbScans.stopped) {
+        KVStore* kvstore = store.getROUnderlyingByShard(shardId);
+        auto cb = std::make_shared<LoadStorageKVPairCallback>(
+                store, true, state.getState());
+        auto cl = std::make_shared<LoadValueCallback>(store.vbMap,
+                                                      state.getState());
 
-    ValueFilter valFilter = getValueFilterForCompressionMode(
-                                          store.getEPEngine().getCompressionMode());
+        ValueFilter valFilter = getValueFilterForCompressionMode(
+                store.getEPEngine().getCompressionMode());
 
-    for (const auto vbid : shardVbIds[shardId]) {
         ScanContext* ctx = kvstore->initScanContext(cb, cl, vbid, 0,
                                                     DocumentFilter::NO_DELETES,
                                                     valFilter);
         if (ctx) {
-            errorCode = kvstore->scan(ctx);
+            scan_error_t errorCode = kvstore->scan(ctx);
             kvstore->destroyScanContext(ctx);
             if (errorCode == scan_again) { // ENGINE_ENOMEM
                 // skip loading remaining VBuckets as memory limit was reached
-                break;
+                vbScans.stopped = true;
             }
         }
     }
 
-    if (++threadtask_count == store.vbMap.getNumShards()) {
-        transition(WarmupState::State::Done);
+    completeVBucketScan();
+}
+
+void Warmup::scheduleVBucketScans(
+        std::function<ExTask(uint16_t, uint16_t)> makeTask,
+        std::function<void()> onComplete) {
+    // Build the list of (shard, vBucket) pairs to scan. Interleave the
+    // shards so that the vBuckets which are first in each shard's list
+    // (the active ones) are scheduled first.
+    std::vector<std::pair<uint16_t, uint16_t>> scans;
+    size_t maxVbsPerShard = 0;
+    for (const auto& vbids : shardVbIds) {
+        maxVbsPerShard = std::max(maxVbsPerShard, vbids.size());
+    }
+    for (size_t ii = 0; ii < maxVbsPerShard; ++ii) {
+        for (size_t shardId = 0; shardId < shardVbIds.size(); ++shardId) {
+            if (ii < shardVbIds[shardId].size()) {
+                scans.emplace_back(uint16_t(shardId), shardVbIds[shardId][ii]);
+            }
+        }
+    }
+
+    vbScans.stopped = false;
+    vbScans.completed = 0;
+    vbScans.total = scans.size();
+
+    if (scans.empty()) {
+        onComplete();
+        return;
+    }
+    vbScans.onComplete = std::move(onComplete);
+
+    for (const auto& scan : scans) {
+        ExecutorPool::get()->schedule(makeTask(scan.first, scan.second));
+    }
+}
+
+void Warmup::completeVBucketScan() {
+    if (++vbScans.completed == vbScans.total) {
+        // The callback normally schedules the next phase's scans, which
+        // assigns a new vbScans.onComplete; move it out so it isn't
+        // destroyed while running.
+        auto onComplete = std::move(vbScans.onComplete);
+        onComplete();
     }
 }
 
@@ -1293,6 +1636,9 @@ void Warmup::step() {
     case WarmupState::State::EstimateDatabaseItemCount:
         scheduleEstimateDatabaseItemCount();
         return;
+    case WarmupState::State::LoadingHashTableSnapshot:
+        scheduleLoadingHashTableSnapshots();
+        return;
     case WarmupState::State::KeyDump:
         scheduleKeyDump();
         return;
@@ -1360,6 +1706,16 @@ void Warmup::addStats(ADD_STAT add_stat, const void *c) const
             add_stat,
             c);
     addStat("min_item_threshold", stats.warmupNumReadCap * 100.0, add_stat, c);
+    addStat("vb_scans", vbScans.total.load(), add_stat, c);
+    addStat("vb_scans_completed", vbScans.completed.load(), add_stat, c);
+    {
+        std::lock_guard<std::mutex> lh(snapshotVbsMutex);
+        addStat("hashtable_snapshot_vbs", snapshotVbs.size(), add_stat, c);
+    }
+    addStat("early_traffic_enabled",
+            earlyTrafficEnabled.load() ? "true" : "false",
+            add_stat,
+            c);
 
     auto md_time = metadata.load();
     if (md_time > md_time.zero()) {
@@ -20,6 +20,7 @@
 #include "config.h"
 
 #include "callbacks.h"
+#include "globaltask.h"
 #include "utility.h"
 
 #include <memcached/engine_common.h>
@@ -29,16 +30,22 @@
 
 #include <atomic>
 #include <deque>
+#include <functional>
 #include <map>
+#include <mutex>
 #include <ostream>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 class Configuration;
 class EPStats;
 class KVBucket;
+class KeyScanBatch;
 class MutationLog;
+class VBucket;
 class VBucketMap;
 
 struct vbucket_state;
@@ -49,6 +56,7 @@ public:
         Initialize,
         CreateVBuckets,
         EstimateDatabaseItemCount,
+        LoadingHashTableSnapshot,
         KeyDump,
         LoadingAccessLog,
         CheckForAccessLog,
@@ -94,6 +102,13 @@ public:
 
     void callback(GetValue &val);
 
+    /**
+     * Load the given item into its vBucket's HashTable.
+     *
+     * @param partial true if the item only has the key and metadata
+     */
+    void load(Item& item, bool partial);
+
 private:
     bool shouldEject() const;
 
@@ -108,6 +123,22 @@ private:
     WarmupState::State warmupState;
 };
 
+/**
+ * Helper class used to load the keys and metadata read by
+ * KVStore::scanKeys into the HashTable, for the key dump.
+ */
+class LoadStorageKeyBatchCallback : public StatusCallback<KeyScanBatch> {
+public:
+    LoadStorageKeyBatchCallback(LoadStorageKVPairCallback& loader,
+                                uint16_t vbid);
+
+    void callback(KeyScanBatch& batch) override;
+
+private:
+    LoadStorageKVPairCallback& loader;
+    const uint16_t vbid;
+};
+
 class LoadValueCallback : public StatusCallback<CacheLookup> {
 public:
     LoadValueCallback(VBucketMap& vbMap, WarmupState::State warmupState)
@@ -187,14 +218,38 @@ public:
 
     bool hasOOMFailure() { return warmupOOMFailure.load(); }
 
+    /**
+     * Allow data traffic while warmup is still loading values (see the
+     * warmup_early_traffic configuration parameter). Must only be called
+     * once all of the keys are loaded (value eviction) or all of the
+     * vBuckets are created (full eviction); the values which aren't loaded
+     * yet are then fetched from disk on demand.
+     */
+    void enableEarlyTraffic();
+
+    bool isEarlyTrafficEnabled() const {
+        return earlyTrafficEnabled.load();
+    }
+
+    /**
+     * Should the loading of the given vBucket only update the items which
+     * are already in its HashTable? This is the case once data traffic is
+     * enabled early, if the keys were loaded (an item missing from the
+     * HashTable has since been deleted) or the vBucket has been modified
+     * since (the item may have been deleted and removed from the
+     * HashTable).
+     */
+    bool shouldOnlyLoadExistingItems(const VBucket& vb) const;
+
     void initialize();
     void createVBuckets(uint16_t shardId);
     void estimateDatabaseItemCount(uint16_t shardId);
-    void keyDumpforShard(uint16_t shardId);
+    void loadHashTableSnapshotforVBucket(uint16_t shardId, uint16_t vbid);
+    void keyDumpforVBucket(uint16_t shardId, uint16_t vbid);
     void checkForAccessLog();
     void loadingAccessLog(uint16_t shardId);
-    void loadKVPairsforShard(uint16_t shardId);
-    void loadDataforShard(uint16_t shardId);
+    void loadKVPairsforVBucket(uint16_t shardId, uint16_t vbid);
+    void loadDataforVBucket(uint16_t shardId, uint16_t vbid);
     void done();
 
 private:
@@ -209,6 +264,7 @@ private:
     void scheduleInitialize();
     void scheduleCreateVBuckets();
     void scheduleEstimateDatabaseItemCount();
+    void scheduleLoadingHashTableSnapshots();
     void scheduleKeyDump();
     void scheduleCheckForAccessLog();
     void scheduleLoadingAccessLog();
@@ -216,6 +272,35 @@ private:
     void scheduleLoadingData();
     void scheduleCompletion();
 
+    /**
+     * Schedule one task per vBucket (across all shards) for the current
+     * phase, so that the phase may use all of the reader threads rather
+     * than one per shard.
+     *
+     * @param makeTask function creating the task to scan the given
+     *                 (shard, vBucket)
+     * @param onComplete called by the last task to complete (or directly
+     *                   if there are no vBuckets to scan)
+     */
+    void scheduleVBucketScans(
+            std::function<ExTask(uint16_t, uint16_t)> makeTask,
+            std::function<void()> onComplete);
+
+    /// Called by the per-vBucket tasks when they are done
+    void completeVBucketScan();
+
+    /**
+     * Called once all of the hash table snapshots are loaded; removes the
+     * vBuckets which were completely restored from the remaining phases.
+     */
+    void hashTableSnapshotsComplete();
+
+    void keyDumpComplete();
+
+    /// Move on to loading keys, either by the key dump (value eviction) or
+    /// directly from the access log / data (full eviction)
+    void transitionToLoadingKeys();
+
     void transition(WarmupState::State to, bool force = false);
 
     WarmupState state;
@@ -247,12 +332,32 @@ private:
     /// contains all vBucket IDs which are present for the given shard.
     std::vector<std::vector<uint16_t>> shardVbIds;
 
+    /// Progress of the per-vBucket scans of the current phase (key dump,
+    /// loading KV pairs or loading data)
+    struct {
+        std::atomic<size_t> total{0};
+        std::atomic<size_t> completed{0};
+        /// Set when a scan hits the memory limit (or warmup is otherwise
+        /// done); the remaining scans are then skipped.
+        std::atomic<bool> stopped{false};
+        std::function<void()> onComplete;
+    } vbScans;
+
+    /// The vBuckets which were completely restored from their
+    /// HashTableSnapshot
+    mutable std::mutex snapshotVbsMutex;
+    std::set<uint16_t> snapshotVbs;
+
     cb::AtomicDuration estimateTime;
     std::atomic<size_t> estimatedItemCount;
     bool cleanShutdown;
     bool corruptAccessLog;
     std::atomic<bool> warmupComplete;
     std::atomic<bool> warmupOOMFailure;
+    std::atomic<bool> earlyTrafficEnabled;
+    /// The high seqno of each vBucket when data traffic was enabled early.
+    /// Written before earlyTrafficEnabled is set, read-only afterwards.
+    std::unordered_map<uint16_t, int64_t> earlyTrafficSeqnos;
     std::atomic<size_t> estimatedWarmupCount;
 
     /// All of the cookies which need notifying when create-vbuckets is done
@@ -6012,6 +6012,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ro_0:failure_get",
                 "ro_0:failure_open",
                 "ro_0:io_compaction_read_bytes",
+                "ro_0:io_compaction_throttle_time",
                 "ro_0:io_compaction_write_bytes",
                 "ro_0:io_bg_fetch_docs_read",
                 "ro_0:io_num_write",
@@ -6027,6 +6028,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ro_1:failure_get",
                 "ro_1:failure_open",
                 "ro_1:io_compaction_read_bytes",
+                "ro_1:io_compaction_throttle_time",
                 "ro_1:io_compaction_write_bytes",
                 "ro_1:io_bg_fetch_docs_read",
                 "ro_1:io_num_write",
@@ -6042,6 +6044,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ro_2:failure_get",
                 "ro_2:failure_open",
                 "ro_2:io_compaction_read_bytes",
+                "ro_2:io_compaction_throttle_time",
                 "ro_2:io_compaction_write_bytes",
                 "ro_2:io_bg_fetch_docs_read",
                 "ro_2:io_num_write",
@@ -6057,6 +6060,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ro_3:failure_get",
                 "ro_3:failure_open",
                 "ro_3:io_compaction_read_bytes",
+                "ro_3:io_compaction_throttle_time",
                 "ro_3:io_compaction_write_bytes",
                 "ro_3:io_bg_fetch_docs_read",
                 "ro_3:io_num_write",
@@ -6078,6 +6082,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "rw_0:failure_set",
                 "rw_0:failure_vbset",
                 "rw_0:io_compaction_read_bytes",
+                "rw_0:io_compaction_throttle_time",
                 "rw_0:io_compaction_write_bytes",
                 "rw_0:io_bg_fetch_docs_read",
                 "rw_0:io_num_write",
@@ -6097,6 +6102,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "rw_1:failure_set",
                 "rw_1:failure_vbset",
                 "rw_1:io_compaction_read_bytes",
+                "rw_1:io_compaction_throttle_time",
                 "rw_1:io_compaction_write_bytes",
                 "rw_1:io_bg_fetch_docs_read",
                 "rw_1:io_num_write",
@@ -6116,6 +6122,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "rw_2:failure_set",
                 "rw_2:failure_vbset",
                 "rw_2:io_compaction_read_bytes",
+                "rw_2:io_compaction_throttle_time",
                 "rw_2:io_compaction_write_bytes",
                 "rw_2:io_bg_fetch_docs_read",
                 "rw_2:io_num_write",
@@ -6135,6 +6142,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "rw_3:failure_set",
                 "rw_3:failure_vbset",
                 "rw_3:io_compaction_read_bytes",
+                "rw_3:io_compaction_throttle_time",
                 "rw_3:io_compaction_write_bytes",
                 "rw_3:io_bg_fetch_docs_read",
                 "rw_3:io_num_write",
@@ -6169,6 +6177,11 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
               "estimate"}},
             {"dcp",
              {"ep_dcp_count",
+              "ep_dcp_compressed_value_cache_evictions",
+              "ep_dcp_compressed_value_cache_hits",
+              "ep_dcp_compressed_value_cache_items",
+              "ep_dcp_compressed_value_cache_mem_used",
+              "ep_dcp_compressed_value_cache_misses",
               "ep_dcp_dead_conn_count",
               "ep_dcp_items_remaining",
               "ep_dcp_items_sent",
@@ -6287,6 +6300,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                         "ep_collections_prototype_enabled",
                         "ep_collections_max_size",
                         "ep_compaction_exp_mem_threshold",
+                        "ep_compaction_max_concurrent_ratio",
                         "ep_compaction_write_queue_cap",
                         "ep_compression_mode",
                         "ep_config_file",
@@ -6298,6 +6312,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                         "ep_data_traffic_enabled",
                         "ep_dbname",
                         "ep_dcp_backfill_byte_limit",
+                        "ep_dcp_compressed_value_cache_size",
                         "ep_dcp_conn_buffer_size",
                         "ep_dcp_conn_buffer_size_aggr_mem_threshold",
                         "ep_dcp_conn_buffer_size_aggressive_perc",
@@ -6374,16 +6389,21 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                         "ep_rocksdb_block_cache_ratio",
                         "ep_rocksdb_block_cache_high_pri_pool_ratio",
                         "ep_rocksdb_memtables_ratio",
+                        "ep_rocksdb_memtables_shared",
                         "ep_rocksdb_default_cf_optimize_compaction",
                         "ep_rocksdb_seqno_cf_optimize_compaction",
                         "ep_rocksdb_write_rate_limit",
                         "ep_rocksdb_uc_max_size_amplification_percent",
+                        "ep_rocksdb_rollback_snapshot_interval",
+                        "ep_rocksdb_rollback_snapshot_count",
                         "ep_time_synchronization",
                         "ep_uuid",
                         "ep_vb0",
                         "ep_waitforwarmup",
                         "ep_warmup",
                         "ep_warmup_batch_size",
+                        "ep_warmup_early_traffic",
+                        "ep_warmup_hashtable_snapshot",
                         "ep_warmup_min_items_threshold",
                         "ep_warmup_min_memory_threshold",
                         "ep_xattr_enabled"}},
@@ -6462,6 +6482,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
               "ep_collections_prototype_enabled",
               "ep_collections_max_size",
               "ep_compaction_exp_mem_threshold",
+              "ep_compaction_max_concurrent_ratio",
               "ep_compaction_write_queue_cap",
               "ep_compression_mode",
               "ep_config_file",
@@ -6478,6 +6499,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
               "ep_data_traffic_enabled",
               "ep_dbname",
               "ep_dcp_backfill_byte_limit",
+              "ep_dcp_compressed_value_cache_size",
               "ep_dcp_conn_buffer_size",
               "ep_dcp_conn_buffer_size_aggr_mem_threshold",
               "ep_dcp_conn_buffer_size_aggressive_perc",
@@ -6533,6 +6555,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
               "ep_initfile",
               "ep_io_bg_fetch_read_count",
               "ep_io_compaction_read_bytes",
+              "ep_io_compaction_throttle_time",
               "ep_io_compaction_write_bytes",
               "ep_io_total_read_bytes",
               "ep_io_total_write_bytes",
@@ -6620,10 +6643,13 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
               "ep_rocksdb_block_cache_ratio",
               "ep_rocksdb_block_cache_high_pri_pool_ratio",
               "ep_rocksdb_memtables_ratio",
+              "ep_rocksdb_memtables_shared",
               "ep_rocksdb_default_cf_optimize_compaction",
               "ep_rocksdb_seqno_cf_optimize_compaction",
               "ep_rocksdb_write_rate_limit",
               "ep_rocksdb_uc_max_size_amplification_percent",
+              "ep_rocksdb_rollback_snapshot_interval",
+              "ep_rocksdb_rollback_snapshot_count",
               "ep_rollback_count",
               "ep_startup_time",
               "ep_storage_age",
@@ -6647,6 +6673,8 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
               "ep_waitforwarmup",
               "ep_warmup",
               "ep_warmup_batch_size",
+              "ep_warmup_early_traffic",
+              "ep_warmup_hashtable_snapshot",
               "ep_warmup_min_items_threshold",
               "ep_warmup_min_memory_threshold",
               "ep_workload_pattern",
@@ -6768,6 +6796,11 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                           "ep_alog_resident_ratio_threshold",
                           "ep_alog_sleep_time",
                           "ep_alog_task_time",
+                          "ep_compaction_global_max_bytes_per_sec",
+                          "ep_compaction_max_bytes_per_sec",
+                          "ep_compaction_throttle_latency_threshold",
+                          "ep_couchstore_async_reads",
+                          "ep_couchstore_block_cache_size",
                           "ep_item_eviction_policy"});
 
         // 'diskinfo and 'diskinfo detail' keys should be present now.
@@ -6800,6 +6833,11 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                              "ep_alog_resident_ratio_threshold",
                              "ep_alog_sleep_time",
                              "ep_alog_task_time",
+                             "ep_compaction_global_max_bytes_per_sec",
+                             "ep_compaction_max_bytes_per_sec",
+                             "ep_compaction_throttle_latency_threshold",
+                             "ep_couchstore_async_reads",
+                             "ep_couchstore_block_cache_size",
                              "ep_item_eviction_policy"});
     }
 
@@ -7015,6 +7053,10 @@ static enum test_result test_mb19687_variable(ENGINE_HANDLE* h,
                                         "ep_warmup_oom",
                                         "ep_warmup_min_memory_threshold",
                                         "ep_warmup_min_item_threshold",
+                                        "ep_warmup_vb_scans",
+                                        "ep_warmup_vb_scans_completed",
+                                        "ep_warmup_hashtable_snapshot_vbs",
+                                        "ep_warmup_early_traffic_enabled",
                                         "ep_warmup_estimated_key_count",
                                         "ep_warmup_estimated_value_count" } });
     }
@@ -7583,8 +7625,7 @@ BaseTestCase testsuite_testcases[] = {
                  test_setup,
                  teardown,
                  nullptr,
-                 /* TODO RDB: implement RocksDBKVStore::getAllKeys */
-                 prepare_skip_broken_under_rocks,
+                 prepare,
                  cleanup),
         TestCase("test ALL_KEYS api during bucket creation",
                  test_all_keys_api_during_bucket_creation,
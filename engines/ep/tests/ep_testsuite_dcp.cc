@@ -5924,6 +5924,7 @@ static enum test_result test_set_dcp_param(ENGINE_HANDLE *h,
     func("dcp_consumer_process_buffered_messages_batch_size", 1000, true);
     func("dcp_consumer_process_buffered_messages_yield_limit", 0, false);
     func("dcp_consumer_process_buffered_messages_batch_size", 0, false);
+    func("dcp_compressed_value_cache_size", 1024 * 1024, true);
     return SUCCESS;
 }
 
@@ -68,6 +68,11 @@ void SynchronousEPEngine::setDcpConnMap(
     dcpConnMap_ = std::move(dcpConnMap);
 }
 
+void SynchronousEPEngine::setDcpFlowControlManager(
+        std::unique_ptr<DcpFlowControlManager> flowControlManager) {
+    dcpFlowControlManager_ = std::move(flowControlManager);
+}
+
 void SynchronousEPEngine::initializeConnmap() {
     dcpConnMap_->initialize();
 }
@@ -40,6 +40,8 @@ public:
 
     void setKVBucket(std::unique_ptr<KVBucket> store);
     void setDcpConnMap(std::unique_ptr<DcpConnMap> dcpConnMap);
+    void setDcpFlowControlManager(
+            std::unique_ptr<DcpFlowControlManager> flowControlManager);
 
     /* Allow us to call normally protected methods */
 
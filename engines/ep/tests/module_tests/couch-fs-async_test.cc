@@ -0,0 +1,193 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "src/couch-kvstore/couch-fs-async.h"
+
+#include "recording_file_ops.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <platform/make_unique.h>
+
+#include <cstdio>
+#include <vector>
+
+class AsyncReadOpsTest : public ::testing::Test {
+protected:
+    static const size_t FileSize = 64 * 1024 + 100;
+
+    void SetUp() override {
+        remove(filename.c_str());
+        ops = std::make_unique<AsyncReadOps>(recording);
+        handle = ops->constructor(&errinfo);
+        ASSERT_EQ(COUCHSTORE_SUCCESS,
+                  ops->open(&errinfo,
+                            &handle,
+                            filename.c_str(),
+                            O_RDWR | O_CREAT));
+        for (size_t ii = 0; ii < FileSize; ++ii) {
+            contents.push_back(uint8_t(ii * 13));
+        }
+        ASSERT_EQ(ssize_t(FileSize),
+                  ops->pwrite(&errinfo,
+                              handle,
+                              contents.data(),
+                              contents.size(),
+                              0));
+    }
+
+    void TearDown() override {
+        ops->close(&errinfo, handle);
+        ops->destructor(handle);
+        remove(filename.c_str());
+    }
+
+    /// Read through the ops, and check the data read
+    void checkRead(size_t nbytes, cs_off_t offset) {
+        std::vector<uint8_t> buf(nbytes);
+        const auto expected = std::min(nbytes, FileSize - size_t(offset));
+        ASSERT_EQ(ssize_t(expected),
+                  ops->pread(&errinfo, handle, buf.data(), nbytes, offset));
+        EXPECT_TRUE(std::equal(buf.begin(),
+                               buf.begin() + expected,
+                               contents.begin() + offset));
+    }
+
+    const std::string filename = "couch-fs-async_test.couch";
+    RecordingOps recording;
+    std::unique_ptr<AsyncReadOps> ops;
+    couch_file_handle handle;
+    couchstore_error_info_t errinfo;
+    std::vector<uint8_t> contents;
+};
+
+const size_t AsyncReadOpsTest::FileSize;
+
+TEST_F(AsyncReadOpsTest, PrefetchedReads) {
+    for (cs_off_t offset = 0; offset < 32 * 1024; offset += 8 * 1024) {
+        ASSERT_EQ(COUCHSTORE_SUCCESS,
+                  ops->advise(&errinfo,
+                              handle,
+                              offset + 100,
+                              5000,
+                              AsyncReadOps::WillNeed));
+    }
+    // Reads within the (aligned) prefetched ranges
+    checkRead(5000, 8 * 1024 + 100);
+    checkRead(4096, 0);
+    checkRead(100, 24 * 1024 + 8000);
+    // ... and one which isn't prefetched
+    checkRead(100, 40 * 1024);
+
+    if (AsyncReadOps::isAvailable()) {
+        EXPECT_EQ(std::vector<size_t>{100}, recording.reads);
+        EXPECT_TRUE(recording.advice_calls.empty());
+    } else {
+        EXPECT_EQ(4, recording.reads.size());
+        EXPECT_EQ(4, recording.advice_calls.size());
+    }
+}
+
+// The files of a thread share its ring; the reads of one file must not be
+// affected by (or lost to) those of another file, or a file which is closed
+TEST_F(AsyncReadOpsTest, FilesShareTheRing) {
+    auto other = ops->constructor(&errinfo);
+    ASSERT_EQ(COUCHSTORE_SUCCESS,
+              ops->open(&errinfo, &other, filename.c_str(), O_RDONLY));
+    for (auto* file : {handle, other}) {
+        ASSERT_EQ(COUCHSTORE_SUCCESS,
+                  ops->advise(&errinfo,
+                              file,
+                              16 * 1024,
+                              4096,
+                              AsyncReadOps::WillNeed));
+    }
+
+    // Reading from the first file reaps the completion of the second
+    checkRead(4096, 16 * 1024);
+    std::vector<uint8_t> buf(4096);
+    ASSERT_EQ(4096, ops->pread(&errinfo, other, buf.data(), 4096, 16 * 1024));
+    EXPECT_TRUE(std::equal(
+            buf.begin(), buf.end(), contents.begin() + 16 * 1024));
+    ops->close(&errinfo, other);
+    ops->destructor(other);
+
+    // ... and a file opened later on uses it as well
+    ASSERT_EQ(COUCHSTORE_SUCCESS,
+              ops->advise(&errinfo, handle, 0, 4096, AsyncReadOps::WillNeed));
+    checkRead(4096, 0);
+
+    if (AsyncReadOps::isAvailable()) {
+        EXPECT_TRUE(recording.reads.empty());
+    }
+}
+
+TEST_F(AsyncReadOpsTest, ShortReadAtEndOfFile) {
+    ASSERT_EQ(COUCHSTORE_SUCCESS,
+              ops->advise(&errinfo,
+                          handle,
+                          FileSize - 200,
+                          1000,
+                          AsyncReadOps::WillNeed));
+    // The prefetch is short, so reads past the end are passed down
+    checkRead(150, FileSize - 200);
+    checkRead(1000, FileSize - 200);
+    checkRead(100, FileSize);
+}
+
+TEST_F(AsyncReadOpsTest, OtherAdvicePassedDown) {
+    ASSERT_EQ(COUCHSTORE_SUCCESS,
+              ops->advise(&errinfo,
+                          handle,
+                          0,
+                          4096,
+                          couchstore_file_advice_t(POSIX_FADV_DONTNEED)));
+    // Too large to prefetch
+    ASSERT_EQ(COUCHSTORE_SUCCESS,
+              ops->advise(&errinfo,
+                          handle,
+                          0,
+                          AsyncReadOps::MaxPrefetchSize + 1,
+                          AsyncReadOps::WillNeed));
+    ASSERT_EQ(2, recording.advice_calls.size());
+    EXPECT_EQ(AsyncReadOps::WillNeed, recording.advice_calls[1].advice);
+}
+
+TEST(ReadHintOpsTest, WillNeedChunk) {
+    const std::string filename = "couch-fs-async_test_hint.couch";
+    RecordingOps recording;
+    ReadHintOps ops(recording);
+    couchstore_error_info_t errinfo;
+
+    // No hints before the file is opened
+    ops.willNeedChunk(0, 100);
+    EXPECT_TRUE(recording.advice_calls.empty());
+
+    auto handle = ops.constructor(&errinfo);
+    ASSERT_EQ(COUCHSTORE_SUCCESS,
+              ops.open(&errinfo, &handle, filename.c_str(), O_RDWR | O_CREAT));
+    ops.willNeedChunk(8192, 10000);
+    ASSERT_EQ(1, recording.advice_calls.size());
+    EXPECT_EQ(8192, recording.advice_calls[0].offset);
+    // Header, data and the markers of the three blocks it spans
+    EXPECT_EQ(10000 + 8 + 3, recording.advice_calls[0].len);
+    EXPECT_EQ(AsyncReadOps::WillNeed, recording.advice_calls[0].advice);
+
+    ops.close(&errinfo, handle);
+    ops.destructor(handle);
+    remove(filename.c_str());
+}
@@ -0,0 +1,255 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "src/couch-kvstore/couch-fs-cache.h"
+
+#include "kvstore.h"
+#include "recording_file_ops.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <vector>
+
+static BlockCache::Key makeKey(uint64_t block) {
+    return {1, 2, block};
+}
+
+static std::vector<uint8_t> makeBlock(uint8_t value) {
+    return std::vector<uint8_t>(BlockCache::BlockSize, value);
+}
+
+TEST(BlockCacheTest, AdmitsOnSecondMiss) {
+    BlockCache cache(16 * BlockCache::BlockSize);
+    std::vector<uint8_t> buf(BlockCache::BlockSize);
+    const auto block = makeBlock('a');
+
+    cache.insert(makeKey(0), block.data());
+    EXPECT_FALSE(cache.lookup(makeKey(0), buf.data()));
+    EXPECT_EQ(0, cache.getStats().items);
+
+    cache.insert(makeKey(0), block.data());
+    ASSERT_TRUE(cache.lookup(makeKey(0), buf.data()));
+    EXPECT_EQ(block, buf);
+    EXPECT_EQ(1, cache.getStats().items);
+    EXPECT_EQ(BlockCache::BlockSize, cache.getStats().size);
+}
+
+TEST(BlockCacheTest, EvictsLeastRecentlyUsed) {
+    BlockCache cache(2 * BlockCache::BlockSize, 1);
+    std::vector<uint8_t> buf(BlockCache::BlockSize);
+    for (uint8_t ii = 0; ii < 2; ++ii) {
+        const auto block = makeBlock(ii);
+        cache.insert(makeKey(ii), block.data());
+        cache.insert(makeKey(ii), block.data());
+    }
+
+    // Touch block 0 so block 1 is the least recently used
+    ASSERT_TRUE(cache.lookup(makeKey(0), buf.data()));
+    const auto block = makeBlock(2);
+    cache.insert(makeKey(2), block.data());
+    cache.insert(makeKey(2), block.data());
+
+    EXPECT_TRUE(cache.lookup(makeKey(0), buf.data()));
+    EXPECT_FALSE(cache.lookup(makeKey(1), buf.data()));
+    ASSERT_TRUE(cache.lookup(makeKey(2), buf.data()));
+    EXPECT_EQ(block, buf);
+    EXPECT_EQ(2, cache.getStats().items);
+    EXPECT_EQ(1, cache.getStats().evictions);
+}
+
+TEST(BlockCacheTest, Invalidate) {
+    BlockCache cache(16 * BlockCache::BlockSize);
+    std::vector<uint8_t> buf(BlockCache::BlockSize);
+    const auto block = makeBlock('a');
+    for (uint64_t ii = 0; ii < 4; ++ii) {
+        cache.insert(makeKey(ii), block.data());
+        cache.insert(makeKey(ii), block.data());
+    }
+
+    cache.invalidate(1, 2, 1, 2);
+    EXPECT_TRUE(cache.lookup(makeKey(0), buf.data()));
+    EXPECT_FALSE(cache.lookup(makeKey(1), buf.data()));
+    EXPECT_FALSE(cache.lookup(makeKey(2), buf.data()));
+    EXPECT_TRUE(cache.lookup(makeKey(3), buf.data()));
+    EXPECT_EQ(2, cache.getStats().items);
+
+    // The invalidated blocks have to miss twice again to be admitted
+    cache.insert(makeKey(1), block.data());
+    EXPECT_FALSE(cache.lookup(makeKey(1), buf.data()));
+}
+
+TEST(BlockCacheTest, SharedPerBucket) {
+    auto cache = BlockCache::get("bucket_a", BlockCache::BlockSize);
+    EXPECT_EQ(cache, BlockCache::get("bucket_a", 2 * BlockCache::BlockSize));
+    EXPECT_NE(cache, BlockCache::get("bucket_b", BlockCache::BlockSize));
+    EXPECT_EQ(BlockCache::BlockSize, cache->getCapacity());
+}
+
+// The cache is bypassed on Windows (there are no inode numbers)
+#ifndef WIN32
+
+class BlockCacheOpsTest : public ::testing::Test {
+protected:
+    /// Size of the test file; the last block is partial
+    static const size_t FileSize = 8 * BlockCache::BlockSize + 100;
+
+    void SetUp() override {
+        remove(filename.c_str());
+        cache = std::make_shared<BlockCache>(64 * BlockCache::BlockSize);
+        createOps(true);
+        for (size_t ii = 0; ii < FileSize; ++ii) {
+            contents.push_back(uint8_t(ii * 7));
+        }
+        ASSERT_EQ(ssize_t(FileSize),
+                  ops->pwrite(&errinfo,
+                              handle,
+                              contents.data(),
+                              contents.size(),
+                              0));
+        recording.reads.clear();
+    }
+
+    void TearDown() override {
+        destroyOps();
+        remove(filename.c_str());
+    }
+
+    void createOps(bool populate) {
+        ops = std::make_unique<BlockCacheOps>(
+                cache, stats, recording, populate);
+        handle = ops->constructor(&errinfo);
+        ASSERT_EQ(COUCHSTORE_SUCCESS,
+                  ops->open(&errinfo,
+                            &handle,
+                            filename.c_str(),
+                            O_RDWR | O_CREAT));
+    }
+
+    void destroyOps() {
+        ops->close(&errinfo, handle);
+        ops->destructor(handle);
+        ops.reset();
+    }
+
+    /// Read through the cache, and check the data read
+    void checkRead(size_t nbytes, cs_off_t offset) {
+        std::vector<uint8_t> buf(nbytes);
+        const auto expected =
+                std::min(nbytes, size_t(FileSize - std::min(FileSize,
+                                                            size_t(offset))));
+        ASSERT_EQ(ssize_t(expected),
+                  ops->pread(&errinfo, handle, buf.data(), nbytes, offset));
+        EXPECT_TRUE(std::equal(buf.begin(),
+                               buf.begin() + expected,
+                               contents.begin() + offset));
+    }
+
+    const std::string filename = "couch-fs-cache_test.couch";
+    std::shared_ptr<BlockCache> cache;
+    FileStats stats;
+    RecordingOps recording;
+    std::unique_ptr<BlockCacheOps> ops;
+    couch_file_handle handle;
+    couchstore_error_info_t errinfo;
+    std::vector<uint8_t> contents;
+};
+
+const size_t BlockCacheOpsTest::FileSize;
+
+TEST_F(BlockCacheOpsTest, ReadsWholeBlocks) {
+    // A small read within a block, and one spanning two blocks
+    checkRead(100, 10);
+    checkRead(200, BlockCache::BlockSize - 100);
+    // The two missing blocks of the second read are read together
+    EXPECT_EQ(std::vector<size_t>(
+                      {BlockCache::BlockSize, 2 * BlockCache::BlockSize}),
+              recording.reads);
+    EXPECT_EQ(0, stats.blockCacheHits);
+    EXPECT_EQ(3, stats.blockCacheMisses);
+}
+
+TEST_F(BlockCacheOpsTest, ReadsEachRunOfMissingBlocksOnce) {
+    // Get block 1 into the cache
+    checkRead(100, BlockCache::BlockSize);
+    checkRead(100, BlockCache::BlockSize);
+    recording.reads.clear();
+
+    // A read spanning blocks 0-3 serves block 1 from the cache, and reads
+    // block 0 and blocks 2-3 from disk
+    checkRead(3 * BlockCache::BlockSize + 200, 100);
+    EXPECT_EQ(std::vector<size_t>(
+                      {BlockCache::BlockSize, 2 * BlockCache::BlockSize}),
+              recording.reads);
+    EXPECT_EQ(1, stats.blockCacheHits);
+    EXPECT_EQ(5, stats.blockCacheMisses);
+}
+
+TEST_F(BlockCacheOpsTest, HitsAfterSecondMiss) {
+    checkRead(100, 10);
+    checkRead(100, 10);
+    recording.reads.clear();
+
+    checkRead(100, 200);
+    checkRead(BlockCache::BlockSize, 0);
+    EXPECT_TRUE(recording.reads.empty());
+    EXPECT_EQ(2, stats.blockCacheHits);
+    EXPECT_EQ(2, stats.blockCacheMisses);
+}
+
+TEST_F(BlockCacheOpsTest, PartialLastBlock) {
+    const cs_off_t lastBlock = 8 * BlockCache::BlockSize;
+    // Reads crossing or starting at the end of file are short
+    checkRead(200, lastBlock + 50);
+    checkRead(200, lastBlock + 50);
+    checkRead(100, FileSize);
+    // The partial block is never cached
+    checkRead(200, lastBlock + 50);
+    EXPECT_EQ(0, stats.blockCacheHits);
+}
+
+TEST_F(BlockCacheOpsTest, LargeReadsBypass) {
+    checkRead(BlockCacheOps::MaxCachedRead + 1, 0);
+    EXPECT_EQ(std::vector<size_t>{BlockCacheOps::MaxCachedRead + 1},
+              recording.reads);
+    EXPECT_EQ(0, stats.blockCacheMisses);
+}
+
+TEST_F(BlockCacheOpsTest, NoPopulate) {
+    destroyOps();
+    createOps(false);
+    for (int ii = 0; ii < 3; ++ii) {
+        checkRead(100, 10);
+    }
+    EXPECT_EQ(0, stats.blockCacheHits);
+    EXPECT_EQ(0, cache->getStats().items);
+}
+
+TEST_F(BlockCacheOpsTest, WriteInvalidates) {
+    checkRead(100, 10);
+    checkRead(100, 10);
+    ASSERT_EQ(1, cache->getStats().items);
+
+    std::fill(contents.begin() + 50, contents.begin() + 60, 0xff);
+    ASSERT_EQ(10,
+              ops->pwrite(&errinfo, handle, contents.data() + 50, 10, 50));
+    EXPECT_EQ(0, cache->getStats().items);
+    checkRead(100, 10);
+}
+
+#endif
@@ -0,0 +1,126 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "src/couch-kvstore/couch-fs-throttle.h"
+
+#include "kvstore.h"
+#include "recording_file_ops.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <vector>
+
+using namespace std::chrono;
+
+TEST(CompactionRateLimiterTest, Unlimited) {
+    CompactionRateLimiter limiter;
+    EXPECT_EQ(0, limiter.reserve(1024 * 1024 * 1024).count());
+}
+
+TEST(CompactionRateLimiterTest, TokenBucket) {
+    CompactionRateLimiter limiter;
+    limiter.setRate(1000000);
+    const auto now = ProcessClock::now();
+
+    // A burst of up to 100ms worth of bytes goes straight through ...
+    EXPECT_EQ(0, limiter.reserve(100000, now).count());
+    // ... after which callers wait for the bytes they take
+    EXPECT_NEAR(100000, limiter.reserve(100000, now).count(), 1);
+    EXPECT_NEAR(
+            50000, limiter.reserve(100000, now + milliseconds(150)).count(), 1);
+    EXPECT_EQ(0, limiter.reserve(0, now + milliseconds(250)).count());
+}
+
+TEST(CompactionRateLimiterTest, AdaptsToLatency) {
+    CompactionRateLimiter limiter;
+    limiter.setRate(1000000);
+    limiter.setLatencyThreshold(milliseconds(10));
+    const auto now = ProcessClock::now();
+
+    limiter.reportLatency(milliseconds(10), now);
+    EXPECT_EQ(1000000, limiter.getCurrentRate());
+    limiter.reportLatency(milliseconds(20), now);
+    EXPECT_EQ(500000, limiter.getCurrentRate());
+    // At most one reduction per interval
+    limiter.reportLatency(milliseconds(20), now + milliseconds(50));
+    EXPECT_EQ(500000, limiter.getCurrentRate());
+
+    auto time = now;
+    for (int ii = 0; ii < 5; ++ii) {
+        time += CompactionRateLimiter::AdjustInterval;
+        limiter.reportLatency(milliseconds(20), time);
+    }
+    EXPECT_EQ(100000, limiter.getCurrentRate());
+
+    // Recovers once the latency is fine again
+    limiter.reserve(0, time + 2 * CompactionRateLimiter::AdjustInterval);
+    EXPECT_EQ(300000, limiter.getCurrentRate());
+    limiter.reserve(0, time + seconds(10));
+    EXPECT_EQ(1000000, limiter.getCurrentRate());
+    EXPECT_EQ(1000000, limiter.getRate());
+}
+
+TEST(CompactionRateLimiterTest, GlobalUsesLowestBucketLimit) {
+    auto bucketA = CompactionRateLimiter::get("bucket_a");
+    auto bucketB = CompactionRateLimiter::get("bucket_b");
+    EXPECT_EQ(bucketA, CompactionRateLimiter::get("bucket_a"));
+    auto global = CompactionRateLimiter::getGlobal();
+
+    CompactionRateLimiter::configure(*bucketA, 100, 2000000, microseconds(0));
+    EXPECT_EQ(100, bucketA->getRate());
+    EXPECT_EQ(2000000, global->getRate());
+    CompactionRateLimiter::configure(*bucketB, 0, 1000000, microseconds(0));
+    EXPECT_EQ(1000000, global->getRate());
+    CompactionRateLimiter::configure(*bucketB, 0, 0, microseconds(0));
+    EXPECT_EQ(2000000, global->getRate());
+
+    // A bucket which has gone away no longer counts
+    bucketA.reset();
+    CompactionRateLimiter::configure(*bucketB, 0, 0, microseconds(0));
+    EXPECT_EQ(0, global->getRate());
+}
+
+TEST(ThrottledOpsTest, WaitsForLimiters) {
+    const std::string filename = "couch-fs-throttle_test.couch";
+    remove(filename.c_str());
+    auto unlimited = std::make_shared<CompactionRateLimiter>();
+    auto limiter = std::make_shared<CompactionRateLimiter>();
+    limiter->setRate(1000000);
+    FileStats stats;
+    RecordingOps recording;
+    ThrottledOps ops({unlimited, limiter}, stats, recording);
+    couchstore_error_info_t errinfo;
+
+    auto handle = ops.constructor(&errinfo);
+    ASSERT_EQ(COUCHSTORE_SUCCESS,
+              ops.open(&errinfo, &handle, filename.c_str(), O_RDWR | O_CREAT));
+    std::vector<uint8_t> buf(100000);
+    // The first write fits in the burst, the read has to wait ~100ms
+    ASSERT_EQ(ssize_t(buf.size()),
+              ops.pwrite(&errinfo, handle, buf.data(), buf.size(), 0));
+    EXPECT_EQ(0, stats.throttleWaitTime);
+    ASSERT_EQ(ssize_t(buf.size()),
+              ops.pread(&errinfo, handle, buf.data(), buf.size(), 0));
+    EXPECT_LT(50000, stats.throttleWaitTime);
+    EXPECT_EQ(std::vector<size_t>{buf.size()}, recording.reads);
+
+    ops.close(&errinfo, handle);
+    ops.destructor(handle);
+    remove(filename.c_str());
+}
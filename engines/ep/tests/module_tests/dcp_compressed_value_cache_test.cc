@@ -0,0 +1,128 @@
+/* -*- MODE: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Unit tests for the DcpCompressedValueCache class.
+ */
+
+#include "dcp/compressed_value_cache.h"
+#include "item.h"
+#include "test_helpers.h"
+
+#include <gtest/gtest.h>
+#include <memcached/protocol_binary.h>
+
+#include <map>
+
+class DcpCompressedValueCacheTest : public ::testing::Test {
+protected:
+    std::unique_ptr<Item> makeItem(int64_t seqno, uint64_t cas) {
+        auto item = makeCompressibleItem(vbid,
+                                         makeStoredDocKey("key"),
+                                         value,
+                                         PROTOCOL_BINARY_DATATYPE_JSON,
+                                         /*shouldCompress*/ false);
+        item->setBySeqno(seqno);
+        item->setCas(cas);
+        return item;
+    }
+
+    static void addStat(const char* key,
+                        const uint16_t klen,
+                        const char* val,
+                        const uint32_t vlen,
+                        gsl::not_null<const void*> cookie) {
+        auto* stats = static_cast<std::map<std::string, std::string>*>(
+                const_cast<void*>(cookie.get()));
+        (*stats)[std::string(key, klen)] = std::string(val, vlen);
+    }
+
+    std::string getStat(const std::string& name) {
+        std::map<std::string, std::string> stats;
+        cache.addStats(addStat, &stats);
+        return stats.at(name);
+    }
+
+    const uint16_t vbid = 0;
+    const std::string value = std::string(1024, 'x');
+    DcpCompressedValueCache cache{1024 * 1024};
+};
+
+// Compressing the same revision twice should only compress it once, and
+// both items should share the compressed value.
+TEST_F(DcpCompressedValueCacheTest, SameRevisionIsReused) {
+    auto item1 = makeItem(1, 100);
+    auto item2 = makeItem(1, 100);
+
+    ASSERT_TRUE(cache.compressValue(vbid, *item1));
+    EXPECT_TRUE(mcbp::datatype::is_snappy(item1->getDataType()));
+    EXPECT_LT(item1->getNBytes(), value.size());
+
+    ASSERT_TRUE(cache.compressValue(vbid, *item2));
+    EXPECT_TRUE(mcbp::datatype::is_snappy(item2->getDataType()));
+    EXPECT_EQ(item1->getValue().get(), item2->getValue().get());
+
+    EXPECT_EQ("1", getStat("ep_dcp_compressed_value_cache_hits"));
+    EXPECT_EQ("1", getStat("ep_dcp_compressed_value_cache_misses"));
+    EXPECT_EQ("1", getStat("ep_dcp_compressed_value_cache_items"));
+}
+
+// A different revision (CAS) or vBucket must not use the cached value
+TEST_F(DcpCompressedValueCacheTest, DifferentRevisionIsNotReused) {
+    auto item1 = makeItem(1, 100);
+    auto item2 = makeItem(1, 101);
+    auto item3 = makeItem(1, 100);
+
+    ASSERT_TRUE(cache.compressValue(vbid, *item1));
+    ASSERT_TRUE(cache.compressValue(vbid, *item2));
+    ASSERT_TRUE(cache.compressValue(vbid + 1, *item3));
+    EXPECT_NE(item1->getValue().get(), item2->getValue().get());
+    EXPECT_NE(item1->getValue().get(), item3->getValue().get());
+
+    EXPECT_EQ("0", getStat("ep_dcp_compressed_value_cache_hits"));
+    EXPECT_EQ("3", getStat("ep_dcp_compressed_value_cache_misses"));
+}
+
+// With a zero size the cache should just compress the value
+TEST_F(DcpCompressedValueCacheTest, Disabled) {
+    cache.setMaxSize(0);
+    auto item1 = makeItem(1, 100);
+    auto item2 = makeItem(1, 100);
+
+    ASSERT_TRUE(cache.compressValue(vbid, *item1));
+    ASSERT_TRUE(cache.compressValue(vbid, *item2));
+    EXPECT_TRUE(mcbp::datatype::is_snappy(item2->getDataType()));
+    EXPECT_NE(item1->getValue().get(), item2->getValue().get());
+    EXPECT_EQ("0", getStat("ep_dcp_compressed_value_cache_items"));
+}
+
+// The cache should never grow beyond its configured size
+TEST_F(DcpCompressedValueCacheTest, BoundedSize) {
+    cache.setMaxSize(64 * 1024);
+    for (int64_t seqno = 1; seqno <= 10000; ++seqno) {
+        auto item = makeItem(seqno, seqno);
+        ASSERT_TRUE(cache.compressValue(vbid, *item));
+    }
+
+    EXPECT_LE(std::stoull(getStat("ep_dcp_compressed_value_cache_mem_used")),
+              cache.getMaxSize());
+    EXPECT_NE("0", getStat("ep_dcp_compressed_value_cache_evictions"));
+
+    cache.setMaxSize(0);
+    EXPECT_EQ("0", getStat("ep_dcp_compressed_value_cache_items"));
+    EXPECT_EQ("0", getStat("ep_dcp_compressed_value_cache_mem_used"));
+}
@@ -29,17 +29,21 @@
 #include "ep_time.h"
 #include "evp_store_test.h"
 #include "fakes/fake_executorpool.h"
+#include "hash_table_snapshot.h"
 #include "item_freq_decayer_visitor.h"
 #include "programs/engine_testapp/mock_server.h"
 #include "taskqueue.h"
 #include "tests/module_tests/test_helpers.h"
 #include "tests/module_tests/test_task.h"
+#include "warmup.h"
 
 #include <libcouchstore/couch_db.h>
+#include <platform/dirutils.h>
 #include <string_utilities.h>
 #include <xattr/blob.h>
 #include <xattr/utils.h>
 
+#include <fstream>
 #include <thread>
 
 ProcessClock::time_point SingleThreadedKVBucketTest::runNextTask(
@@ -1779,6 +1783,29 @@ public:
         engine->getKVBucket()->initializeWarmupTask();
         engine->getKVBucket()->startWarmupTask();
     }
+
+    /// Mark the bucket as shut down gracefully (as destroy(false) would)
+    void recordCleanShutdown() {
+        engine->getEpStats().isShutdown = true;
+        store->snapshotStats();
+    }
+
+    std::map<std::string, std::string> getWarmupStats() {
+        std::map<std::string, std::string> stats;
+        store->getWarmup()->addStats(
+                [](const char* key,
+                   const uint16_t klen,
+                   const char* val,
+                   const uint32_t vlen,
+                   gsl::not_null<const void*> cookie) {
+                    auto& stats =
+                            *static_cast<std::map<std::string, std::string>*>(
+                                    const_cast<void*>(cookie.get()));
+                    stats[std::string(key, klen)] = std::string(val, vlen);
+                },
+                &stats);
+        return stats;
+    }
 };
 
 TEST_F(WarmupTest, hlcEpoch) {
@@ -1859,6 +1886,207 @@ TEST_F(WarmupTest, fetchDocInDifferentCompressionModes) {
               info1.datatype);
 }
 
+// Warmup scans each vBucket in its own task; check that every vBucket is
+// loaded and that the progress stats account for all of them.
+TEST_F(WarmupTest, ScanPerVBucket) {
+    const std::vector<uint16_t> vbids{0, 1, 2, 3};
+    for (const auto vb : vbids) {
+        setVBucketStateAndRunPersistTask(vb, vbucket_state_active);
+        store_item(vb, makeStoredDocKey("key" + std::to_string(vb)), "value");
+        flush_vbucket_to_disk(vb);
+    }
+
+    resetEngineAndWarmup();
+
+    for (const auto vb : vbids) {
+        auto item = store->get(
+                makeStoredDocKey("key" + std::to_string(vb)), vb, nullptr, {});
+        EXPECT_EQ(ENGINE_SUCCESS, item.getStatus()) << "vb:" << vb;
+    }
+
+    auto stats = getWarmupStats();
+    EXPECT_EQ(std::to_string(vbids.size()), stats["ep_warmup_vb_scans"]);
+    EXPECT_EQ(std::to_string(vbids.size()),
+              stats["ep_warmup_vb_scans_completed"]);
+}
+
+// With fewer vBuckets than shards some shards have no key dump task; check
+// that they don't make the key dump look failed (which would skip
+// CheckForAccessLog and fall back to loading everything in LoadingKVPairs).
+TEST_F(WarmupTest, ScanFewerVBucketsThanShards) {
+    ASSERT_LT(size_t(1), store->getVBuckets().getNumShards());
+    setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
+    store_item(vbid, makeStoredDocKey("key"), "value");
+    flush_vbucket_to_disk(vbid);
+
+    resetEngineAndWarmup();
+
+    auto item = store->get(makeStoredDocKey("key"), vbid, nullptr, {});
+    EXPECT_EQ(ENGINE_SUCCESS, item.getStatus());
+
+    auto stats = getWarmupStats();
+    EXPECT_EQ("1", stats["ep_warmup_vb_scans"]);
+    EXPECT_EQ("1", stats["ep_warmup_vb_scans_completed"]);
+    // keys_time is only recorded by CheckForAccessLog
+    EXPECT_EQ(1, stats.count("ep_warmup_keys_time"));
+}
+
+// Check that after a graceful shutdown the hash tables are restored from
+// their snapshot (including which items are resident), and that the
+// snapshots are removed once used.
+TEST_F(WarmupTest, HashTableSnapshot) {
+    const std::vector<uint16_t> vbids{0, 1};
+    for (const auto vb : vbids) {
+        setVBucketStateAndRunPersistTask(vb, vbucket_state_active);
+        store_item(vb, makeStoredDocKey("key1"), "value1");
+        store_item(vb, makeStoredDocKey("key2"), "value2");
+        flush_vbucket_to_disk(vb, 2);
+    }
+    evict_key(0, makeStoredDocKey("key2"));
+
+    engine->getConfiguration().setWarmupHashtableSnapshot(true);
+    recordCleanShutdown();
+    resetEngineAndEnableWarmup("warmup_hashtable_snapshot=true");
+
+    for (const auto vb : vbids) {
+        EXPECT_TRUE(cb::io::isFile(
+                HashTableSnapshot::getFileName(test_dbname, vb)))
+                << "vb:" << vb;
+    }
+
+    runReadersUntilWarmedUp();
+
+    EXPECT_EQ(std::to_string(vbids.size()),
+              getWarmupStats()["ep_warmup_hashtable_snapshot_vbs"]);
+    for (const auto vb : vbids) {
+        EXPECT_FALSE(cb::io::isFile(
+                HashTableSnapshot::getFileName(test_dbname, vb)))
+                << "vb:" << vb;
+    }
+
+    auto vb0 = store->getVBucket(0);
+    EXPECT_EQ(2, vb0->ht.getNumItems());
+    EXPECT_EQ(1, vb0->ht.getNumInMemoryNonResItems());
+    auto vb1 = store->getVBucket(1);
+    EXPECT_EQ(2, vb1->ht.getNumItems());
+    EXPECT_EQ(0, vb1->ht.getNumInMemoryNonResItems());
+
+    auto item = store->get(makeStoredDocKey("key1"), 0, cookie, {});
+    ASSERT_EQ(ENGINE_SUCCESS, item.getStatus());
+    EXPECT_EQ("value1", item.item->getValue()->to_s());
+    item = store->get(makeStoredDocKey("key2"), 1, cookie, {});
+    ASSERT_EQ(ENGINE_SUCCESS, item.getStatus());
+    EXPECT_EQ("value2", item.item->getValue()->to_s());
+}
+
+// The collections system events are counted on disk but are never in the
+// hash table; they must not make the value eviction item count check
+// discard the snapshot.
+TEST_F(WarmupTest, HashTableSnapshotWithCollections) {
+    resetEngineAndWarmup("collections_prototype_enabled=true");
+    setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
+    store->getVBucket(vbid)->updateFromManifest(
+            {R"({"separator":":",
+                 "collections":[{"name":"$default", "uid":"0"},
+                                {"name":"meat", "uid":"1"}]})"});
+    store_item(vbid, makeStoredDocKey("key"), "value");
+    store_item(vbid, {"meat:one", DocNamespace::Collections}, "value");
+    // The meat create event and 2 items
+    flush_vbucket_to_disk(vbid, 3);
+    ASSERT_EQ(1, store->getRWUnderlying(vbid)->getSystemItemCount(vbid));
+
+    engine->getConfiguration().setWarmupHashtableSnapshot(true);
+    recordCleanShutdown();
+    resetEngineAndEnableWarmup(
+            "collections_prototype_enabled=true;"
+            "warmup_hashtable_snapshot=true");
+
+    EXPECT_TRUE(cb::io::isFile(
+            HashTableSnapshot::getFileName(test_dbname, vbid)));
+
+    runReadersUntilWarmedUp();
+
+    EXPECT_EQ("1", getWarmupStats()["ep_warmup_hashtable_snapshot_vbs"]);
+    EXPECT_EQ(2, store->getVBucket(vbid)->ht.getNumItems());
+}
+
+// A corrupt snapshot must not be used; the vBucket is then loaded from disk.
+TEST_F(WarmupTest, HashTableSnapshotCorrupt) {
+    const std::vector<uint16_t> vbids{0, 1};
+    for (const auto vb : vbids) {
+        setVBucketStateAndRunPersistTask(vb, vbucket_state_active);
+        store_item(vb, makeStoredDocKey("key"), "value");
+        flush_vbucket_to_disk(vb);
+    }
+
+    engine->getConfiguration().setWarmupHashtableSnapshot(true);
+    recordCleanShutdown();
+    resetEngineAndEnableWarmup("warmup_hashtable_snapshot=true");
+
+    // Drop the last byte of vb:0's snapshot
+    const auto fname = HashTableSnapshot::getFileName(test_dbname, 0);
+    std::string content;
+    {
+        std::ifstream in(fname, std::ios::binary);
+        content.assign(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+    }
+    ASSERT_FALSE(content.empty());
+    content.pop_back();
+    {
+        std::ofstream out(fname, std::ios::binary | std::ios::trunc);
+        out << content;
+    }
+
+    runReadersUntilWarmedUp();
+
+    EXPECT_EQ("1", getWarmupStats()["ep_warmup_hashtable_snapshot_vbs"]);
+    EXPECT_FALSE(cb::io::isFile(fname));
+    for (const auto vb : vbids) {
+        auto item = store->get(makeStoredDocKey("key"), vb, cookie, {});
+        EXPECT_EQ(ENGINE_SUCCESS, item.getStatus()) << "vb:" << vb;
+    }
+}
+
+// With warmup_early_traffic, traffic is allowed as soon as the keys are
+// loaded. Changes made by clients before the values are loaded must not be
+// overwritten (or a deleted item resurrected) by the loading of the values.
+TEST_F(WarmupTest, EarlyTraffic) {
+    setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
+    store_item(vbid, makeStoredDocKey("key1"), "value1");
+    store_item(vbid, makeStoredDocKey("key2"), "value2");
+    flush_vbucket_to_disk(vbid, 2);
+
+    resetEngineAndEnableWarmup("warmup_early_traffic=true");
+
+    auto& readerQueue = *task_executor->getLpTaskQ()[READER_TASK_IDX];
+    while (!store->getWarmup()->isEarlyTrafficEnabled()) {
+        ASSERT_FALSE(store->getWarmup()->isComplete());
+        EXPECT_TRUE(store->isWarmupBlockingTraffic());
+        CheckedExecutor executor(task_executor, readerQueue);
+        executor.runCurrentTask();
+    }
+    EXPECT_TRUE(store->isWarmingUp());
+    EXPECT_FALSE(store->isWarmupBlockingTraffic());
+
+    // Modify both keys before their values are loaded
+    store_item(vbid, makeStoredDocKey("key1"), "new");
+    delete_item(vbid, makeStoredDocKey("key2"));
+    flush_vbucket_to_disk(vbid, 2);
+
+    while (store->isWarmingUp()) {
+        CheckedExecutor executor(task_executor, readerQueue);
+        executor.runCurrentTask();
+    }
+
+    auto item = store->get(makeStoredDocKey("key1"), vbid, cookie, {});
+    ASSERT_EQ(ENGINE_SUCCESS, item.getStatus());
+    EXPECT_EQ("new", item.item->getValue()->to_s());
+    item = store->get(makeStoredDocKey("key2"), vbid, cookie, {});
+    EXPECT_EQ(ENGINE_KEY_ENOENT, item.getStatus());
+    EXPECT_EQ("true", getWarmupStats()["ep_warmup_early_traffic_enabled"]);
+}
+
 TEST_F(WarmupTest, mightContainXattrs) {
     setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
 
@@ -2119,6 +2347,51 @@ TEST_F(SingleThreadedEPBucketTest, CreatedItemFreqDecayerTask) {
     EXPECT_TRUE(isItemFreqDecayerTaskSnoozed());
 }
 
+TEST(EPBucketCompactionTest, Priority) {
+    EXPECT_EQ(0, EPBucket::getCompactionPriority({0, 0}));
+    EXPECT_EQ(0, EPBucket::getCompactionPriority({1000, 1000}));
+    // Same amount of space reclaimed, less to rewrite
+    EXPECT_LT(EPBucket::getCompactionPriority({2000, 1000}),
+              EPBucket::getCompactionPriority({1500, 500}));
+    // Same fraction reclaimed, more space
+    EXPECT_LT(EPBucket::getCompactionPriority({2000, 1000}),
+              EPBucket::getCompactionPriority({4000, 2000}));
+}
+
+// Compactions beyond the concurrency limit wait for the running ones, and are
+// then started with the most fragmented file first.
+TEST_F(SingleThreadedEPBucketTest, CompactionsStartedInPriorityOrder) {
+    engine->getConfiguration().setCompactionMaxConcurrentRatio(0.0);
+    for (uint16_t vb = 0; vb < 3; ++vb) {
+        setVBucketStateAndRunPersistTask(vb, vbucket_state_active);
+    }
+    // Leave vb:2 with the most stale data
+    auto key = makeStoredDocKey("key");
+    store_item(1, key, "value");
+    flush_vbucket_to_disk(1);
+    for (int ii = 0; ii < 10; ++ii) {
+        store_item(2, key, "value");
+        flush_vbucket_to_disk(2);
+    }
+
+    for (uint16_t vb = 0; vb < 3; ++vb) {
+        compaction_ctx compactreq;
+        compactreq.purge_before_ts = 0;
+        compactreq.purge_before_seq = 0;
+        compactreq.drop_deletes = false;
+        compactreq.db_file_id = vb;
+        EXPECT_EQ(ENGINE_EWOULDBLOCK,
+                  store->scheduleCompaction(vb, compactreq, nullptr));
+    }
+
+    auto& lpWriterQ = *task_executor->getLpTaskQ()[WRITER_TASK_IDX];
+    runNextTask(lpWriterQ, "Compact DB file 0");
+    runNextTask(lpWriterQ, "Compact DB file 2");
+    runNextTask(lpWriterQ, "Compact DB file 1");
+    EXPECT_EQ(0, lpWriterQ.getFutureQueueSize());
+    EXPECT_EQ(0, lpWriterQ.getReadyQueueSize());
+}
+
 extern uint32_t dcp_last_delete_time;
 extern std::string dcp_last_key;
 // Combine warmup and DCP so we can check deleteTimes come back from disk
@@ -151,6 +151,47 @@ TEST_P(EPStoreEvictionTest, GetKeyStatsEjected) {
     }
 }
 
+// Each background fetch of a cookie has its own BGFETCH_WAIT span, which must
+// be ended by the completion of that fetch (and not of another one).
+TEST_P(EPStoreEvictionTest, BgFetchWaitSpans) {
+    auto* c = (struct mock_connstruct*)cookie;
+    c->setTracingEnabled(true);
+
+    const auto key1 = makeStoredDocKey("key1");
+    const auto key2 = makeStoredDocKey("key2");
+    store_item(vbid, key1, "value1");
+    store_item(vbid, key2, "value2");
+    flush_vbucket_to_disk(vbid, 2);
+    evict_key(vbid, key1);
+    evict_key(vbid, key2);
+
+    get_options_t options = static_cast<get_options_t>(QUEUE_BG_FETCH |
+                                                       HONOR_STATES |
+                                                       TRACK_REFERENCE |
+                                                       DELETE_TEMP |
+                                                       HIDE_LOCKED_CAS |
+                                                       TRACK_STATISTICS);
+    EXPECT_EQ(ENGINE_EWOULDBLOCK,
+              store->get(key1, vbid, cookie, options).getStatus());
+    EXPECT_EQ(ENGINE_EWOULDBLOCK,
+              store->get(key2, vbid, cookie, options).getStatus());
+
+    runBGFetcherTask();
+
+    int waitSpans = 0;
+    for (const auto& span : c->getTracer().getDurations()) {
+        if (span.code == cb::tracing::TraceCode::BGFETCH_WAIT) {
+            ++waitSpans;
+            EXPECT_NE(std::chrono::microseconds::max(), span.duration)
+                    << "BGFETCH_WAIT span " << waitSpans << " not ended";
+        }
+    }
+    EXPECT_EQ(2, waitSpans);
+
+    c->getTracer().clear();
+    c->setTracingEnabled(false);
+}
+
 // Replace tests //////////////////////////////////////////////////////////////
 
 // Test replace against an ejected key.
@@ -20,11 +20,15 @@
 #include <platform/dirutils.h>
 
 #include "callbacks.h"
+#include "collections/vbucket_manifest.h"
 #include "couch-kvstore/couch-kvstore.h"
 #include "kvstore.h"
 #include "kvstore_config.h"
 #ifdef EP_USE_ROCKSDB
+#include "rocksdb-kvstore/rocksdb-kvstore.h"
 #include "rocksdb-kvstore/rocksdb-kvstore_config.h"
+
+#include <rocksdb/write_buffer_manager.h>
 #endif
 #include "src/internal.h"
 #include "tests/module_tests/test_helpers.h"
@@ -331,6 +335,56 @@ TEST_F(CouchKVStoreTest, CompactStatsTest) {
     EXPECT_GE(io_compaction_write_bytes, io_write_bytes);
 }
 
+// Verify that the file I/O latency is broken down by the kind of work done.
+TEST_F(CouchKVStoreTest, IOClassTimingsTest) {
+    KVStoreConfig config(
+            1024, 4, data_dir, "couchdb", 0, false /*persistnamespace*/);
+    auto kvstore = setup_kv_store(config);
+
+    kvstore->begin(std::make_unique<TransactionContext>());
+    const auto key = makeStoredDocKey("key");
+    Item item(key, 0, 0, "value", 5);
+    WriteCallback wc;
+    kvstore->set(item, wc);
+    EXPECT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    GetValue gv = kvstore->get(key, 0);
+    checkGetValue(gv);
+    {
+        // An enclosing scope takes precedence over the KVStore's own
+        IOClassScope ioClass(IOClass::Warmup);
+        gv = kvstore->get(key, 0);
+        checkGetValue(gv);
+    }
+    EXPECT_EQ(IOClass::Other, IOClassScope::current());
+
+    compaction_ctx cctx;
+    cctx.purge_before_seq = 0;
+    cctx.purge_before_ts = 0;
+    cctx.curr_time = 0;
+    cctx.drop_deletes = 0;
+    cctx.db_file_id = 0;
+    EXPECT_TRUE(kvstore->compactDB(&cctx));
+
+    std::map<std::string, std::string> stats;
+    kvstore->addTimingStats(add_stat_callback, &stats);
+    auto hasHisto = [&stats](const std::string& name) {
+        const auto prefix = "rw_0:" + name + "_";
+        auto it = stats.lower_bound(prefix);
+        return it != stats.end() &&
+               it->first.compare(0, prefix.size(), prefix) == 0;
+    };
+    EXPECT_TRUE(hasHisto("fsWriteTime_flush"));
+    EXPECT_TRUE(hasHisto("fsSyncTime_flush"));
+    EXPECT_TRUE(hasHisto("fsOpenTime_bgfetch"));
+    EXPECT_TRUE(hasHisto("fsReadTime_bgfetch"));
+    EXPECT_TRUE(hasHisto("fsReadTime_warmup"));
+    EXPECT_TRUE(hasHisto("fsWriteTime_compaction"));
+    // Only the classes which did any I/O are reported
+    EXPECT_FALSE(hasHisto("fsReadTime_backfill"));
+    EXPECT_FALSE(hasHisto("fsWriteTime_bgfetch"));
+}
+
 // Regression test for MB-17517 - ensure that if a couchstore file has a max
 // CAS of -1, it is detected and reset to zero when file is loaded.
 TEST_F(CouchKVStoreTest, MB_17517MaxCasOfMinus1) {
@@ -1855,6 +1909,33 @@ public:
     MOCK_METHOD2(callback, void(TransactionContext& txCtx, int& value));
 };
 
+// Verify that the flusher trusts what the HashTable knew about the key's
+// document on disk, instead of looking the key up.
+TEST_F(CouchKVStoreTest, KnownDiskStateSkipsLookup) {
+    KVStoreConfig config(
+            1024, 4, data_dir, "couchdb", 0, false /*persistnamespace*/);
+    auto kvstore = setup_kv_store(config);
+
+    // The key isn't on disk, but the item claims it is: reported as an update
+    Item known(makeStoredDocKey("known"), 0, 0, "value", 5);
+    known.setKnownDiskState(KnownDiskState::Alive);
+    Item unknown(makeStoredDocKey("unknown"), 0, 0, "value", 5);
+
+    MockPersistenceCallbacks mpc;
+    kvstore->begin(std::make_unique<TransactionContext>());
+    kvstore->set(known, mpc);
+    kvstore->set(unknown, mpc);
+    EXPECT_CALL(mpc, callback(_, mutation_result(1, false))).Times(1);
+    EXPECT_CALL(mpc, callback(_, mutation_result(1, true))).Times(1);
+    EXPECT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+
+    // Once stored, an unknown key is found by the lookup
+    kvstore->begin(std::make_unique<TransactionContext>());
+    kvstore->set(unknown, mpc);
+    EXPECT_CALL(mpc, callback(_, mutation_result(1, false))).Times(1);
+    EXPECT_TRUE(kvstore->commit(nullptr /*no collections manifest*/));
+}
+
 // Test fixture for tests which run on all KVStore implementations (Couchstore
 // and RocksDB).
 // The string parameter represents the KVStore implementation that each test
@@ -2082,6 +2163,111 @@ TEST_P(KVStoreParamTest, CompactAndScan) {
     t3.join();
 }
 
+/// Records the batches of a key scan, stopping the scan after stopAfter of them
+class KeyScanRecorder : public StatusCallback<KeyScanBatch> {
+public:
+    void callback(KeyScanBatch& batch) override {
+        batchSizes.push_back(batch.size());
+        for (const auto& record : batch.getRecords()) {
+            const auto key = batch.getKey(record);
+            keys.emplace_back(reinterpret_cast<const char*>(key.data()),
+                              key.size());
+            flags.push_back(record.flags);
+        }
+        setStatus(batchSizes.size() == stopAfter ? ENGINE_ENOMEM
+                                                 : ENGINE_SUCCESS);
+    }
+
+    size_t stopAfter = 0;
+    std::vector<size_t> batchSizes;
+    std::vector<std::string> keys;
+    std::vector<uint32_t> flags;
+};
+
+TEST_P(KVStoreParamTest, ScanKeysInBatches) {
+    kvstore->begin(std::make_unique<TransactionContext>());
+    WriteCallback wc;
+    for (int i = 1; i <= 5; i++) {
+        Item item(makeStoredDocKey("key" + std::to_string(i)),
+                  i,
+                  0,
+                  "value",
+                  5,
+                  PROTOCOL_BINARY_RAW_BYTES,
+                  0,
+                  i);
+        kvstore->set(item, wc);
+    }
+    kvstore->commit(nullptr /*no collections manifest*/);
+
+    auto cb = std::make_shared<GetCallback>();
+    auto cl = std::make_shared<KVStoreTestCacheCallback>(1, 5, 0);
+    ScanContext* scanCtx = kvstore->initScanContext(
+            cb, cl, 0, 1, DocumentFilter::ALL_ITEMS, ValueFilter::KEYS_ONLY);
+    ASSERT_NE(nullptr, scanCtx);
+
+    // Stopping after the first batch leaves the rest for the next call
+    KeyScanRecorder recorder;
+    recorder.stopAfter = 1;
+    EXPECT_EQ(scan_again, kvstore->scanKeys(scanCtx, recorder, 2));
+    EXPECT_EQ(2, scanCtx->lastReadSeqno);
+    EXPECT_EQ(scan_success, kvstore->scanKeys(scanCtx, recorder, 2));
+    kvstore->destroyScanContext(scanCtx);
+
+    EXPECT_EQ((std::vector<size_t>{2, 2, 1}), recorder.batchSizes);
+    EXPECT_EQ((std::vector<std::string>{
+                      "key1", "key2", "key3", "key4", "key5"}),
+              recorder.keys);
+    EXPECT_EQ((std::vector<uint32_t>{1, 2, 3, 4, 5}), recorder.flags);
+}
+
+TEST_P(KVStoreParamTest, GetAllKeys) {
+    kvstore->begin(std::make_unique<TransactionContext>());
+    NiceMock<MockPersistenceCallbacks> mpc;
+    for (int i = 1; i <= 5; i++) {
+        Item item(makeStoredDocKey("key" + std::to_string(i)),
+                  0,
+                  0,
+                  "value",
+                  5,
+                  PROTOCOL_BINARY_RAW_BYTES,
+                  0,
+                  i);
+        kvstore->set(item, mpc);
+    }
+    kvstore->commit(nullptr /*no collections manifest*/);
+
+    kvstore->begin(std::make_unique<TransactionContext>());
+    Item deleted(makeStoredDocKey("key3"),
+                 0,
+                 0,
+                 "value",
+                 5,
+                 PROTOCOL_BINARY_RAW_BYTES,
+                 0,
+                 6);
+    deleted.setDeleted();
+    kvstore->del(deleted, mpc);
+    kvstore->commit(nullptr /*no collections manifest*/);
+
+    // Deleted keys are skipped, and at most count keys are returned
+    std::vector<std::string> keys;
+    auto cb = std::make_shared<CustomCallback<const DocKey&>>(
+            [&keys](const DocKey& key) {
+                keys.emplace_back(reinterpret_cast<const char*>(key.data()),
+                                  key.size());
+            });
+    EXPECT_EQ(ENGINE_SUCCESS,
+              kvstore->getAllKeys(0, makeStoredDocKey("key2"), 2, cb));
+    EXPECT_EQ((std::vector<std::string>{"key2", "key4"}), keys);
+
+    keys.clear();
+    EXPECT_EQ(ENGINE_SUCCESS,
+              kvstore->getAllKeys(0, makeStoredDocKey("key"), 10, cb));
+    EXPECT_EQ((std::vector<std::string>{"key1", "key2", "key4", "key5"}),
+              keys);
+}
+
 std::string kvstoreTestParams[] = {
 #ifdef EP_USE_ROCKSDB
         "rocksdb",
@@ -2178,4 +2364,582 @@ TEST_F(RocksDBKVStoreTest, StatisticsOptionWrongValueTest) {
     // Re-open with the new configuration
     kvstore = setup_kv_store(*kvstoreConfig);
 }
+
+// Verify that rollback stops at the most recent retained Snapshot before the
+// rollback point, and restores the items persisted after it
+TEST_F(RocksDBKVStoreTest, RollbackToSnapshot) {
+    Configuration config;
+    config.setDbname(data_dir);
+    config.setBackend("rocksdb");
+    config.setRocksdbRollbackSnapshotInterval(5);
+    config.setRocksdbRollbackSnapshotCount(2);
+    kvstoreConfig =
+            std::make_unique<RocksDBKVStoreConfig>(config, 0 /*shardId*/);
+    // Close the opened DB instance
+    kvstore.reset();
+    // Re-open with the new configuration
+    kvstore = setup_kv_store(*kvstoreConfig);
+
+    // key1..key15 at seqnos 1..15, then key1..key5 updated at seqnos 16..20.
+    // Snapshots are taken at seqnos 5, 10, 15 and 20; only 15 and 20 are kept.
+    WriteCallback wc;
+    for (int64_t seqno = 1; seqno <= 20; seqno++) {
+        const auto key =
+                "key" + std::to_string(seqno <= 15 ? seqno : seqno - 15);
+        const std::string value = seqno <= 15 ? "value" : "newvalue";
+        Item item(makeStoredDocKey(key),
+                  0,
+                  0,
+                  value.data(),
+                  value.size(),
+                  PROTOCOL_BINARY_RAW_BYTES,
+                  0,
+                  seqno);
+        kvstore->begin(std::make_unique<TransactionContext>());
+        kvstore->set(item, wc);
+        kvstore->commit(nullptr /*no collections manifest*/);
+    }
+
+    std::vector<std::string> keys;
+    auto rcb = std::make_shared<CustomRBCallback>([&keys](GetValue val) {
+        keys.emplace_back(reinterpret_cast<const char*>(
+                                  val.item->getKey().data()),
+                          val.item->getKey().size());
+    });
+    auto result = kvstore->rollback(0, 17, rcb);
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(15, result.highSeqno);
+    EXPECT_EQ((std::vector<std::string>{
+                      "key1", "key2", "key3", "key4", "key5"}),
+              keys);
+
+    for (int i = 1; i <= 15; i++) {
+        auto gv = kvstore->get(makeStoredDocKey("key" + std::to_string(i)), 0);
+        checkGetValue(gv);
+        EXPECT_EQ(i, gv.item->getBySeqno());
+    }
+
+    // No Snapshot is retained before seqno 15
+    EXPECT_FALSE(kvstore->rollback(0, 12, rcb).success);
+}
+
+// Verify that the rollback Snapshots are shared by the VBuckets of a shard, so
+// that the Snapshot taken while a VBucket was last written is released even if
+// the VBucket stays idle, and the VBucket can roll back to a newer one
+TEST_F(RocksDBKVStoreTest, RollbackSnapshotReleasedForIdleVBucket) {
+    Configuration config;
+    config.setDbname(data_dir);
+    config.setBackend("rocksdb");
+    config.setRocksdbRollbackSnapshotInterval(5);
+    config.setRocksdbRollbackSnapshotCount(2);
+    kvstoreConfig =
+            std::make_unique<RocksDBKVStoreConfig>(config, 0 /*shardId*/);
+    // Close the opened DB instance
+    kvstore.reset();
+    // Re-open with the new configuration
+    kvstore = setup_kv_store(*kvstoreConfig, {0, 4});
+
+    WriteCallback wc;
+    auto store = [this, &wc](uint16_t vbid, int64_t seqno) {
+        Item item(makeStoredDocKey("key" + std::to_string(seqno)),
+                  0,
+                  0,
+                  "value",
+                  5,
+                  PROTOCOL_BINARY_RAW_BYTES,
+                  0,
+                  seqno,
+                  vbid);
+        kvstore->begin(std::make_unique<TransactionContext>());
+        kvstore->set(item, wc);
+        kvstore->commit(nullptr /*no collections manifest*/);
+    };
+
+    // vb:4 is written up to seqno 5, which takes a Snapshot, then stays idle
+    for (int64_t seqno = 1; seqno <= 5; seqno++) {
+        store(4, seqno);
+    }
+    size_t numSnapshots = 0;
+    ASSERT_TRUE(kvstore->getStat("kNumSnapshots", numSnapshots));
+    EXPECT_EQ(1, numSnapshots);
+
+    // vb:0 takes 4 more Snapshots; only the 2 most recent are retained
+    for (int64_t seqno = 1; seqno <= 20; seqno++) {
+        store(0, seqno);
+    }
+    ASSERT_TRUE(kvstore->getStat("kNumSnapshots", numSnapshots));
+    EXPECT_EQ(2, numSnapshots);
+
+    // vb:4 can still roll back to seqno 5, from a Snapshot taken while idle
+    for (int64_t seqno = 6; seqno <= 8; seqno++) {
+        store(4, seqno);
+    }
+    auto rcb(std::make_shared<CustomRBCallback>());
+    auto result = kvstore->rollback(4, 6, rcb);
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(5, result.highSeqno);
+}
+
+// Verify that the VBuckets of a shard work with a shared Memtables quota,
+// also across a restart
+TEST_F(RocksDBKVStoreTest, MemtablesShared) {
+    Configuration config;
+    config.setDbname(data_dir);
+    config.setBackend("rocksdb");
+    config.setRocksdbMemtablesShared(true);
+    kvstoreConfig =
+            std::make_unique<RocksDBKVStoreConfig>(config, 0 /*shardId*/);
+    // Close the opened DB instance
+    kvstore.reset();
+    // Re-open with the new configuration
+    kvstore = setup_kv_store(*kvstoreConfig, {0, 4});
+
+    // The WriteBufferManager enforces the whole quota of the shard, and the
+    // Memtables of each CF are sized against the whole quota
+    auto& rocksdbConfig = dynamic_cast<RocksDBKVStoreConfig&>(*kvstoreConfig);
+    const size_t quota = rocksdbConfig.getBucketQuota() /
+                         rocksdbConfig.getMaxShards() *
+                         rocksdbConfig.getMemtablesRatio();
+    auto& rocksdbKVStore = dynamic_cast<RocksDBKVStore&>(*kvstore);
+    const auto& writeBufferManager =
+            rocksdbKVStore.getDBOptions().write_buffer_manager;
+    ASSERT_TRUE(writeBufferManager);
+    EXPECT_EQ(quota, writeBufferManager->buffer_size());
+    const auto& defaultCFOptions = rocksdbKVStore.getDefaultCFOptions();
+    const auto& seqnoCFOptions = rocksdbKVStore.getSeqnoCFOptions();
+    EXPECT_EQ(size_t(quota * 0.9 / defaultCFOptions.max_write_buffer_number),
+              defaultCFOptions.write_buffer_size);
+    EXPECT_EQ(size_t((quota - quota * 0.9) /
+                     seqnoCFOptions.max_write_buffer_number),
+              seqnoCFOptions.write_buffer_size);
+
+    // A WriteBatch is still split at the Memtables size of one VBucket
+    EXPECT_EQ((defaultCFOptions.write_buffer_size +
+               seqnoCFOptions.write_buffer_size) /
+                      2,
+              rocksdbKVStore.getWriteBatchLimit());
+
+    // VBuckets 0 and 4 both belong to shard 0
+    WriteCallback wc;
+    for (uint16_t vbid : {0, 4}) {
+        Item item(makeStoredDocKey("key"),
+                  0,
+                  0,
+                  "value",
+                  5,
+                  PROTOCOL_BINARY_RAW_BYTES,
+                  0,
+                  1,
+                  vbid);
+        kvstore->begin(std::make_unique<TransactionContext>());
+        kvstore->set(item, wc);
+        kvstore->commit(nullptr /*no collections manifest*/);
+    }
+
+    kvstore.reset();
+    kvstore = setup_kv_store(*kvstoreConfig, {0, 4});
+    for (uint16_t vbid : {0, 4}) {
+        auto gv = kvstore->get(makeStoredDocKey("key"), vbid);
+        checkGetValue(gv);
+        EXPECT_EQ(vbid, gv.item->getVBucketId());
+    }
+}
+
+// Creates the SystemEvent Items which carry the collections manifest of a
+// VBucket to KVStore::commit
+class ManifestEventFactory : public Collections::VB::Manifest {
+public:
+    ManifestEventFactory()
+        : Collections::VB::Manifest({/* no collection data*/}) {
+    }
+
+    std::unique_ptr<Item> makeCollectionEvent(const std::string& collection,
+                                              int64_t seqno) const {
+        return createSystemEvent(SystemEvent::Collection,
+                                 {{collection.data(), collection.size()}, 1},
+                                 false,
+                                 seqno);
+    }
+};
+
+// Returns the names of the CFs of the given VBucket in the (closed) DB of
+// shard 0, for all of its revisions
+static std::vector<std::string> listVBucketCFs(const std::string& dbname,
+                                               uint16_t vbid) {
+    std::vector<std::string> cfs;
+    auto status = rocksdb::DB::ListColumnFamilies(
+            rocksdb::DBOptions(), dbname + "/rocksdb.0", &cfs);
+    EXPECT_TRUE(status.ok()) << status.ToString();
+
+    std::vector<std::string> vbCFs;
+    for (const auto& prefix : {"default_", "local+seqno_"}) {
+        const auto name = prefix + std::to_string(vbid);
+        for (const auto& cf : cfs) {
+            if (cf == name || cf.compare(0, name.size() + 1, name + ".") == 0) {
+                vbCFs.push_back(cf);
+            }
+        }
+    }
+    return vbCFs;
+}
+
+// Verify that the namespace of a key is persisted with it when the
+// collections prototype is enabled, so that the same key in different
+// namespaces are different documents, and that the keys are ordered by
+// namespace
+TEST_F(RocksDBKVStoreTest, NamespacedKeyLayout) {
+    Configuration config;
+    config.setDbname(data_dir);
+    config.setBackend("rocksdb");
+    config.setCollectionsPrototypeEnabled(true);
+    kvstoreConfig =
+            std::make_unique<RocksDBKVStoreConfig>(config, 0 /*shardId*/);
+    ASSERT_TRUE(kvstoreConfig->shouldPersistDocNamespace());
+    // Close the opened DB instance
+    kvstore.reset();
+    // Re-open with the new configuration
+    kvstore = setup_kv_store(*kvstoreConfig);
+
+    const std::vector<StoredDocKey> keys = {
+            makeStoredDocKey("key", DocNamespace::DefaultCollection),
+            makeStoredDocKey("key", DocNamespace::Collections),
+            makeStoredDocKey(Collections::SystemEventPrefix,
+                             DocNamespace::System)};
+    WriteCallback wc;
+    int64_t seqno = 1;
+    for (const auto& key : keys) {
+        Item item(key, 0, 0, "value", 5, PROTOCOL_BINARY_RAW_BYTES, 0, seqno);
+        kvstore->begin(std::make_unique<TransactionContext>());
+        kvstore->set(item, wc);
+        kvstore->commit(nullptr /*no collections manifest*/);
+        seqno++;
+    }
+
+    seqno = 1;
+    for (const auto& key : keys) {
+        auto gv = kvstore->get(key, 0);
+        checkGetValue(gv);
+        EXPECT_EQ(key, gv.item->getKey());
+        EXPECT_EQ(seqno, gv.item->getBySeqno());
+        seqno++;
+    }
+
+    std::vector<StoredDocKey> allKeys;
+    auto cb = std::make_shared<CustomCallback<const DocKey&>>(
+            [&allKeys](const DocKey& key) { allKeys.emplace_back(key); });
+    EXPECT_EQ(ENGINE_SUCCESS,
+              kvstore->getAllKeys(0, makeStoredDocKey(""), 10, cb));
+    EXPECT_EQ(keys, allKeys);
+
+    // Starting in the Collections namespace skips the DefaultCollection one
+    allKeys.clear();
+    const auto start = makeStoredDocKey("", DocNamespace::Collections);
+    EXPECT_EQ(ENGINE_SUCCESS, kvstore->getAllKeys(0, start, 10, cb));
+    EXPECT_EQ(std::vector<StoredDocKey>(keys.begin() + 1, keys.end()),
+              allKeys);
+
+    EXPECT_EQ(1, kvstore->getSystemItemCount(0));
+}
+
+// Verify that the collections manifest committed with a batch is read back,
+// also across a restart, and that a rollback restores the manifest persisted
+// with the Snapshot it rolls back to
+TEST_F(RocksDBKVStoreTest, CollectionsManifest) {
+    Configuration config;
+    config.setDbname(data_dir);
+    config.setBackend("rocksdb");
+    config.setRocksdbRollbackSnapshotInterval(5);
+    config.setRocksdbRollbackSnapshotCount(2);
+    kvstoreConfig =
+            std::make_unique<RocksDBKVStoreConfig>(config, 0 /*shardId*/);
+    // Close the opened DB instance
+    kvstore.reset();
+    // Re-open with the new configuration
+    kvstore = setup_kv_store(*kvstoreConfig);
+
+    EXPECT_EQ("", kvstore->getCollectionsManifest(0));
+
+    // The manifest is committed with the batches at seqnos 5 (which takes a
+    // Snapshot) and 8
+    ManifestEventFactory factory;
+    auto manifest5 = factory.makeCollectionEvent("meat", 5);
+    auto manifest8 = factory.makeCollectionEvent("meat", 8);
+    const auto json5 = Collections::VB::Manifest::serialToJson(*manifest5);
+    const auto json8 = Collections::VB::Manifest::serialToJson(*manifest8);
+    ASSERT_NE(json5, json8);
+
+    WriteCallback wc;
+    for (int64_t seqno = 1; seqno <= 8; seqno++) {
+        Item item(makeStoredDocKey("key" + std::to_string(seqno)),
+                  0,
+                  0,
+                  "value",
+                  5,
+                  PROTOCOL_BINARY_RAW_BYTES,
+                  0,
+                  seqno);
+        kvstore->begin(std::make_unique<TransactionContext>());
+        kvstore->set(item, wc);
+        const Item* manifest = seqno == 5 ? manifest5.get()
+                                          : seqno == 8 ? manifest8.get()
+                                                       : nullptr;
+        EXPECT_TRUE(kvstore->commit(manifest));
+        if (seqno == 5) {
+            EXPECT_EQ(json5, kvstore->getCollectionsManifest(0));
+        }
+    }
+    EXPECT_EQ(json8, kvstore->getCollectionsManifest(0));
+
+    auto rcb(std::make_shared<CustomRBCallback>());
+    auto result = kvstore->rollback(0, 6, rcb);
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(5, result.highSeqno);
+    EXPECT_EQ(json5, kvstore->getCollectionsManifest(0));
+
+    kvstore.reset();
+    kvstore = setup_kv_store(*kvstoreConfig);
+    EXPECT_EQ(json5, kvstore->getCollectionsManifest(0));
+}
+
+// Test fixture for the erasing of the keys of a dropped collection by
+// RocksDBKVStore::compactDB
+class RocksDBKVStoreCollectionsEraseTest : public RocksDBKVStoreTest {
+protected:
+    void SetUp() override {
+        RocksDBKVStoreTest::SetUp();
+        Configuration config;
+        config.setDbname(data_dir);
+        config.setBackend("rocksdb");
+        config.setCollectionsPrototypeEnabled(true);
+        kvstoreConfig =
+                std::make_unique<RocksDBKVStoreConfig>(config, 0 /*shardId*/);
+        // Close the opened DB instance
+        kvstore.reset();
+        // Re-open with the new configuration
+        kvstore = setup_kv_store(*kvstoreConfig);
+
+        // The keys of the 'meat' collection sort between the 'dairy' and
+        // 'vegetable' ones
+        for (const auto& collection : {"dairy", "meat", "vegetable"}) {
+            for (int i = 1; i <= 3; i++) {
+                store(makeStoredDocKey(std::string(collection) + ":key" +
+                                               std::to_string(i),
+                                       DocNamespace::Collections));
+            }
+        }
+        store(makeStoredDocKey("key"));
+    }
+
+    void store(const StoredDocKey& key) {
+        Item item(key, 0, 0, "value", 5, PROTOCOL_BINARY_RAW_BYTES, 0, ++seqno);
+        kvstore->begin(std::make_unique<TransactionContext>());
+        kvstore->set(item, wc);
+        kvstore->commit(nullptr /*no collections manifest*/);
+    }
+
+    // Erases the keys of the 'meat' collection
+    static bool isMeat(const DocKey& key) {
+        const std::string prefix = "meat:";
+        return key.getDocNamespace() == DocNamespace::Collections &&
+               key.size() >= prefix.size() &&
+               std::equal(prefix.begin(),
+                          prefix.end(),
+                          reinterpret_cast<const char*>(key.data()));
+    }
+
+    std::vector<std::string> getAllKeys() {
+        std::vector<std::string> keys;
+        auto cb = std::make_shared<CustomCallback<const DocKey&>>(
+                [&keys](const DocKey& key) {
+                    keys.emplace_back(
+                            reinterpret_cast<const char*>(key.data()),
+                            key.size());
+                });
+        EXPECT_EQ(ENGINE_SUCCESS,
+                  kvstore->getAllKeys(0, makeStoredDocKey(""), 100, cb));
+        return keys;
+    }
+
+    WriteCallback wc;
+    int64_t seqno = 0;
+};
+
+// Verify that compaction erases only the keys of the dropped collection, with
+// a range delete when nothing has been written during the compaction
+TEST_F(RocksDBKVStoreCollectionsEraseTest, DropCollection) {
+    compaction_ctx cctx;
+    cctx.db_file_id = 0;
+    cctx.collectionsEraser = [](const DocKey key, int64_t) {
+        return isMeat(key);
+    };
+    EXPECT_TRUE(kvstore->compactDB(&cctx));
+    EXPECT_EQ(3, cctx.stats.collectionsItemsPurged);
+
+    EXPECT_EQ((std::vector<std::string>{"key",
+                                        "dairy:key1",
+                                        "dairy:key2",
+                                        "dairy:key3",
+                                        "vegetable:key1",
+                                        "vegetable:key2",
+                                        "vegetable:key3"}),
+              getAllKeys());
+    for (int i = 1; i <= 3; i++) {
+        auto gv = kvstore->get(
+                makeStoredDocKey("meat:key" + std::to_string(i),
+                                 DocNamespace::Collections),
+                0);
+        EXPECT_EQ(ENGINE_KEY_ENOENT, gv.getStatus());
+    }
+
+    // A second compaction finds nothing left to erase
+    compaction_ctx cctx2;
+    cctx2.db_file_id = 0;
+    cctx2.collectionsEraser = cctx.collectionsEraser;
+    EXPECT_TRUE(kvstore->compactDB(&cctx2));
+    EXPECT_EQ(0, cctx2.stats.collectionsItemsPurged);
+}
+
+// Verify that if the collection is written to while compaction looks for its
+// keys (e.g., it has been re-created), only the keys which have not changed
+// since the compaction started are erased
+TEST_F(RocksDBKVStoreCollectionsEraseTest, DropCollectionConcurrentWrite) {
+    bool written = false;
+    compaction_ctx cctx;
+    cctx.db_file_id = 0;
+    cctx.collectionsEraser = [this, &written](const DocKey key, int64_t) {
+        if (!written) {
+            // Inside the range of the erased keys, and updating one of them
+            store(makeStoredDocKey("meat:key1a", DocNamespace::Collections));
+            store(makeStoredDocKey("meat:key2", DocNamespace::Collections));
+            written = true;
+        }
+        return isMeat(key);
+    };
+    EXPECT_TRUE(kvstore->compactDB(&cctx));
+    EXPECT_EQ(3, cctx.stats.collectionsItemsPurged);
+
+    EXPECT_EQ((std::vector<std::string>{"key",
+                                        "dairy:key1",
+                                        "dairy:key2",
+                                        "dairy:key3",
+                                        "meat:key1a",
+                                        "meat:key2",
+                                        "vegetable:key1",
+                                        "vegetable:key2",
+                                        "vegetable:key3"}),
+              getAllKeys());
+    for (auto i : {1, 3}) {
+        auto gv = kvstore->get(
+                makeStoredDocKey("meat:key" + std::to_string(i),
+                                 DocNamespace::Collections),
+                0);
+        EXPECT_EQ(ENGINE_KEY_ENOENT, gv.getStatus());
+    }
+    auto gv = kvstore->get(
+            makeStoredDocKey("meat:key2", DocNamespace::Collections), 0);
+    checkGetValue(gv);
+    EXPECT_EQ(seqno, gv.item->getBySeqno());
+}
+
+// Verify that a VBucket re-created while the deletion of its previous
+// revision is pending gets new CFs, which are kept by 'delVBucket' and across
+// a restart
+TEST_F(RocksDBKVStoreTest, DeleteAndRecreateVBucket) {
+    WriteCallback wc;
+    auto store = [this, &wc](const std::string& key, int64_t seqno) {
+        Item item(makeStoredDocKey(key),
+                  0,
+                  0,
+                  "value",
+                  5,
+                  PROTOCOL_BINARY_RAW_BYTES,
+                  0,
+                  seqno);
+        kvstore->begin(std::make_unique<TransactionContext>());
+        kvstore->set(item, wc);
+        kvstore->commit(nullptr /*no collections manifest*/);
+    };
+
+    store("old", 1);
+    const auto revision = kvstore->prepareToDelete(0);
+    // Re-create the VBucket, as setVBucketState would
+    initialize_kv_store(kvstore.get(), 0);
+    EXPECT_EQ(ENGINE_KEY_ENOENT,
+              kvstore->get(makeStoredDocKey("old"), 0).getStatus());
+    store("new", 1);
+
+    kvstore->delVBucket(0, revision);
+    EXPECT_EQ(ENGINE_KEY_ENOENT,
+              kvstore->get(makeStoredDocKey("old"), 0).getStatus());
+    auto gv = kvstore->get(makeStoredDocKey("new"), 0);
+    checkGetValue(gv);
+
+    // Only the CFs of the new revision are left
+    kvstore.reset();
+    const auto cfs = listVBucketCFs(data_dir, 0);
+    ASSERT_EQ(2, cfs.size());
+    EXPECT_NE("default_0." + std::to_string(revision), cfs[0]);
+    EXPECT_EQ(0, cfs[0].compare(0, 10, "default_0."));
+    EXPECT_EQ("local+seqno_0." + cfs[0].substr(10), cfs[1]);
+
+    kvstore = setup_kv_store(*kvstoreConfig);
+    EXPECT_EQ(ENGINE_KEY_ENOENT,
+              kvstore->get(makeStoredDocKey("old"), 0).getStatus());
+    gv = kvstore->get(makeStoredDocKey("new"), 0);
+    checkGetValue(gv);
+}
+
+// Verify that the CFs of a revision whose deletion did not complete before
+// shutdown are dropped when the DB is opened again, and the re-created
+// VBucket is kept
+TEST_F(RocksDBKVStoreTest, StaleVBucketRevisionDroppedOnOpen) {
+    WriteCallback wc;
+    auto store = [this, &wc](const std::string& key) {
+        Item item(makeStoredDocKey(key),
+                  0,
+                  0,
+                  "value",
+                  5,
+                  PROTOCOL_BINARY_RAW_BYTES,
+                  0,
+                  1);
+        kvstore->begin(std::make_unique<TransactionContext>());
+        kvstore->set(item, wc);
+        kvstore->commit(nullptr /*no collections manifest*/);
+    };
+
+    store("old");
+    const auto revision = kvstore->prepareToDelete(0);
+    initialize_kv_store(kvstore.get(), 0);
+    store("new");
+
+    // Shutdown before 'delVBucket'
+    kvstore.reset();
+    const auto staleCFs = std::vector<std::string>{
+            "default_0." + std::to_string(revision),
+            "local+seqno_0." + std::to_string(revision)};
+    auto cfs = listVBucketCFs(data_dir, 0);
+    EXPECT_EQ(4, cfs.size());
+    for (const auto& cf : staleCFs) {
+        EXPECT_NE(cfs.end(), std::find(cfs.begin(), cfs.end(), cf)) << cf;
+    }
+
+    kvstore = setup_kv_store(*kvstoreConfig);
+    EXPECT_EQ(ENGINE_KEY_ENOENT,
+              kvstore->get(makeStoredDocKey("old"), 0).getStatus());
+    auto gv = kvstore->get(makeStoredDocKey("new"), 0);
+    checkGetValue(gv);
+
+    kvstore.reset();
+    cfs = listVBucketCFs(data_dir, 0);
+    EXPECT_EQ(2, cfs.size());
+    for (const auto& cf : staleCFs) {
+        EXPECT_EQ(cfs.end(), std::find(cfs.begin(), cfs.end(), cf)) << cf;
+    }
+
+    // The re-created VBucket is still there after the drop
+    kvstore = setup_kv_store(*kvstoreConfig);
+    gv = kvstore->get(makeStoredDocKey("new"), 0);
+    checkGetValue(gv);
+}
 #endif
@@ -506,6 +506,61 @@ TEST_F(MutationLogTest, BatchLoad) {
     }
 }
 
+TEST_F(MutationLogTest, LoadByFrequency) {
+    {
+        MutationLog ml(tmp_log_filename.c_str());
+        ml.open();
+
+        // 4 cold items (freq 0) and 4 hot items (freq 200), interleaved.
+        for (size_t ii = 0; ii < 8; ii++) {
+            std::string key = std::string("key") + std::to_string(ii);
+            ml.newItem(0, makeStoredDocKey(key), (ii % 2) ? 200 : 0);
+        }
+        ml.commit1();
+        ml.commit2();
+    }
+
+    {
+        MutationLog ml(tmp_log_filename.c_str());
+        ml.open();
+        MutationLogHarvester h(ml);
+        h.setVBucket(0);
+
+        // The log is read once, and every entry is seen exactly once.
+        h.loadByFrequency();
+        EXPECT_EQ(10, h.total());
+
+        // The hot items are handed out first.
+        std::map<StoredDocKey, uint64_t> maps[1];
+        EXPECT_TRUE(h.loadNextBatch(4));
+        h.apply(&maps, loaderFun);
+        ASSERT_EQ(4, maps[0].size());
+        for (size_t ii = 1; ii < 8; ii += 2) {
+            EXPECT_EQ(1,
+                      maps[0].count(makeStoredDocKey(std::string("key") +
+                                                     std::to_string(ii))));
+        }
+
+        // ... followed by the cold ones.
+        maps[0].clear();
+        EXPECT_FALSE(h.loadNextBatch(0));
+        h.apply(&maps, loaderFun);
+        ASSERT_EQ(4, maps[0].size());
+        for (size_t ii = 0; ii < 8; ii += 2) {
+            EXPECT_EQ(1,
+                      maps[0].count(makeStoredDocKey(std::string("key") +
+                                                     std::to_string(ii))));
+        }
+
+        // Nothing left to load.
+        maps[0].clear();
+        EXPECT_FALSE(h.loadNextBatch(0));
+        h.apply(&maps, loaderFun);
+        EXPECT_TRUE(maps[0].empty());
+        EXPECT_EQ(10, h.total());
+    }
+}
+
 // @todo
 //   Test Read Only log
 //   Test close / open / close / open
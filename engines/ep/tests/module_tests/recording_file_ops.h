@@ -0,0 +1,91 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include <libcouchstore/couch_db.h>
+
+#include <vector>
+
+/**
+ * Wraps the default couchstore file ops, recording the size of every read
+ * and the advice which reach the file.
+ */
+class RecordingOps : public FileOpsInterface {
+public:
+    couch_file_handle constructor(couchstore_error_info_t* errinfo) override {
+        return ops.constructor(errinfo);
+    }
+    couchstore_error_t open(couchstore_error_info_t* errinfo,
+                            couch_file_handle* handle,
+                            const char* path,
+                            int oflag) override {
+        return ops.open(errinfo, handle, path, oflag);
+    }
+    couchstore_error_t close(couchstore_error_info_t* errinfo,
+                             couch_file_handle handle) override {
+        return ops.close(errinfo, handle);
+    }
+    couchstore_error_t set_periodic_sync(couch_file_handle handle,
+                                         uint64_t period_bytes) override {
+        return ops.set_periodic_sync(handle, period_bytes);
+    }
+    ssize_t pread(couchstore_error_info_t* errinfo,
+                  couch_file_handle handle,
+                  void* buf,
+                  size_t nbytes,
+                  cs_off_t offset) override {
+        reads.push_back(nbytes);
+        return ops.pread(errinfo, handle, buf, nbytes, offset);
+    }
+    ssize_t pwrite(couchstore_error_info_t* errinfo,
+                   couch_file_handle handle,
+                   const void* buf,
+                   size_t nbytes,
+                   cs_off_t offset) override {
+        return ops.pwrite(errinfo, handle, buf, nbytes, offset);
+    }
+    cs_off_t goto_eof(couchstore_error_info_t* errinfo,
+                      couch_file_handle handle) override {
+        return ops.goto_eof(errinfo, handle);
+    }
+    couchstore_error_t sync(couchstore_error_info_t* errinfo,
+                            couch_file_handle handle) override {
+        return ops.sync(errinfo, handle);
+    }
+    couchstore_error_t advise(couchstore_error_info_t* errinfo,
+                              couch_file_handle handle,
+                              cs_off_t offset,
+                              cs_off_t len,
+                              couchstore_file_advice_t advice) override {
+        advice_calls.push_back({offset, len, advice});
+        return ops.advise(errinfo, handle, offset, len, advice);
+    }
+    void destructor(couch_file_handle handle) override {
+        ops.destructor(handle);
+    }
+
+    struct Advice {
+        cs_off_t offset;
+        cs_off_t len;
+        couchstore_file_advice_t advice;
+    };
+
+    FileOpsInterface& ops = *couchstore_get_default_file_ops();
+    std::vector<size_t> reads;
+    std::vector<Advice> advice_calls;
+};
@@ -333,15 +333,25 @@ struct SERVER_DOCUMENT_API {
 struct SERVER_TRACING_API {
     /**
      * begin tracing on the specified trace code
+     *
+     * @return the id of the new span (an invalid id if the cookie isn't
+     *         being traced)
      */
-    void (*begin_trace)(gsl::not_null<const void*> cookie,
-                        cb::tracing::TraceCode tracecode);
+    cb::tracing::SpanId (*begin_trace)(gsl::not_null<const void*> cookie,
+                                       cb::tracing::TraceCode tracecode);
 
     /**
-     * end trace on the specified trace code
+     * end trace on the specified trace code (the first span with the code)
      */
     void (*end_trace)(gsl::not_null<const void*> cookie,
                       cb::tracing::TraceCode tracecode);
+
+    /**
+     * end the given span (as returned by begin_trace). To be used when the
+     * cookie may have more than one span with the same trace code.
+     */
+    void (*end_trace_span)(gsl::not_null<const void*> cookie,
+                           cb::tracing::SpanId spanId);
 };
 
 #ifdef WIN32
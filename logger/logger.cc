@@ -69,6 +69,16 @@ Config::Config(const cJSON& json) {
                     R"(Config: "console" must be a bool)");
         }
     }
+
+    obj = cJSON_GetObjectItem(root, "drop_on_overflow");
+    if (obj != nullptr) {
+        if (obj->type == cJSON_True) {
+            drop_on_overflow = true;
+        } else if (obj->type != cJSON_False) {
+            throw std::invalid_argument(
+                    R"(Config: "drop_on_overflow" must be a bool)");
+        }
+    }
 }
 
 bool Config::operator==(const Config& other) const {
@@ -76,7 +86,8 @@ bool Config::operator==(const Config& other) const {
            (this->buffersize == other.buffersize) &&
            (this->cyclesize == other.cyclesize) &&
            (this->unit_test == other.unit_test) &&
-           (this->console == other.console);
+           (this->console == other.console) &&
+           (this->drop_on_overflow == other.drop_on_overflow);
 }
 
 bool Config::operator!=(const Config& other) const {
@@ -25,7 +25,12 @@
 #include <memcached/server_api.h>
 #include <spdlog/logger.h>
 
+#include <cstddef>
+#include <new>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 namespace cb {
 namespace logger {
@@ -48,6 +53,9 @@ struct LOGGER_PUBLIC_API Config {
     bool unit_test = false;
     /// Should messages be passed on to the console via stderr
     bool console = true;
+    /// Should messages be dropped (and counted) rather than blocking the
+    /// caller when the logging queue is full
+    bool drop_on_overflow = false;
 };
 
 /**
@@ -93,6 +101,13 @@ std::shared_ptr<spdlog::logger> get();
 LOGGER_PUBLIC_API
 EXTENSION_LOGGER_DESCRIPTOR& getLoggerDescriptor();
 
+/**
+ * Get the number of log messages which have been dropped because the
+ * logging queue was full (only happens when drop_on_overflow is set)
+ */
+LOGGER_PUBLIC_API
+uint64_t getDroppedMessageCount();
+
 /**
  * Convert a log level as being used by the memcached logger
  * to spdlog's log levels
@@ -103,6 +118,133 @@ EXTENSION_LOGGER_DESCRIPTOR& getLoggerDescriptor();
 LOGGER_PUBLIC_API
 spdlog::level::level_enum convertToSpdSeverity(EXTENSION_LOG_LEVEL sev);
 
+/**
+ * A log message whose arguments have been captured (by value) on the
+ * calling thread, so that the message can be formatted later on by the
+ * logger's formatter thread. See LOG_WARNING_DEFERRED and friends.
+ */
+class DeferredEntry {
+public:
+    explicit DeferredEntry(spdlog::level::level_enum level)
+        : level(level), time(spdlog::log_clock::now()) {
+    }
+
+    virtual ~DeferredEntry() = default;
+
+    /// Format the message (without the level / timestamp) into out
+    virtual void format(fmt::MemoryWriter& out) const = 0;
+
+    const spdlog::level::level_enum level;
+    /// The time the message was logged (not when it was formatted)
+    const spdlog::log_clock::time_point time;
+};
+
+/// The maximum size of a deferred entry (format string plus arguments)
+const size_t DeferredEntrySize = 256;
+
+/**
+ * Is deferred formatting available? (Only the file logger created by
+ * initialize() runs the formatter thread)
+ */
+LOGGER_PUBLIC_API
+bool isDeferredFormattingEnabled();
+
+/**
+ * Reserve room for a deferred entry in the calling thread's buffer.
+ *
+ * The buffer is lock free (single producer / single consumer), and
+ * allocated the first time a thread logs a deferred message.
+ *
+ * @return storage for an entry of up to DeferredEntrySize bytes, or
+ *         nullptr if the buffer is full (the message is then dropped
+ *         and counted, see getDroppedMessageCount())
+ */
+LOGGER_PUBLIC_API
+void* reserveDeferredEntry();
+
+/**
+ * Publish the entry constructed in the storage returned by the last
+ * call to reserveDeferredEntry() to the formatter thread.
+ */
+LOGGER_PUBLIC_API
+void commitDeferredEntry();
+
+namespace detail {
+
+/// Strings are copied as the caller's buffer may not outlive the call
+template <typename T>
+using DeferredArg = typename std::conditional<
+        std::is_same<std::decay_t<T>, const char*>::value ||
+                std::is_same<std::decay_t<T>, char*>::value,
+        std::string,
+        std::decay_t<T>>::type;
+
+template <typename... Args>
+class DeferredEntryImpl : public DeferredEntry {
+public:
+    template <typename... T>
+    DeferredEntryImpl(spdlog::level::level_enum level,
+                      const char* formatString,
+                      T&&... args)
+        : DeferredEntry(level),
+          formatString(formatString),
+          args(std::forward<T>(args)...) {
+    }
+
+    void format(fmt::MemoryWriter& out) const override {
+        format(out, std::index_sequence_for<Args...>{});
+    }
+
+private:
+    template <size_t... I>
+    void format(fmt::MemoryWriter& out, std::index_sequence<I...>) const {
+        out.write(formatString, std::get<I>(args)...);
+    }
+
+    const char* const formatString;
+    const std::tuple<Args...> args;
+};
+
+} // namespace detail
+
+/**
+ * Log a message without formatting it on the calling thread. The
+ * arguments are copied into a per-thread buffer and the message is
+ * formatted (and passed on to the sinks) by the formatter thread. If the
+ * buffer is full the message is dropped and counted rather than blocking
+ * the caller.
+ *
+ * The format string must outlive the call (use the LOG_*_DEFERRED macros,
+ * which only accept string literals), and the arguments are copied by
+ * value so don't pass pointers to data which may go away (C strings are
+ * copied into a std::string).
+ *
+ * Falls back to formatting the message on the calling thread if the
+ * formatter thread isn't running (e.g. with the console logger).
+ */
+template <typename... Args>
+void logDeferred(spdlog::level::level_enum severity,
+                 const char* formatString,
+                 Args&&... args) {
+    using Entry = detail::DeferredEntryImpl<detail::DeferredArg<Args>...>;
+    static_assert(sizeof(Entry) <= DeferredEntrySize,
+                  "cb::logger::logDeferred: arguments too large, use the "
+                  "non-deferred log macros");
+    static_assert(alignof(Entry) <= alignof(std::max_align_t),
+                  "cb::logger::logDeferred: unsupported argument alignment");
+
+    if (!isDeferredFormattingEnabled()) {
+        get()->log(severity, formatString, std::forward<Args>(args)...);
+        return;
+    }
+
+    void* storage = reserveDeferredEntry();
+    if (storage != nullptr) {
+        new (storage) Entry(severity, formatString, std::forward<Args>(args)...);
+        commitDeferredEntry();
+    }
+}
+
 /**
  * Tell the logger to flush its buffers
  */
@@ -137,3 +279,20 @@ void shutdown();
 #define LOG_ERROR(...) CB_LOG_ENTRY(spdlog::level::level_enum::err, __VA_ARGS__)
 #define LOG_CRITICAL(...) \
     CB_LOG_ENTRY(spdlog::level::level_enum::critical, __VA_ARGS__)
+
+/*
+ * Deferred variants of the log macros, for hot paths (for instance messages
+ * a client may trigger on every request). The format string must be a string
+ * literal and at least one argument must be given. See logDeferred().
+ */
+#define CB_LOG_DEFERRED_ENTRY(severity, fmt, ...)                       \
+    do {                                                                \
+        if (severity >= cb::logger::get()->level()) {                   \
+            cb::logger::logDeferred(severity, "" fmt, __VA_ARGS__);     \
+        }                                                               \
+    } while (false)
+
+#define LOG_INFO_DEFERRED(fmt, ...) \
+    CB_LOG_DEFERRED_ENTRY(spdlog::level::level_enum::info, fmt, __VA_ARGS__)
+#define LOG_WARNING_DEFERRED(fmt, ...) \
+    CB_LOG_DEFERRED_ENTRY(spdlog::level::level_enum::warn, fmt, __VA_ARGS__)
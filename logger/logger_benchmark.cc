@@ -110,6 +110,40 @@ void LogToLoggerWithEnabledLogLevel(benchmark::State& state) {
 
 BENCHMARK(LogToLoggerWithEnabledLogLevel)->ThreadRange(1, 8);
 
+/**
+ * Benchmark the cost of logging a message with deferred formatting (the
+ * arguments are copied to the thread's buffer and formatted by the
+ * formatter thread). Messages which don't fit in the buffer are dropped.
+ */
+void LogDeferredToLoggerWithEnabledLogLevel(benchmark::State& state) {
+    if (state.thread_index == 0) {
+        cb::logger::Config config{};
+        config.cyclesize = 2048;
+        config.buffersize = 8192;
+        config.unit_test = true;
+        config.console = false;
+
+        auto init = cb::logger::initialize(config);
+        if (init) {
+            std::cerr << "Failed to initialize logger: " << *init;
+            return;
+        }
+
+        cb::logger::get()->set_level(spdlog::level::level_enum::trace);
+    }
+
+    const std::string description{"127.0.0.1:11210"};
+    while (state.KeepRunning()) {
+        LOG_INFO_DEFERRED("{}: Foo {}", description, 0xdeadbeef);
+    }
+
+    if (state.thread_index == 0) {
+        cb::logger::shutdown();
+    }
+}
+
+BENCHMARK(LogDeferredToLoggerWithEnabledLogLevel)->ThreadRange(1, 8);
+
 int main(int argc, char** argv) {
     ::benchmark::Initialize(&argc, argv);
     if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
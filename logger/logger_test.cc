@@ -50,14 +50,19 @@ protected:
      * Set up the logger
      *
      * @param cyclesize - the size to use before switching file
+     * @param buffersize - the number of messages the logging queue holds
+     * @param dropOnOverflow - drop messages if the logging queue is full
      */
-    void SetUpLogger(size_t cyclesize) {
+    void SetUpLogger(size_t cyclesize,
+                     size_t buffersize = 8192,
+                     bool dropOnOverflow = false) {
         cb::logger::Config config;
         config.filename = filename;
         config.cyclesize = cyclesize;
-        config.buffersize = 8192;
+        config.buffersize = buffersize;
         config.unit_test = true;
         config.console = false;
+        config.drop_on_overflow = dropOnOverflow;
 
         const auto ret = cb::logger::initialize(config);
         EXPECT_FALSE(ret) << ret.get();
@@ -145,6 +150,110 @@ TEST_F(SpdloggerTest, FmtStyleFormatting) {
               countInFile(files.front(), "INFO FmtStyleFormatting deadbeef"));
 }
 
+/**
+ * Test that with drop_on_overflow set the logger drops (and counts)
+ * messages rather than blocking when the queue is full, and that every
+ * message is either written or counted as dropped.
+ */
+TEST_F(SpdloggerTest, DropOnOverflow) {
+    cb::logger::shutdown();
+    RemoveFiles();
+    SetUpLogger(20 * 1024 * 1024, 8, true);
+
+    const auto initial = cb::logger::getDroppedMessageCount();
+    const int count = 10000;
+    for (int ii = 0; ii < count; ++ii) {
+        LOG_INFO("DropOnOverflow {}", ii);
+    }
+    cb::logger::shutdown();
+
+    const auto dropped = cb::logger::getDroppedMessageCount() - initial;
+    files = cb::io::findFilesWithPrefix(filename);
+    ASSERT_EQ(1, files.size()) << "We should only have a single logfile";
+    EXPECT_EQ(count,
+              countInFile(files.front(), "INFO DropOnOverflow ") + dropped);
+}
+
+/**
+ * Test that with drop_on_overflow set the logger goes back to writing
+ * messages once the queue has drained after an overflow (every message
+ * dropped must give its slot in the queue back)
+ */
+TEST_F(SpdloggerTest, DropOnOverflowRecovers) {
+    cb::logger::shutdown();
+    RemoveFiles();
+    SetUpLogger(20 * 1024 * 1024, 8, true);
+
+    const auto initial = cb::logger::getDroppedMessageCount();
+    const int rounds = 100;
+    for (int round = 0; round < rounds; ++round) {
+        for (int ii = 0; ii < 1000; ++ii) {
+            LOG_INFO("DropOnOverflow flood {}", ii);
+        }
+        // Wait for the queue to drain; there must be room again
+        cb::logger::flush();
+        LOG_INFO("DropOnOverflowRecovers {}", round);
+        cb::logger::flush();
+    }
+    EXPECT_LT(initial, cb::logger::getDroppedMessageCount())
+            << "The queue should have overflowed";
+    cb::logger::shutdown();
+
+    files = cb::io::findFilesWithPrefix(filename);
+    ASSERT_EQ(1, files.size()) << "We should only have a single logfile";
+    EXPECT_EQ(rounds,
+              countInFile(files.front(), "INFO DropOnOverflowRecovers "));
+    EXPECT_LT(0,
+              countInFile(files.front(),
+                          "log messages as the logger queue was full"));
+}
+
+/**
+ * Test that deferred messages are formatted by the formatter thread with
+ * copies of the arguments (the caller's strings may be gone by then)
+ */
+TEST_F(SpdloggerTest, DeferredFormatting) {
+    ASSERT_TRUE(cb::logger::isDeferredFormattingEnabled());
+    {
+        std::string value{"temporary"};
+        char buffer[] = "buffer";
+        LOG_INFO_DEFERRED("DeferredFormatting {} {} {:x}",
+                          value,
+                          buffer,
+                          uint32_t(0xdeadbeef));
+        value.assign("overwritten");
+        buffer[0] = 'X';
+    }
+    cb::logger::shutdown();
+    files = cb::io::findFilesWithPrefix(filename);
+    ASSERT_EQ(1, files.size()) << "We should only have a single logfile";
+    EXPECT_EQ(1,
+              countInFile(files.front(),
+                          "INFO DeferredFormatting temporary buffer "
+                          "deadbeef"));
+}
+
+/**
+ * Test that deferred messages which don't fit in the thread's buffer are
+ * dropped and counted rather than blocking the caller
+ */
+TEST_F(SpdloggerTest, DeferredFormattingDropsWhenFull) {
+    const auto initial = cb::logger::getDroppedMessageCount();
+    const int count = 10000;
+    for (int ii = 0; ii < count; ++ii) {
+        LOG_INFO_DEFERRED("DeferredFormattingDropsWhenFull {}", ii);
+    }
+    cb::logger::shutdown();
+
+    const auto dropped = cb::logger::getDroppedMessageCount() - initial;
+    files = cb::io::findFilesWithPrefix(filename);
+    ASSERT_EQ(1, files.size()) << "We should only have a single logfile";
+    EXPECT_EQ(count,
+              countInFile(files.front(),
+                          "INFO DeferredFormattingDropsWhenFull ") +
+                      dropped);
+}
+
 /**
  * Tests writing the maximum allowed message to file. Messages are held in
  * a buffer of size 2048, which allows for a message of size 2047 characters
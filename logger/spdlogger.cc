@@ -25,12 +25,20 @@
 #include <memcached/extension.h>
 #include <phosphor/phosphor.h>
 #include <platform/processclock.h>
+#include <spdlog/async_logger.h>
 #include <spdlog/sinks/dist_sink.h>
 #include <spdlog/sinks/null_sink.h>
 #include <spdlog/sinks/stdout_sinks.h>
 #include <spdlog/spdlog.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #ifndef WIN32
 #include <spdlog/sinks/ansicolor_sink.h>
@@ -67,6 +75,172 @@ spdlog::level::level_enum cb::logger::convertToSpdSeverity(
     throw std::invalid_argument("Unknown severity level");
 }
 
+/**
+ * Book-keeping for the drop_on_overflow mode of the file logger.
+ */
+struct OverflowState {
+    explicit OverflowState(size_t capacity) : capacity(capacity) {
+    }
+
+    /// The maximum number of messages we allow to be queued for the sink
+    /// thread at any time
+    const size_t capacity;
+    /// The number of messages queued but not yet handed to the sinks
+    std::atomic<size_t> inflight{0};
+    /// The total number of messages queued, and handed to the sinks
+    std::atomic<uint64_t> queued{0};
+    std::atomic<uint64_t> completed{0};
+    /// The number of messages dropped but not yet reported in the log
+    std::atomic<uint64_t> unreported{0};
+};
+
+/// Total number of messages dropped since the process started
+static std::atomic<uint64_t> dropped_messages{0};
+
+/**
+ * Sink which sits between the async logger's worker thread and the real
+ * sinks, and keeps track of how many messages have been consumed from the
+ * queue.
+ */
+class completion_counting_sink : public spdlog::sinks::sink {
+public:
+    completion_counting_sink(spdlog::sink_ptr sink,
+                             std::shared_ptr<OverflowState> state)
+        : sink(std::move(sink)), state(std::move(state)) {
+    }
+
+    void log(const spdlog::details::log_msg& msg) override {
+        sink->log(msg);
+        state->completed++;
+        state->inflight--;
+    }
+
+    void flush() override {
+        sink->flush();
+    }
+
+private:
+    const spdlog::sink_ptr sink;
+    const std::shared_ptr<OverflowState> state;
+};
+
+/**
+ * The async logger used for the file logger. On top of spdlog's async
+ * logger it accepts messages formatted by the deferred formatter thread
+ * (which keep the time they were logged at).
+ */
+class file_async_logger : public spdlog::async_logger {
+public:
+    using spdlog::async_logger::async_logger;
+
+    void log_deferred(const cb::logger::DeferredEntry& entry) {
+        if (!should_log(entry.level)) {
+            return;
+        }
+        try {
+            spdlog::details::log_msg msg(&name(), entry.level);
+            msg.time = entry.time;
+            entry.format(msg.raw);
+            _sink_it(msg);
+        } catch (const std::exception& ex) {
+            _err_handler(ex.what());
+        }
+    }
+};
+
+/**
+ * Async logger which never blocks the calling thread. spdlog's own
+ * block_retry policy makes the caller spin until there is room in the
+ * queue, which means that a flood of log messages (for instance a warning
+ * triggered by every request from a misbehaving client) stalls the
+ * front-end threads. Instead we drop messages when the queue is full,
+ * count them, and log how many messages were lost the next time there is
+ * room in the queue.
+ *
+ * Messages logged through the regular log methods are formatted on the
+ * calling thread; hot paths should use the deferred log macros which move
+ * the formatting to the formatter thread as well.
+ */
+class dropping_async_logger : public file_async_logger {
+public:
+    dropping_async_logger(const std::string& name,
+                          spdlog::sink_ptr sink,
+                          size_t queue_size,
+                          std::chrono::milliseconds flush_interval,
+                          std::shared_ptr<OverflowState> state)
+        : file_async_logger(
+                  name,
+                  std::make_shared<completion_counting_sink>(sink, state),
+                  queue_size,
+                  // We keep the queue from filling up (see reserve()), but
+                  // never block if it does happen
+                  spdlog::async_overflow_policy::discard_log_msg,
+                  nullptr,
+                  flush_interval),
+          state(std::move(state)) {
+    }
+
+    /**
+     * Write out the messages queued so far. spdlog would queue a flush
+     * request, which takes a slot in the queue that we don't account for
+     * (and which spdlog may discard, along with any message which then
+     * doesn't fit). Instead wait for the sink thread to have handed the
+     * messages queued so far to the sinks, and flush the sinks from here.
+     */
+    void flush() override {
+        const auto target = state->queued.load();
+        while (state->completed.load() < target) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        for (auto& sink : _sinks) {
+            sink->flush();
+        }
+    }
+
+protected:
+    void _sink_it(spdlog::details::log_msg& msg) override {
+        if (!reserve()) {
+            state->unreported++;
+            dropped_messages++;
+            return;
+        }
+
+        const auto unreported = state->unreported.exchange(0);
+        if (unreported != 0) {
+            if (reserve()) {
+                spdlog::details::log_msg report(&name(), spdlog::level::warn);
+                report.raw << "Dropped " << unreported
+                           << " log messages as the logger queue was full";
+                file_async_logger::_sink_it(report);
+            } else {
+                state->unreported += unreported;
+            }
+        }
+
+        file_async_logger::_sink_it(msg);
+    }
+
+private:
+    /**
+     * Reserve a slot in the queue for a message. Every message queued is
+     * reserved, and the capacity is below the size of spdlog's queue, so
+     * spdlog never has to discard one (which would leave its slot reserved
+     * forever).
+     *
+     * @return true if the message may be queued
+     */
+    bool reserve() {
+        if (state->inflight.fetch_add(1) >= state->capacity) {
+            state->inflight--;
+            return false;
+        }
+        state->queued++;
+        return true;
+    }
+
+    const std::shared_ptr<OverflowState> state;
+};
+
 /**
  * Instances of spdlog (async) file logger.
  * The files logger requires a rotating file sink which is manually configured
@@ -77,6 +251,172 @@ spdlog::level::level_enum cb::logger::convertToSpdSeverity(
  */
 static std::shared_ptr<spdlog::logger> file_logger;
 
+/**
+ * The per-thread buffer of deferred log entries. The owning thread is the
+ * only producer, and entries are consumed (formatted, logged and
+ * destroyed) by whoever holds the formatter's drain mutex.
+ */
+class DeferredBuffer {
+public:
+    /// Storage for the next entry, or nullptr if the buffer is full
+    void* reserve() {
+        const auto pos = tail.load(std::memory_order_relaxed);
+        if (pos - head.load(std::memory_order_acquire) == slots.size()) {
+            return nullptr;
+        }
+        return &slots[pos % slots.size()];
+    }
+
+    void commit() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+    }
+
+    template <typename Callback>
+    void consume(Callback callback) {
+        auto pos = head.load(std::memory_order_relaxed);
+        const auto end = tail.load(std::memory_order_acquire);
+        for (; pos != end; ++pos) {
+            auto* entry = reinterpret_cast<cb::logger::DeferredEntry*>(
+                    &slots[pos % slots.size()]);
+            callback(*entry);
+            entry->~DeferredEntry();
+            head.store(pos + 1, std::memory_order_release);
+        }
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) ==
+               tail.load(std::memory_order_acquire);
+    }
+
+private:
+    using Slot =
+            std::aligned_storage<cb::logger::DeferredEntrySize,
+                                 alignof(std::max_align_t)>::type;
+    std::array<Slot, 256> slots;
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+};
+
+/// The buffers of all threads which have logged deferred messages. The
+/// buffer of a thread which has gone away is removed once it is drained.
+static std::mutex deferred_buffers_mutex;
+static std::vector<std::shared_ptr<DeferredBuffer>> deferred_buffers;
+
+static thread_local std::shared_ptr<DeferredBuffer> thread_buffer;
+
+/// Is the formatter thread running?
+static std::atomic<bool> deferred_enabled{false};
+/// Deferred messages dropped but not yet reported in the log
+static std::atomic<uint64_t> deferred_unreported{0};
+
+/**
+ * Formats the deferred log messages of all threads and passes them on to
+ * the file logger. Runs a thread which drains the buffers periodically;
+ * flush() drains them synchronously.
+ */
+class DeferredFormatter {
+public:
+    explicit DeferredFormatter(std::shared_ptr<file_async_logger> logger)
+        : logger(std::move(logger)), thread([this]() { run(); }) {
+        deferred_enabled = true;
+    }
+
+    ~DeferredFormatter() {
+        deferred_enabled = false;
+        {
+            std::lock_guard<std::mutex> lh(mutex);
+            stop = true;
+        }
+        cond.notify_one();
+        thread.join();
+        // Messages logged by threads which saw deferred_enabled just
+        // before we cleared it are picked up by the next formatter
+        drain();
+    }
+
+    void drain() {
+        std::lock_guard<std::mutex> guard(drainMutex);
+        std::vector<std::shared_ptr<DeferredBuffer>> buffers;
+        {
+            std::lock_guard<std::mutex> lh(deferred_buffers_mutex);
+            buffers = deferred_buffers;
+        }
+
+        for (auto& buffer : buffers) {
+            buffer->consume([this](const cb::logger::DeferredEntry& entry) {
+                logger->log_deferred(entry);
+            });
+        }
+
+        const auto dropped = deferred_unreported.exchange(0);
+        if (dropped != 0) {
+            logger->warn(
+                    "Dropped {} deferred log messages as the thread log "
+                    "buffer was full",
+                    dropped);
+        }
+
+        buffers.clear();
+        std::lock_guard<std::mutex> lh(deferred_buffers_mutex);
+        deferred_buffers.erase(
+                std::remove_if(deferred_buffers.begin(),
+                               deferred_buffers.end(),
+                               [](const std::shared_ptr<DeferredBuffer>& b) {
+                                   // The owning thread has gone away
+                                   return b.use_count() == 1 && b->empty();
+                               }),
+                deferred_buffers.end());
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lh(mutex);
+        while (!stop) {
+            lh.unlock();
+            drain();
+            lh.lock();
+            cond.wait_for(lh, std::chrono::milliseconds(10), [this]() {
+                return stop;
+            });
+        }
+    }
+
+    const std::shared_ptr<file_async_logger> logger;
+    /// Serialises the consumers of the thread buffers
+    std::mutex drainMutex;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool stop = false;
+    std::thread thread;
+};
+
+static std::unique_ptr<DeferredFormatter> deferred_formatter;
+
+bool cb::logger::isDeferredFormattingEnabled() {
+    return deferred_enabled.load(std::memory_order_relaxed);
+}
+
+void* cb::logger::reserveDeferredEntry() {
+    if (!thread_buffer) {
+        thread_buffer = std::make_shared<DeferredBuffer>();
+        std::lock_guard<std::mutex> lh(deferred_buffers_mutex);
+        deferred_buffers.push_back(thread_buffer);
+    }
+
+    auto* storage = thread_buffer->reserve();
+    if (storage == nullptr) {
+        deferred_unreported++;
+        dropped_messages++;
+    }
+    return storage;
+}
+
+void cb::logger::commitDeferredEntry() {
+    thread_buffer->commit();
+}
+
 /**
  * Retrieves a message, applies formatting and then logs it to stderr and
  * to file, according to the severity.
@@ -86,6 +426,10 @@ static void log(EXTENSION_LOG_LEVEL mcd_severity,
                 const char* fmt,
                 ...) {
     const auto severity = cb::logger::convertToSpdSeverity(mcd_severity);
+    if (!file_logger->should_log(severity)) {
+        // Don't waste time formatting messages we're going to throw away
+        return;
+    }
 
     // Retrieve formatted log message
     char msg[2048];
@@ -116,6 +460,9 @@ static void log(EXTENSION_LOG_LEVEL mcd_severity,
 
 LOGGER_PUBLIC_API
 void cb::logger::flush() {
+    if (deferred_formatter) {
+        deferred_formatter->drain();
+    }
     if (file_logger) {
         file_logger->flush();
     }
@@ -123,6 +470,7 @@ void cb::logger::flush() {
 
 LOGGER_PUBLIC_API
 void cb::logger::shutdown() {
+    deferred_formatter.reset();
     flush();
     file_logger.reset();
     spdlog::drop_all();
@@ -176,14 +524,31 @@ boost::optional<std::string> cb::logger::initialize(
             sink->add_sink(stderrsink);
         }
 
+        deferred_formatter.reset();
         spdlog::drop(logger_name);
-        file_logger =
-                spdlog::create_async(logger_name,
-                                     sink,
-                                     buffersz,
-                                     spdlog::async_overflow_policy::block_retry,
-                                     nullptr,
-                                     std::chrono::milliseconds(200));
+        std::shared_ptr<file_async_logger> logger;
+        if (logger_settings.drop_on_overflow) {
+            // Leave some room in the queue for the terminate request
+            auto state = std::make_shared<OverflowState>(
+                    buffersz > 2 ? buffersz - 2 : 1);
+            logger = std::make_shared<dropping_async_logger>(
+                    logger_name,
+                    sink,
+                    buffersz,
+                    std::chrono::milliseconds(200),
+                    state);
+        } else {
+            logger = std::make_shared<file_async_logger>(
+                    logger_name,
+                    sink,
+                    buffersz,
+                    spdlog::async_overflow_policy::block_retry,
+                    nullptr,
+                    std::chrono::milliseconds(200));
+        }
+        spdlog::register_logger(logger);
+        file_logger = logger;
+        deferred_formatter = std::make_unique<DeferredFormatter>(logger);
     } catch (const spdlog::spdlog_ex& ex) {
         std::string msg =
                 std::string{"Log initialization failed: "} + ex.what();
@@ -195,11 +560,16 @@ boost::optional<std::string> cb::logger::initialize(
     return {};
 }
 
+uint64_t cb::logger::getDroppedMessageCount() {
+    return dropped_messages.load();
+}
+
 std::shared_ptr<spdlog::logger> cb::logger::get() {
     return file_logger;
 }
 
 void cb::logger::createBlackholeLogger() {
+    deferred_formatter.reset();
     // delete if already exists
     spdlog::drop(logger_name);
 
@@ -211,6 +581,7 @@ void cb::logger::createBlackholeLogger() {
 }
 
 void cb::logger::createConsoleLogger() {
+    deferred_formatter.reset();
     // delete if already exists
     spdlog::drop(logger_name);
     file_logger = spdlog::stderr_color_mt(logger_name);
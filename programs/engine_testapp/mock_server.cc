@@ -343,14 +343,14 @@ void mock_init_alloc_hooks() {
 }
 
 // Begin -  Tracing api
-static void begin_trace(gsl::not_null<const void*> void_cookie,
-                        cb::tracing::TraceCode tracecode) {
+static cb::tracing::SpanId begin_trace(gsl::not_null<const void*> void_cookie,
+                                       cb::tracing::TraceCode tracecode) {
     auto* cookie = reinterpret_cast<mock_connstruct*>(
             const_cast<void*>(void_cookie.get()));
     if (!cookie->isTracingEnabled()) {
-        return;
+        return cb::tracing::Tracer::invalidSpanId();
     }
-    cookie->getTracer().begin(tracecode);
+    return cookie->getTracer().begin(tracecode);
 }
 
 static void end_trace(gsl::not_null<const void*> void_cookie,
@@ -362,6 +362,16 @@ static void end_trace(gsl::not_null<const void*> void_cookie,
     }
     cookie->getTracer().end(tracecode);
 }
+
+static void end_trace_span(gsl::not_null<const void*> void_cookie,
+                           cb::tracing::SpanId spanId) {
+    auto* cookie = reinterpret_cast<mock_connstruct*>(
+            const_cast<void*>(void_cookie.get()));
+    if (!cookie->isTracingEnabled()) {
+        return;
+    }
+    cookie->getTracer().end(spanId);
+}
 // End -  Tracing api
 
 SERVER_HANDLE_V1 *get_mock_server_api(void)
@@ -426,6 +436,7 @@ SERVER_HANDLE_V1 *get_mock_server_api(void)
 
       tracing_api.begin_trace = begin_trace;
       tracing_api.end_trace = end_trace;
+      tracing_api.end_trace_span = end_trace_span;
 
       rv.interface = 1;
       rv.core = &core_api;
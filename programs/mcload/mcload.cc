@@ -0,0 +1,719 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * mcload - a load generator for memcached.
+ *
+ * Each connection is driven by its own thread, which sends a configurable
+ * mix of GET / SET / subdoc operations (optionally pipelined) for keys
+ * picked from a uniform, zipfian or hotspot distribution.
+ *
+ * The latency of each operation is recorded on the client side. When a
+ * target rate is specified (-r) the operations are scheduled at fixed
+ * intervals and the latency is measured from the time the operation
+ * _should_ have been sent, so that a stalled server is not hidden by the
+ * client backing off (coordinated omission).
+ */
+
+#include "config.h"
+
+#include <getopt.h>
+#include <hdr_histogram.h>
+#include <platform/make_unique.h>
+#include <programs/getpass.h>
+#include <programs/hostname_utils.h>
+#include <protocol/connection/client_connection.h>
+#include <protocol/connection/client_mcbp_commands.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+enum class OpType { Get, Set, SubdocGet, SubdocSet, Count };
+
+static const std::array<const char*, size_t(OpType::Count)> opNames = {
+        {"get", "set", "sdget", "sdset"}};
+
+/**
+ * Picks the next key (as an index into the keyspace) to operate on.
+ */
+class KeyDistribution {
+public:
+    virtual ~KeyDistribution() = default;
+    virtual uint64_t next(std::mt19937_64& rng) = 0;
+};
+
+class UniformDistribution : public KeyDistribution {
+public:
+    explicit UniformDistribution(uint64_t numKeys) : dist(0, numKeys - 1) {
+    }
+
+    uint64_t next(std::mt19937_64& rng) override {
+        return dist(rng);
+    }
+
+private:
+    std::uniform_int_distribution<uint64_t> dist;
+};
+
+/**
+ * Zipfian distribution over [0, numKeys), using the algorithm from Gray et
+ * al, "Quickly Generating Billion-Record Synthetic Databases" (as used by
+ * YCSB). The ranks are scattered over the keyspace with a hash so that the
+ * popular keys aren't all adjacent.
+ */
+class ZipfianDistribution : public KeyDistribution {
+public:
+    ZipfianDistribution(uint64_t numKeys, double theta)
+        : numKeys(numKeys), theta(theta) {
+        const double zeta2 = zeta(2);
+        zetaN = zeta(numKeys);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1 - std::pow(2.0 / numKeys, 1 - theta)) / (1 - zeta2 / zetaN);
+    }
+
+    uint64_t next(std::mt19937_64& rng) override {
+        const double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        const double uz = u * zetaN;
+        uint64_t rank;
+        if (uz < 1.0) {
+            rank = 0;
+        } else if (uz < 1.0 + std::pow(0.5, theta)) {
+            rank = 1;
+        } else {
+            rank = uint64_t(numKeys * std::pow(eta * u - eta + 1, alpha));
+        }
+        return scatter(std::min(rank, numKeys - 1));
+    }
+
+private:
+    double zeta(uint64_t n) const {
+        double sum = 0;
+        for (uint64_t ii = 0; ii < n; ++ii) {
+            sum += 1 / std::pow(ii + 1, theta);
+        }
+        return sum;
+    }
+
+    uint64_t scatter(uint64_t rank) const {
+        // FNV-1a over the bytes of the rank
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (int ii = 0; ii < 8; ++ii) {
+            hash ^= (rank >> (ii * 8)) & 0xff;
+            hash *= 0x100000001b3ull;
+        }
+        return hash % numKeys;
+    }
+
+    const uint64_t numKeys;
+    const double theta;
+    double zetaN;
+    double alpha;
+    double eta;
+};
+
+/**
+ * A fraction of the keyspace (the hot set) receives a fraction of the
+ * operations; the remaining operations go to the rest of the keys. Both
+ * sets are accessed uniformly.
+ */
+class HotspotDistribution : public KeyDistribution {
+public:
+    HotspotDistribution(uint64_t numKeys, double hotKeys, double hotOps)
+        : hotOps(hotOps),
+          hotSet(std::max(uint64_t(1), uint64_t(numKeys * hotKeys))),
+          hot(0, hotSet - 1),
+          cold(std::min(hotSet, numKeys - 1), numKeys - 1) {
+    }
+
+    uint64_t next(std::mt19937_64& rng) override {
+        if (std::uniform_real_distribution<double>(0, 1)(rng) < hotOps) {
+            return hot(rng);
+        }
+        return cold(rng);
+    }
+
+private:
+    const double hotOps;
+    const uint64_t hotSet;
+    std::uniform_int_distribution<uint64_t> hot;
+    std::uniform_int_distribution<uint64_t> cold;
+};
+
+struct HdrDeleter {
+    void operator()(struct hdr_histogram* val) {
+        free(val);
+    }
+};
+
+using HdrHistogramUniquePtr = std::unique_ptr<struct hdr_histogram, HdrDeleter>;
+
+static HdrHistogramUniquePtr createHistogram() {
+    struct hdr_histogram* hist;
+    // 1us - 60s, 3 significant figures
+    if (hdr_init(1, 60 * 1000 * 1000, 3, &hist) != 0) {
+        throw std::bad_alloc();
+    }
+    return HdrHistogramUniquePtr(hist);
+}
+
+struct Options {
+    std::string host{"localhost"};
+    std::string port{"11210"};
+    sa_family_t family = AF_UNSPEC;
+    bool secure = false;
+    std::string user;
+    std::string password;
+    std::string bucket;
+
+    size_t connections = 1;
+    size_t depth = 1;
+    uint64_t rate = 0;
+    std::chrono::seconds duration{10};
+    bool populate = false;
+
+    uint64_t numKeys = 100000;
+    std::string keyPrefix{"mcload_"};
+    std::string distribution{"uniform"};
+    uint16_t numVbuckets = 1;
+
+    size_t minValueSize = 256;
+    size_t maxValueSize = 256;
+
+    /// Relative weight of each operation type
+    std::array<unsigned int, size_t(OpType::Count)> mix{{90, 10, 0, 0}};
+};
+
+static std::unique_ptr<KeyDistribution> createDistribution(
+        const Options& options) {
+    // name[:param[:param]]
+    std::vector<std::string> parts;
+    std::istringstream in(options.distribution);
+    std::string part;
+    while (std::getline(in, part, ':')) {
+        parts.push_back(part);
+    }
+    if (parts.empty()) {
+        throw std::invalid_argument("Invalid key distribution");
+    }
+
+    if (parts[0] == "uniform") {
+        return std::make_unique<UniformDistribution>(options.numKeys);
+    }
+    if (parts[0] == "zipfian") {
+        const double theta = parts.size() > 1 ? std::stod(parts[1]) : 0.99;
+        if (theta <= 0 || theta >= 1) {
+            throw std::invalid_argument("zipfian: theta must be in (0, 1)");
+        }
+        return std::make_unique<ZipfianDistribution>(options.numKeys, theta);
+    }
+    if (parts[0] == "hotspot") {
+        const double hotKeys = parts.size() > 1 ? std::stod(parts[1]) : 0.2;
+        const double hotOps = parts.size() > 2 ? std::stod(parts[2]) : 0.8;
+        if (hotKeys <= 0 || hotKeys > 1 || hotOps < 0 || hotOps > 1) {
+            throw std::invalid_argument(
+                    "hotspot: fractions must be in (0, 1]");
+        }
+        return std::make_unique<HotspotDistribution>(
+                options.numKeys, hotKeys, hotOps);
+    }
+    throw std::invalid_argument("Unknown key distribution: " + parts[0]);
+}
+
+static void parseMix(const std::string& spec, Options& options) {
+    // op=weight[,op=weight...]
+    options.mix.fill(0);
+    std::istringstream in(spec);
+    std::string entry;
+    while (std::getline(in, entry, ',')) {
+        const auto idx = entry.find('=');
+        if (idx == std::string::npos) {
+            throw std::invalid_argument("Invalid mix entry: " + entry);
+        }
+        const auto name = entry.substr(0, idx);
+        auto iter = std::find_if(
+                opNames.begin(), opNames.end(), [&name](const char* n) {
+                    return name == n;
+                });
+        if (iter == opNames.end()) {
+            throw std::invalid_argument("Unknown operation in mix: " + name);
+        }
+        options.mix[iter - opNames.begin()] = std::stoul(entry.substr(idx + 1));
+    }
+    if (std::all_of(options.mix.begin(),
+                    options.mix.end(),
+                    [](unsigned int w) { return w == 0; })) {
+        throw std::invalid_argument("The operation mix is empty");
+    }
+}
+
+/**
+ * Create a JSON document of (roughly) the requested size. All of the
+ * values are JSON so that the same keys may be used by the subdoc
+ * operations.
+ */
+static std::string createValue(size_t size) {
+    static const std::string prefix{"{\"counter\":0,\"pad\":\""};
+    static const std::string suffix{"\"}"};
+    const size_t overhead = prefix.size() + suffix.size();
+    const size_t padding = size > overhead ? size - overhead : 0;
+    return prefix + std::string(padding, 'x') + suffix;
+}
+
+/**
+ * The state of one connection (and the thread driving it)
+ */
+class Worker {
+public:
+    Worker(const Options& options, size_t id)
+        : options(options),
+          rng(std::random_device()() + id),
+          keys(createDistribution(options)),
+          ops(options.mix.begin(), options.mix.end()),
+          valueSize(options.minValueSize, options.maxValueSize) {
+        for (auto& h : histograms) {
+            h = createHistogram();
+        }
+    }
+
+    void connect() {
+        in_port_t port;
+        sa_family_t fam;
+        std::string host;
+        std::tie(host, port, fam) =
+                cb::inet::parse_hostname(options.host, options.port);
+        const auto family =
+                options.family == AF_UNSPEC ? fam : options.family;
+        connection = std::make_unique<MemcachedConnection>(
+                host, port, family, options.secure);
+        connection->connect();
+        connection->hello("mcload", MEMCACHED_VERSION, "load generator");
+        connection->setDatatypeJson(true);
+        connection->setXerrorSupport(true);
+        if (!options.user.empty()) {
+            connection->authenticate(options.user,
+                                     options.password,
+                                     connection->getSaslMechanisms());
+        }
+        if (!options.bucket.empty()) {
+            connection->selectBucket(options.bucket);
+        }
+    }
+
+    /**
+     * Store all of the keys in [begin, end) so that the GETs in the run
+     * don't just measure cache misses.
+     */
+    void populate(uint64_t begin, uint64_t end) {
+        for (auto key = begin; key < end;) {
+            size_t batch = 0;
+            for (; batch < options.depth && key < end; ++batch, ++key) {
+                connection->sendCommand(*createCommand(OpType::Set, key));
+            }
+            for (size_t ii = 0; ii < batch; ++ii) {
+                BinprotResponse rsp;
+                connection->recvResponse(rsp);
+                if (!rsp.isSuccess()) {
+                    throw ConnectionError("populate failed", rsp);
+                }
+            }
+        }
+    }
+
+    void run(Clock::time_point start, Clock::time_point end) {
+        // The interval between two batches for this connection
+        Clock::duration interval{0};
+        if (options.rate > 0) {
+            interval = std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(double(options.depth) *
+                                                  options.connections /
+                                                  options.rate));
+        }
+
+        std::vector<OpType> batch(options.depth);
+        auto intended = start;
+        while (!stop) {
+            auto now = Clock::now();
+            if (now >= end) {
+                break;
+            }
+            if (interval.count() != 0) {
+                if (intended > now) {
+                    std::this_thread::sleep_until(intended);
+                }
+            } else {
+                intended = now;
+            }
+
+            for (auto& op : batch) {
+                op = OpType(ops(rng));
+                connection->sendCommand(*createCommand(op, keys->next(rng)));
+            }
+            for (const auto& op : batch) {
+                BinprotResponse rsp;
+                connection->recvResponse(rsp);
+                const auto latency =
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                                Clock::now() - intended);
+                auto& stats = opStats[size_t(op)];
+                switch (rsp.getStatus()) {
+                case PROTOCOL_BINARY_RESPONSE_SUCCESS:
+                    break;
+                case PROTOCOL_BINARY_RESPONSE_KEY_ENOENT:
+                    ++stats.misses;
+                    break;
+                default:
+                    ++stats.errors;
+                }
+                hdr_record_value(
+                        histograms[size_t(op)].get(),
+                        std::max(int64_t(1), int64_t(latency.count())));
+                ++stats.count;
+                ++totalOps;
+            }
+            intended += interval;
+        }
+    }
+
+    struct OpStats {
+        uint64_t count = 0;
+        uint64_t misses = 0;
+        uint64_t errors = 0;
+    };
+
+    const Options& options;
+    std::mt19937_64 rng;
+    std::unique_ptr<KeyDistribution> keys;
+    std::discrete_distribution<size_t> ops;
+    std::uniform_int_distribution<size_t> valueSize;
+    std::unique_ptr<MemcachedConnection> connection;
+
+    std::array<HdrHistogramUniquePtr, size_t(OpType::Count)> histograms;
+    std::array<OpStats, size_t(OpType::Count)> opStats;
+    std::atomic<uint64_t> totalOps{0};
+    std::atomic_bool stop{false};
+
+private:
+    std::string getKey(uint64_t key) const {
+        return options.keyPrefix + std::to_string(key);
+    }
+
+    std::unique_ptr<BinprotCommand> createCommand(OpType op, uint64_t key) {
+        const auto vbucket = uint16_t(key % options.numVbuckets);
+        switch (op) {
+        case OpType::Get: {
+            auto cmd = std::make_unique<BinprotGetCommand>();
+            cmd->setKey(getKey(key));
+            cmd->setVBucket(vbucket);
+            return std::move(cmd);
+        }
+        case OpType::Set: {
+            auto cmd = std::make_unique<BinprotMutationCommand>();
+            cmd->setMutationType(MutationType::Set);
+            cmd->setKey(getKey(key));
+            cmd->setVBucket(vbucket);
+            cmd->setDatatype(cb::mcbp::Datatype::JSON);
+            cmd->setValue(createValue(valueSize(rng)));
+            return std::move(cmd);
+        }
+        case OpType::SubdocGet: {
+            auto cmd = std::make_unique<BinprotSubdocCommand>(
+                    PROTOCOL_BINARY_CMD_SUBDOC_GET, getKey(key), "counter");
+            cmd->setVBucket(vbucket);
+            return std::move(cmd);
+        }
+        case OpType::SubdocSet: {
+            auto cmd = std::make_unique<BinprotSubdocCommand>(
+                    PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT,
+                    getKey(key),
+                    "counter",
+                    std::to_string(key));
+            cmd->setVBucket(vbucket);
+            return std::move(cmd);
+        }
+        case OpType::Count:
+            break;
+        }
+        throw std::logic_error("createCommand: invalid operation");
+    }
+};
+
+static void printReport(const std::vector<std::unique_ptr<Worker>>& workers,
+                        std::chrono::duration<double> elapsed) {
+    std::cout << std::endl
+              << std::setw(6) << "op" << std::setw(12) << "count"
+              << std::setw(12) << "ops/s" << std::setw(10) << "misses"
+              << std::setw(10) << "errors" << std::setw(10) << "p50"
+              << std::setw(10) << "p99" << std::setw(10) << "p99.9"
+              << std::setw(10) << "p99.99" << std::setw(10) << "max"
+              << std::endl;
+
+    auto total = createHistogram();
+    Worker::OpStats totalStats;
+    auto printRow = [elapsed](const char* name,
+                              const Worker::OpStats& stats,
+                              const struct hdr_histogram* h) {
+        std::cout << std::setw(6) << name << std::setw(12) << stats.count
+                  << std::setw(12) << uint64_t(stats.count / elapsed.count())
+                  << std::setw(10) << stats.misses << std::setw(10)
+                  << stats.errors << std::setw(10)
+                  << hdr_value_at_percentile(h, 50.0) << std::setw(10)
+                  << hdr_value_at_percentile(h, 99.0) << std::setw(10)
+                  << hdr_value_at_percentile(h, 99.9) << std::setw(10)
+                  << hdr_value_at_percentile(h, 99.99) << std::setw(10)
+                  << hdr_max(h) << std::endl;
+    };
+
+    for (size_t op = 0; op < size_t(OpType::Count); ++op) {
+        auto merged = createHistogram();
+        Worker::OpStats stats;
+        for (const auto& w : workers) {
+            hdr_add(merged.get(), w->histograms[op].get());
+            stats.count += w->opStats[op].count;
+            stats.misses += w->opStats[op].misses;
+            stats.errors += w->opStats[op].errors;
+        }
+        if (stats.count == 0) {
+            continue;
+        }
+        printRow(opNames[op], stats, merged.get());
+        hdr_add(total.get(), merged.get());
+        totalStats.count += stats.count;
+        totalStats.misses += stats.misses;
+        totalStats.errors += stats.errors;
+    }
+    printRow("total", totalStats, total.get());
+    std::cout << "(latencies in microseconds)" << std::endl;
+}
+
+static void usage() {
+    std::cerr
+            << "Usage: mcload [options]" << std::endl
+            << "  -h hostname[:port]  Host (and optional port number) to "
+               "connect to"
+            << std::endl
+            << "  -p port          Port number" << std::endl
+            << "  -u username      Username" << std::endl
+            << "  -P password      Password" << std::endl
+            << "  -S               Read password from stdin" << std::endl
+            << "  -b bucket        Bucket name" << std::endl
+            << "  -s               Connect to node securely (using SSL)"
+            << std::endl
+            << "  -4               Use IPv4" << std::endl
+            << "  -6               Use IPv6" << std::endl
+            << "  -c connections   Number of connections (one thread each) "
+               "[1]"
+            << std::endl
+            << "  -D depth         Number of operations to pipeline per "
+               "connection [1]"
+            << std::endl
+            << "  -r ops/s         Target rate for all connections "
+               "(0 = unthrottled) [0]"
+            << std::endl
+            << "  -t seconds       Duration of the run [10]" << std::endl
+            << "  -k keys          Number of keys [100000]" << std::endl
+            << "  -K prefix        Key prefix [mcload_]" << std::endl
+            << "  -d distribution  uniform, zipfian[:theta] or "
+               "hotspot[:hot_keys:hot_ops] [uniform]"
+            << std::endl
+            << "  -v size[:max]    Value size (or range of sizes) [256]"
+            << std::endl
+            << "  -m mix           Operation mix as op=weight,... with op "
+               "one of"
+            << std::endl
+            << "                   get, set, sdget, sdset [get=90,set=10]"
+            << std::endl
+            << "  -V vbuckets      Spread the keys over this many vbuckets "
+               "[1]"
+            << std::endl
+            << "  -L               Store all of the keys before the run"
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    int cmd;
+
+    /* Initialize the socket subsystem */
+    cb_initialize_sockets();
+
+    try {
+        const char* optstring = "46h:p:u:P:Sb:sc:D:r:t:k:K:d:v:m:V:L";
+        while ((cmd = getopt(argc, argv, optstring)) != EOF) {
+            switch (cmd) {
+            case '6':
+                options.family = AF_INET6;
+                break;
+            case '4':
+                options.family = AF_INET;
+                break;
+            case 'h':
+                options.host.assign(optarg);
+                break;
+            case 'p':
+                options.port.assign(optarg);
+                break;
+            case 'u':
+                options.user.assign(optarg);
+                break;
+            case 'P':
+                options.password.assign(optarg);
+                break;
+            case 'S':
+                options.password.assign(getpass());
+                break;
+            case 'b':
+                options.bucket.assign(optarg);
+                break;
+            case 's':
+                options.secure = true;
+                break;
+            case 'c':
+                options.connections = std::stoul(optarg);
+                break;
+            case 'D':
+                options.depth = std::stoul(optarg);
+                break;
+            case 'r':
+                options.rate = std::stoull(optarg);
+                break;
+            case 't':
+                options.duration = std::chrono::seconds(std::stoul(optarg));
+                break;
+            case 'k':
+                options.numKeys = std::stoull(optarg);
+                break;
+            case 'K':
+                options.keyPrefix.assign(optarg);
+                break;
+            case 'd':
+                options.distribution.assign(optarg);
+                break;
+            case 'v': {
+                const std::string spec{optarg};
+                const auto idx = spec.find(':');
+                options.minValueSize = std::stoul(spec.substr(0, idx));
+                options.maxValueSize =
+                        idx == std::string::npos
+                                ? options.minValueSize
+                                : std::stoul(spec.substr(idx + 1));
+                break;
+            }
+            case 'm':
+                parseMix(optarg, options);
+                break;
+            case 'V':
+                options.numVbuckets = uint16_t(std::stoul(optarg));
+                break;
+            case 'L':
+                options.populate = true;
+                break;
+            default:
+                usage();
+                return EXIT_FAILURE;
+            }
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (options.connections == 0 || options.depth == 0 ||
+        options.numKeys == 0 || options.numVbuckets == 0 ||
+        options.minValueSize > options.maxValueSize) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (options.password.empty()) {
+        const char* env_password = std::getenv("CB_PASSWORD");
+        if (env_password) {
+            options.password = env_password;
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    try {
+        for (size_t ii = 0; ii < options.connections; ++ii) {
+            workers.emplace_back(std::make_unique<Worker>(options, ii));
+            workers.back()->connect();
+        }
+
+        if (options.populate) {
+            std::cout << "Storing " << options.numKeys << " keys"
+                      << std::endl;
+            workers.front()->populate(0, options.numKeys);
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto start = Clock::now();
+    const auto end = start + options.duration;
+    std::vector<std::thread> threads;
+    std::atomic_bool failed{false};
+    for (auto& w : workers) {
+        threads.emplace_back([&w, &failed, start, end]() {
+            try {
+                w->run(start, end);
+            } catch (const std::exception& ex) {
+                std::cerr << "Worker failed: " << ex.what() << std::endl;
+                failed = true;
+            }
+        });
+    }
+
+    // Report the throughput once a second while the workers run
+    uint64_t lastOps = 0;
+    for (auto next = start + std::chrono::seconds(1); next <= end && !failed;
+         next += std::chrono::seconds(1)) {
+        std::this_thread::sleep_until(next);
+        uint64_t ops = 0;
+        for (const auto& w : workers) {
+            ops += w->totalOps;
+        }
+        std::cout << std::chrono::duration_cast<std::chrono::seconds>(
+                             next - start)
+                             .count()
+                  << "s: " << ops - lastOps << " ops/s" << std::endl;
+        lastOps = ops;
+    }
+
+    for (auto& w : workers) {
+        w->stop = true;
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    printReport(workers,
+                std::chrono::duration<double>(Clock::now() - start));
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
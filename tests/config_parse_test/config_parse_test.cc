@@ -433,6 +433,7 @@ TEST_F(SettingsTest, ParseLoggerSettings) {
     cJSON_AddNumberToObject(obj.get(), "buffersize", 1024);
     cJSON_AddNumberToObject(obj.get(), "cyclesize", 10485760);
     cJSON_AddBoolToObject(obj.get(), "unit_test", true);
+    cJSON_AddBoolToObject(obj.get(), "drop_on_overflow", true);
 
     unique_cJSON_ptr root(cJSON_CreateObject());
     cJSON_AddItemToObject(root.get(), "logger", obj.release());
@@ -445,6 +446,7 @@ TEST_F(SettingsTest, ParseLoggerSettings) {
     EXPECT_EQ(1024, config.buffersize);
     EXPECT_EQ(10485760, config.cyclesize);
     EXPECT_EQ(true, config.unit_test);
+    EXPECT_EQ(true, config.drop_on_overflow);
 }
 
 TEST_F(SettingsTest, StdinListener) {
@@ -774,6 +776,35 @@ TEST_F(SettingsTest, max_packet_size) {
     }
 }
 
+TEST_F(SettingsTest, InflatedDocumentCacheSize) {
+    nonNumericValuesShouldFail("inflated_document_cache_size");
+
+    unique_cJSON_ptr obj(cJSON_CreateObject());
+    // the config file specifies it in MB, we're keeping it as bytes internally
+    cJSON_AddNumberToObject(obj.get(), "inflated_document_cache_size", 16);
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(16 * 1024 * 1024, settings.getInflatedDocumentCacheSize());
+        EXPECT_TRUE(settings.has.inflated_document_cache_size);
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    // 0 disables the cache
+    cJSON_ReplaceItemInObject(
+            obj.get(), "inflated_document_cache_size", cJSON_CreateNumber(0));
+    try {
+        Settings settings(obj);
+        EXPECT_EQ(0, settings.getInflatedDocumentCacheSize());
+    } catch (std::exception& exception) {
+        FAIL() << exception.what();
+    }
+
+    cJSON_ReplaceItemInObject(
+            obj.get(), "inflated_document_cache_size", cJSON_CreateNumber(-1));
+    EXPECT_THROW(Settings settings(obj), std::invalid_argument);
+}
+
 TEST_F(SettingsTest, SaslMechanisms) {
     nonStringValuesShouldFail("sasl_mechanisms");
 
@@ -1303,6 +1334,23 @@ TEST(SettingsUpdateTest, MaxPacketSizeIsDynamic) {
               settings.getMaxPacketSize());
 }
 
+TEST(SettingsUpdateTest, InflatedDocumentCacheSizeIsDynamic) {
+    Settings settings;
+    Settings updated;
+    // setting it to the same value should work
+    auto old = settings.getInflatedDocumentCacheSize();
+    updated.setInflatedDocumentCacheSize(old);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+
+    // changing it should work
+    updated.setInflatedDocumentCacheSize(old + 1024);
+    EXPECT_NO_THROW(settings.updateSettings(updated, false));
+    EXPECT_EQ(old, settings.getInflatedDocumentCacheSize());
+    EXPECT_NO_THROW(settings.updateSettings(updated));
+    EXPECT_EQ(updated.getInflatedDocumentCacheSize(),
+              settings.getInflatedDocumentCacheSize());
+}
+
 TEST(SettingsUpdateTest, SaslMechanismsIsNotDynamic) {
     Settings settings;
     Settings updated;
@@ -0,0 +1,256 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include "embedded_daemon.h"
+
+#include <cJSON_utils.h>
+#include <platform/dirutils.h>
+#include <platform/make_unique.h>
+#include <protocol/connection/client_connection.h>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+
+// Provided by the memcached_daemon library
+extern "C" int memcached_main(int argc, char** argv);
+extern void shutdown_server();
+extern void dispatch_conn_new(SOCKET sfd, int parent_port);
+
+static const char bucketName[] = "default";
+
+BenchConnection::BenchConnection(SOCKET sock) : sock(sock) {
+}
+
+BenchConnection::~BenchConnection() {
+    ::close(sock);
+}
+
+void BenchConnection::send(cb::const_byte_buffer data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        auto nw = ::send(sock, data.data() + offset, data.size() - offset, 0);
+        if (nw == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(
+                    errno, std::system_category(), "BenchConnection::send");
+        }
+        offset += size_t(nw);
+    }
+}
+
+void BenchConnection::read(uint8_t* dest, size_t nbytes) {
+    size_t offset = 0;
+    while (offset < nbytes) {
+        auto nr = ::recv(sock, dest + offset, nbytes - offset, 0);
+        if (nr == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(
+                    errno, std::system_category(), "BenchConnection::read");
+        }
+        if (nr == 0) {
+            throw std::runtime_error(
+                    "BenchConnection::read: connection closed by server");
+        }
+        offset += size_t(nr);
+    }
+}
+
+const protocol_binary_response_header& BenchConnection::recvFrame() {
+    const size_t headerLen = sizeof(protocol_binary_response_header);
+    if (buffer.size() < headerLen) {
+        buffer.resize(headerLen);
+    }
+    read(buffer.data(), headerLen);
+
+    auto* header =
+            reinterpret_cast<protocol_binary_response_header*>(buffer.data());
+    const size_t bodylen = ntohl(header->response.bodylen);
+    if (buffer.size() < headerLen + bodylen) {
+        buffer.resize(headerLen + bodylen);
+        header = reinterpret_cast<protocol_binary_response_header*>(
+                buffer.data());
+    }
+    read(buffer.data() + headerLen, bodylen);
+    return *header;
+}
+
+void BenchConnection::execute(cb::const_byte_buffer frame,
+                              protocol_binary_response_status expected) {
+    send(frame);
+    const auto& header = recvFrame();
+    const auto status = ntohs(header.response.status);
+    if (status != expected) {
+        throw std::runtime_error(
+                "BenchConnection::execute: unexpected status " +
+                std::to_string(status) + " for opcode " +
+                std::to_string(header.response.opcode));
+    }
+}
+
+EmbeddedDaemon::EmbeddedDaemon(BenchEngine engine) : engine(engine) {
+    const auto pid = std::to_string(getpid());
+    configFile = cb::io::getcwd() + "/frontend_bench.json." + pid;
+    portFile = cb::io::getcwd() + "/frontend_bench_ports." + pid;
+
+    // The "default" user (no password) in the test password database is
+    // what allows the unauthenticated connections to use the default bucket
+    std::string pwfile{SOURCE_ROOT};
+    pwfile.append("/tests/testapp/cbsaslpw.json");
+    setenv("CBSASL_PWFILE", pwfile.c_str(), 1);
+    setenv("MEMCACHED_PORT_FILENAME", portFile.c_str(), 1);
+    unlink(portFile.c_str());
+
+    writeConfig();
+    serverThread = std::thread([this]() {
+        char* argv[] = {const_cast<char*>("./memcached"),
+                        const_cast<char*>("-C"),
+                        const_cast<char*>(configFile.c_str()),
+                        nullptr};
+        memcached_main(3, argv);
+    });
+
+    waitForPortFile();
+    createBucket();
+}
+
+EmbeddedDaemon::~EmbeddedDaemon() {
+    try {
+        deleteBucket();
+    } catch (const std::exception& e) {
+        fprintf(stderr, "EmbeddedDaemon: failed to delete bucket: %s\n",
+                e.what());
+    }
+    shutdown_server();
+    serverThread.join();
+    unlink(configFile.c_str());
+}
+
+std::unique_ptr<BenchConnection> EmbeddedDaemon::connect() {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        throw std::system_error(
+                errno, std::system_category(), "EmbeddedDaemon::connect");
+    }
+    dispatch_conn_new(fds[1], port);
+    return std::make_unique<BenchConnection>(fds[0]);
+}
+
+void EmbeddedDaemon::writeConfig() {
+    unique_cJSON_ptr root(cJSON_CreateObject());
+
+    cJSON* logger = cJSON_CreateObject();
+    cJSON_AddTrueToObject(logger, "unit_test");
+    cJSON_AddFalseToObject(logger, "console");
+    cJSON_AddItemToObject(root.get(), "logger", logger);
+    cJSON_AddFalseToObject(root.get(), "stdin_listener");
+
+    // We need one interface: it is used for the parent port of the
+    // socketpair connections, and by the admin connection creating the
+    // bucket.
+    cJSON* array = cJSON_CreateArray();
+    cJSON* obj = cJSON_CreateObject();
+    cJSON_AddNumberToObject(obj, "port", 0);
+    cJSON_AddTrueToObject(obj, "ipv4");
+    cJSON_AddFalseToObject(obj, "ipv6");
+    cJSON_AddNumberToObject(obj, "maxconn", 1000);
+    cJSON_AddNumberToObject(obj, "backlog", 1024);
+    cJSON_AddStringToObject(obj, "host", "*");
+    cJSON_AddStringToObject(obj, "protocol", "memcached");
+    cJSON_AddTrueToObject(obj, "management");
+    cJSON_AddItemToArray(array, obj);
+    cJSON_AddItemToObject(root.get(), "interfaces", array);
+
+    std::string rbac{SOURCE_ROOT};
+    rbac.append("/tests/testapp/rbac.json");
+    cJSON_AddStringToObject(root.get(), "rbac_file", rbac.c_str());
+    std::string errmaps{SOURCE_ROOT};
+    errmaps.append("/etc/couchbase/kv/error_maps");
+    cJSON_AddStringToObject(root.get(), "error_maps_dir", errmaps.c_str());
+    cJSON_AddTrueToObject(root.get(), "datatype_json");
+    cJSON_AddTrueToObject(root.get(), "datatype_snappy");
+    cJSON_AddTrueToObject(root.get(), "xattr_enabled");
+
+    std::ofstream out(configFile);
+    out << to_string(root, false) << std::endl;
+}
+
+void EmbeddedDaemon::waitForPortFile() {
+    const auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::minutes(1);
+    while (!cb::io::isFile(portFile)) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            throw std::runtime_error(
+                    "EmbeddedDaemon: timed out waiting for " + portFile);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    std::ifstream in(portFile);
+    std::string content((std::istreambuf_iterator<char>(in)),
+                        std::istreambuf_iterator<char>());
+    unlink(portFile.c_str());
+
+    unique_cJSON_ptr json(cJSON_Parse(content.c_str()));
+    cJSON* ports = json ? cJSON_GetObjectItem(json.get(), "ports") : nullptr;
+    if (ports == nullptr) {
+        throw std::runtime_error("EmbeddedDaemon: invalid port file: " +
+                                 content);
+    }
+    for (int ii = 0; ii < cJSON_GetArraySize(ports); ++ii) {
+        auto* entry = cJSON_GetArrayItem(ports, ii);
+        auto* family = cJSON_GetObjectItem(entry, "family");
+        if (family && strcmp(family->valuestring, "AF_INET") == 0) {
+            port = in_port_t(cJSON_GetObjectItem(entry, "port")->valueint);
+            return;
+        }
+    }
+    throw std::runtime_error("EmbeddedDaemon: no AF_INET port in: " +
+                             content);
+}
+
+void EmbeddedDaemon::createBucket() {
+    MemcachedConnection conn("", port, AF_INET, false);
+    conn.connect();
+    conn.authenticate("@admin", "password", "PLAIN");
+    switch (engine) {
+    case BenchEngine::Default:
+        conn.createBucket(bucketName, "", BucketType::Memcached);
+        return;
+    case BenchEngine::EWouldBlock:
+        conn.createBucket(
+                bucketName, "default_engine.so", BucketType::EWouldBlock);
+        return;
+    }
+    throw std::logic_error("EmbeddedDaemon::createBucket: invalid engine");
+}
+
+void EmbeddedDaemon::deleteBucket() {
+    MemcachedConnection conn("", port, AF_INET, false);
+    conn.connect();
+    conn.authenticate("@admin", "password", "PLAIN");
+    conn.deleteBucket(bucketName);
+}
@@ -0,0 +1,132 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include "config.h"
+
+#include <memcached/protocol_binary.h>
+#include <platform/sized_buffer.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * The backend used for the "default" bucket the benchmarks run against
+ */
+enum class BenchEngine {
+    /// default_engine (memcache bucket)
+    Default,
+    /// ewouldblock_engine in front of default_engine. This adds the EWB
+    /// interposer to the request path, and provides the internal DCP
+    /// producer used by the DCP benchmarks.
+    EWouldBlock
+};
+
+/**
+ * A connection to the embedded daemon over one end of a socketpair. The
+ * other end is handed directly to one of the daemon's worker threads, so
+ * there is no TCP stack (or listen/accept) in the path being measured.
+ *
+ * The connection is synchronous and minimal on purpose: the frames are
+ * encoded by the caller (once, outside of the measured loop) and the
+ * responses are read into a reusable buffer.
+ */
+class BenchConnection {
+public:
+    explicit BenchConnection(SOCKET sock);
+    ~BenchConnection();
+
+    BenchConnection(const BenchConnection&) = delete;
+
+    /**
+     * Send all of the bytes in the provided buffer
+     *
+     * @throws std::system_error if an error occurs
+     */
+    void send(cb::const_byte_buffer data);
+
+    /**
+     * Read the next (complete) frame from the server into the internal
+     * buffer.
+     *
+     * @return the header of the frame (valid until the next call)
+     * @throws std::system_error if an error occurs, or std::runtime_error
+     *         if the server closed the connection
+     */
+    const protocol_binary_response_header& recvFrame();
+
+    /**
+     * Send the frame and read the response, and verify that the status
+     * of the response is the expected one.
+     *
+     * @throws std::runtime_error if the response has a different status
+     */
+    void execute(cb::const_byte_buffer frame,
+                 protocol_binary_response_status expected =
+                         PROTOCOL_BINARY_RESPONSE_SUCCESS);
+
+private:
+    void read(uint8_t* dest, size_t nbytes);
+
+    SOCKET sock;
+    std::vector<uint8_t> buffer;
+};
+
+/**
+ * An instance of memcached running in a thread of this process, with a
+ * single bucket named "default". Clients which haven't authenticated
+ * are associated with the "default" bucket (with the privileges of the
+ * "default" RBAC entry), so the benchmark connections can be used without
+ * going through SASL.
+ *
+ * There may only be one instance at a time (memcached relies on global
+ * state).
+ */
+class EmbeddedDaemon {
+public:
+    explicit EmbeddedDaemon(BenchEngine engine);
+
+    ~EmbeddedDaemon();
+
+    EmbeddedDaemon(const EmbeddedDaemon&) = delete;
+
+    BenchEngine getEngine() const {
+        return engine;
+    }
+
+    /**
+     * Create a new connection to the daemon. The server end of the
+     * socketpair is dispatched to one of the worker threads (round robin,
+     * like accepted connections).
+     */
+    std::unique_ptr<BenchConnection> connect();
+
+private:
+    void writeConfig();
+    void waitForPortFile();
+    void createBucket();
+    void deleteBucket();
+
+    const BenchEngine engine;
+    std::string configFile;
+    std::string portFile;
+    in_port_t port = 0;
+    std::thread serverThread;
+};
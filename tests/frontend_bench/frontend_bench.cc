@@ -0,0 +1,215 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * End-to-end benchmarks of the memcached front-end: the packets are
+ * written to a socketpair owned by one of the daemon's worker threads, so
+ * each operation goes through libevent, the mcbp state machine, the
+ * validators, the executors and the engine (and back).
+ */
+
+#include "frontend_bench.h"
+
+#include <protocol/connection/client_connection.h>
+#include <protocol/connection/client_mcbp_commands.h>
+
+#include <string>
+#include <vector>
+
+static const std::string benchKey{"frontend_bench"};
+static const std::string benchJsonKey{"frontend_bench_json"};
+static const std::string benchJsonDoc{
+        R"({"name":"frontend_bench","count":0,"tags":["a","b","c"]})"};
+
+template <typename T>
+static std::vector<uint8_t> encode(const T& command) {
+    std::vector<uint8_t> frame;
+    command.encode(frame);
+    return frame;
+}
+
+static std::vector<uint8_t> encodeSet(const std::string& key,
+                                      const std::string& value) {
+    BinprotMutationCommand cmd;
+    cmd.setMutationType(MutationType::Set);
+    cmd.setKey(key);
+    cmd.setValue(value);
+    return encode(cmd);
+}
+
+/**
+ * Connect to the embedded daemon, or mark the benchmark as skipped if it
+ * isn't running.
+ */
+static std::unique_ptr<BenchConnection> connect(benchmark::State& state) {
+    if (!embeddedDaemon) {
+        state.SkipWithError("The embedded daemon isn't running");
+        return {};
+    }
+    return embeddedDaemon->connect();
+}
+
+/**
+ * Send the same (pre-encoded) frame in a loop and verify that each of the
+ * responses is successful.
+ */
+static void runFrame(benchmark::State& state,
+                     BenchConnection& conn,
+                     const std::vector<uint8_t>& frame) {
+    uint64_t ops = 0;
+    uint64_t cycles = 0;
+    while (state.KeepRunning()) {
+        const auto start = readCycleCounter();
+        conn.execute({frame.data(), frame.size()});
+        cycles += readCycleCounter() - start;
+        ++ops;
+    }
+    reportOpCost(state, ops, cycles);
+}
+
+static void BM_Get(benchmark::State& state) {
+    auto conn = connect(state);
+    if (!conn) {
+        return;
+    }
+    auto set = encodeSet(benchKey, std::string(state.range(0), 'x'));
+    conn->execute({set.data(), set.size()});
+
+    BinprotGetCommand get;
+    get.setKey(benchKey);
+    runFrame(state, *conn, encode(get));
+}
+BENCHMARK(BM_Get)->Arg(32)->Arg(1024)->Arg(16384);
+
+static void BM_Set(benchmark::State& state) {
+    auto conn = connect(state);
+    if (!conn) {
+        return;
+    }
+    runFrame(state,
+             *conn,
+             encodeSet(benchKey, std::string(state.range(0), 'x')));
+}
+BENCHMARK(BM_Set)->Arg(32)->Arg(1024)->Arg(16384);
+
+/**
+ * A batch of GETs is sent in a single write before the responses are
+ * read, which is how the smart clients pipeline requests to a node. This
+ * measures the per-op cost when the worker thread finds more than one
+ * packet in its input buffer.
+ */
+static void BM_GetPipelined(benchmark::State& state) {
+    auto conn = connect(state);
+    if (!conn) {
+        return;
+    }
+    auto set = encodeSet(benchKey, std::string(32, 'x'));
+    conn->execute({set.data(), set.size()});
+
+    const auto batchSize = size_t(state.range(0));
+    BinprotGetCommand get;
+    get.setKey(benchKey);
+    const auto frame = encode(get);
+    std::vector<uint8_t> batch;
+    for (size_t ii = 0; ii < batchSize; ++ii) {
+        batch.insert(batch.end(), frame.begin(), frame.end());
+    }
+
+    uint64_t cycles = 0;
+    while (state.KeepRunning()) {
+        const auto start = readCycleCounter();
+        conn->send({batch.data(), batch.size()});
+        for (size_t ii = 0; ii < batchSize; ++ii) {
+            const auto& rsp = conn->recvFrame();
+            if (rsp.response.status != 0) {
+                state.SkipWithError("GET failed");
+                return;
+            }
+        }
+        cycles += readCycleCounter() - start;
+    }
+    reportOpCost(state, state.iterations() * batchSize, cycles);
+}
+BENCHMARK(BM_GetPipelined)->Arg(1)->Arg(8)->Arg(64);
+
+static void BM_SubdocGet(benchmark::State& state) {
+    auto conn = connect(state);
+    if (!conn) {
+        return;
+    }
+    auto set = encodeSet(benchJsonKey, benchJsonDoc);
+    conn->execute({set.data(), set.size()});
+
+    BinprotSubdocCommand cmd(
+            PROTOCOL_BINARY_CMD_SUBDOC_GET, benchJsonKey, "tags[1]");
+    runFrame(state, *conn, encode(cmd));
+}
+BENCHMARK(BM_SubdocGet);
+
+static void BM_SubdocDictUpsert(benchmark::State& state) {
+    auto conn = connect(state);
+    if (!conn) {
+        return;
+    }
+    auto set = encodeSet(benchJsonKey, benchJsonDoc);
+    conn->execute({set.data(), set.size()});
+
+    BinprotSubdocCommand cmd(PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT,
+                             benchJsonKey,
+                             "count",
+                             "1");
+    runFrame(state, *conn, encode(cmd));
+}
+BENCHMARK(BM_SubdocDictUpsert);
+
+/**
+ * Measure the cost of producing DCP mutations. This uses the internal DCP
+ * stream of the ewouldblock_engine (an endless stream of the same item)
+ * so that we measure the front-end (dcp_step and the DCP message
+ * producers) and not the engine's DCP implementation.
+ */
+static void BM_DcpProducer(benchmark::State& state) {
+    if (embeddedDaemon &&
+        embeddedDaemon->getEngine() != BenchEngine::EWouldBlock) {
+        state.SkipWithError("DCP requires the ewouldblock engine");
+        return;
+    }
+    auto conn = connect(state);
+    if (!conn) {
+        return;
+    }
+
+    BinprotDcpOpenCommand open{"ewb_internal"};
+    open.makeProducer();
+    const auto frame = encode(open);
+    conn->execute({frame.data(), frame.size()});
+
+    uint64_t ops = 0;
+    uint64_t cycles = 0;
+    while (state.KeepRunning()) {
+        const auto start = readCycleCounter();
+        const auto& msg = conn->recvFrame();
+        cycles += readCycleCounter() - start;
+        if (msg.response.opcode != PROTOCOL_BINARY_CMD_DCP_MUTATION) {
+            state.SkipWithError("Expected DCP_MUTATION");
+            return;
+        }
+        ++ops;
+    }
+    reportOpCost(state, ops, cycles);
+}
+BENCHMARK(BM_DcpProducer);
@@ -0,0 +1,72 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+/*
+ * Shared state and helpers for the memcached front-end benchmarks.
+ */
+
+#include "config.h"
+#include "embedded_daemon.h"
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * The daemon the end-to-end benchmarks run against. Created by main()
+ * before the benchmarks are run (the validator benchmarks don't use it).
+ */
+extern std::unique_ptr<EmbeddedDaemon> embeddedDaemon;
+
+/**
+ * Read the CPU's cycle counter. On platforms where we don't have access to
+ * it we fall back to nanoseconds, which makes "CyclesPerOp" a time per op
+ * (but still comparable between runs on the same machine).
+ */
+inline uint64_t readCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+}
+
+/**
+ * Report the throughput (items/s) and the number of CPU cycles spent
+ * per operation for a benchmark run.
+ *
+ * @param state the benchmark state
+ * @param ops the number of operations performed
+ * @param cycles the number of cycles spent performing them
+ */
+inline void reportOpCost(benchmark::State& state,
+                         uint64_t ops,
+                         uint64_t cycles) {
+    state.SetItemsProcessed(ops);
+    if (ops > 0) {
+        state.counters["CyclesPerOp"] = double(cycles) / double(ops);
+    }
+}
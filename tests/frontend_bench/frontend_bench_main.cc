@@ -0,0 +1,77 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "frontend_bench.h"
+
+#include <platform/make_unique.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+std::unique_ptr<EmbeddedDaemon> embeddedDaemon;
+
+static void usage() {
+    std::cerr << "Usage: memcached_frontend_bench "
+              << "[--engine=ewouldblock|default|none] "
+              << "[benchmark options]" << std::endl
+              << std::endl
+              << "  --engine=ewouldblock  Run against ewouldblock_engine in "
+              << "front of default_engine (default)" << std::endl
+              << "  --engine=default      Run against default_engine"
+              << std::endl
+              << "  --engine=none         Don't start the daemon (only the "
+              << "validator benchmarks are run)" << std::endl;
+}
+
+/**
+ * main() function for memcached_frontend_bench. Starts memcached in a
+ * thread of this process (with the requested engine backing the "default"
+ * bucket), then runs all of the registered GoogleBenchmark benchmarks.
+ *
+ * --benchmark_filter can be used to run a subset of the benchmarks.
+ */
+int main(int argc, char** argv) {
+    ::benchmark::Initialize(&argc, argv);
+
+    bool startDaemon = true;
+    BenchEngine engine = BenchEngine::EWouldBlock;
+    for (int ii = 1; ii < argc; ++ii) {
+        if (strcmp(argv[ii], "--engine=ewouldblock") == 0) {
+            engine = BenchEngine::EWouldBlock;
+        } else if (strcmp(argv[ii], "--engine=default") == 0) {
+            engine = BenchEngine::Default;
+        } else if (strcmp(argv[ii], "--engine=none") == 0) {
+            startDaemon = false;
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    try {
+        if (startDaemon) {
+            embeddedDaemon = std::make_unique<EmbeddedDaemon>(engine);
+        }
+        ::benchmark::RunSpecifiedBenchmarks();
+        embeddedDaemon.reset();
+    } catch (const std::exception& e) {
+        std::cerr << "memcached_frontend_bench: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
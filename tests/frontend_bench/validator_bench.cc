@@ -0,0 +1,140 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmarks of the packet validators in isolation (no daemon, socket or
+ * engine involved), to separate the cost of validation from the rest of
+ * the request path measured in frontend_bench.cc.
+ */
+
+#include "frontend_bench.h"
+
+#include <daemon/connection_mcbp.h>
+#include <daemon/cookie.h>
+#include <daemon/mcbp_validators.h>
+#include <daemon/settings.h>
+#include <protocol/connection/client_connection.h>
+#include <protocol/connection/client_mcbp_commands.h>
+
+#include <vector>
+
+/**
+ * A connection which doesn't own a socket and isn't bound to libevent
+ */
+class BenchMcbpConnection : public McbpConnection {
+public:
+    BenchMcbpConnection() : McbpConnection() {
+    }
+};
+
+/**
+ * A cookie operating on a packet in the provided buffer rather than in the
+ * read buffer of the connection
+ */
+class BenchCookie : public Cookie {
+public:
+    BenchCookie(McbpConnection& connection, cb::const_byte_buffer buffer)
+        : Cookie(connection) {
+        setPacket(PacketContent::Full, buffer);
+    }
+};
+
+static void runValidator(benchmark::State& state,
+                         protocol_binary_command opcode,
+                         const std::vector<uint8_t>& packet) {
+    settings.setXattrEnabled(true);
+    McbpValidatorChains chains;
+    McbpValidatorChains::initializeMcbpValidatorChains(chains);
+
+    BenchMcbpConnection connection;
+    connection.enableDatatype(cb::mcbp::Feature::XATTR);
+    connection.enableDatatype(cb::mcbp::Feature::JSON);
+    BenchCookie cookie(connection, {packet.data(), packet.size()});
+
+    uint64_t ops = 0;
+    uint64_t cycles = 0;
+    while (state.KeepRunning()) {
+        const auto start = readCycleCounter();
+        benchmark::DoNotOptimize(chains.invoke(opcode, cookie));
+        cycles += readCycleCounter() - start;
+        ++ops;
+    }
+    reportOpCost(state, ops, cycles);
+}
+
+static void runValidator(benchmark::State& state,
+                         const BinprotCommand& command) {
+    std::vector<uint8_t> packet;
+    command.encode(packet);
+    runValidator(state, command.getOp(), packet);
+}
+
+static void BM_ValidateGet(benchmark::State& state) {
+    BinprotGetCommand cmd;
+    cmd.setKey("frontend_bench");
+    runValidator(state, cmd);
+}
+BENCHMARK(BM_ValidateGet);
+
+static void BM_ValidateSet(benchmark::State& state) {
+    BinprotMutationCommand cmd;
+    cmd.setMutationType(MutationType::Set);
+    cmd.setKey("frontend_bench");
+    cmd.setValue(std::string(state.range(0), 'x'));
+    runValidator(state, cmd);
+}
+BENCHMARK(BM_ValidateSet)->Arg(32)->Arg(16384);
+
+static void BM_ValidateSubdocDictUpsert(benchmark::State& state) {
+    BinprotSubdocCommand cmd(PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT,
+                             "frontend_bench",
+                             "count",
+                             "1");
+    runValidator(state, cmd);
+}
+BENCHMARK(BM_ValidateSubdocDictUpsert);
+
+/**
+ * There is no bucket associated with the connection, so the DCP_MUTATION
+ * validator returns NOT_SUPPORTED once the packet itself has been checked.
+ */
+static void BM_ValidateDcpMutation(benchmark::State& state) {
+    const std::string key{"frontend_bench"};
+    const std::string value(state.range(0), 'x');
+    protocol_binary_request_dcp_mutation request(false /*collections*/,
+                                                 0 /*opaque*/,
+                                                 0 /*vbucket*/,
+                                                 0 /*cas*/,
+                                                 uint16_t(key.size()),
+                                                 uint32_t(value.size()),
+                                                 PROTOCOL_BINARY_RAW_BYTES,
+                                                 1 /*bySeqno*/,
+                                                 0 /*revSeqno*/,
+                                                 0 /*flags*/,
+                                                 0 /*expiration*/,
+                                                 0 /*lockTime*/,
+                                                 0 /*nmeta*/,
+                                                 0 /*nru*/,
+                                                 0 /*collectionLen*/);
+    const size_t headerLen = sizeof(request.message.header) +
+                             request.message.header.request.extlen;
+    std::vector<uint8_t> packet(request.bytes, request.bytes + headerLen);
+    packet.insert(packet.end(), key.begin(), key.end());
+    packet.insert(packet.end(), value.begin(), value.end());
+    runValidator(state, PROTOCOL_BINARY_CMD_DCP_MUTATION, packet);
+}
+BENCHMARK(BM_ValidateDcpMutation)->Arg(32)->Arg(16384);
@@ -0,0 +1,117 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "daemon/inflated_document_cache.h"
+
+#include <gtest/gtest.h>
+#include <memcached/types.h>
+
+class InflatedDocumentCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        document = R"({"name":"inflated_document_cache_test"})";
+        ASSERT_TRUE(cb::compression::deflate(
+                cb::compression::Algorithm::Snappy, document, compressed));
+    }
+
+    static std::string to_string(const InflatedDocumentCache::Document& doc) {
+        cb::const_char_buffer buf = *doc;
+        return {buf.data(), buf.size()};
+    }
+
+    InflatedDocumentCache cache{1024 * 1024};
+    const std::string key{"key"};
+    std::string document;
+    cb::compression::Buffer compressed;
+};
+
+TEST_F(InflatedDocumentCacheTest, HitOnSameCas) {
+    auto first = cache.get(key, 1, compressed);
+    ASSERT_TRUE(first);
+    EXPECT_EQ(document, to_string(first));
+
+    auto second = cache.get(key, 1, compressed);
+    ASSERT_TRUE(second);
+    // The second request should be served from the cache
+    EXPECT_EQ(first.get(), second.get());
+
+    const auto stats = cache.getStats();
+    EXPECT_EQ(1, stats.hits);
+    EXPECT_EQ(1, stats.misses);
+    EXPECT_EQ(1, stats.items);
+}
+
+TEST_F(InflatedDocumentCacheTest, MissOnNewCas) {
+    auto first = cache.get(key, 1, compressed);
+    auto second = cache.get(key, 2, compressed);
+    ASSERT_TRUE(second);
+    EXPECT_NE(first.get(), second.get());
+    EXPECT_EQ(document, to_string(second));
+
+    // The old revision should have been replaced
+    const auto stats = cache.getStats();
+    EXPECT_EQ(0, stats.hits);
+    EXPECT_EQ(2, stats.misses);
+    EXPECT_EQ(1, stats.items);
+}
+
+TEST_F(InflatedDocumentCacheTest, LockedCasNotCached) {
+    auto first = cache.get(key, LOCKED_CAS, compressed);
+    auto second = cache.get(key, LOCKED_CAS, compressed);
+    ASSERT_TRUE(first);
+    ASSERT_TRUE(second);
+    EXPECT_NE(first.get(), second.get());
+    EXPECT_EQ(0, cache.getStats().items);
+}
+
+TEST_F(InflatedDocumentCacheTest, Disabled) {
+    cache.setMaxSize(0);
+    auto first = cache.get(key, 1, compressed);
+    auto second = cache.get(key, 1, compressed);
+    ASSERT_TRUE(first);
+    ASSERT_TRUE(second);
+    EXPECT_NE(first.get(), second.get());
+    EXPECT_EQ(0, cache.getStats().items);
+}
+
+TEST_F(InflatedDocumentCacheTest, InvalidInput) {
+    const std::string garbage = "this is not snappy";
+    EXPECT_FALSE(cache.get(key, 1, garbage));
+    EXPECT_EQ(0, cache.getStats().items);
+}
+
+TEST_F(InflatedDocumentCacheTest, BoundedSize) {
+    for (uint64_t ii = 0; ii < 100000; ++ii) {
+        const auto id = "key_" + std::to_string(ii);
+        ASSERT_TRUE(cache.get(id, ii + 1, compressed));
+    }
+
+    const auto stats = cache.getStats();
+    EXPECT_LE(stats.size, cache.getMaxSize());
+    EXPECT_NE(0, stats.evictions);
+    EXPECT_EQ(100000, stats.items + stats.evictions);
+
+    // Shrinking the cache should evict entries immediately
+    cache.setMaxSize(cache.getMaxSize() / 2);
+    EXPECT_LE(cache.getStats().size, cache.getMaxSize());
+}
+
+TEST_F(InflatedDocumentCacheTest, DocumentOutlivesEviction) {
+    auto doc = cache.get(key, 1, compressed);
+    cache.clear();
+    EXPECT_EQ(0, cache.getStats().items);
+    EXPECT_EQ(document, to_string(doc));
+}
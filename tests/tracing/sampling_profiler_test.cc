@@ -0,0 +1,97 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+
+#include <gtest/gtest.h>
+#include <tracing/sampling_profiler.h>
+
+#include <chrono>
+
+using cb::tracing::SamplingProfiler;
+
+class MockSamplingProfiler : public SamplingProfiler {
+public:
+    using SamplingProfiler::getThreadType;
+};
+
+TEST(SamplingProfilerTest, ThreadType) {
+    EXPECT_EQ("mc:worker", MockSamplingProfiler::getThreadType("mc:worker_0"));
+    EXPECT_EQ("mc:worker", MockSamplingProfiler::getThreadType("mc:worker_12"));
+    EXPECT_EQ("writer_worker",
+              MockSamplingProfiler::getThreadType("writer_worker_3"));
+    EXPECT_EQ("mc:listener", MockSamplingProfiler::getThreadType("mc:listener"));
+    EXPECT_EQ("123", MockSamplingProfiler::getThreadType("123"));
+}
+
+TEST(SamplingProfilerTest, InvalidInterval) {
+    EXPECT_THROW(SamplingProfiler::getInstance().start(
+                         std::chrono::microseconds(0)),
+                 std::invalid_argument);
+}
+
+#ifndef WIN32
+/// Burn CPU for the given amount of wall-clock time
+static uint64_t spin(std::chrono::milliseconds duration) {
+    const auto end = std::chrono::steady_clock::now() + duration;
+    volatile uint64_t counter = 0;
+    while (std::chrono::steady_clock::now() < end) {
+        for (int ii = 0; ii < 10000; ++ii) {
+            counter = counter + 1;
+        }
+    }
+    return counter;
+}
+
+TEST(SamplingProfilerTest, AttributesSamples) {
+    auto& profiler = SamplingProfiler::getInstance();
+    profiler.clear();
+
+    SamplingProfiler::registerThread("test_thread_1");
+    SamplingProfiler::setActivity({"Spinning", 8});
+    profiler.start(std::chrono::microseconds(1000));
+    EXPECT_TRUE(profiler.isRunning());
+    spin(std::chrono::milliseconds(500));
+    profiler.stop();
+    EXPECT_FALSE(profiler.isRunning());
+    SamplingProfiler::setActivity({});
+    SamplingProfiler::unregisterThread();
+
+    const auto stats = profiler.getStats();
+    EXPECT_GT(stats.samples, 0u);
+    EXPECT_EQ(0u, stats.threads) << "unregistered thread should be released";
+
+    const auto summary = profiler.getActivitySummary();
+    const auto it = summary.find("test_thread:Spinning");
+    ASSERT_NE(summary.end(), it);
+    EXPECT_GT(it->second, 0u);
+
+    const auto entries = profiler.getProfile(5);
+    ASSERT_FALSE(entries.empty());
+    EXPECT_LE(entries.size(), 5u);
+    EXPECT_EQ("test_thread", entries.front().threadType);
+    EXPECT_EQ("Spinning", entries.front().activity);
+    EXPECT_FALSE(entries.front().frames.empty());
+    for (size_t ii = 1; ii < entries.size(); ++ii) {
+        EXPECT_GE(entries[ii - 1].count, entries[ii].count);
+    }
+
+    profiler.clear();
+    EXPECT_EQ(0u, profiler.getStats().samples);
+    EXPECT_TRUE(profiler.getProfile(5).empty());
+}
+#endif
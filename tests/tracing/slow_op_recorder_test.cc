@@ -0,0 +1,168 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+
+#include <gtest/gtest.h>
+#include <tracing/slow_op_recorder.h>
+
+#include <thread>
+
+using cb::tracing::SlowOpRecorder;
+using cb::tracing::Span;
+using cb::tracing::TraceCode;
+using std::chrono::microseconds;
+
+/// Tracer which allows spans with given times to be added
+class MockTracer : public cb::tracing::Tracer {
+public:
+    void add(TraceCode code, int64_t start, int64_t duration) {
+        vecSpans.emplace_back(code, microseconds(start), microseconds(duration));
+    }
+
+    void addOpen(TraceCode code, int64_t start) {
+        vecSpans.emplace_back(code, microseconds(start));
+    }
+};
+
+class SlowOpRecorderTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        recorder.setThreshold(microseconds(1000));
+    }
+
+    /// Add the spans of a request of the given duration (including the send
+    /// span) to the tracer
+    static void makeRequest(MockTracer& tracer, int64_t duration) {
+        tracer.add(TraceCode::REQUEST, 100, duration - 10);
+        tracer.add(TraceCode::DECODE, 101, 2);
+        tracer.add(TraceCode::GET, 105, duration - 20);
+        tracer.add(TraceCode::SEND, 100 + duration - 10, 10);
+    }
+
+    SlowOpRecorder recorder;
+};
+
+TEST_F(SlowOpRecorderTest, BelowThreshold) {
+    MockTracer tracer;
+    makeRequest(tracer, 999);
+    EXPECT_FALSE(recorder.maybeRecord(tracer, 0x00, 1, 2));
+    EXPECT_TRUE(recorder.getRecords().empty());
+    EXPECT_EQ(0u, recorder.getStats().recorded);
+}
+
+TEST_F(SlowOpRecorderTest, Disabled) {
+    recorder.setThreshold(microseconds(0));
+    MockTracer tracer;
+    makeRequest(tracer, 1000000);
+    EXPECT_FALSE(recorder.maybeRecord(tracer, 0x00, 1, 2));
+    EXPECT_TRUE(recorder.getRecords().empty());
+}
+
+TEST_F(SlowOpRecorderTest, RecordsBreakdown) {
+    MockTracer tracer;
+    makeRequest(tracer, 5000);
+    // A span which never ended isn't recorded
+    tracer.addOpen(TraceCode::BGFETCH_WAIT, 200);
+    EXPECT_TRUE(recorder.maybeRecord(tracer, 0x01, 7, 42));
+
+    const auto records = recorder.getRecords();
+    ASSERT_EQ(1u, records.size());
+    const auto& record = records.front();
+    // The total includes the send span, which ends after the request span
+    EXPECT_EQ(microseconds(5000), record.duration);
+    EXPECT_EQ(7u, record.connectionId);
+    EXPECT_EQ(42u, record.opaque);
+    EXPECT_EQ(0x01, record.opcode);
+    EXPECT_EQ(5u, record.totalSpans);
+    ASSERT_EQ(4u, record.numSpans);
+    EXPECT_EQ(TraceCode::REQUEST, record.spans[0].code);
+    EXPECT_EQ(microseconds(0), record.spans[0].offset);
+    EXPECT_EQ(TraceCode::DECODE, record.spans[1].code);
+    EXPECT_EQ(microseconds(1), record.spans[1].offset);
+    EXPECT_EQ(microseconds(2), record.spans[1].duration);
+    EXPECT_EQ(TraceCode::SEND, record.spans[3].code);
+    EXPECT_EQ(microseconds(4990), record.spans[3].offset);
+    EXPECT_EQ(microseconds(10), record.spans[3].duration);
+}
+
+TEST_F(SlowOpRecorderTest, TruncatesSpans) {
+    MockTracer tracer;
+    tracer.add(TraceCode::REQUEST, 0, 2000);
+    for (size_t ii = 0; ii < SlowOpRecorder::MaxSpans + 4; ++ii) {
+        tracer.add(TraceCode::GET, ii, 1);
+    }
+    EXPECT_TRUE(recorder.maybeRecord(tracer, 0x00, 1, 1));
+    const auto records = recorder.getRecords();
+    ASSERT_EQ(1u, records.size());
+    EXPECT_EQ(SlowOpRecorder::MaxSpans + 5, records.front().totalSpans);
+    EXPECT_EQ(SlowOpRecorder::MaxSpans, records.front().numSpans);
+}
+
+TEST_F(SlowOpRecorderTest, RingKeepsMostRecent) {
+    const size_t count = SlowOpRecorder::Capacity + 10;
+    for (size_t ii = 0; ii < count; ++ii) {
+        MockTracer tracer;
+        makeRequest(tracer, 2000);
+        EXPECT_TRUE(recorder.maybeRecord(tracer, 0x00, 1, uint32_t(ii)));
+    }
+
+    const auto records = recorder.getRecords();
+    ASSERT_EQ(SlowOpRecorder::Capacity, records.size());
+    // Oldest first
+    for (size_t ii = 0; ii < records.size(); ++ii) {
+        EXPECT_EQ(uint32_t(ii + 10), records[ii].opaque);
+    }
+    EXPECT_EQ(count, recorder.getStats().recorded);
+
+    recorder.clear();
+    EXPECT_TRUE(recorder.getRecords().empty());
+    EXPECT_EQ(0u, recorder.getStats().recorded);
+
+    MockTracer tracer;
+    makeRequest(tracer, 2000);
+    EXPECT_TRUE(recorder.maybeRecord(tracer, 0x00, 1, 1234));
+    ASSERT_EQ(1u, recorder.getRecords().size());
+    EXPECT_EQ(1234u, recorder.getRecords().front().opaque);
+}
+
+TEST_F(SlowOpRecorderTest, ConcurrentWriters) {
+    const size_t perThread = 2000;
+    std::vector<std::thread> threads;
+    for (uint32_t tt = 0; tt < 4; ++tt) {
+        threads.emplace_back([this, tt]() {
+            MockTracer tracer;
+            makeRequest(tracer, 2000);
+            for (size_t ii = 0; ii < perThread; ++ii) {
+                recorder.maybeRecord(tracer, 0x00, tt, uint32_t(ii));
+            }
+        });
+    }
+    for (size_t ii = 0; ii < 100; ++ii) {
+        for (const auto& record : recorder.getRecords()) {
+            ASSERT_EQ(microseconds(2000), record.duration);
+            ASSERT_EQ(4u, record.numSpans);
+        }
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    const auto stats = recorder.getStats();
+    EXPECT_EQ(4 * perThread, stats.recorded + stats.dropped);
+    EXPECT_EQ(SlowOpRecorder::Capacity, recorder.getRecords().size());
+}
@@ -0,0 +1,381 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <tracing/sampling_profiler.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#ifndef WIN32
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+namespace cb {
+namespace tracing {
+
+const std::chrono::microseconds SamplingProfiler::DefaultInterval{10000};
+
+std::atomic<uint64_t> SamplingProfiler::unregisteredSamples{0};
+
+thread_local SamplingProfiler::ThreadBuffer* SamplingProfiler::threadBuffer;
+
+/// How often the collector thread drains the per-thread rings
+static const std::chrono::milliseconds collectInterval{100};
+
+/**
+ * Number of frames at the top of each recorded stack which belong to the
+ * profiler itself (handleSignal and the signal trampoline).
+ */
+static const size_t skipFrames = 2;
+
+SamplingProfiler::ThreadBuffer::ThreadBuffer(std::string name)
+    : name(std::move(name)), type(getThreadType(this->name)) {
+    activity[0][0] = '\0';
+    activity[1][0] = '\0';
+}
+
+size_t SamplingProfiler::EntryKeyHash::operator()(const EntryKey& key) const {
+    size_t hash = std::hash<std::string>()(key.threadType) ^
+                  (std::hash<std::string>()(key.activity) << 1);
+    for (auto* frame : key.frames) {
+        hash = hash * 31 + std::hash<void*>()(frame);
+    }
+    return hash;
+}
+
+SamplingProfiler& SamplingProfiler::getInstance() {
+    static SamplingProfiler instance;
+    return instance;
+}
+
+SamplingProfiler::~SamplingProfiler() {
+    stop();
+}
+
+void SamplingProfiler::registerThread(const std::string& name) {
+    auto& profiler = getInstance();
+    std::lock_guard<std::mutex> guard(profiler.mutex);
+    profiler.threadBuffers.emplace_back(std::make_unique<ThreadBuffer>(name));
+    threadBuffer = profiler.threadBuffers.back().get();
+}
+
+void SamplingProfiler::unregisterThread() {
+    auto* buffer = threadBuffer;
+    if (buffer == nullptr) {
+        return;
+    }
+    // Make sure the signal handler no longer uses the buffer before it's
+    // handed over to the collector (which frees it once drained).
+    threadBuffer = nullptr;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    buffer->registered = false;
+}
+
+void SamplingProfiler::setActivity(cb::const_char_buffer activity) {
+    auto* buffer = threadBuffer;
+    if (buffer == nullptr) {
+        return;
+    }
+    // The signal handler can only interrupt this thread, so it's enough to
+    // write the slot it isn't reading and then switch the slots.
+    const int next = 1 - buffer->activityIndex.load(std::memory_order_relaxed);
+    auto& slot = buffer->activity[next];
+    const auto length = std::min(activity.size(), MaxActivityLength - 1);
+    std::copy(activity.data(), activity.data() + length, slot.begin());
+    slot[length] = '\0';
+    std::atomic_signal_fence(std::memory_order_release);
+    buffer->activityIndex.store(next, std::memory_order_relaxed);
+}
+
+void SamplingProfiler::handleSignal(int) {
+#ifndef WIN32
+    const int savedErrno = errno;
+    auto* buffer = threadBuffer;
+    if (buffer == nullptr) {
+        unregisteredSamples++;
+        errno = savedErrno;
+        return;
+    }
+
+    const auto head = buffer->head.load(std::memory_order_relaxed);
+    const auto tail = buffer->tail.load(std::memory_order_acquire);
+    if (head - tail >= RingSize) {
+        buffer->dropped++;
+        errno = savedErrno;
+        return;
+    }
+
+    auto& sample = buffer->ring[head % RingSize];
+    const int depth = backtrace(sample.frames.data(), int(MaxFrames));
+    sample.depth = depth > 0 ? size_t(depth) : 0;
+    const auto& activity =
+            buffer->activity[buffer->activityIndex.load(
+                    std::memory_order_relaxed)];
+    std::copy(activity.begin(), activity.end(), sample.activity.begin());
+    buffer->head.store(head + 1, std::memory_order_release);
+    errno = savedErrno;
+#endif
+}
+
+void SamplingProfiler::start(std::chrono::microseconds newInterval) {
+    if (newInterval.count() <= 0) {
+        throw std::invalid_argument(
+                "SamplingProfiler::start: interval must be non-zero");
+    }
+#ifdef WIN32
+    throw std::runtime_error(
+            "SamplingProfiler::start: not supported on this platform");
+#else
+    std::lock_guard<std::mutex> guard(controlMutex);
+    if (!running) {
+        // backtrace() loads libgcc the first time it's called, which isn't
+        // safe to do in a signal handler.
+        void* frame;
+        backtrace(&frame, 1);
+
+        // Note that the handler is never uninstalled; the default action
+        // of a SIGPROF which is still pending after stop() would be to
+        // terminate the process.
+        struct sigaction action = {};
+        action.sa_handler = handleSignal;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        if (sigaction(SIGPROF, &action, nullptr) != 0) {
+            throw std::system_error(errno,
+                                    std::system_category(),
+                                    "SamplingProfiler::start: sigaction");
+        }
+
+        {
+            std::lock_guard<std::mutex> lh(collectorMutex);
+            stopCollector = false;
+        }
+        collector = std::thread(&SamplingProfiler::collect, this);
+        running = true;
+    }
+
+    interval = newInterval;
+    const auto usecs = interval.count();
+    struct itimerval timer;
+    timer.it_interval.tv_sec = usecs / 1000000;
+    timer.it_interval.tv_usec = usecs % 1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+        throw std::system_error(errno,
+                                std::system_category(),
+                                "SamplingProfiler::start: setitimer");
+    }
+#endif
+}
+
+void SamplingProfiler::stop() {
+#ifndef WIN32
+    std::lock_guard<std::mutex> guard(controlMutex);
+    if (!running) {
+        return;
+    }
+
+    struct itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+
+    {
+        std::lock_guard<std::mutex> lh(collectorMutex);
+        stopCollector = true;
+    }
+    collectorCond.notify_one();
+    collector.join();
+    running = false;
+
+    // Pick up the samples recorded since the last collection
+    drain();
+#endif
+}
+
+void SamplingProfiler::clear() {
+    std::lock_guard<std::mutex> guard(mutex);
+    profile.clear();
+    samples = 0;
+    dropped = 0;
+    overflow = 0;
+    unregisteredSamples = 0;
+}
+
+void SamplingProfiler::collect() {
+    std::unique_lock<std::mutex> lh(collectorMutex);
+    while (!stopCollector) {
+        collectorCond.wait_for(lh, collectInterval);
+        drain();
+    }
+}
+
+void SamplingProfiler::drain() {
+    std::lock_guard<std::mutex> guard(mutex);
+    for (auto it = threadBuffers.begin(); it != threadBuffers.end();) {
+        auto& buffer = **it;
+        // Read the flag first; if the thread was unregistered every sample
+        // it recorded is visible below.
+        const bool registered = buffer.registered;
+        auto tail = buffer.tail.load(std::memory_order_relaxed);
+        const auto head = buffer.head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) {
+            const auto& sample = buffer.ring[tail % RingSize];
+            EntryKey key;
+            key.threadType = buffer.type;
+            key.activity = sample.activity.data();
+            if (sample.depth > skipFrames) {
+                key.frames.assign(sample.frames.begin() + skipFrames,
+                                  sample.frames.begin() + sample.depth);
+            }
+
+            auto entry = profile.find(key);
+            if (entry != profile.end()) {
+                entry->second++;
+            } else if (profile.size() < MaxEntries) {
+                profile.emplace(std::move(key), 1);
+            } else {
+                overflow++;
+                continue;
+            }
+            samples++;
+        }
+        buffer.tail.store(tail, std::memory_order_release);
+        dropped += buffer.dropped.exchange(0);
+
+        if (registered) {
+            ++it;
+        } else {
+            it = threadBuffers.erase(it);
+        }
+    }
+}
+
+std::vector<SamplingProfiler::Entry> SamplingProfiler::getProfile(
+        size_t limit) {
+    drain();
+
+    std::vector<Entry> entries;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        entries.reserve(profile.size());
+        for (const auto& entry : profile) {
+            entries.push_back({entry.first.threadType,
+                               entry.first.activity,
+                               entry.first.frames,
+                               entry.second});
+        }
+    }
+
+    limit = std::min(limit, entries.size());
+    std::partial_sort(entries.begin(),
+                      entries.begin() + limit,
+                      entries.end(),
+                      [](const Entry& a, const Entry& b) {
+                          return a.count > b.count;
+                      });
+    entries.resize(limit);
+    return entries;
+}
+
+std::unordered_map<std::string, uint64_t>
+SamplingProfiler::getActivitySummary() {
+    drain();
+
+    std::unordered_map<std::string, uint64_t> summary;
+    std::lock_guard<std::mutex> guard(mutex);
+    for (const auto& entry : profile) {
+        std::string key = entry.first.threadType;
+        if (!entry.first.activity.empty()) {
+            key += ":" + entry.first.activity;
+        }
+        summary[key] += entry.second;
+    }
+    return summary;
+}
+
+SamplingProfiler::Stats SamplingProfiler::getStats() {
+    drain();
+
+    Stats stats;
+    stats.running = running;
+    {
+        std::lock_guard<std::mutex> guard(controlMutex);
+        stats.interval = interval;
+    }
+    std::lock_guard<std::mutex> guard(mutex);
+    stats.threads = threadBuffers.size();
+    stats.samples = samples;
+    stats.dropped = dropped;
+    stats.unregistered = unregisteredSamples;
+    stats.overflow = overflow;
+    return stats;
+}
+
+std::string SamplingProfiler::symbolize(void* frame) {
+    std::stringstream ss;
+#ifndef WIN32
+    Dl_info info;
+    if (dladdr(frame, &info) != 0) {
+        if (info.dli_sname != nullptr) {
+            int status;
+            char* demangled = abi::__cxa_demangle(
+                    info.dli_sname, nullptr, nullptr, &status);
+            ss << (status == 0 ? demangled : info.dli_sname) << "+0x"
+               << std::hex
+               << (static_cast<char*>(frame) -
+                   static_cast<char*>(info.dli_saddr));
+            free(demangled);
+            return ss.str();
+        }
+        if (info.dli_fname != nullptr) {
+            std::string module = info.dli_fname;
+            const auto slash = module.rfind('/');
+            if (slash != std::string::npos) {
+                module = module.substr(slash + 1);
+            }
+            ss << module << "+0x" << std::hex
+               << (static_cast<char*>(frame) -
+                   static_cast<char*>(info.dli_fbase));
+            return ss.str();
+        }
+    }
+#endif
+    ss << frame;
+    return ss.str();
+}
+
+std::string SamplingProfiler::getThreadType(const std::string& name) {
+    auto end = name.find_last_not_of("0123456789");
+    if (end == std::string::npos) {
+        return name;
+    }
+    if (name[end] == '_' && end > 0) {
+        --end;
+    }
+    return name.substr(0, end + 1);
+}
+
+} // namespace tracing
+} // namespace cb
@@ -0,0 +1,235 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <memcached/visibility.h>
+#include <platform/sized_buffer.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace cb {
+namespace tracing {
+
+/**
+ * A statistical CPU profiler which runs inside the process.
+ *
+ * While running, an interval timer measuring the CPU time of the process
+ * (ITIMER_PROF) delivers SIGPROF to whichever thread is on-CPU. The signal
+ * handler records the stack of the interrupted thread, together with the
+ * thread's current activity (e.g. the description of the GlobalTask it's
+ * running), into a single-producer / single-consumer ring owned by that
+ * thread; it never takes a lock or allocates memory. A collector thread
+ * drains the rings and aggregates the samples by thread type, activity and
+ * stack.
+ *
+ * Only threads which have called registerThread() are attributed; samples
+ * which hit other threads are only counted. The cost is a couple of
+ * microseconds per sample, so at the default of 100 samples per second of
+ * CPU time the overhead is well below 1%.
+ *
+ * Not supported on Windows (start() throws).
+ */
+class MEMCACHED_PUBLIC_CLASS SamplingProfiler {
+public:
+    /// Maximum number of stack frames recorded per sample
+    static const size_t MaxFrames = 32;
+
+    /// Maximum length of an activity description (including the NUL)
+    static const size_t MaxActivityLength = 64;
+
+    /// Number of samples each thread can buffer between two collections
+    static const size_t RingSize = 256;
+
+    /**
+     * Maximum number of distinct (thread type, activity, stack) entries in
+     * the profile; samples for further entries are only counted.
+     */
+    static const size_t MaxEntries = 4096;
+
+    static const std::chrono::microseconds DefaultInterval;
+
+    /// One aggregated entry of the profile
+    struct Entry {
+        std::string threadType;
+        std::string activity;
+        std::vector<void*> frames;
+        uint64_t count;
+    };
+
+    struct Stats {
+        bool running;
+        std::chrono::microseconds interval;
+        size_t threads;
+        /// Samples aggregated into the profile
+        uint64_t samples;
+        /// Samples lost because a thread's ring was full
+        uint64_t dropped;
+        /// Samples which hit a thread which isn't registered
+        uint64_t unregistered;
+        /// Samples not aggregated because the profile has MaxEntries
+        uint64_t overflow;
+    };
+
+    static SamplingProfiler& getInstance();
+
+    /**
+     * Register the calling thread so its samples are attributed. The thread
+     * type is the name with any trailing "_<n>" / digits removed (so all
+     * "mc:worker_<n>" threads are aggregated as "mc:worker").
+     */
+    static void registerThread(const std::string& name);
+
+    /// Unregister the calling thread; must be called before it exits.
+    static void unregisterThread();
+
+    /**
+     * Set what the calling thread is currently doing (an empty buffer clears
+     * it). Cheap, and a no-op for threads which aren't registered.
+     */
+    static void setActivity(cb::const_char_buffer activity);
+
+    /**
+     * Start sampling (or change the interval if already running).
+     * @param interval CPU time between two samples
+     * @throws std::invalid_argument if the interval is zero
+     * @throws std::system_error if the timer or signal handler couldn't be
+     *         installed
+     */
+    void start(std::chrono::microseconds interval = DefaultInterval);
+
+    /// Stop sampling. The profile is kept until clear() is called.
+    void stop();
+
+    bool isRunning() const {
+        return running;
+    }
+
+    /// Discard the collected profile and reset the counters
+    void clear();
+
+    /**
+     * Get the (up to) limit entries with the highest sample count, in
+     * descending order of count.
+     */
+    std::vector<Entry> getProfile(size_t limit);
+
+    /// Get the number of samples per thread type and activity
+    std::unordered_map<std::string, uint64_t> getActivitySummary();
+
+    Stats getStats();
+
+    /**
+     * Resolve a frame to "symbol+0xoffset" (or "module+0xoffset" if there is
+     * no symbol for the address).
+     */
+    static std::string symbolize(void* frame);
+
+    ~SamplingProfiler();
+
+protected:
+    struct Sample {
+        size_t depth;
+        std::array<void*, MaxFrames> frames;
+        std::array<char, MaxActivityLength> activity;
+    };
+
+    /**
+     * Per-thread state. The ring is written by the signal handler (running
+     * on the owning thread) and read by the collector. The activity is
+     * double buffered: setActivity() writes the slot the handler isn't
+     * reading, then flips activityIndex.
+     */
+    struct ThreadBuffer {
+        explicit ThreadBuffer(std::string name);
+
+        const std::string name;
+        const std::string type;
+        std::array<Sample, RingSize> ring;
+        std::atomic<size_t> head{0};
+        std::atomic<size_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+        std::array<std::array<char, MaxActivityLength>, 2> activity;
+        std::atomic<int> activityIndex{0};
+        std::atomic<bool> registered{true};
+    };
+
+    struct EntryKey {
+        bool operator==(const EntryKey& other) const {
+            return threadType == other.threadType &&
+                   activity == other.activity && frames == other.frames;
+        }
+
+        std::string threadType;
+        std::string activity;
+        std::vector<void*> frames;
+    };
+
+    struct EntryKeyHash {
+        size_t operator()(const EntryKey& key) const;
+    };
+
+    SamplingProfiler() = default;
+
+    /// SIGPROF handler; records a sample for the interrupted thread
+    static void handleSignal(int signal);
+
+    /// Body of the collector thread
+    void collect();
+
+    /// Move the samples of all threads from the rings into the profile
+    void drain();
+
+    static std::string getThreadType(const std::string& name);
+
+    /// Guards threadBuffers and the profile
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+    std::unordered_map<EntryKey, uint64_t, EntryKeyHash> profile;
+    uint64_t samples = 0;
+    uint64_t dropped = 0;
+    uint64_t overflow = 0;
+    static std::atomic<uint64_t> unregisteredSamples;
+
+    /**
+     * The buffer of the calling thread (nullptr if it isn't registered).
+     * mcd_tracing is loaded with the process, so the variable lives in the
+     * static TLS block and is safe to read from the signal handler.
+     */
+    static thread_local ThreadBuffer* threadBuffer;
+
+    /// Guards starting and stopping
+    std::mutex controlMutex;
+    std::atomic<bool> running{false};
+    std::chrono::microseconds interval{DefaultInterval};
+    std::thread collector;
+    std::mutex collectorMutex;
+    std::condition_variable collectorCond;
+    bool stopCollector = false;
+};
+
+} // namespace tracing
+} // namespace cb
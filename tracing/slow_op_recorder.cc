@@ -0,0 +1,144 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <tracing/slow_op_recorder.h>
+
+#include <algorithm>
+
+namespace cb {
+namespace tracing {
+
+const size_t SlowOpRecorder::MaxSpans;
+const size_t SlowOpRecorder::Capacity;
+const std::chrono::microseconds SlowOpRecorder::DefaultThreshold{100000};
+
+SlowOpRecorder& SlowOpRecorder::getInstance() {
+    static SlowOpRecorder instance;
+    return instance;
+}
+
+bool SlowOpRecorder::maybeRecord(const Tracer& tracer,
+                                 uint8_t opcode,
+                                 uint32_t connectionId,
+                                 uint32_t opaque) {
+    const auto limit = getThreshold();
+    const auto& spans = tracer.getDurations();
+    if (limit.count() == 0 || spans.empty()) {
+        return false;
+    }
+
+    // The first span covers the request itself, but ends before the
+    // response is sent; use the end of the last span which ended.
+    const auto start = spans.front().start;
+    auto end = start;
+    for (const auto& span : spans) {
+        if (span.duration != std::chrono::microseconds::max()) {
+            end = std::max(end, span.start + span.duration);
+        }
+    }
+    if (end - start < limit) {
+        return false;
+    }
+
+    Record record;
+    record.timestamp = std::chrono::system_clock::now();
+    record.duration = end - start;
+    record.connectionId = connectionId;
+    record.opaque = opaque;
+    record.opcode = opcode;
+    record.totalSpans = uint16_t(std::min(spans.size(), size_t(UINT16_MAX)));
+    record.numSpans = 0;
+    for (const auto& span : spans) {
+        if (record.numSpans == MaxSpans) {
+            break;
+        }
+        if (span.duration == std::chrono::microseconds::max()) {
+            continue;
+        }
+        record.spans[record.numSpans++] = {
+                span.code, span.start - start, span.duration};
+    }
+
+    store(record);
+    return true;
+}
+
+void SlowOpRecorder::store(const Record& record) {
+    const auto ticket = position.fetch_add(1, std::memory_order_relaxed);
+    auto& slot = slots[ticket % Capacity];
+
+    auto sequence = slot.sequence.load(std::memory_order_relaxed);
+    if ((sequence & 1) != 0 ||
+        !slot.sequence.compare_exchange_strong(sequence,
+                                               2 * (ticket + 1) - 1,
+                                               std::memory_order_acquire)) {
+        // Another writer is using the slot (the ring wrapped around)
+        dropped++;
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.record = record;
+    slot.sequence.store(2 * (ticket + 1), std::memory_order_release);
+    recorded++;
+}
+
+std::vector<SlowOpRecorder::Record> SlowOpRecorder::getRecords() const {
+    const auto first = firstValid.load(std::memory_order_acquire);
+    std::vector<std::pair<uint64_t, Record>> copies;
+    copies.reserve(Capacity);
+    for (const auto& slot : slots) {
+        const auto before = slot.sequence.load(std::memory_order_acquire);
+        if (before == 0 || (before & 1) != 0 || (before / 2) - 1 < first) {
+            continue;
+        }
+        Record record = slot.record;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before) {
+            // Overwritten while we copied it
+            continue;
+        }
+        copies.emplace_back((before / 2) - 1, record);
+    }
+
+    std::sort(copies.begin(),
+              copies.end(),
+              [](const std::pair<uint64_t, Record>& a,
+                 const std::pair<uint64_t, Record>& b) {
+                  return a.first < b.first;
+              });
+
+    std::vector<Record> records;
+    records.reserve(copies.size());
+    for (const auto& copy : copies) {
+        records.push_back(copy.second);
+    }
+    return records;
+}
+
+SlowOpRecorder::Stats SlowOpRecorder::getStats() const {
+    return {getThreshold(), recorded.load(), dropped.load()};
+}
+
+void SlowOpRecorder::clear() {
+    firstValid.store(position.load(std::memory_order_relaxed),
+                     std::memory_order_release);
+    recorded = 0;
+    dropped = 0;
+}
+
+} // namespace tracing
+} // namespace cb
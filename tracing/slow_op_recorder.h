@@ -0,0 +1,148 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2018 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#pragma once
+
+#include <memcached/visibility.h>
+#include "tracing/tracer.h"
+#include "tracing/tracetypes.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace cb {
+namespace tracing {
+
+/**
+ * Keeps the full span breakdown of the most recent requests which took
+ * longer than a (configurable) threshold.
+ *
+ * The Tracer of a cookie is cleared as soon as the next command on the
+ * connection starts, so only the total duration survives (in the response
+ * and in the timings histograms). The recorder copies the spans of slow
+ * requests into a fixed size ring so outliers can be attributed after the
+ * fact.
+ *
+ * Recording is lock-free: a writer claims a slot with a fetch_add on the
+ * ring position, and each slot is guarded by a sequence number (odd while
+ * the slot is being written) so readers can detect and skip a slot which
+ * is modified while they copy it. If two writers race for the same slot
+ * (which requires the ring to wrap while a record is being written) the
+ * second one drops its record.
+ */
+class MEMCACHED_PUBLIC_CLASS SlowOpRecorder {
+public:
+    /// Maximum number of spans kept per request
+    static const size_t MaxSpans = 16;
+
+    /// Number of requests kept
+    static const size_t Capacity = 1024;
+
+    static const std::chrono::microseconds DefaultThreshold;
+
+    struct RecordedSpan {
+        TraceCode code;
+        /// Start of the span relative to the start of the request
+        std::chrono::microseconds offset;
+        std::chrono::microseconds duration;
+    };
+
+    struct Record {
+        /// Wall-clock time the request was recorded (just after completion)
+        std::chrono::system_clock::time_point timestamp;
+        /// Total duration, from the start of the request to the end of the
+        /// last span
+        std::chrono::microseconds duration;
+        uint32_t connectionId;
+        uint32_t opaque;
+        uint8_t opcode;
+        /// Number of spans the request had (may exceed MaxSpans)
+        uint16_t totalSpans;
+        /// Number of valid entries in spans
+        uint16_t numSpans;
+        std::array<RecordedSpan, MaxSpans> spans;
+    };
+
+    struct Stats {
+        std::chrono::microseconds threshold;
+        /// Requests recorded since the last clear()
+        uint64_t recorded;
+        /// Requests not recorded because of a concurrent write to the slot
+        uint64_t dropped;
+    };
+
+    static SlowOpRecorder& getInstance();
+
+    /**
+     * Set the threshold for recording a request. A threshold of zero
+     * disables the recorder.
+     */
+    void setThreshold(std::chrono::microseconds value) {
+        threshold.store(value.count(), std::memory_order_relaxed);
+    }
+
+    std::chrono::microseconds getThreshold() const {
+        return std::chrono::microseconds(
+                threshold.load(std::memory_order_relaxed));
+    }
+
+    /**
+     * Record the spans of the given (completed) request if its duration
+     * exceeds the threshold. Spans which haven't ended are skipped.
+     *
+     * @return true if the request was recorded
+     */
+    bool maybeRecord(const Tracer& tracer,
+                     uint8_t opcode,
+                     uint32_t connectionId,
+                     uint32_t opaque);
+
+    /// Get the requests currently in the ring, oldest first
+    std::vector<Record> getRecords() const;
+
+    Stats getStats() const;
+
+    /// Discard all of the recorded requests
+    void clear();
+
+protected:
+    /**
+     * A slot in the ring. The sequence is 2 * (ticket + 1) once the record
+     * for the given ticket is complete, and odd while it is being written
+     * (0 means the slot was never written).
+     */
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        Record record;
+    };
+
+    void store(const Record& record);
+
+    std::atomic<int64_t> threshold{DefaultThreshold.count()};
+    /// The ticket the next record is written with
+    std::atomic<uint64_t> position{0};
+    /// Records with a lower ticket were discarded by clear()
+    std::atomic<uint64_t> firstValid{0};
+    std::atomic<uint64_t> recorded{0};
+    std::atomic<uint64_t> dropped{0};
+    std::array<Slot, Capacity> slots;
+};
+
+} // namespace tracing
+} // namespace cb
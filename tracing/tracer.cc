@@ -166,6 +166,15 @@ MEMCACHED_PUBLIC_API std::string to_string(
         return "store.if";
     case TraceCode::UNLOCK:
         return "unlock";
+
+    case TraceCode::DECODE:
+        return "decode";
+    case TraceCode::BGFETCH_WAIT:
+        return "bg.wait";
+    case TraceCode::CHECKPOINT_QUEUE:
+        return "checkpoint.queue";
+    case TraceCode::SEND:
+        return "send";
     }
     return "unknown tracecode";
 }
@@ -65,7 +65,7 @@ public:
  */
 class MEMCACHED_PUBLIC_CLASS Tracer {
 public:
-    using SpanId = std::size_t;
+    using SpanId = cb::tracing::SpanId;
 
     static SpanId invalidSpanId();
 
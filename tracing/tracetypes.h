@@ -16,6 +16,7 @@
  */
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 #include <memcached/visibility.h>
@@ -23,6 +24,9 @@
 namespace cb {
 namespace tracing {
 
+/// Identifies a span of a Tracer (as returned by Tracer::begin)
+using SpanId = std::size_t;
+
 enum class TraceCode {
     REQUEST, /* Whole Request */
 
@@ -45,6 +49,12 @@ enum class TraceCode {
     STORE,
     STOREIF,
     UNLOCK,
+
+    /* Request breakdown, kept by the SlowOpRecorder */
+    DECODE, /* Privilege check and validation of the request */
+    BGFETCH_WAIT, /* Queued for (and running) a background fetch */
+    CHECKPOINT_QUEUE, /* Queueing a mutation into the checkpoint */
+    SEND, /* Transmitting the response */
 };
 } // namespace tracing
 } // namespace cb